@@ -276,6 +276,12 @@ typedef void* GLeglImageOES;
 #define GL_MAX_TEXTURE_MAX_ANISOTROPY_EXT                       0x84FF
 #endif
 
+/* GL_EXT_texture_compression_dxt1 */
+#ifndef GL_EXT_texture_compression_dxt1
+#define GL_COMPRESSED_RGB_S3TC_DXT1_EXT                         0x83F0
+#define GL_COMPRESSED_RGBA_S3TC_DXT1_EXT                        0x83F1
+#endif
+
 /* GL_EXT_texture_format_BGRA8888 */
 #ifndef GL_EXT_texture_format_BGRA8888
 #define GL_BGRA_EXT                                             0x80E1
@@ -288,6 +294,51 @@ typedef void* GLeglImageOES;
 #define GL_TEXTURE_LOD_BIAS_EXT                                 0x8501
 #endif
 
+/*------------------------------------------------------------------------*
+ * FIMG extension tokens
+ *------------------------------------------------------------------------*/
+
+/* GL_FIMG_perf_counters */
+/*
+ * Counter tokens are private to this implementation and use block
+ * 0xFF00..0xFF1F, far above enum blocks allocated by Khronos so far.
+ * Counters are 32-bit and wrap around; wait times (us) wrap after about
+ * 71 minutes of waiting, so reset counters after each query.
+ */
+#ifndef GL_FIMG_perf_counters
+#define GL_FIMG_perf_counters 1
+#define GL_PERF_COUNTER_FRAMES_FIMG                             0xFF00
+#define GL_PERF_COUNTER_DRAWS_FIMG                              0xFF01
+#define GL_PERF_COUNTER_BATCHES_FIMG                            0xFF02
+#define GL_PERF_COUNTER_VERTICES_FIMG                           0xFF03
+#define GL_PERF_COUNTER_VERTEX_BYTES_FIMG                       0xFF04
+#define GL_PERF_COUNTER_WRITES_FIMG                             0xFF05
+#define GL_PERF_COUNTER_FULL_FLUSHES_FIMG                       0xFF06
+#define GL_PERF_COUNTER_SELECTIVE_FLUSHES_FIMG                  0xFF07
+#define GL_PERF_COUNTER_FLUSH_WAIT_TIME_FIMG                    0xFF08
+#define GL_PERF_COUNTER_CACHE_WAIT_TIME_FIMG                    0xFF09
+#define GL_PERF_COUNTER_SHADER_HITS_FIMG                        0xFF0A
+#define GL_PERF_COUNTER_SHADER_MISSES_FIMG                      0xFF0B
+#define GL_PERF_COUNTER_SHADER_LOADS_FIMG                       0xFF0C
+#define GL_PERF_COUNTER_TEX_CACHE_INVALIDATIONS_FIMG            0xFF0D
+#define GL_PERF_COUNTER_FULL_RESTORES_FIMG                      0xFF0E
+#define GL_PERF_COUNTER_TEXTURE_UPLOADS_FIMG                    0xFF0F
+#define GL_PERF_COUNTER_TEXTURE_BYTES_FIMG                      0xFF10
+#define GL_PERF_COUNTER_COUNT_FIMG                              17
+#ifdef GL_GLEXT_PROTOTYPES
+GL_API GLsizei GL_APIENTRY glGetPerfCountersFIMG (GLsizei count, GLuint *counters);
+GL_API void GL_APIENTRY glResetPerfCountersFIMG (void);
+#endif
+typedef GLsizei (GL_APIENTRYP PFNGLGETPERFCOUNTERSFIMGPROC) (GLsizei count, GLuint *counters);
+typedef void (GL_APIENTRYP PFNGLRESETPERFCOUNTERSFIMGPROC) (void);
+#endif
+
+/* GL_FIMG_texture_compression_hint */
+#ifndef GL_FIMG_texture_compression_hint
+#define GL_FIMG_texture_compression_hint 1
+#define GL_TEXTURE_COMPRESSION_HINT_FIMG                        0x84EF
+#endif
+
 /*------------------------------------------------------------------------*
  * IMG extension tokens
  *------------------------------------------------------------------------*/
@@ -852,6 +903,11 @@ typedef void (GL_APIENTRYP PFNGLMULTIDRAWELEMENTSEXTPROC) (GLenum mode, const GL
 #define GL_EXT_texture_filter_anisotropic 1
 #endif
 
+/* GL_EXT_texture_compression_dxt1 */
+#ifndef GL_EXT_texture_compression_dxt1
+#define GL_EXT_texture_compression_dxt1 1
+#endif
+
 /* GL_EXT_texture_format_BGRA8888 */
 #ifndef GL_EXT_texture_format_BGRA8888
 #define GL_EXT_texture_format_BGRA8888 1
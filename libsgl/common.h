@@ -22,6 +22,8 @@
 #ifndef _LIBSGL_COMMON_H_
 #define _LIBSGL_COMMON_H_
 
+#include "libfimg/fimg.h"
+
 /** Allow non power of two textures */
 #define FGL_NPOT_TEXTURES
 
@@ -40,7 +42,7 @@
 /** Number of supported light sources */
 #define FGL_MAX_LIGHTS			8
 /** Number of supported user clip planes */
-#define FGL_MAX_CLIP_PLANES		1
+#define FGL_MAX_CLIP_PLANES		4
 /** Modelview matrix stack depth */
 #define FGL_MAX_MODELVIEW_STACK_DEPTH	16
 /** Projection matrix stack depth */
@@ -49,6 +51,14 @@
 #define FGL_MAX_TEXTURE_STACK_DEPTH	2
 /** Bits of subpixel precision */
 #define FGL_MAX_SUBPIXEL_BITS		4
+/** Smallest texture (in texels) encoded to S3TC on compression hint */
+#define FGL_S3TC_ENCODE_MIN_TEXELS	(128*128)
+/** Texture surfaces kept until GPU finishes instead of waiting for it */
+#define FGL_MAX_RETIRED_SURFACES	16
+/** Memory (in bytes) kept in retired texture surfaces */
+#define FGL_MAX_RETIRED_SIZE		(8 << 20)
+/** Largest texture (in bytes) copied instead of waiting for GPU to update */
+#define FGL_MAX_ORPHAN_COPY_SIZE	(1 << 20)
 /** Highest texture dimension */
 #define FGL_MAX_TEXTURE_SIZE		2047
 /** Highest viewport dimension */
@@ -114,6 +124,34 @@ public:
 #define FUNCTION_TRACER
 #endif
 
+#ifdef FIMG_PROFILE
+/**
+ * A class that records execution time of a scope in driver timeline profile.
+ *
+ * Should be used through #FGL_PROFILE_SCOPE macro.
+ */
+class FGLProfileScope {
+	const char *name;
+	uint64_t start;
+public:
+	inline FGLProfileScope(const char *n)
+	: name(n), start(fimgProfileBegin()) {}
+
+	inline ~FGLProfileScope()
+	{
+		fimgProfileEnd(name, start);
+	}
+};
+
+/**
+ * A macro recording execution time of the rest of current scope
+ * in driver timeline profile under given name.
+ */
+#define FGL_PROFILE_SCOPE(name)	FGLProfileScope __ps(name)
+#else
+#define FGL_PROFILE_SCOPE(name)
+#endif
+
 #undef NELEM
 /** A macro returning the number of elements in a static array. */
 #define NELEM(x) (sizeof(x)/sizeof(*(x)))
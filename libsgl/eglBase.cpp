@@ -1309,6 +1309,8 @@ EGLAPI EGLBoolean EGLAPIENTRY eglWaitNative(EGLint engine)
 
 EGLAPI EGLBoolean EGLAPIENTRY eglSwapBuffers(EGLDisplay dpy, EGLSurface surface)
 {
+	FGL_PROFILE_SCOPE("eglSwapBuffers");
+
 	if (!fglEGLValidateDisplay(dpy)) {
 		setError(EGL_BAD_DISPLAY);
 		return EGL_FALSE;
@@ -1323,8 +1325,18 @@ EGLAPI EGLBoolean EGLAPIENTRY eglSwapBuffers(EGLDisplay dpy, EGLSurface surface)
 
 	/* Flush the context attached to the surface if it's current */
 	FGLContext *ctx = getGlThreadSpecific();
-	if ((FGLContext *)d->ctx == ctx)
+	if ((FGLContext *)d->ctx == ctx) {
 		glFinish();
+#ifdef FIMG_TRACE
+		fimgTraceFrame(ctx->fimg);
+#endif
+#ifdef FIMG_PERF_COUNTERS
+		fimgPerfFrame(ctx->fimg);
+#endif
+#ifdef FIMG_PROFILE
+		fimgProfileFrame();
+#endif
+	}
 
 	/* post the surface */
 	if (!d->swapBuffers())
@@ -1383,6 +1395,12 @@ static const FGLExtensionMap gExtensionMap[] = {
 		(EGLFunc)&glGenBuffers },
 	{ "glEGLImageTargetTexture2DOES",
 		(EGLFunc)&glEGLImageTargetTexture2DOES },
+#ifdef FIMG_PERF_COUNTERS
+	{ "glGetPerfCountersFIMG",
+		(EGLFunc)&glGetPerfCountersFIMG },
+	{ "glResetPerfCountersFIMG",
+		(EGLFunc)&glResetPerfCountersFIMG },
+#endif
 	{ NULL, NULL }
 };
 
@@ -32,6 +32,36 @@
  *	4x4 matrix (for geometry transformation)
  */
 
+/*
+ *	Matrix classification
+ */
+
+void FGLmatrix::classify(void)
+{
+	if (data[MAT4(0, 3)] != 0 || data[MAT4(1, 3)] != 0
+	    || data[MAT4(2, 3)] != 0 || data[MAT4(3, 3)] != 1) {
+		type = FGL_MATRIX_TYPE_GENERAL;
+		return;
+	}
+
+	if (data[MAT4(0, 0)] != 1 || data[MAT4(0, 1)] != 0
+	    || data[MAT4(0, 2)] != 0 || data[MAT4(1, 0)] != 0
+	    || data[MAT4(1, 1)] != 1 || data[MAT4(1, 2)] != 0
+	    || data[MAT4(2, 0)] != 0 || data[MAT4(2, 1)] != 0
+	    || data[MAT4(2, 2)] != 1) {
+		type = FGL_MATRIX_TYPE_AFFINE;
+		return;
+	}
+
+	if (data[MAT4(3, 0)] != 0 || data[MAT4(3, 1)] != 0
+	    || data[MAT4(3, 2)] != 0) {
+		type = FGL_MATRIX_TYPE_TRANSLATION;
+		return;
+	}
+
+	type = FGL_MATRIX_TYPE_IDENTITY;
+}
+
 /*
  *	Matrix loading
  */
@@ -44,6 +74,8 @@ void FGLmatrix::zero(void)
 		(*this)[i][2] = 0;
 		(*this)[i][3] = 0;
 	}
+
+	type = FGL_MATRIX_TYPE_GENERAL;
 }
 
 void FGLmatrix::identity(void)
@@ -54,11 +86,15 @@ void FGLmatrix::identity(void)
 	(*this)[1][1] = 1;
 	(*this)[2][2] = 1;
 	(*this)[3][3] = 1;
+
+	type = FGL_MATRIX_TYPE_IDENTITY;
 }
 
 void FGLmatrix::load(const GLfloat *m)
 {
 	memcpy(data, m, 16 * sizeof(GLfloat));
+
+	classify();
 }
 
 void FGLmatrix::load(const GLfixed *m)
@@ -69,6 +105,8 @@ void FGLmatrix::load(const GLfixed *m)
 		(*this)[x][2] = floatFromFixed(m[MAT4(x, 2)]);
 		(*this)[x][3] = floatFromFixed(m[MAT4(x, 3)]);
 	}
+
+	classify();
 }
 
 void FGLmatrix::rotate(GLfloat angle, GLfloat x, GLfloat y, GLfloat z)
@@ -113,6 +151,8 @@ void FGLmatrix::rotate(GLfloat angle, GLfloat x, GLfloat y, GLfloat z)
 	(*this)[0][2] = xz * ci - ys;
 	(*this)[1][2] = yz * ci + xs;
 	(*this)[2][2] = z2 * ci + c;
+
+	type = FGL_MATRIX_TYPE_AFFINE;
 }
 
 void FGLmatrix::translate(GLfloat x, GLfloat y, GLfloat z)
@@ -122,6 +162,8 @@ void FGLmatrix::translate(GLfloat x, GLfloat y, GLfloat z)
 	(*this)[3][0] = x;
 	(*this)[3][1] = y;
 	(*this)[3][2] = z;
+
+	type = FGL_MATRIX_TYPE_TRANSLATION;
 }
 
 void FGLmatrix::scale(GLfloat x, GLfloat y, GLfloat z)
@@ -131,6 +173,8 @@ void FGLmatrix::scale(GLfloat x, GLfloat y, GLfloat z)
 	(*this)[0][0] = x;
 	(*this)[1][1] = y;
 	(*this)[2][2] = z;
+
+	type = FGL_MATRIX_TYPE_AFFINE;
 }
 
 void FGLmatrix::frustum(GLfloat l, GLfloat r, GLfloat b, GLfloat t,
@@ -149,6 +193,8 @@ void FGLmatrix::frustum(GLfloat l, GLfloat r, GLfloat b, GLfloat t,
 
 	(*this)[3][2] = (-2.0 * f * n) / (f - n);
 	(*this)[3][3] = 0.0f ;
+
+	type = FGL_MATRIX_TYPE_GENERAL;
 }
 
 void FGLmatrix::ortho(GLfloat l, GLfloat r, GLfloat b, GLfloat t,
@@ -165,6 +211,8 @@ void FGLmatrix::ortho(GLfloat l, GLfloat r, GLfloat b, GLfloat t,
 	(*this)[3][0] = (r + l) / (l - r);
 	(*this)[3][1] = (t + b) / (b - t);
 	(*this)[3][2] = (f + n) / (n - f);
+
+	type = FGL_MATRIX_TYPE_AFFINE;
 }
 
 void FGLmatrix::inverseTranslate(GLfloat x, GLfloat y, GLfloat z)
@@ -174,6 +222,8 @@ void FGLmatrix::inverseTranslate(GLfloat x, GLfloat y, GLfloat z)
 	(*this)[3][0] = -x;
 	(*this)[3][1] = -y;
 	(*this)[3][2] = -z;
+
+	type = FGL_MATRIX_TYPE_TRANSLATION;
 }
 
 /*
@@ -187,6 +237,8 @@ void FGLmatrix::inverseScale(GLfloat x, GLfloat y, GLfloat z)
 	(*this)[0][0] = 1.0f/x;
 	(*this)[1][1] = 1.0f/y;
 	(*this)[2][2] = 1.0f/z;
+
+	type = FGL_MATRIX_TYPE_AFFINE;
 }
 
 /*
@@ -206,6 +258,8 @@ void FGLmatrix::inverseFrustum(GLfloat left, GLfloat right,
 	(*this)[3][1] = (bottom + top) / (2 * zNear);
 	(*this)[3][2] = -1;
 	(*this)[3][3] = (zFar + zNear) / (-2 * zFar * zNear);
+
+	type = FGL_MATRIX_TYPE_GENERAL;
 }
 
 /*
@@ -223,6 +277,8 @@ void FGLmatrix::inverseOrtho(GLfloat left, GLfloat right,
 	(*this)[3][0] = (left + right) / 2;
 	(*this)[3][1] = (bottom + top) / 2;
 	(*this)[3][2] = (zNear + zFar) / -2;
+
+	type = FGL_MATRIX_TYPE_AFFINE;
 }
 
 /*
@@ -256,6 +312,8 @@ void FGLmatrix::multiply(const GLfloat *m)
 	}
 
 	data = work;
+
+	classify();
 }
 
 void FGLmatrix::multiply(const GLfixed *m)
@@ -285,6 +343,8 @@ void FGLmatrix::multiply(const GLfixed *m)
 	}
 
 	data = work;
+
+	classify();
 }
 
 void FGLmatrix::leftMultiply(FGLmatrix const &m)
@@ -314,6 +374,8 @@ void FGLmatrix::leftMultiply(FGLmatrix const &m)
 	}
 
 	data = work;
+
+	classify();
 }
 
 void FGLmatrix::multiply(const FGLmatrix &a, const FGLmatrix &b)
@@ -336,6 +398,8 @@ void FGLmatrix::multiply(const FGLmatrix &a, const FGLmatrix &b)
 				+ a[2][3]*b[i][2]
 				+ a[3][3]*b[i][3];
 	}
+
+	classify();
 }
 
 void FGLmatrix::inverse(void)
@@ -495,4 +559,6 @@ void FGLmatrix::transpose(void)
 	}
 
 	data = work;
+
+	classify();
 }
@@ -12,12 +12,28 @@
  */
 #define MAT4(col, row)	(4*(col) + (row))
 
+/**
+ * Classes of transformations represented by a matrix, ordered from
+ * the most specific one.
+ */
+enum FGLmatrixType {
+	/** Identity transformation. */
+	FGL_MATRIX_TYPE_IDENTITY = 0,
+	/** Translation only. */
+	FGL_MATRIX_TYPE_TRANSLATION,
+	/** Affine transformation (bottom row equal to 0, 0, 0, 1). */
+	FGL_MATRIX_TYPE_AFFINE,
+	/** Any other transformation. */
+	FGL_MATRIX_TYPE_GENERAL
+};
+
 /** A class representing a 4x4 single precision floating-point matrix. */
 struct FGLmatrix {
 	GLfloat storage[2*16];
 
 	GLfloat *data;
 	int index;
+	FGLmatrixType type;
 
 	/**
 	 * Default constructor.
@@ -25,7 +41,8 @@ struct FGLmatrix {
 	 */
 	inline FGLmatrix() :
 		data(storage),
-		index(0) {};
+		index(0),
+		type(FGL_MATRIX_TYPE_GENERAL) {};
 
 	/**
 	 * Copying constructor.
@@ -38,6 +55,20 @@ struct FGLmatrix {
 		*this = m;
 	}
 
+	/**
+	 * Determines class of transformation represented by matrix contents
+	 * and stores it in type field.
+	 */
+	void classify(void);
+	/**
+	 * Checks whether the matrix is known to be an identity matrix.
+	 * @return True if the matrix is an identity matrix.
+	 */
+	inline bool isIdentity(void) const
+	{
+		return type == FGL_MATRIX_TYPE_IDENTITY;
+	}
+
 	/** Fills the matrix with zeroes. */
 	void zero(void);
 	/** Sets the matrix to identity transformation. */
@@ -56,7 +87,7 @@ struct FGLmatrix {
 	 * Loads the matrix from another matrix.
 	 * @param m Matrix to load data from.
 	 */
-	inline void load(FGLmatrix const &m) { load(m.data); };
+	inline void load(FGLmatrix const &m) { *this = m; };
 	/**
 	 * Multiplies the matrix with floating-point values from external array.
 	 * @param m Array of matrix values of the multiplier matrix
@@ -212,7 +243,7 @@ struct FGLmatrix {
 	 * @param m Matrix being assigned.
 	 * @return This matrix.
 	 */
-	inline FGLmatrix &operator=(FGLmatrix const &m) { memcpy(data, m.data, 16 * sizeof(GLfloat)); return *this; };
+	inline FGLmatrix &operator=(FGLmatrix const &m) { memcpy(data, m.data, 16 * sizeof(GLfloat)); type = m.type; return *this; };
 };
 
 #endif
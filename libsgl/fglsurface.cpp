@@ -49,6 +49,9 @@
 
 FGLLocalSurface::FGLLocalSurface(unsigned long req_size)
 	: fd(-1)
+#ifdef FIMG_IO_BACKEND
+	, anonymous(false)
+#endif
 {
 	pmem_region region;
 	unsigned long page_size = getpagesize();
@@ -58,6 +61,21 @@ FGLLocalSurface::FGLLocalSurface(unsigned long req_size)
 
 	/* Create a buffer file (cached) */
 	fd = open("/dev/pmem_gpu1", O_RDWR, 0);
+#ifdef FIMG_IO_BACKEND
+	if (fd < 0) {
+		/* No PMEM (e.g. on a host) - use memory visible to simulator */
+		vaddr = mmap(NULL, size, PROT_WRITE | PROT_READ,
+					MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+		if (vaddr == MAP_FAILED) {
+			LOGE("EGL: Anonymous buffer allocation failed (%s)",
+							strerror(errno));
+			return;
+		}
+		paddr = fimgSimMapMemory(0, vaddr, size);
+		anonymous = true;
+		return;
+	}
+#endif
 	if(fd < 0) {
 		LOGE("EGL: Could not open PMEM device (%s)", strerror(errno));
 		return;
@@ -76,6 +94,9 @@ FGLLocalSurface::FGLLocalSurface(unsigned long req_size)
 		goto err_phys;
 	}
 	this->paddr = region.offset;
+#ifdef FIMG_IO_BACKEND
+	fimgSimMapMemory(paddr, vaddr, size);
+#endif
 
 	/* Allocation succeeded */
 	return;
@@ -93,6 +114,13 @@ FGLLocalSurface::~FGLLocalSurface()
 	if (!isValid())
 		return;
 
+#ifdef FIMG_IO_BACKEND
+	fimgSimUnmapMemory(paddr);
+	if (anonymous) {
+		munmap(vaddr, size);
+		return;
+	}
+#endif
 	munmap(vaddr, size);
 	close(fd);
 }
@@ -111,6 +139,10 @@ void FGLLocalSurface::flush(void)
 {
 	struct pmem_region region;
 
+#ifdef FIMG_IO_BACKEND
+	if (anonymous)
+		return;
+#endif
 	region.offset = 0;
 	region.len = size;
 
@@ -123,11 +155,16 @@ FGLExternalSurface::FGLExternalSurface(void *v, intptr_t p, size_t s)
 	vaddr = v;
 	paddr = p;
 	size = s;
+#ifdef FIMG_IO_BACKEND
+	paddr = fimgSimMapMemory(p, v, s);
+#endif
 }
 
 FGLExternalSurface::~FGLExternalSurface()
 {
-
+#ifdef FIMG_IO_BACKEND
+	fimgSimUnmapMemory(paddr);
+#endif
 }
 
 int FGLExternalSurface::lock(int usage)
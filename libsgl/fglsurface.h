@@ -31,6 +31,7 @@
 #include <EGL/egl.h>
 #include <EGL/eglext.h>
 #include "types.h"
+#include "libfimg/config.h"
 
 /**
  * Base class representing abstract backing surface (2D buffer).
@@ -87,6 +88,10 @@ public:
 /** A class implementing a surface backed by internally allocated memory. */
 class FGLLocalSurface : public FGLSurface {
 	int		fd;
+#ifdef FIMG_IO_BACKEND
+	/** Surface uses anonymous memory registered with simulator. */
+	bool		anonymous;
+#endif
 public:
 	/**
 	 * Creates a local surface.
@@ -100,7 +105,11 @@ public:
 	virtual int	lock(int usage = 0);
 	virtual int	unlock(void);
 
+#ifdef FIMG_IO_BACKEND
+	virtual bool	isValid(void) { return fd >= 0 || anonymous; };
+#else
 	virtual bool	isValid(void) { return fd >= 0; };
+#endif
 };
 
 /** A class implementing a surface backed by external (native) buffer. */
@@ -29,6 +29,7 @@
 
 struct FGLTexture;
 struct FGLTextureState;
+struct FGLContext;
 
 /**
  * An FGLObject that points to an FGLTexture object and can be bound
@@ -41,6 +42,23 @@ typedef FGLObject<FGLTexture, FGLTextureState> FGLTextureObject;
  */
 typedef FGLObjectBinding<FGLTexture, FGLTextureState> FGLTextureObjectBinding;
 
+#ifdef FIMG_ASYNC_TEXTURE_UPLOAD
+/**
+ * Waits until all queued uploads of given texture are finished.
+ * @param tex Texture to wait for.
+ */
+extern void fglWaitForTextureUpload(FGLTexture *tex);
+#endif
+
+/**
+ * Expands paletted texture to direct color format, to free palette memory
+ * for another paletted texture.
+ * @param ctx Rendering context.
+ * @param tex Texture to expand.
+ * @return True on success, false on allocation failure.
+ */
+extern bool fglExpandPalettedTexture(FGLContext *ctx, FGLTexture *tex);
+
 /** A class representing OpenGL ES texture object. */
 struct FGLTexture : public FGLFramebufferAttachable {
 	/** FGLObject that can be bound to FGLTextureState */
@@ -56,6 +74,10 @@ struct FGLTexture : public FGLFramebufferAttachable {
 	using FGLFramebufferAttachable::height;
 	/** Flag indicating that the texture is compressed. */
 	GLboolean	compressed;
+	/** Texture compression hint at the time of image specification. */
+	GLenum		compressionHint;
+	/** Flag indicating that the texture must not be encoded to S3TC. */
+	bool		noEncode;
 	/** Highest mipmap level supported by this texture. */
 	GLint		maxLevel;
 	/** OpenGL ES image format. */
@@ -95,6 +117,15 @@ struct FGLTexture : public FGLFramebufferAttachable {
 	 * last rendering using it.
 	 */
 	bool		dirty;
+	/**
+	 * Bit mask of texture units which might have data of this texture
+	 * in their texture caches.
+	 */
+	uint32_t	cachedUnits;
+#ifdef FIMG_ASYNC_TEXTURE_UPLOAD
+	/** Count of queued uploads not finished by the upload thread yet. */
+	volatile unsigned pendingUploads;
+#endif
 
 	/**
 	 * Creates texture object.
@@ -104,6 +135,8 @@ struct FGLTexture : public FGLFramebufferAttachable {
 		object(this),
 		name(name),
 		compressed(0),
+		compressionHint(GL_DONT_CARE),
+		noEncode(false),
 		maxLevel(0),
 		type(GL_UNSIGNED_BYTE),
 		minFilter(GL_NEAREST_MIPMAP_LINEAR),
@@ -115,7 +148,11 @@ struct FGLTexture : public FGLFramebufferAttachable {
 		invReady(false),
 		fimg(NULL),
 		valid(false),
-		dirty(false)
+		dirty(false),
+		cachedUnits(0)
+#ifdef FIMG_ASYNC_TEXTURE_UPLOAD
+		, pendingUploads(0)
+#endif
 	{
 		fimg = fimgCreateTexture();
 		if(fimg == NULL)
@@ -135,6 +172,9 @@ struct FGLTexture : public FGLFramebufferAttachable {
 		if(!isValid())
 			return;
 
+#ifdef FIMG_ASYNC_TEXTURE_UPLOAD
+		fglWaitForTextureUpload(this);
+#endif
 		if (eglImage)
 			eglImage->disconnect();
 		else
@@ -154,11 +194,16 @@ struct FGLTexture : public FGLFramebufferAttachable {
 
 	/**
 	 * Checks whether the texture is complete.
-	 * A texture is considered complete if it has backing surface.
+	 * A texture is considered complete if it has backing surface
+	 * and no uploads of it are pending.
 	 * @return True if the texture is complete, otherwise false.
 	 */
 	inline bool isComplete(void)
 	{
+#ifdef FIMG_ASYNC_TEXTURE_UPLOAD
+		if (pendingUploads)
+			return false;
+#endif
 		return (surface != 0);
 	}
 
@@ -25,6 +25,7 @@
 
 #include <cstdio>
 #include <cstdlib>
+#include <cstring>
 #include <errno.h>
 #include <pthread.h>
 #include <fcntl.h>
@@ -689,6 +690,7 @@ GL_API void GL_APIENTRY glShadeModel (GLenum mode)
  */
 static inline void fglSetupMatrices(FGLContext *ctx)
 {
+	FGL_PROFILE_SCOPE("fglSetupMatrices");
 	if (ctx->matrix.dirty[FGL_MATRIX_MODELVIEW]
 		|| ctx->matrix.dirty[FGL_MATRIX_PROJECTION])
 	{
@@ -702,12 +704,16 @@ static inline void fglSetupMatrices(FGLContext *ctx)
 
 		fimgLoadMatrix(ctx->fimg, FGFP_MATRIX_TRANSFORM, transform->data);
 
-		/* Load lighting matrix */
+		/* Load model-view matrix for eye-space calculations */
+		fimgLoadMatrix(ctx->fimg, FGFP_MATRIX_MODELVIEW, modview->data);
+
+		/* Load lighting matrix (identity is not uploaded) */
 		FGLmatrix *light;
 
 		light = &ctx->matrix.stack[FGL_MATRIX_MODELVIEW_INVERSE].top();
 
-		fimgLoadMatrix(ctx->fimg, FGFP_MATRIX_LIGHTING, light->data);
+		fimgLoadMatrix(ctx->fimg, FGFP_MATRIX_LIGHTING,
+				light->isIdentity() ? NULL : light->data);
 
 		/* Mark transformation matrices as clean */
 		ctx->matrix.dirty[FGL_MATRIX_MODELVIEW] = GL_FALSE;
@@ -721,8 +727,10 @@ static inline void fglSetupMatrices(FGLContext *ctx)
 		if(!ctx->matrix.dirty[FGL_MATRIX_TEXTURE(i)])
 			continue;
 
+		/* Identity texture matrix selects shader without transform */
 		FGLmatrix *tex = &ctx->matrix.stack[FGL_MATRIX_TEXTURE(i)].top();
-		fimgLoadMatrix(ctx->fimg, FGFP_MATRIX_TEXTURE(i), tex->data);
+		fimgLoadMatrix(ctx->fimg, FGFP_MATRIX_TEXTURE(i),
+					tex->isIdentity() ? NULL : tex->data);
 		ctx->matrix.dirty[FGL_MATRIX_TEXTURE(i)] = GL_FALSE;
 	} while (i--);
 }
@@ -732,12 +740,15 @@ static inline void fglSetupMatrices(FGLContext *ctx)
  * Determines which textures are used for rendering, binds textures to
  * texture units using libfimg, manages texture surface flushing and
  * libfimg texture cache invalidation.
+ * Palette memory is shared by all texture units, so paletted textures other
+ * than the first one found are expanded to direct color formats.
  * @param ctx Rendering context.
  */
 static inline void fglSetupTextures(FGLContext *ctx)
 {
-	bool flush = false;
+	FGL_PROFILE_SCOPE("fglSetupTextures");
 	int i = FGL_MAX_TEXTURE_UNITS - 1;
+	FGLTexture *paletted = 0;
 
 	do {
 		FGLTexture *tex = 0;
@@ -748,6 +759,11 @@ static inline void fglSetupTextures(FGLContext *ctx)
 		if (!tex && ctx->texture[i].enabled)
 			tex = ctx->texture[i].getTexture();
 
+#ifdef FIMG_ASYNC_TEXTURE_UPLOAD
+		/* Wait only for uploads of textures used by this draw */
+		if (tex)
+			fglWaitForTextureUpload(tex);
+#endif
 		if (!tex || !tex->isComplete()) {
 			/* Texture is not ready */
 			fimgCompatSetTextureFunc(ctx->fimg,
@@ -755,12 +771,33 @@ static inline void fglSetupTextures(FGLContext *ctx)
 			continue;
 		}
 
+		if (tex->pixFormat == FGL_PIXFMT_4BPP
+		    || tex->pixFormat == FGL_PIXFMT_8BPP) {
+			if (!paletted) {
+				paletted = tex;
+			} else if (tex != paletted
+			    && !fglExpandPalettedTexture(ctx, tex)) {
+				/* Texture cannot be used without its palette */
+				setError(GL_OUT_OF_MEMORY);
+				fimgCompatSetTextureFunc(ctx->fimg,
+							i, FGFP_TEXFUNC_NONE);
+				continue;
+			}
+		}
+
 		/* Texture is ready */
 		if (tex->dirty) {
 			tex->surface->flush();
 			tex->dirty = false;
-			flush = true;
+
+			/* Only units which could have cached old texels */
+			uint32_t units = tex->cachedUnits | (1 << i);
+			for (int j = 0; j < FGL_MAX_TEXTURE_UNITS; ++j)
+				if (units & (1 << j))
+					fimgInvalidateTextureCache(ctx->fimg, j);
+			tex->cachedUnits = 0;
 		}
+		tex->cachedUnits |= 1 << i;
 
 		fimgCompatSetupTexture(ctx->fimg, tex->fimg, i);
 		fimgCompatSetTextureFunc(ctx->fimg,
@@ -768,9 +805,43 @@ static inline void fglSetupTextures(FGLContext *ctx)
 
 		ctx->busyTexture[i] = tex;
 	} while (i--);
+}
+
+/**
+ * Sets up point rendering.
+ * Selects point size source for vertex shader and configures point sprite
+ * texture coordinate replacement. Hardware can replace coordinates of only
+ * one attribute, so first enabled unit requesting replacement is used.
+ * @param ctx Rendering context.
+ * @return Primitive type to be used by libfimg for rendering points.
+ */
+static inline uint32_t fglSetupPoints(FGLContext *ctx)
+{
+	const float *atten = ctx->rasterizer.pointAttenuation;
+	fimgPointSizeMode sizeMode = FGFP_POINT_SIZE_STATIC;
 
-	if (flush)
-		fimgInvalidateTextureCache(ctx->fimg);
+	if (atten[0] != 1.0f || atten[1] != 0.0f || atten[2] != 0.0f)
+		sizeMode = FGFP_POINT_SIZE_ATTENUATED;
+	else if (ctx->array[FGL_ARRAY_POINT_SIZE].enabled)
+		sizeMode = FGFP_POINT_SIZE_ATTRIB;
+
+	fimgCompatSetPointSizeMode(ctx->fimg, sizeMode);
+
+	if (!ctx->enable.pointSprite)
+		return FGPE_POINTS;
+
+	int i;
+	for (i = 0; i < FGL_MAX_TEXTURE_UNITS; ++i)
+		if (ctx->texture[i].enabled && ctx->texture[i].coordReplace)
+			break;
+
+	/* Texture coordinates of unit i are passed in attribute i + 1 */
+	if (i < FGL_MAX_TEXTURE_UNITS)
+		fimgSetCoordReplace(ctx->fimg, i + 1);
+	else
+		fimgSetCoordReplace(ctx->fimg, FIMG_ATTRIB_NUM);
+
+	return FGPE_POINT_SPRITE;
 }
 
 static void fglSetScissor(FGLContext *ctx, GLint x, GLint y,
@@ -787,6 +858,7 @@ static void fglSetColorMask(FGLContext *ctx);
  */
 static inline int fglSetupFramebuffer(FGLContext *ctx)
 {
+	FGL_PROFILE_SCOPE("fglSetupFramebuffer");
 	FGLAbstractFramebuffer *fb = ctx->framebuffer.get();
 	FGLFramebufferAttachable *fba;
 
@@ -905,12 +977,13 @@ GL_API void GL_APIENTRY glDrawArrays (GLenum mode, GLint first, GLsizei count)
 	fglSetupTextures(ctx);
 
 	fimgSetAttribCount(ctx->fimg, 4 + FGL_MAX_TEXTURE_UNITS);
+	fimgCompatSetPointSizeMode(ctx->fimg, FGFP_POINT_SIZE_STATIC);
 
 	switch (mode) {
 	case GL_POINTS:
 		if (count < 1)
 			return;
-		fglMode = FGPE_POINTS;
+		fglMode = fglSetupPoints(ctx);
 		break;
 	case GL_LINE_STRIP:
 		if (count < 2)
@@ -996,12 +1069,13 @@ GL_API void GL_APIENTRY glDrawElements (GLenum mode, GLsizei count, GLenum type,
 	fglSetupTextures(ctx);
 
 	fimgSetAttribCount(ctx->fimg, 4 + FGL_MAX_TEXTURE_UNITS);
+	fimgCompatSetPointSizeMode(ctx->fimg, FGFP_POINT_SIZE_STATIC);
 
 	switch (mode) {
 	case GL_POINTS:
 		if (count < 1)
 			return;
-		fglMode = FGPE_POINTS;
+		fglMode = fglSetupPoints(ctx);
 		break;
 	case GL_LINE_STRIP:
 		if (count < 2)
@@ -1117,20 +1191,9 @@ GL_API void GL_APIENTRY glDrawTexfOES (GLfloat x, GLfloat y, GLfloat z, GLfloat
 		fglDisableClientState(ctx, i);
 	}
 
-	/* TODO: Replace this with dedicated shader or conditional operation */
-	FGLmatrix *matrix = &ctx->matrix.transformMatrix;
-	matrix->identity();
-
-	fimgLoadMatrix(ctx->fimg, FGFP_MATRIX_TRANSFORM, matrix->data);
-	fimgLoadMatrix(ctx->fimg, FGFP_MATRIX_LIGHTING, matrix->data);
-	ctx->matrix.dirty[FGL_MATRIX_MODELVIEW] = 1;
-	fimgLoadMatrix(ctx->fimg, FGFP_MATRIX_TEXTURE(0), matrix->data);
-	ctx->matrix.dirty[FGL_MATRIX_TEXTURE(0)] = 1;
-	fimgLoadMatrix(ctx->fimg, FGFP_MATRIX_TEXTURE(1), matrix->data);
-	ctx->matrix.dirty[FGL_MATRIX_TEXTURE(1)] = 1;
-
-	// fimgCompatLightingEnable(ctx->fimg, 0);
-	/* End of TODO */
+	/* Vertices are given in window coordinates */
+	fimgCompatSetScreenSpace(ctx->fimg, 1);
+	fimgCompatSetPointSizeMode(ctx->fimg, FGFP_POINT_SIZE_STATIC);
 
 	float zD;
 
@@ -1182,6 +1245,10 @@ GL_API void GL_APIENTRY glDrawTexfOES (GLfloat x, GLfloat y, GLfloat z, GLfloat
 			enabled = ctx->texture[i].enabled;
 		}
 
+#ifdef FIMG_ASYNC_TEXTURE_UPLOAD
+		if (enabled)
+			fglWaitForTextureUpload(tex);
+#endif
 		if (!enabled || !tex->isComplete())
 			continue;
 
@@ -1217,6 +1284,8 @@ GL_API void GL_APIENTRY glDrawTexfOES (GLfloat x, GLfloat y, GLfloat z, GLfloat
 
 	/* Restore previous state */
 
+	fimgCompatSetScreenSpace(ctx->fimg, 0);
+
 	for (int i = 0; i < 4 + FGL_MAX_TEXTURE_UNITS; i++) {
 		if (arrayEnabled[i])
 			fglEnableClientState(ctx, i);
@@ -1405,6 +1474,7 @@ GL_API void GL_APIENTRY glPointSize (GLfloat size)
 		size = FGL_MAX_POINT_SIZE;
 
 	ctx->rasterizer.pointSize = size;
+	ctx->vertex[FGL_ARRAY_POINT_SIZE][0] = size;
 	fimgSetPointWidth(ctx->fimg, size);
 }
 
@@ -1926,6 +1996,155 @@ GL_API void GL_APIENTRY glStencilMask (GLuint mask)
 	}
 }
 
+/*
+	Fog
+*/
+
+/**
+ * Configures fog function of libfimg according to fog state.
+ * @param ctx Rendering context.
+ */
+static inline void fglSetFogMode(FGLContext *ctx)
+{
+	fimgFogMode mode = FGFP_FOG_NONE;
+
+	if (ctx->enable.fog) {
+		switch (ctx->fog.mode) {
+		case GL_LINEAR:
+			mode = FGFP_FOG_LINEAR;
+			break;
+		case GL_EXP:
+			mode = FGFP_FOG_EXP;
+			break;
+		case GL_EXP2:
+			mode = FGFP_FOG_EXP2;
+			break;
+		}
+	}
+
+	fimgCompatSetFogMode(ctx->fimg, mode);
+}
+
+GL_API void GL_APIENTRY glFogf (GLenum pname, GLfloat param)
+{
+	FGLContext *ctx = getContext();
+
+	switch (pname) {
+	case GL_FOG_MODE:
+		switch ((GLenum)param) {
+		case GL_LINEAR:
+		case GL_EXP:
+		case GL_EXP2:
+			break;
+		default:
+			setError(GL_INVALID_ENUM);
+			return;
+		}
+		ctx->fog.mode = (GLenum)param;
+		fglSetFogMode(ctx);
+		return;
+	case GL_FOG_DENSITY:
+		if (param < 0.0f) {
+			setError(GL_INVALID_VALUE);
+			return;
+		}
+		ctx->fog.density = param;
+		break;
+	case GL_FOG_START:
+		ctx->fog.start = param;
+		break;
+	case GL_FOG_END:
+		ctx->fog.end = param;
+		break;
+	default:
+		setError(GL_INVALID_ENUM);
+		return;
+	}
+
+	fimgCompatSetFogParams(ctx->fimg,
+			ctx->fog.density, ctx->fog.start, ctx->fog.end);
+}
+
+GL_API void GL_APIENTRY glFogfv (GLenum pname, const GLfloat *params)
+{
+	FGLContext *ctx = getContext();
+
+	switch (pname) {
+	case GL_FOG_COLOR:
+		ctx->fog.color[0] = clampFloat(params[0]);
+		ctx->fog.color[1] = clampFloat(params[1]);
+		ctx->fog.color[2] = clampFloat(params[2]);
+		ctx->fog.color[3] = clampFloat(params[3]);
+		fimgCompatSetFogColor(ctx->fimg, ctx->fog.color[0],
+			ctx->fog.color[1], ctx->fog.color[2], ctx->fog.color[3]);
+		break;
+	default:
+		glFogf(pname, *params);
+	}
+}
+
+GL_API void GL_APIENTRY glFogx (GLenum pname, GLfixed param)
+{
+	if (pname == GL_FOG_MODE)
+		glFogf(pname, (GLfloat)param);
+	else
+		glFogf(pname, floatFromFixed(param));
+}
+
+GL_API void GL_APIENTRY glFogxv (GLenum pname, const GLfixed *params)
+{
+	switch (pname) {
+	case GL_FOG_COLOR: {
+		GLfloat color[4];
+		color[0] = floatFromFixed(params[0]);
+		color[1] = floatFromFixed(params[1]);
+		color[2] = floatFromFixed(params[2]);
+		color[3] = floatFromFixed(params[3]);
+		glFogfv(pname, color);
+		break; }
+	default:
+		glFogx(pname, *params);
+	}
+}
+
+/*
+	User clip planes
+*/
+
+GL_API void GL_APIENTRY glClipPlanef (GLenum plane, const GLfloat *equation)
+{
+	if (plane < GL_CLIP_PLANE0
+	    || plane >= GL_CLIP_PLANE0 + FGL_MAX_CLIP_PLANES) {
+		setError(GL_INVALID_ENUM);
+		return;
+	}
+
+	FGLContext *ctx = getContext();
+	unsigned idx = plane - GL_CLIP_PLANE0;
+	GLfloat *eye = ctx->clipPlane[idx];
+	const FGLmatrix &inv =
+			ctx->matrix.stack[FGL_MATRIX_MODELVIEW_INVERSE].top();
+
+	/* Plane equation is transformed by inverse of model-view matrix */
+	for (int i = 0; i < 4; ++i)
+		eye[i] = equation[0] * inv[i][0] + equation[1] * inv[i][1]
+			+ equation[2] * inv[i][2] + equation[3] * inv[i][3];
+
+	fimgCompatSetClipPlane(ctx->fimg, idx, eye);
+}
+
+GL_API void GL_APIENTRY glClipPlanex (GLenum plane, const GLfixed *equation)
+{
+	GLfloat eqn[4];
+
+	eqn[0] = floatFromFixed(equation[0]);
+	eqn[1] = floatFromFixed(equation[1]);
+	eqn[2] = floatFromFixed(equation[2]);
+	eqn[3] = floatFromFixed(equation[3]);
+
+	glClipPlanef(plane, eqn);
+}
+
 /*
 	Enable/disable
 */
@@ -1993,6 +2212,24 @@ static inline void fglSet(GLenum cap, bool state)
 		fimgSetLogicalOpEnable(ctx->fimg, state);
 		ctx->enable.colorLogicOp = state;
 		break;
+	case GL_FOG:
+		ctx->enable.fog = state;
+		fglSetFogMode(ctx);
+		break;
+	case GL_CLIP_PLANE0:
+	case GL_CLIP_PLANE1:
+	case GL_CLIP_PLANE2:
+	case GL_CLIP_PLANE3: {
+		unsigned idx = cap - GL_CLIP_PLANE0;
+		if (state)
+			ctx->enable.clipPlanes |= 1 << idx;
+		else
+			ctx->enable.clipPlanes &= ~(1 << idx);
+		fimgCompatSetClipPlaneEnable(ctx->fimg, idx, state);
+		break; }
+	case GL_POINT_SPRITE_OES:
+		ctx->enable.pointSprite = state;
+		break;
 	case GL_LIGHTING:
 	case GL_LIGHT0:
 	case GL_LIGHT1:
@@ -2004,7 +2241,6 @@ static inline void fglSet(GLenum cap, bool state)
 	case GL_LIGHT7:
 	case GL_NORMALIZE:
 	case GL_COLOR_MATERIAL:
-	case GL_FOG:
 	case GL_POINT_SMOOTH:
 	case GL_LINE_SMOOTH:
 	case GL_MULTISAMPLE:
@@ -2031,7 +2267,26 @@ GL_API void GL_APIENTRY glDisable (GLenum cap)
 
 GL_API void GL_APIENTRY glFlush (void)
 {
-	/* Nothing to do here */
+#ifdef FIMG_LOCK_LEASE
+	FGLContext *ctx = getContext();
+
+	/* Let other processes use the hardware */
+	fimgEndHardwareLease(ctx->fimg);
+#endif
+}
+
+/**
+ * Frees texture surfaces retired while being used by GPU.
+ * (Must be called when GPU does not use them anymore.)
+ * @param ctx Rendering context.
+ */
+static void fglFreeRetiredSurfaces(FGLContext *ctx)
+{
+	for (unsigned i = 0; i < ctx->retiredSurfaces; ++i)
+		delete ctx->retiredSurface[i];
+
+	ctx->retiredSurfaces = 0;
+	ctx->retiredSize = 0;
 }
 
 GL_API void GL_APIENTRY glFinish (void)
@@ -2045,6 +2300,7 @@ GL_API void GL_APIENTRY glFinish (void)
 
 	for (int i = 0; i < FGL_MAX_TEXTURE_UNITS; ++i)
 		ctx->busyTexture[i] = 0;
+	fglFreeRetiredSurfaces(ctx);
 
 	ctx->finished = true;
 }
@@ -2053,39 +2309,43 @@ GL_API void GL_APIENTRY glFinish (void)
 	Stubs
 */
 
-GL_API void GL_APIENTRY glClipPlanef (GLenum plane, const GLfloat *equation)
-{
-	FUNC_UNIMPLEMENTED;
-}
-
-GL_API void GL_APIENTRY glClipPlanex (GLenum plane, const GLfixed *equation)
-{
-	FUNC_UNIMPLEMENTED;
-}
-
-GL_API void GL_APIENTRY glFogf (GLenum pname, GLfloat param)
-{
-	FUNC_UNIMPLEMENTED;
-}
-
-GL_API void GL_APIENTRY glFogfv (GLenum pname, const GLfloat *params)
-{
-	FUNC_UNIMPLEMENTED;
-}
-
-GL_API void GL_APIENTRY glFogx (GLenum pname, GLfixed param)
+GL_API void GL_APIENTRY glHint (GLenum target, GLenum mode)
 {
-	FUNC_UNIMPLEMENTED;
-}
+	switch (mode) {
+	case GL_FASTEST:
+	case GL_NICEST:
+	case GL_DONT_CARE:
+		break;
+	default:
+		setError(GL_INVALID_ENUM);
+		return;
+	}
 
-GL_API void GL_APIENTRY glFogxv (GLenum pname, const GLfixed *params)
-{
-	FUNC_UNIMPLEMENTED;
-}
+	FGLContext *ctx = getContext();
 
-GL_API void GL_APIENTRY glHint (GLenum target, GLenum mode)
-{
-	FUNC_UNIMPLEMENTED;
+	switch (target) {
+	case GL_PERSPECTIVE_CORRECTION_HINT:
+		ctx->hint.perspectiveCorrection = mode;
+		break;
+	case GL_POINT_SMOOTH_HINT:
+		ctx->hint.pointSmooth = mode;
+		break;
+	case GL_LINE_SMOOTH_HINT:
+		ctx->hint.lineSmooth = mode;
+		break;
+	case GL_FOG_HINT:
+		ctx->hint.fog = mode;
+		break;
+	case GL_GENERATE_MIPMAP_HINT:
+		ctx->hint.generateMipmap = mode;
+		break;
+	case GL_TEXTURE_COMPRESSION_HINT_FIMG:
+		/* Large opaque textures specified once are encoded to S3TC */
+		ctx->hint.textureCompression = mode;
+		break;
+	default:
+		setError(GL_INVALID_ENUM);
+	}
 }
 
 GL_API void GL_APIENTRY glLightModelf (GLenum pname, GLfloat param)
@@ -2152,24 +2412,82 @@ GL_API void GL_APIENTRY glMaterialxv (GLenum face, GLenum pname,
 	FUNC_UNIMPLEMENTED;
 }
 
+/*
+	Points
+*/
+
 GL_API void GL_APIENTRY glPointParameterf (GLenum pname, GLfloat param)
 {
-	FUNC_UNIMPLEMENTED;
+	FGLContext *ctx = getContext();
+
+	switch (pname) {
+	case GL_POINT_SIZE_MIN:
+		if (param < 0.0f) {
+			setError(GL_INVALID_VALUE);
+			return;
+		}
+		ctx->rasterizer.pointSizeMin = param;
+		fimgSetMinimumPointWidth(ctx->fimg,
+					clamp(param, FGL_MIN_POINT_SIZE,
+						FGL_MAX_POINT_SIZE));
+		break;
+	case GL_POINT_SIZE_MAX:
+		if (param < 0.0f) {
+			setError(GL_INVALID_VALUE);
+			return;
+		}
+		ctx->rasterizer.pointSizeMax = param;
+		fimgSetMaximumPointWidth(ctx->fimg,
+					clamp(param, FGL_MIN_POINT_SIZE,
+						FGL_MAX_POINT_SIZE));
+		break;
+	case GL_POINT_FADE_THRESHOLD_SIZE:
+		if (param < 0.0f) {
+			setError(GL_INVALID_VALUE);
+			return;
+		}
+		/* Points are never multisampled, so fading is not used */
+		ctx->rasterizer.pointFadeThreshold = param;
+		break;
+	default:
+		setError(GL_INVALID_ENUM);
+	}
 }
 
 GL_API void GL_APIENTRY glPointParameterfv (GLenum pname, const GLfloat *params)
 {
-	FUNC_UNIMPLEMENTED;
+	FGLContext *ctx = getContext();
+
+	switch (pname) {
+	case GL_POINT_DISTANCE_ATTENUATION:
+		memcpy(ctx->rasterizer.pointAttenuation, params,
+							3 * sizeof(GLfloat));
+		fimgCompatSetPointAttenuation(ctx->fimg, params);
+		break;
+	default:
+		glPointParameterf(pname, params[0]);
+	}
 }
 
 GL_API void GL_APIENTRY glPointParameterx (GLenum pname, GLfixed param)
 {
-	FUNC_UNIMPLEMENTED;
+	glPointParameterf(pname, floatFromFixed(param));
 }
 
 GL_API void GL_APIENTRY glPointParameterxv (GLenum pname, const GLfixed *params)
 {
-	FUNC_UNIMPLEMENTED;
+	GLfloat floatParams[3];
+
+	switch (pname) {
+	case GL_POINT_DISTANCE_ATTENUATION:
+		floatParams[2] = floatFromFixed(params[2]);
+		floatParams[1] = floatFromFixed(params[1]);
+		/* fall through */
+	default:
+		floatParams[0] = floatFromFixed(params[0]);
+	}
+
+	glPointParameterfv(pname, floatParams);
 }
 
 /*
@@ -2199,6 +2517,15 @@ FGLContext *fglCreateContext(void)
 		fimgSetAttribute(ctx->fimg, i, FGHI_ATTRIB_DT_FLOAT,
 						fglDefaultAttribSize[i]);
 
+	/* Texture compression can be enabled for unmodified applications */
+	const char *compression = getenv("FGL_TEXTURE_COMPRESSION");
+	if (compression) {
+		if (!strcmp(compression, "fastest"))
+			ctx->hint.textureCompression = GL_FASTEST;
+		else if (!strcmp(compression, "nicest"))
+			ctx->hint.textureCompression = GL_NICEST;
+	}
+
 	return ctx;
 }
 
@@ -2217,6 +2544,7 @@ void fglDestroyContext(FGLContext *ctx)
 	fglTextureObjects.clean(ctx);
 	fglFramebufferObjects.clean(ctx);
 	fglRenderbufferObjects.clean(ctx);
+	fglFreeRetiredSurfaces(ctx);
 
 	fimgDestroyContext(ctx->fimg);
 	delete ctx;
@@ -576,6 +576,11 @@ GL_API void GL_APIENTRY glFramebufferTexture2DOES (GLenum target,
 			fglTextureObjects[texture] = tex;
 			tex->target = textarget;
 		}
+
+#ifdef FIMG_ASYNC_TEXTURE_UPLOAD
+		/* Framebuffer attachments are uploaded synchronously */
+		fglWaitForTextureUpload(tex);
+#endif
 	}
 
 	FGLContext *ctx = getContext();
@@ -59,15 +59,36 @@ static char const * const gExtensionsString =
 	"GL_OES_packed_depth_stencil "
 	"GL_OES_texture_npot "
 	"GL_OES_point_size_array "
+	"GL_OES_point_sprite "
 	"GL_OES_rgb8_rgba8 "
 	"GL_OES_depth24 "
 	"GL_OES_stencil8 "
+	"GL_OES_compressed_ETC1_RGB8_texture "
+	"GL_OES_compressed_paletted_texture "
 	"GL_EXT_texture_format_BGRA8888 "
+	"GL_EXT_texture_compression_dxt1 "
+#ifdef FIMG_PERF_COUNTERS
+	"GL_FIMG_perf_counters "
+#endif
+	"GL_FIMG_texture_compression_hint "
 	"GL_ARB_texture_non_power_of_two"
 ;
 
 /** Compressed texture formats supported by this OpenGL ES implementation. */
 static const GLint fglCompressedTextureFormats[] = {
+	GL_ETC1_RGB8_OES,
+	GL_COMPRESSED_RGB_S3TC_DXT1_EXT,
+	GL_COMPRESSED_RGBA_S3TC_DXT1_EXT,
+	GL_PALETTE4_RGB8_OES,
+	GL_PALETTE4_RGBA8_OES,
+	GL_PALETTE4_R5_G6_B5_OES,
+	GL_PALETTE4_RGBA4_OES,
+	GL_PALETTE4_RGB5_A1_OES,
+	GL_PALETTE8_RGB8_OES,
+	GL_PALETTE8_RGBA8_OES,
+	GL_PALETTE8_R5_G6_B5_OES,
+	GL_PALETTE8_RGBA4_OES,
+	GL_PALETTE8_RGB5_A1_OES,
 };
 
 /** Pixel format supported by this OpenGL ES implementation. */
@@ -836,6 +857,20 @@ void fglGetState(FGLContext *ctx, GLenum pname, FGLStateGetter &state)
 	case GL_POINT_SIZE:
 		state.putFloat(ctx->rasterizer.pointSize);
 		break;
+	case GL_POINT_SIZE_MIN:
+		state.putFloat(ctx->rasterizer.pointSizeMin);
+		break;
+	case GL_POINT_SIZE_MAX:
+		state.putFloat(ctx->rasterizer.pointSizeMax);
+		break;
+	case GL_POINT_FADE_THRESHOLD_SIZE:
+		state.putFloat(ctx->rasterizer.pointFadeThreshold);
+		break;
+	case GL_POINT_DISTANCE_ATTENUATION:
+		state.putFloat(ctx->rasterizer.pointAttenuation[0]);
+		state.putFloat(ctx->rasterizer.pointAttenuation[1]);
+		state.putFloat(ctx->rasterizer.pointAttenuation[2]);
+		break;
 	case GL_LINE_WIDTH:
 		state.putFloat(ctx->rasterizer.lineWidth);
 		break;
@@ -851,6 +886,24 @@ void fglGetState(FGLContext *ctx, GLenum pname, FGLStateGetter &state)
 	case GL_POLYGON_OFFSET_UNITS:
 		state.putFloat(ctx->rasterizer.polyOffUnits);
 		break;
+	case GL_FOG_MODE:
+		state.putEnum(ctx->fog.mode);
+		break;
+	case GL_FOG_DENSITY:
+		state.putFloat(ctx->fog.density);
+		break;
+	case GL_FOG_START:
+		state.putFloat(ctx->fog.start);
+		break;
+	case GL_FOG_END:
+		state.putFloat(ctx->fog.end);
+		break;
+	case GL_FOG_COLOR:
+		state.putNormalized(ctx->fog.color[0]);
+		state.putNormalized(ctx->fog.color[1]);
+		state.putNormalized(ctx->fog.color[2]);
+		state.putNormalized(ctx->fog.color[3]);
+		break;
 	case GL_TEXTURE_BINDING_2D: {
 		FGLTextureObjectBinding *b =
 				&ctx->texture[ctx->activeTexture].binding;
@@ -928,6 +981,24 @@ void fglGetState(FGLContext *ctx, GLenum pname, FGLStateGetter &state)
 	case GL_UNPACK_ALIGNMENT:
 		state.putInteger(ctx->unpackAlignment);
 		break;
+	case GL_PERSPECTIVE_CORRECTION_HINT:
+		state.putEnum(ctx->hint.perspectiveCorrection);
+		break;
+	case GL_POINT_SMOOTH_HINT:
+		state.putEnum(ctx->hint.pointSmooth);
+		break;
+	case GL_LINE_SMOOTH_HINT:
+		state.putEnum(ctx->hint.lineSmooth);
+		break;
+	case GL_FOG_HINT:
+		state.putEnum(ctx->hint.fog);
+		break;
+	case GL_GENERATE_MIPMAP_HINT:
+		state.putEnum(ctx->hint.generateMipmap);
+		break;
+	case GL_TEXTURE_COMPRESSION_HINT_FIMG:
+		state.putEnum(ctx->hint.textureCompression);
+		break;
 	case GL_PACK_ALIGNMENT:
 		state.putInteger(ctx->packAlignment);
 		break;
@@ -957,6 +1028,9 @@ void fglGetState(FGLContext *ctx, GLenum pname, FGLStateGetter &state)
 	case GL_MAX_LIGHTS:
 		state.putInteger(FGL_MAX_LIGHTS);
 		break;
+	case GL_MAX_CLIP_PLANES:
+		state.putInteger(FGL_MAX_CLIP_PLANES);
+		break;
 	case GL_SAMPLE_BUFFERS :
 		state.putInteger(0);
 		break;
@@ -1101,6 +1175,12 @@ void fglGetState(FGLContext *ctx, GLenum pname, FGLStateGetter &state)
 	case GL_BLEND:
 	case GL_DITHER:
 	case GL_COLOR_LOGIC_OP:
+	case GL_FOG:
+	case GL_CLIP_PLANE0:
+	case GL_CLIP_PLANE1:
+	case GL_CLIP_PLANE2:
+	case GL_CLIP_PLANE3:
+	case GL_POINT_SPRITE_OES:
 	case GL_VERTEX_ARRAY:
 	case GL_NORMAL_ARRAY:
 	case GL_COLOR_ARRAY:
@@ -1208,6 +1288,15 @@ GL_API GLboolean GL_APIENTRY glIsEnabled (GLenum cap)
 		return ctx->enable.dither;
 	case GL_COLOR_LOGIC_OP:
 		return ctx->enable.colorLogicOp;
+	case GL_FOG:
+		return ctx->enable.fog;
+	case GL_CLIP_PLANE0:
+	case GL_CLIP_PLANE1:
+	case GL_CLIP_PLANE2:
+	case GL_CLIP_PLANE3:
+		return !!(ctx->enable.clipPlanes & (1 << (cap - GL_CLIP_PLANE0)));
+	case GL_POINT_SPRITE_OES:
+		return ctx->enable.pointSprite;
 	case GL_VERTEX_ARRAY:
 		return ctx->array[FGL_ARRAY_VERTEX].enabled;
 	case GL_NORMAL_ARRAY:
@@ -1264,19 +1353,74 @@ GL_API void GL_APIENTRY glGetBufferParameteriv (GLenum target,
 	}
 }
 
+GL_API void GL_APIENTRY glGetClipPlanef (GLenum pname, GLfloat eqn[4])
+{
+	if (pname < GL_CLIP_PLANE0
+	    || pname >= GL_CLIP_PLANE0 + FGL_MAX_CLIP_PLANES) {
+		setError(GL_INVALID_ENUM);
+		return;
+	}
+
+	FGLContext *ctx = getContext();
+
+	memcpy(eqn, ctx->clipPlane[pname - GL_CLIP_PLANE0], sizeof(FGLvec4f));
+}
+
+GL_API void GL_APIENTRY glGetClipPlanex (GLenum pname, GLfixed eqn[4])
+{
+	if (pname < GL_CLIP_PLANE0
+	    || pname >= GL_CLIP_PLANE0 + FGL_MAX_CLIP_PLANES) {
+		setError(GL_INVALID_ENUM);
+		return;
+	}
+
+	FGLContext *ctx = getContext();
+	const GLfloat *plane = ctx->clipPlane[pname - GL_CLIP_PLANE0];
+
+	for (int i = 0; i < 4; ++i)
+		eqn[i] = fixedFromFloat(plane[i]);
+}
+
+#ifdef FIMG_PERF_COUNTERS
 /*
- * Stubs
+ * Performance counters
+ *
+ * Counters are returned in order of their tokens, so value of counter
+ * GL_PERF_COUNTER_*_FIMG is stored at index of its token minus
+ * GL_PERF_COUNTER_FRAMES_FIMG.
  */
 
-GL_API void GL_APIENTRY glGetClipPlanef (GLenum pname, GLfloat eqn[4])
+GL_API GLsizei GL_APIENTRY glGetPerfCountersFIMG (GLsizei count,
+							GLuint *counters)
 {
-	FUNC_UNIMPLEMENTED;
+	if (count < 0) {
+		setError(GL_INVALID_VALUE);
+		return 0;
+	}
+
+	FGLContext *ctx = getContext();
+	fimgPerfCounters perf;
+
+	fimgGetPerfCounters(ctx->fimg, &perf);
+
+	if ((size_t)count > FIMG_NUM_PERF_COUNTERS)
+		count = FIMG_NUM_PERF_COUNTERS;
+	memcpy(counters, &perf, count * sizeof(GLuint));
+
+	return count;
 }
 
-GL_API void GL_APIENTRY glGetClipPlanex (GLenum pname, GLfixed eqn[4])
+GL_API void GL_APIENTRY glResetPerfCountersFIMG (void)
 {
-	FUNC_UNIMPLEMENTED;
+	FGLContext *ctx = getContext();
+
+	fimgResetPerfCounters(ctx->fimg);
 }
+#endif
+
+/*
+ * Stubs
+ */
 
 GL_API void GL_APIENTRY glGetLightfv (GLenum light, GLenum pname,
 							GLfloat *params)
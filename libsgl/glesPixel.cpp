@@ -1015,6 +1015,7 @@ static inline void fglDepthClear(FGLContext *ctx, bool lineByLine,
 static void fglClear(FGLContext *ctx, GLbitfield mode)
 {
 	FUNCTION_TRACER;
+	FGL_PROFILE_SCOPE("fglClear");
 	FGLAbstractFramebuffer *fb = ctx->framebuffer.get();
 	uint32_t stride = fb->getWidth();
 	bool lineByLine = false;
@@ -25,6 +25,7 @@
 
 #include <cstdio>
 #include <cstdlib>
+#include <cmath>
 #include <errno.h>
 #include <pthread.h>
 #include <fcntl.h>
@@ -531,6 +532,8 @@ static void fglDownscaleBy2RGBA4444(void *dstData, const void *srcData,
 	}
 }
 
+static void fglGenerateMipmapsS3TC(FGLTexture *obj, unsigned int baseLevel);
+
 /**
  * Generates mipmaps for given texture.
  * @param obj Texture to generate mipmaps for.
@@ -543,6 +546,11 @@ static void fglGenerateMipmaps(FGLTexture *obj, unsigned int baseLevel)
 	unsigned int h = obj->height;
 	unsigned int offset;
 
+	if (obj->pixFormat == FGL_PIXFMT_S3TC) {
+		fglGenerateMipmapsS3TC(obj, baseLevel);
+		return;
+	}
+
 	offset = fimgGetTexMipmapOffset(obj->fimg, baseLevel);
 	nextLevel = (uint8_t *)obj->surface->vaddr + pix->pixelSize*offset;
 
@@ -593,13 +601,54 @@ static void fglGenerateMipmaps(FGLTexture *obj, unsigned int baseLevel)
 	}
 }
 
+/**
+ * Calculates count of texels occupied by mipmap level in texture memory.
+ * S3TC images are stored in whole 4x4 blocks and 4bpp levels are padded
+ * to start at byte boundary.
+ * @param pixFormat Texture pixel format.
+ * @param width Mipmap level width.
+ * @param height Mipmap level height.
+ * @return Count of texels.
+ */
+static inline size_t fglLevelTexels(uint32_t pixFormat,
+				unsigned int width, unsigned int height)
+{
+	switch (pixFormat) {
+	case FGL_PIXFMT_S3TC:
+		return ((width + 3) & ~3) * ((height + 3) & ~3);
+	case FGL_PIXFMT_4BPP:
+		return (width * height + 1) & ~1;
+	default:
+		return width * height;
+	}
+}
+
+/**
+ * Calculates size of texture memory occupied by given count of texels.
+ * @param pixFormat Texture pixel format.
+ * @param texels Count of texels.
+ * @return Size in bytes.
+ */
+static inline size_t fglTexelBytes(uint32_t pixFormat, size_t texels)
+{
+	switch (pixFormat) {
+	case FGL_PIXFMT_S3TC:
+	case FGL_PIXFMT_4BPP:
+		return texels / 2;
+	case FGL_PIXFMT_8BPP:
+		return texels;
+	default:
+		return texels * FGLPixelFormat::get(pixFormat)->pixelSize;
+	}
+}
+
 /**
  * Calculates texture mipmap parameters and total size in memory.
  * @param obj Texture to process.
  * @param width Texture width.
  * @param height Texture height.
  * @param bpp Texture pixel size in bytes.
- * @return Texture size in bytes.
+ * @return Texture size in pixels.
  */
 static size_t fglCalculateMipmaps(FGLTexture *obj, unsigned int width,
 					unsigned int height, unsigned int bpp)
@@ -607,7 +656,7 @@ static size_t fglCalculateMipmaps(FGLTexture *obj, unsigned int width,
 	size_t offset, size;
 	unsigned int lvl, check;
 
-	size = width * height;
+	size = fglLevelTexels(obj->pixFormat, width, height);
 	offset = 0;
 	check = max(width, height);
 	lvl = 0;
@@ -631,7 +680,7 @@ static size_t fglCalculateMipmaps(FGLTexture *obj, unsigned int width,
 		if (height >= 2)
 			height /= 2;
 
-		size = width * height;
+		size = fglLevelTexels(obj->pixFormat, width, height);
 	} while (1);
 
 	obj->maxLevel = lvl;
@@ -733,6 +782,7 @@ static inline uint16_t fglPackAL88(uint8_t l, uint8_t a)
 static void fglConvertTexture(FGLTexture *obj, unsigned level,
 			const GLvoid *pixels, unsigned alignment)
 {
+	FGL_PROFILE_SCOPE("fglConvertTexture");
 	const FGLPixelFormat *pix = FGLPixelFormat::get(obj->pixFormat);
 	unsigned offset = pix->pixelSize*fimgGetTexMipmapOffset(obj->fimg, level);
 
@@ -813,370 +863,2826 @@ static void fglConvertTexture(FGLTexture *obj, unsigned level,
 	}
 }
 
+/*
+ * ETC1 compressed textures
+ *
+ * The hardware does not support ETC1, so compressed images are transcoded
+ * to RGB565 when loaded. Every ETC1 block consists of two sub-blocks, each
+ * using only four colors, so the colors are computed once per sub-block
+ * and pixels are just looked up by their 2-bit indices.
+ */
+
+/** ETC1 intensity modifiers indexed by table codeword and pixel index. */
+static const int fglETC1Modifiers[8][4] = {
+	{  2,   8,  -2,   -8 },
+	{  5,  17,  -5,  -17 },
+	{  9,  29,  -9,  -29 },
+	{ 13,  42, -13,  -42 },
+	{ 18,  60, -18,  -60 },
+	{ 24,  80, -24,  -80 },
+	{ 33, 106, -33, -106 },
+	{ 47, 183, -47, -183 },
+};
+
 /**
- * Waits until the hardware stops accessing given texture.
- * @param ctx Rendering context.
- * @param tex Texture to wait for.
+ * Clamps color component to 0-255 range.
+ * @param c Color component.
+ * @return Clamped color component.
  */
-static inline void fglWaitForTexture(FGLContext *ctx, FGLTexture *tex)
+static inline int fglClampColor(int c)
 {
-	for (int i = 0; i < FGL_MAX_TEXTURE_UNITS; ++i) {
-		if (ctx->busyTexture[i] == tex) {
-			glFinish();
-			break;
-		}
-	}
+	if (c < 0)
+		return 0;
+	if (c > 255)
+		return 255;
+	return c;
 }
 
-GL_API void GL_APIENTRY glTexImage2D (GLenum target, GLint level,
-	GLint internalformat, GLsizei width, GLsizei height, GLint border,
-	GLenum format, GLenum type, const GLvoid *pixels)
+/**
+ * Computes RGB565 colors of an ETC1 sub-block.
+ * @param pal Array of 4 colors to fill.
+ * @param r Red component of base color.
+ * @param g Green component of base color.
+ * @param b Blue component of base color.
+ * @param table Intensity modifier table codeword.
+ */
+static inline void fglETC1Palette(uint16_t *pal,
+				int r, int g, int b, unsigned table)
 {
-	/* Check conditions required by specification */
-	if (target != GL_TEXTURE_2D) {
-		setError(GL_INVALID_ENUM);
-		return;
-	}
-
-	if (level < 0) {
-		setError(GL_INVALID_VALUE);
-		return;
-	}
-
-	if (border != 0) {
-		setError(GL_INVALID_VALUE);
-		return;
-	}
+	const int *mod = fglETC1Modifiers[table];
 
-	if ((GLenum)internalformat != format) {
-		setError(GL_INVALID_OPERATION);
-		return;
+	for (int i = 0; i < 4; ++i) {
+		int m = mod[i];
+		pal[i] = ((fglClampColor(r + m) >> 3) << 11)
+			| ((fglClampColor(g + m) >> 2) << 5)
+			| (fglClampColor(b + m) >> 3);
 	}
+}
 
-	FGLContext *ctx = getContext();
-	FGLTexture *obj = ctx->texture[ctx->activeTexture].getTexture();
-
-	/* Mipmap image specification */
-	if (level > 0) {
-		if (obj->eglImage) {
-			/* TODO: Copy eglImage contents into new texture */
-			setError(GL_INVALID_OPERATION);
-			return;
-		}
-
-		GLint mipmapW, mipmapH;
-
-		mipmapW = obj->width >> level;
-		if (!mipmapW)
-			mipmapW = 1;
-
-		mipmapH = obj->height >> level;
-		if (!mipmapH)
-			mipmapH = 1;
-
-		if (!obj->surface) {
-			/* Mipmaps can be specified only if base level exists */
-			setError(GL_INVALID_OPERATION);
-			return;
-		}
+/**
+ * Extends 4-bit color component to 8 bits.
+ * @param c 4-bit color component.
+ * @return 8-bit color component.
+ */
+static inline int fglExtend4(int c)
+{
+	return (c << 4) | c;
+}
 
-		/* Check dimensions */
-		if (mipmapW != width || mipmapH != height) {
-			/* Invalid size */
-			setError(GL_INVALID_VALUE);
-			return;
-		}
+/**
+ * Extends 5-bit color component to 8 bits.
+ * @param c 5-bit color component.
+ * @return 8-bit color component.
+ */
+static inline int fglExtend5(int c)
+{
+	return (c << 3) | (c >> 2);
+}
 
-		/* Check format */
-		if (obj->format != format || obj->type != type) {
-			/* Must be the same format as base level */
-			setError(GL_INVALID_ENUM);
-			return;
-		}
+/**
+ * Decodes single ETC1 block into RGB565 pixels.
+ * @param dst Destination pixel of top-left corner of the block.
+ * @param stride Destination line width in pixels.
+ * @param src ETC1 block (8 bytes).
+ * @param w Count of block columns to write (1-4).
+ * @param h Count of block rows to write (1-4).
+ */
+static void fglDecodeETC1Block(uint16_t *dst, unsigned stride,
+				const uint8_t *src, unsigned w, unsigned h)
+{
+	uint16_t pal[2][4];
+	unsigned table1 = src[3] >> 5;
+	unsigned table2 = (src[3] >> 2) & 7;
+
+	if (src[3] & 2) {
+		/* Differential mode */
+		int r = src[0] >> 3;
+		int g = src[1] >> 3;
+		int b = src[2] >> 3;
+		/* Sign extend 3-bit deltas */
+		int dr = (src[0] & 3) - (src[0] & 4);
+		int dg = (src[1] & 3) - (src[1] & 4);
+		int db = (src[2] & 3) - (src[2] & 4);
+
+		fglETC1Palette(pal[0], fglExtend5(r),
+				fglExtend5(g), fglExtend5(b), table1);
+		fglETC1Palette(pal[1], fglExtend5((r + dr) & 0x1f),
+				fglExtend5((g + dg) & 0x1f),
+				fglExtend5((b + db) & 0x1f), table2);
+	} else {
+		/* Individual mode */
+		fglETC1Palette(pal[0], fglExtend4(src[0] >> 4),
+				fglExtend4(src[1] >> 4),
+				fglExtend4(src[2] >> 4), table1);
+		fglETC1Palette(pal[1], fglExtend4(src[0] & 0xf),
+				fglExtend4(src[1] & 0xf),
+				fglExtend4(src[2] & 0xf), table2);
+	}
 
-		/* Copy the image (with conversion if needed) */
-		if (pixels != NULL) {
-			const FGLPixelFormat *pix =
-					FGLPixelFormat::get(obj->pixFormat);
-
-			fglWaitForTexture(ctx, obj);
-
-			if (obj->convert) {
-				fglConvertTexture(obj, level, pixels,
-							ctx->unpackAlignment);
-			} else {
-				if (ctx->unpackAlignment <= pix->pixelSize)
-					fglLoadTextureDirect(obj, level, pixels);
-				else
-					fglLoadTexture(obj, level, pixels,
-						       ctx->unpackAlignment);
-			}
+	/* Pixel indices are stored column by column, MSBs first */
+	uint32_t msb = (src[4] << 8) | src[5];
+	uint32_t lsb = (src[6] << 8) | src[7];
+	bool flip = src[3] & 1;
 
-			if (obj->genMipmap)
-				fglGenerateMipmaps(obj, level);
+	for (unsigned y = 0; y < h; ++y) {
+		for (unsigned x = 0; x < w; ++x) {
+			unsigned bit = 4*x + y;
+			unsigned idx = (((msb >> bit) & 1) << 1)
+							| ((lsb >> bit) & 1);
+			unsigned sub = flip ? (y >> 1) : (x >> 1);
 
-			obj->dirty = true;
+			dst[x] = pal[sub][idx];
 		}
-
-		return;
-	}
-
-	/* Base image specification */
-	bool convert;
-	int pixFormat = fglGetFormatInfo(format, type, &convert);
-	if (pixFormat < 0) {
-		setError(GL_INVALID_VALUE);
-		return;
+		dst += stride;
 	}
+}
 
-	fglWaitForTexture(ctx, obj);
+/**
+ * Loads ETC1 compressed image into texture memory, transcoding it to RGB565.
+ * @param obj Texture object.
+ * @param level Mipmap level.
+ * @param data ETC1 compressed image.
+ */
+static void fglLoadTextureETC1(FGLTexture *obj, unsigned level,
+							const GLvoid *data)
+{
+	FGL_PROFILE_SCOPE("fglLoadTextureETC1");
+	unsigned offset = 2*fimgGetTexMipmapOffset(obj->fimg, level);
 
-	if (obj->eglImage) {
-		obj->eglImage->disconnect();
-		obj->eglImage = 0;
-		obj->surface = 0;
-	}
+	unsigned width = obj->width >> level;
+	if (!width)
+		width = 1;
 
-	if (width != obj->width || height != obj->height
-	    || (uint32_t)pixFormat != obj->pixFormat)
-		obj->markFramebufferDirty();
+	unsigned height = obj->height >> level;
+	if (!height)
+		height = 1;
 
-	const FGLPixelFormat *pix = FGLPixelFormat::get(pixFormat);
-	obj->invReady = false;
-	obj->width = width;
-	obj->height = height;
-	obj->format = format;
-	obj->type = type;
-	obj->pixFormat = pixFormat;
-	obj->convert = convert;
-	obj->mask = 0;
-	if (pix->pixFormat != (uint32_t)-1)
-		obj->mask = BIT_VAL(FGL_ATTACHMENT_COLOR);
+	const uint8_t *src8 = (const uint8_t *)data;
+	uint16_t *dst16 = (uint16_t *)((uint8_t *)obj->surface->vaddr + offset);
 
-	if (!width || !height) {
-		delete obj->surface;
-		obj->surface = 0;
-		return;
-	}
+	for (unsigned y = 0; y < height; y += 4) {
+		unsigned h = min(height - y, 4U);
 
-	/* Calculate mipmaps */
-	uint32_t size = pix->pixelSize*fglCalculateMipmaps(obj,
-						width, height, pix->pixelSize);
+		for (unsigned x = 0; x < width; x += 4) {
+			unsigned w = min(width - x, 4U);
 
-	if (obj->surface) {
-		int32_t delta = obj->surface->size - size;
-		if (delta < 0 || delta > 16384) {
-			delete obj->surface;
-			obj->surface = 0;
+			fglDecodeETC1Block(dst16 + x, width, src8, w, h);
+			src8 += 8;
 		}
-	}
 
-	/* (Re)allocate the texture if needed */
-	if (!obj->surface) {
-		obj->surface = new FGLLocalSurface(size);
-		if(!obj->surface || !obj->surface->isValid()) {
-			delete obj->surface;
-			obj->surface = 0;
-			obj->width = 0;
-			obj->height = 0;
-			obj->format = 0;
-			obj->type = 0;
-			obj->pixFormat = 0;
-			setError(GL_OUT_OF_MEMORY);
-			return;
-		}
+		dst16 += 4*width;
 	}
+}
 
-	fimgInitTexture(obj->fimg, pix->flags,
-					pix->texFormat, obj->surface->paddr);
-	fimgSetTex2DSize(obj->fimg, width, height, obj->maxLevel);
+/*
+ * S3TC compressed textures
+ *
+ * The texture unit decodes DXT1 blocks natively, so the blocks are stored
+ * in texture memory as they are, 4 bits per texel.
+ */
 
-	/* Copy the image (with conversion if needed) */
-	if (pixels != NULL) {
-		if (obj->convert) {
-			fglConvertTexture(obj, level, pixels,
-						ctx->unpackAlignment);
-		} else {
-			if (ctx->unpackAlignment <= pix->pixelSize)
-				fglLoadTextureDirect(obj, level, pixels);
-			else
-				fglLoadTexture(obj, level, pixels,
-						ctx->unpackAlignment);
-		}
+/**
+ * Loads DXT1 compressed image into texture memory.
+ * @param obj Texture object.
+ * @param level Mipmap level.
+ * @param data DXT1 compressed image.
+ */
+static void fglLoadTextureS3TC(FGLTexture *obj, unsigned level,
+							const GLvoid *data)
+{
+	unsigned offset = fglTexelBytes(obj->pixFormat,
+				fimgGetTexMipmapOffset(obj->fimg, level));
 
-		if (obj->genMipmap)
-			fglGenerateMipmaps(obj, 0);
+	unsigned width = obj->width >> level;
+	if (!width)
+		width = 1;
 
-		obj->dirty = true;
-	}
+	unsigned height = obj->height >> level;
+	if (!height)
+		height = 1;
+
+	memcpy((uint8_t *)obj->surface->vaddr + offset, data,
+				8*((width + 3)/4)*((height + 3)/4));
 }
 
 /**
- * Copies part of texture image from client buffer to texture memory.
- * Line-by-line variant.
+ * Copies part of DXT1 compressed image to texture memory.
  * @param obj Texture object.
  * @param level Mipmap level.
- * @param pixels Client buffer.
- * @param alignment Line width alignment.
- * @param x Left-most coordinate of the region.
- * @param y Bottom-most coordinate of the region.
+ * @param data DXT1 compressed image of the region.
+ * @param x Left-most coordinate of the region (multiple of 4).
+ * @param y Bottom-most coordinate of the region (multiple of 4).
  * @param w Width of the region.
  * @param h Height of the region.
  */
-static void fglLoadTexturePartial(FGLTexture *obj, unsigned level,
-			const GLvoid *pixels, unsigned alignment,
-			unsigned x, unsigned y, unsigned w, unsigned h)
+static void fglLoadTextureS3TCPartial(FGLTexture *obj, unsigned level,
+			const GLvoid *data, unsigned x, unsigned y,
+			unsigned w, unsigned h)
 {
-	const FGLPixelFormat *pix = FGLPixelFormat::get(obj->pixFormat);
-	unsigned offset = pix->pixelSize*fimgGetTexMipmapOffset(obj->fimg, level);
+	unsigned offset = fglTexelBytes(obj->pixFormat,
+				fimgGetTexMipmapOffset(obj->fimg, level));
 
 	unsigned width = obj->width >> level;
 	if (!width)
 		width = 1;
-	unsigned height = obj->height >> level;
-	if (!height)
-		height = 1;
 
-	size_t line = w*pix->pixelSize;
-	size_t srcStride = (line + alignment - 1) & ~(alignment - 1);
-	size_t dstStride = width*pix->pixelSize;
-	size_t xoffset = x*pix->pixelSize;
-	size_t yoffset = y*dstStride;
-	const uint8_t *src8 = (const uint8_t *)pixels;
-	uint8_t *dst8 = (uint8_t *)obj->surface->vaddr
-						+ offset + yoffset + xoffset;
+	size_t line = 8*((w + 3)/4);
+	size_t dstStride = 8*((width + 3)/4);
+	unsigned rows = (h + 3)/4;
+	const uint8_t *src8 = (const uint8_t *)data;
+	uint8_t *dst8 = (uint8_t *)obj->surface->vaddr + offset
+					+ (y/4)*dstStride + 8*(x/4);
 	do {
 		memcpy(dst8, src8, line);
-		src8 += srcStride;
+		src8 += line;
 		dst8 += dstStride;
-	} while (--h);
+	} while (--rows);
 }
 
+/*
+ * S3TC encoding
+ *
+ * Large opaque RGB(A) textures can be encoded to DXT1 when uploaded,
+ * if enabled with GL_TEXTURE_COMPRESSION_HINT_FIMG. GL_FASTEST uses
+ * endpoints from bounding box of block colors, GL_NICEST fits endpoints
+ * to principal axis of the colors and refines them by least squares.
+ * Encoded textures keep their uncompressed format for the application.
+ * Only textures specified once are kept encoded. Partial updates and
+ * translucent mipmap levels convert the texture back to uncompressed
+ * storage, as DXT1 cannot store them without loss accumulating with every
+ * update, and such textures are not encoded again.
+ */
+
 /**
- * Copies part of texture image from client buffer to texture memory.
- * Variant with pixel format conversion to supported format.
- * @param obj Texture object.
- * @param level Mipmap level.
- * @param pixels Client buffer.
- * @param alignment Line width alignment.
- * @param x Left-most coordinate of the region.
- * @param y Bottom-most coordinate of the region.
- * @param w Width of the region.
- * @param h Height of the region.
+ * Packs 8-bit color components into RGB565 value with rounding.
+ * @param r Red component.
+ * @param g Green component.
+ * @param b Blue component.
+ * @return RGB565 value.
  */
-static void fglConvertTexturePartial(FGLTexture *obj, unsigned level,
-			const GLvoid *pixels, unsigned alignment,
-			unsigned x, unsigned y, unsigned w, unsigned h)
+static inline uint16_t fglPackRGB565(int r, int g, int b)
 {
-	const FGLPixelFormat *pix = FGLPixelFormat::get(obj->pixFormat);
-	unsigned offset = pix->pixelSize*fimgGetTexMipmapOffset(obj->fimg, level);
+	return (((r*31 + 127)/255) << 11) | (((g*63 + 127)/255) << 5)
+							| ((b*31 + 127)/255);
+}
+
+/**
+ * Unpacks RGB565 value into 8-bit color components.
+ * @param c RGB565 value.
+ * @param rgb Array of 3 color components to fill.
+ */
+static inline void fglUnpackRGB565(uint16_t c, int *rgb)
+{
+	rgb[0] = ((c >> 8) & 0xf8) | (c >> 13);
+	rgb[1] = ((c >> 3) & 0xfc) | ((c >> 9) & 3);
+	rgb[2] = ((c << 3) & 0xf8) | ((c >> 2) & 7);
+}
+
+/**
+ * Computes DXT1 palette of a block in 4-color mode.
+ * @param c0 First endpoint.
+ * @param c1 Second endpoint.
+ * @param pal Array of 4 colors to fill.
+ */
+static inline void fglS3TCPalette(uint16_t c0, uint16_t c1, int (*pal)[3])
+{
+	fglUnpackRGB565(c0, pal[0]);
+	fglUnpackRGB565(c1, pal[1]);
+
+	for (int i = 0; i < 3; ++i) {
+		pal[2][i] = (2*pal[0][i] + pal[1][i])/3;
+		pal[3][i] = (pal[0][i] + 2*pal[1][i])/3;
+	}
+}
+
+/**
+ * Selects nearest palette colors for pixels of a block.
+ * @param px Block pixels.
+ * @param c0 First endpoint (must not be lower than c1).
+ * @param c1 Second endpoint.
+ * @param indices Location to store packed 2-bit indices.
+ * @return Squared error of the block.
+ */
+static unsigned fglS3TCIndices(const int (*px)[3], uint16_t c0, uint16_t c1,
+							uint32_t *indices)
+{
+	int pal[4][3];
+	uint32_t idx = 0;
+	unsigned err = 0;
+
+	fglS3TCPalette(c0, c1, pal);
+
+	for (int i = 0; i < 16; ++i) {
+		unsigned best = 0, bestDist = ~0U;
+
+		for (unsigned j = 0; j < 4; ++j) {
+			int dr = px[i][0] - pal[j][0];
+			int dg = px[i][1] - pal[j][1];
+			int db = px[i][2] - pal[j][2];
+			unsigned dist = dr*dr + dg*dg + db*db;
+
+			if (dist < bestDist) {
+				bestDist = dist;
+				best = j;
+			}
+		}
+
+		idx |= best << (2*i);
+		err += bestDist;
+	}
+
+	*indices = idx;
+	return err;
+}
+
+/**
+ * Computes block endpoints from bounding box of block colors.
+ * @param px Block pixels.
+ * @param c Array of 2 endpoints to fill.
+ */
+static void fglS3TCBoundingBox(const int (*px)[3], uint16_t *c)
+{
+	int lo[3] = { 255, 255, 255 };
+	int hi[3] = { 0, 0, 0 };
+
+	for (int i = 0; i < 16; ++i) {
+		for (int j = 0; j < 3; ++j) {
+			lo[j] = min(lo[j], px[i][j]);
+			hi[j] = max(hi[j], px[i][j]);
+		}
+	}
+
+	/* Inset the box to reduce error of colors near its center */
+	for (int j = 0; j < 3; ++j) {
+		int inset = (hi[j] - lo[j]) >> 4;
+		lo[j] += inset;
+		hi[j] -= inset;
+	}
+
+	c[0] = fglPackRGB565(hi[0], hi[1], hi[2]);
+	c[1] = fglPackRGB565(lo[0], lo[1], lo[2]);
+}
+
+/**
+ * Computes block endpoints from extremes of block colors projected
+ * on principal axis of the colors.
+ * @param px Block pixels.
+ * @param c Array of 2 endpoints to fill.
+ */
+static void fglS3TCPrincipalAxis(const int (*px)[3], uint16_t *c)
+{
+	float mean[3] = { 0, 0, 0 };
+	float cov[6] = { 0, 0, 0, 0, 0, 0 };
+	float axis[3] = { 1, 1, 1 };
+
+	for (int i = 0; i < 16; ++i)
+		for (int j = 0; j < 3; ++j)
+			mean[j] += px[i][j];
+	for (int j = 0; j < 3; ++j)
+		mean[j] /= 16;
+
+	for (int i = 0; i < 16; ++i) {
+		float r = px[i][0] - mean[0];
+		float g = px[i][1] - mean[1];
+		float b = px[i][2] - mean[2];
+
+		cov[0] += r*r;
+		cov[1] += r*g;
+		cov[2] += r*b;
+		cov[3] += g*g;
+		cov[4] += g*b;
+		cov[5] += b*b;
+	}
+
+	/* Power iteration converges to the principal eigenvector */
+	for (int iter = 0; iter < 8; ++iter) {
+		float r = cov[0]*axis[0] + cov[1]*axis[1] + cov[2]*axis[2];
+		float g = cov[1]*axis[0] + cov[3]*axis[1] + cov[4]*axis[2];
+		float b = cov[2]*axis[0] + cov[4]*axis[1] + cov[5]*axis[2];
+		float m = max(fabsf(r), max(fabsf(g), fabsf(b)));
+
+		if (m == 0.0f)
+			break;
+
+		axis[0] = r/m;
+		axis[1] = g/m;
+		axis[2] = b/m;
+	}
+
+	int lo = 0, hi = 0;
+	float loDot = 0, hiDot = 0;
+
+	for (int i = 0; i < 16; ++i) {
+		float dot = px[i][0]*axis[0] + px[i][1]*axis[1]
+							+ px[i][2]*axis[2];
+
+		if (!i || dot < loDot) {
+			loDot = dot;
+			lo = i;
+		}
+		if (!i || dot > hiDot) {
+			hiDot = dot;
+			hi = i;
+		}
+	}
+
+	c[0] = fglPackRGB565(px[hi][0], px[hi][1], px[hi][2]);
+	c[1] = fglPackRGB565(px[lo][0], px[lo][1], px[lo][2]);
+}
+
+/**
+ * Refines block endpoints by least squares fit to pixels using given indices.
+ * @param px Block pixels.
+ * @param indices Packed 2-bit indices.
+ * @param c Array of 2 endpoints to update.
+ */
+static void fglS3TCRefine(const int (*px)[3], uint32_t indices, uint16_t *c)
+{
+	/* Weights of first endpoint for each index */
+	static const float weights[4] = { 1.0f, 0.0f, 2.0f/3, 1.0f/3 };
+	float aa = 0, bb = 0, ab = 0;
+	float ax[3] = { 0, 0, 0 };
+	float bx[3] = { 0, 0, 0 };
+
+	for (int i = 0; i < 16; ++i) {
+		float a = weights[(indices >> (2*i)) & 3];
+		float b = 1.0f - a;
+
+		aa += a*a;
+		bb += b*b;
+		ab += a*b;
+
+		for (int j = 0; j < 3; ++j) {
+			ax[j] += a*px[i][j];
+			bx[j] += b*px[i][j];
+		}
+	}
+
+	float det = aa*bb - ab*ab;
+	if (fabsf(det) < 1e-6f)
+		return;
+
+	int e0[3], e1[3];
+	for (int j = 0; j < 3; ++j) {
+		float v0 = (ax[j]*bb - bx[j]*ab)/det;
+		float v1 = (bx[j]*aa - ax[j]*ab)/det;
+
+		e0[j] = clamp((int)(v0 + 0.5f), 0, 255);
+		e1[j] = clamp((int)(v1 + 0.5f), 0, 255);
+	}
+
+	c[0] = fglPackRGB565(e0[0], e0[1], e0[2]);
+	c[1] = fglPackRGB565(e1[0], e1[1], e1[2]);
+}
+
+/**
+ * Selects indices for given endpoints, ordering the endpoints for 4-color
+ * mode of DXT1.
+ * @param px Block pixels.
+ * @param c Array of 2 endpoints (reordered if needed).
+ * @param indices Location to store packed 2-bit indices.
+ * @return Squared error of the block.
+ */
+static unsigned fglS3TCFit(const int (*px)[3], uint16_t *c,
+							uint32_t *indices)
+{
+	if (c[0] < c[1]) {
+		uint16_t tmp = c[0];
+		c[0] = c[1];
+		c[1] = tmp;
+	}
+
+	return fglS3TCIndices(px, c[0], c[1], indices);
+}
+
+/**
+ * Encodes single 4x4 block of pixels to DXT1.
+ * @param dst Destination block (8 bytes).
+ * @param px Block pixels.
+ * @param nicest Use slower encoding with higher quality.
+ */
+static void fglEncodeS3TCBlock(uint8_t *dst, const int (*px)[3], bool nicest)
+{
+	uint16_t c[2];
+	uint32_t indices;
+	unsigned err;
+
+	if (nicest) {
+		fglS3TCPrincipalAxis(px, c);
+		err = fglS3TCFit(px, c, &indices);
+
+		for (int iter = 0; iter < 2 && err; ++iter) {
+			uint16_t rc[2] = { c[0], c[1] };
+			uint32_t rindices;
+
+			fglS3TCRefine(px, indices, rc);
+			unsigned rerr = fglS3TCFit(px, rc, &rindices);
+			if (rerr >= err)
+				break;
+
+			c[0] = rc[0];
+			c[1] = rc[1];
+			indices = rindices;
+			err = rerr;
+		}
+	} else {
+		fglS3TCBoundingBox(px, c);
+		fglS3TCFit(px, c, &indices);
+	}
+
+	dst[0] = c[0];
+	dst[1] = c[0] >> 8;
+	dst[2] = c[1];
+	dst[3] = c[1] >> 8;
+	dst[4] = indices;
+	dst[5] = indices >> 8;
+	dst[6] = indices >> 16;
+	dst[7] = indices >> 24;
+}
+
+/**
+ * Encodes region of ARGB8888 image to DXT1 blocks.
+ * @param dst DXT1 image.
+ * @param src ARGB8888 image.
+ * @param width Image width.
+ * @param height Image height.
+ * @param x0 Left-most block column of the region.
+ * @param y0 Top-most block row of the region.
+ * @param x1 Block column after the region.
+ * @param y1 Block row after the region.
+ * @param nicest Use slower encoding with higher quality.
+ */
+static void fglEncodeS3TC(uint8_t *dst, const uint32_t *src,
+			unsigned width, unsigned height, unsigned x0,
+			unsigned y0, unsigned x1, unsigned y1, bool nicest)
+{
+	unsigned blocks = (width + 3)/4;
+	int px[16][3];
+
+	for (unsigned by = y0; by < y1; ++by) {
+		for (unsigned bx = x0; bx < x1; ++bx) {
+			/* Edge pixels are replicated into incomplete blocks */
+			for (unsigned i = 0; i < 16; ++i) {
+				unsigned x = min(4*bx + i % 4, width - 1);
+				unsigned y = min(4*by + i / 4, height - 1);
+				uint32_t p = src[y*width + x];
+
+				px[i][0] = (p >> 16) & 0xff;
+				px[i][1] = (p >> 8) & 0xff;
+				px[i][2] = p & 0xff;
+			}
+
+			fglEncodeS3TCBlock(dst + 8*(by*blocks + bx), px, nicest);
+		}
+	}
+}
+
+/**
+ * Decodes DXT1 image into ARGB8888 image.
+ * @param dst ARGB8888 image.
+ * @param src DXT1 image.
+ * @param width Image width.
+ * @param height Image height.
+ */
+static void fglDecodeS3TC(uint32_t *dst, const uint8_t *src,
+					unsigned width, unsigned height)
+{
+	for (unsigned by = 0; by < height; by += 4) {
+		for (unsigned bx = 0; bx < width; bx += 4) {
+			uint16_t c0 = src[0] | (src[1] << 8);
+			uint16_t c1 = src[2] | (src[3] << 8);
+			uint32_t idx = src[4] | (src[5] << 8)
+					| (src[6] << 16) | (src[7] << 24);
+			uint32_t pal[4];
+			int rgb[4][3];
+
+			fglS3TCPalette(c0, c1, rgb);
+			if (c0 <= c1) {
+				/* 3-color mode */
+				for (int i = 0; i < 3; ++i)
+					rgb[2][i] = (rgb[0][i] + rgb[1][i])/2;
+			}
+
+			for (int i = 0; i < 4; ++i)
+				pal[i] = fglPackARGB8888(rgb[i][0],
+						rgb[i][1], rgb[i][2], 255);
+			if (c0 <= c1)
+				pal[3] = 0;
+
+			unsigned w = min(width - bx, 4U);
+			unsigned h = min(height - by, 4U);
+			for (unsigned y = 0; y < h; ++y)
+				for (unsigned x = 0; x < w; ++x)
+					dst[(by + y)*width + bx + x] =
+						pal[(idx >> (2*(4*y + x))) & 3];
+			src += 8;
+		}
+	}
+}
+
+/**
+ * Checks whether RGB or RGBA image has only opaque pixels.
+ * @param format Image format (GL_RGB or GL_RGBA).
+ * @param width Image width.
+ * @param height Image height.
+ * @param pixels Client buffer.
+ * @param alignment Line width alignment.
+ * @return True if the image is opaque.
+ */
+static bool fglIsImageOpaque(GLenum format, GLsizei width, GLsizei height,
+			const GLvoid *pixels, unsigned alignment)
+{
+	if (format == GL_RGB)
+		return true;
+
+	size_t stride = (4*width + alignment - 1) & ~(alignment - 1);
+	const uint8_t *src8 = (const uint8_t *)pixels + 3;
+	for (GLsizei y = 0; y < height; ++y) {
+		for (GLsizei x = 0; x < width; ++x)
+			if (src8[4*x] != 255)
+				return false;
+		src8 += stride;
+	}
+
+	return true;
+}
+
+/**
+ * Checks whether texture image should be encoded to S3TC.
+ * @param ctx Rendering context.
+ * @param format Image format.
+ * @param type Image pixel type.
+ * @param width Image width.
+ * @param height Image height.
+ * @param pixels Client buffer.
+ * @param alignment Line width alignment.
+ * @return True if the image should be encoded.
+ */
+static bool fglShouldEncodeS3TC(FGLContext *ctx, GLenum format, GLenum type,
+			GLsizei width, GLsizei height, const GLvoid *pixels,
+			unsigned alignment)
+{
+	if (ctx->hint.textureCompression == GL_DONT_CARE)
+		return false;
+
+	/* Textures without initial contents are likely render targets */
+	if (!pixels || type != GL_UNSIGNED_BYTE)
+		return false;
+
+	if (width*height < FGL_S3TC_ENCODE_MIN_TEXELS)
+		return false;
+
+	if (format != GL_RGB && format != GL_RGBA)
+		return false;
+
+	/* DXT1 cannot store translucent pixels */
+	return fglIsImageOpaque(format, width, height, pixels, alignment);
+}
+
+/**
+ * Unpacks RGB or RGBA image from client buffer into ARGB8888 buffer.
+ * @param dst Destination buffer.
+ * @param dstStride Destination line width in pixels.
+ * @param pixels Client buffer.
+ * @param format Image format (GL_RGB or GL_RGBA).
+ * @param alignment Line width alignment.
+ * @param w Image width.
+ * @param h Image height.
+ */
+static void fglUnpackARGB8888(uint32_t *dst, unsigned dstStride,
+			const GLvoid *pixels, GLenum format,
+			unsigned alignment, unsigned w, unsigned h)
+{
+	unsigned bpp = (format == GL_RGBA) ? 4 : 3;
+	size_t line = bpp*w;
+	size_t srcStride = (line + alignment - 1) & ~(alignment - 1);
+	const uint8_t *src8 = (const uint8_t *)pixels;
+
+	do {
+		const uint8_t *p = src8;
+		for (unsigned x = 0; x < w; ++x) {
+			dst[x] = fglPackARGB8888(p[0], p[1], p[2],
+						(bpp == 4) ? p[3] : 255);
+			p += bpp;
+		}
+		src8 += srcStride;
+		dst += dstStride;
+	} while (--h);
+}
+
+/**
+ * Encodes region of texture mipmap level from ARGB8888 image of the level.
+ * @param obj Texture object.
+ * @param level Mipmap level.
+ * @param src ARGB8888 image of whole level.
+ * @param x Left-most coordinate of the region.
+ * @param y Top-most coordinate of the region.
+ * @param w Width of the region.
+ * @param h Height of the region.
+ */
+static void fglEncodeTextureLevel(FGLTexture *obj, unsigned level,
+			const uint32_t *src, unsigned x, unsigned y,
+			unsigned w, unsigned h)
+{
+	unsigned offset = fglTexelBytes(obj->pixFormat,
+				fimgGetTexMipmapOffset(obj->fimg, level));
+
+	unsigned width = obj->width >> level;
+	if (!width)
+		width = 1;
+
+	unsigned height = obj->height >> level;
+	if (!height)
+		height = 1;
+
+	fglEncodeS3TC((uint8_t *)obj->surface->vaddr + offset, src,
+			width, height, x/4, y/4, (x + w + 3)/4, (y + h + 3)/4,
+			obj->compressionHint == GL_NICEST);
+}
+
+/**
+ * Encodes texture image from client buffer into S3TC texture memory.
+ * @param obj Texture object.
+ * @param level Mipmap level.
+ * @param pixels Client buffer.
+ * @param alignment Line width alignment.
+ * @return True on success, false on allocation failure.
+ */
+static bool fglEncodeTexture(FGLTexture *obj, unsigned level,
+			const GLvoid *pixels, unsigned alignment)
+{
+	FGL_PROFILE_SCOPE("fglEncodeTexture");
+
+	unsigned width = obj->width >> level;
+	if (!width)
+		width = 1;
+
+	unsigned height = obj->height >> level;
+	if (!height)
+		height = 1;
+
+	uint32_t *buf = (uint32_t *)malloc(4*width*height);
+	if (!buf)
+		return false;
+
+	fglUnpackARGB8888(buf, width, pixels, obj->format,
+						alignment, width, height);
+	fglEncodeTextureLevel(obj, level, buf, 0, 0, width, height);
+
+	free(buf);
+	return true;
+}
+
+/**
+ * Generates mipmaps of S3TC texture, by decoding given level, scaling
+ * it down and encoding the results.
+ * @param obj Texture object.
+ * @param baseLevel Level to generate mipmaps from.
+ */
+static void fglGenerateMipmapsS3TC(FGLTexture *obj, unsigned int baseLevel)
+{
+	unsigned offset = fglTexelBytes(obj->pixFormat,
+				fimgGetTexMipmapOffset(obj->fimg, baseLevel));
+
+	unsigned width = obj->width >> baseLevel;
+	if (!width)
+		width = 1;
+
+	unsigned height = obj->height >> baseLevel;
+	if (!height)
+		height = 1;
+
+	uint32_t *buf = (uint32_t *)malloc(4*width*height);
+	if (!buf) {
+		LOGE("Failed to allocate mipmap generation buffer");
+		return;
+	}
+
+	fglDecodeS3TC(buf, (uint8_t *)obj->surface->vaddr + offset,
+							width, height);
+
+	for (int level = baseLevel; level < obj->maxLevel; ++level) {
+		/* Scaled down in place */
+		fglDownscaleBy2ARGB8888(buf, buf, width, height);
+
+		width = max(width / 2, 1U);
+		height = max(height / 2, 1U);
+
+		fglEncodeTextureLevel(obj, level + 1, buf,
+						0, 0, width, height);
+	}
+
+	free(buf);
+}
+
+/*
+ * Paletted textures
+ *
+ * Indices are stored in native 4bpp or 8bpp formats and the palette is
+ * loaded into palette memory of the texture unit when the texture is used.
+ */
+
+/** Palette entry formats of paletted texture formats. */
+enum {
+	FGL_PALETTE_RGB8 = 0,
+	FGL_PALETTE_RGBA8,
+	FGL_PALETTE_R5_G6_B5,
+	FGL_PALETTE_RGBA4,
+	FGL_PALETTE_RGB5_A1,
+	FGL_PALETTE_NUM_FORMATS
+};
+
+/** Sizes of palette entries in client buffer. */
+static const unsigned fglPaletteEntrySize[FGL_PALETTE_NUM_FORMATS] = {
+	3, 4, 2, 2, 2
+};
+
+/** Hardware palette formats used for palette entries. */
+static const unsigned fglPaletteHwFormat[FGL_PALETTE_NUM_FORMATS] = {
+	FGTU_TSTA_PAL_TEX_FORMAT_8888,
+	FGTU_TSTA_PAL_TEX_FORMAT_8888,
+	FGTU_TSTA_PAL_TEX_FORMAT_565,
+	FGTU_TSTA_PAL_TEX_FORMAT_4444,
+	FGTU_TSTA_PAL_TEX_FORMAT_1555,
+};
+
+/** Pixel formats matching hardware palette formats of palette entries. */
+static const int fglPaletteExpandFormat[FGL_PALETTE_NUM_FORMATS] = {
+	FGL_PIXFMT_ARGB8888,
+	FGL_PIXFMT_ARGB8888,
+	FGL_PIXFMT_RGB565,
+	FGL_PIXFMT_ARGB4444,
+	FGL_PIXFMT_ARGB1555,
+};
+
+/**
+ * Converts palette entry from client buffer to hardware format.
+ * @param format Palette entry format.
+ * @param src Palette entry in client buffer.
+ * @return Palette entry in hardware format.
+ */
+static inline uint32_t fglConvertPaletteEntry(unsigned format,
+							const uint8_t *src)
+{
+	uint16_t val;
+
+	switch (format) {
+	case FGL_PALETTE_RGB8:
+		return fglPackARGB8888(src[0], src[1], src[2], 255);
+	case FGL_PALETTE_RGBA8:
+		return fglPackARGB8888(src[0], src[1], src[2], src[3]);
+	}
+
+	memcpy(&val, src, sizeof(val));
+
+	switch (format) {
+	case FGL_PALETTE_RGBA4:
+		/* RGBA4444 -> ARGB4444 */
+		return (val >> 4) | ((val & 0xf) << 12);
+	case FGL_PALETTE_RGB5_A1:
+		/* RGBA5551 -> ARGB1555 */
+		return (val >> 1) | ((val & 1) << 15);
+	default:
+		return val;
+	}
+}
+
+/**
+ * Loads mipmap level of paletted texture into texture memory.
+ * @param obj Texture object.
+ * @param level Mipmap level.
+ * @param data Indices of the level, packed without padding.
+ * @return Size of the level in client buffer.
+ */
+static size_t fglLoadTexturePaletted(FGLTexture *obj, unsigned level,
+							const uint8_t *data)
+{
+	unsigned offset = fglTexelBytes(obj->pixFormat,
+				fimgGetTexMipmapOffset(obj->fimg, level));
+
+	unsigned width = obj->width >> level;
+	if (!width)
+		width = 1;
+
+	unsigned height = obj->height >> level;
+	if (!height)
+		height = 1;
+
+	uint8_t *dst8 = (uint8_t *)obj->surface->vaddr + offset;
+
+	if (obj->pixFormat == FGL_PIXFMT_8BPP) {
+		memcpy(dst8, data, width*height);
+		return width*height;
+	}
+
+	/* First index is in high nibble, the hardware expects it in low one */
+	size_t size = (width*height + 1)/2;
+	for (size_t i = 0; i < size; ++i)
+		dst8[i] = (data[i] >> 4) | (data[i] << 4);
+
+	return size;
+}
+
+/*
+ * Compressed textures
+ */
+
+/**
+ * Gets pixel format used to store compressed texture format.
+ * @param format Compressed texture format.
+ * @return Pixel format or -1 if the format is not supported.
+ */
+static int fglGetCompressedFormatInfo(GLenum format)
+{
+	switch (format) {
+	case GL_ETC1_RGB8_OES:
+		/* Transcoded when loading */
+		return FGL_PIXFMT_RGB565;
+	case GL_COMPRESSED_RGB_S3TC_DXT1_EXT:
+	case GL_COMPRESSED_RGBA_S3TC_DXT1_EXT:
+		return FGL_PIXFMT_S3TC;
+	case GL_PALETTE4_RGB8_OES:
+	case GL_PALETTE4_RGBA8_OES:
+	case GL_PALETTE4_R5_G6_B5_OES:
+	case GL_PALETTE4_RGBA4_OES:
+	case GL_PALETTE4_RGB5_A1_OES:
+		return FGL_PIXFMT_4BPP;
+	case GL_PALETTE8_RGB8_OES:
+	case GL_PALETTE8_RGBA8_OES:
+	case GL_PALETTE8_R5_G6_B5_OES:
+	case GL_PALETTE8_RGBA4_OES:
+	case GL_PALETTE8_RGB5_A1_OES:
+		return FGL_PIXFMT_8BPP;
+	default:
+		return -1;
+	}
+}
+
+/**
+ * Calculates size of block compressed image.
+ * (ETC1 and DXT1 use 8 bytes per 4x4 block.)
+ * @param width Image width.
+ * @param height Image height.
+ * @return Image size in bytes.
+ */
+static inline GLsizei fglCompressedImageSize(GLsizei width, GLsizei height)
+{
+	return 8*((width + 3)/4)*((height + 3)/4);
+}
+
+/**
+ * Loads compressed image into texture memory.
+ * @param obj Texture object.
+ * @param level Mipmap level.
+ * @param data Compressed image.
+ */
+static void fglLoadCompressedTexture(FGLTexture *obj, unsigned level,
+							const GLvoid *data)
+{
+	if (obj->pixFormat == FGL_PIXFMT_S3TC)
+		fglLoadTextureS3TC(obj, level, data);
+	else
+		fglLoadTextureETC1(obj, level, data);
+}
+
+/**
+ * Copies texture memory except the region about to be modified and the
+ * mipmap levels about to be generated from it.
+ * @param tex Texture object.
+ * @param dst Destination memory.
+ * @param src Source memory.
+ * @param level Mipmap level to be modified.
+ * @param x Left-most coordinate of the region.
+ * @param y Bottom-most coordinate of the region.
+ * @param w Width of the region.
+ * @param h Height of the region.
+ */
+static void fglCopyTextureOutside(FGLTexture *tex, uint8_t *dst,
+			const uint8_t *src, int level, unsigned x, unsigned y,
+			unsigned w, unsigned h)
+{
+	unsigned width = tex->width;
+	unsigned height = tex->height;
+
+	for (int l = 0; l <= tex->maxLevel; ++l) {
+		size_t offset = fglTexelBytes(tex->pixFormat,
+					fimgGetTexMipmapOffset(tex->fimg, l));
+		size_t size = fglTexelBytes(tex->pixFormat,
+				fglLevelTexels(tex->pixFormat, width, height));
+		unsigned lw = width;
+		unsigned lh = height;
+
+		width = max(width / 2, 1U);
+		height = max(height / 2, 1U);
+
+		if (l > level && tex->genMipmap)
+			/* Generated from the modified level */
+			break;
+
+		/* Texels of 4bpp textures share bytes */
+		if (l != level || tex->pixFormat == FGL_PIXFMT_4BPP) {
+			memcpy(dst + offset, src + offset, size);
+			continue;
+		}
+
+		/* S3TC textures are modified in whole 4x4 blocks */
+		unsigned unit = (tex->pixFormat == FGL_PIXFMT_S3TC) ? 4 : 1;
+		unsigned rows = (lh + unit - 1) / unit;
+		size_t line = size / rows;
+		size_t unitBytes = line / ((lw + unit - 1) / unit);
+		unsigned y0 = y / unit;
+		unsigned y1 = (y + h + unit - 1) / unit;
+		size_t x0 = unitBytes*(x / unit);
+		size_t x1 = unitBytes*((x + w + unit - 1) / unit);
+
+		memcpy(dst + offset, src + offset, line*y0);
+		for (unsigned row = y0; row < y1; ++row) {
+			size_t pos = offset + line*row;
+
+			memcpy(dst + pos, src + pos, x0);
+			memcpy(dst + pos + x1, src + pos + x1, line - x1);
+		}
+		memcpy(dst + offset + line*y1, src + offset + line*y1,
+							line*(rows - y1));
+	}
+}
+
+/**
+ * Makes texture memory safe to be modified by the CPU. If the texture might
+ * be used by the hardware at the moment, it is given new memory instead of
+ * waiting for the hardware to finish. The old memory is retired and freed
+ * in glFinish, when the hardware does not access it anymore.
+ *
+ * Retired memory is limited by FGL_MAX_RETIRED_SURFACES and
+ * FGL_MAX_RETIRED_SIZE, after which the hardware is waited for. Textures
+ * larger than FGL_MAX_ORPHAN_COPY_SIZE are always waited for when their
+ * contents must be preserved, as copying them takes longer than the hardware
+ * needs to finish. This covers textures updated many times per frame, such
+ * as a 1024x1024 RGBA glyph atlas, which would otherwise use up the limits
+ * after a single update.
+ * @param ctx Rendering context.
+ * @param tex Texture to be modified.
+ * @param level Mipmap level to be modified or -1 if contents of the texture
+ * are replaced as a whole and the texture is left without memory.
+ * @param x Left-most coordinate of modified region of the level.
+ * @param y Bottom-most coordinate of modified region of the level.
+ * @param w Width of modified region of the level.
+ * @param h Height of modified region of the level.
+ */
+static void fglOrphanTextureRegion(FGLContext *ctx, FGLTexture *tex,
+			int level, unsigned x, unsigned y, unsigned w, unsigned h)
+{
+	int i;
+
+#ifdef FIMG_ASYNC_TEXTURE_UPLOAD
+	fglWaitForTextureUpload(tex);
+#endif
+
+	/* Hardware might render into framebuffer attachments at any time */
+	FGLFramebufferAttachableObject *fbo =
+				&tex->FGLFramebufferAttachable::object;
+	if (fbo->begin() != fbo->end()) {
+		glFinish();
+		return;
+	}
+
+	for (i = 0; i < FGL_MAX_TEXTURE_UNITS; ++i)
+		if (ctx->busyTexture[i] == tex)
+			break;
+
+	if (i == FGL_MAX_TEXTURE_UNITS)
+		/* Not used by the hardware */
+		return;
+
+	/* Memory of eglImages is owned by somebody else */
+	if (tex->eglImage || !tex->surface
+	    || ctx->retiredSurfaces == FGL_MAX_RETIRED_SURFACES
+	    || ctx->retiredSize + tex->surface->size > FGL_MAX_RETIRED_SIZE
+	    || (level >= 0
+	    && tex->surface->size > FGL_MAX_ORPHAN_COPY_SIZE)) {
+		glFinish();
+		return;
+	}
+
+	FGLSurface *surface = 0;
+
+	if (level >= 0) {
+		surface = new FGLLocalSurface(tex->surface->size);
+		if (!surface || !surface->isValid()) {
+			delete surface;
+			glFinish();
+			return;
+		}
+
+		/* Untouched parts of the texture must stay intact */
+		fglCopyTextureOutside(tex, (uint8_t *)surface->vaddr,
+				(const uint8_t *)tex->surface->vaddr,
+				level, x, y, w, h);
+		fimgSetTexBaseAddr(tex->fimg, surface->paddr);
+		tex->dirty = true;
+		tex->cachedUnits = BIT_MASK(FGL_MAX_TEXTURE_UNITS);
+	}
+
+	ctx->retiredSurface[ctx->retiredSurfaces++] = tex->surface;
+	ctx->retiredSize += tex->surface->size;
+	tex->surface = surface;
+	tex->markFramebufferDirty();
+
+	for (i = 0; i < FGL_MAX_TEXTURE_UNITS; ++i)
+		if (ctx->busyTexture[i] == tex)
+			ctx->busyTexture[i] = 0;
+}
+
+/**
+ * Makes texture memory safe to be modified by the CPU, preserving contents
+ * of the texture except given mipmap level.
+ * @param ctx Rendering context.
+ * @param tex Texture to be modified.
+ * @param level Mipmap level to be replaced.
+ */
+static inline void fglOrphanTextureLevel(FGLContext *ctx, FGLTexture *tex,
+								int level)
+{
+	unsigned w = max((unsigned)tex->width >> level, 1U);
+	unsigned h = max((unsigned)tex->height >> level, 1U);
+
+	fglOrphanTextureRegion(ctx, tex, level, 0, 0, w, h);
+}
+
+/**
+ * Makes texture memory safe to be replaced as a whole by the CPU, leaving
+ * the texture without memory if it might be used by the hardware.
+ * @param ctx Rendering context.
+ * @param tex Texture to be modified.
+ */
+static inline void fglOrphanTexture(FGLContext *ctx, FGLTexture *tex)
+{
+	fglOrphanTextureRegion(ctx, tex, -1, 0, 0, 0, 0);
+}
+
+/**
+ * Converts texture encoded to S3TC back to its uncompressed format, before
+ * it gets updated with data which cannot be encoded without loss of quality.
+ * The texture is not encoded again, even if its image is specified again.
+ * @param ctx Rendering context.
+ * @param obj Texture object.
+ * @return True on success, false on allocation failure.
+ */
+static bool fglDecodeTexture(FGLContext *ctx, FGLTexture *obj)
+{
+	if (obj->pixFormat != FGL_PIXFMT_S3TC || obj->compressed)
+		return true;
+
+	FGL_PROFILE_SCOPE("fglDecodeTexture");
+#ifdef FIMG_ASYNC_TEXTURE_UPLOAD
+	fglWaitForTextureUpload(obj);
+#endif
+
+	unsigned offset[FGL_MAX_MIPMAP_LEVEL + 1];
+	for (int level = 0; level <= obj->maxLevel; ++level)
+		offset[level] = fglTexelBytes(FGL_PIXFMT_S3TC,
+				fimgGetTexMipmapOffset(obj->fimg, level));
+
+	bool convert;
+	int pixFormat = fglGetFormatInfo(obj->format, obj->type, &convert);
+	const FGLPixelFormat *pix = FGLPixelFormat::get(pixFormat);
+
+	obj->pixFormat = pixFormat;
+	uint32_t size = fglTexelBytes(pixFormat, fglCalculateMipmaps(obj,
+				obj->width, obj->height, pix->pixelSize));
+
+	FGLSurface *surface = new FGLLocalSurface(size);
+	if (!surface || !surface->isValid()) {
+		delete surface;
+		obj->pixFormat = FGL_PIXFMT_S3TC;
+		fglCalculateMipmaps(obj, obj->width, obj->height,
+			FGLPixelFormat::get(FGL_PIXFMT_S3TC)->pixelSize);
+		return false;
+	}
+
+	/* Retired memory stays valid until the hardware is finished with it */
+	FGLSurface *old = obj->surface;
+	fglOrphanTexture(ctx, obj);
+
+	unsigned width = obj->width;
+	unsigned height = obj->height;
+	for (int level = 0; level <= obj->maxLevel; ++level) {
+		uint32_t *dst = (uint32_t *)surface->vaddr
+				+ fimgGetTexMipmapOffset(obj->fimg, level);
+
+		fglDecodeS3TC(dst, (const uint8_t *)old->vaddr
+					+ offset[level], width, height);
+
+		/* GL_RGBA is stored in client byte order */
+		if (pixFormat == FGL_PIXFMT_ABGR8888) {
+			for (unsigned i = 0; i < width*height; ++i)
+				dst[i] = (dst[i] & 0xff00ff00)
+					| ((dst[i] >> 16) & 0xff)
+					| ((dst[i] & 0xff) << 16);
+		}
+
+		width = max(width / 2, 1U);
+		height = max(height / 2, 1U);
+	}
+
+	if (obj->surface == old)
+		delete old;
+
+	obj->surface = surface;
+	obj->convert = convert;
+	obj->noEncode = true;
+	obj->dirty = true;
+	obj->markFramebufferDirty();
+
+	fimgInitTexture(obj->fimg, pix->flags,
+					pix->texFormat, surface->paddr);
+	fimgSetTex2DSize(obj->fimg, obj->width, obj->height, obj->maxLevel);
+	fimgSetTexPalette(obj->fimg, 0, NULL, 0);
+	obj->cachedUnits = BIT_MASK(FGL_MAX_TEXTURE_UNITS);
+
+	return true;
+}
+
+/**
+ * Expands paletted texture to the direct color format of its palette
+ * entries. Palette memory is shared by all texture units, so only one
+ * paletted texture can be used by a draw and any other one is expanded.
+ * The texture stays expanded until its image is specified again.
+ * @param ctx Rendering context.
+ * @param obj Texture object.
+ * @return True on success, false on allocation failure.
+ */
+bool fglExpandPalettedTexture(FGLContext *ctx, FGLTexture *obj)
+{
+	const uint32_t *palette;
+	if (!fimgGetTexPalette(obj->fimg, &palette))
+		return true;
+
+	FGL_PROFILE_SCOPE("fglExpandPalettedTexture");
+#ifdef FIMG_ASYNC_TEXTURE_UPLOAD
+	fglWaitForTextureUpload(obj);
+#endif
+
+	int oldFormat = obj->pixFormat;
+	unsigned offset[FGL_MAX_MIPMAP_LEVEL + 1];
+	for (int level = 0; level <= obj->maxLevel; ++level)
+		offset[level] = fglTexelBytes(oldFormat,
+				fimgGetTexMipmapOffset(obj->fimg, level));
+
+	unsigned palFormat = (obj->format - GL_PALETTE4_RGB8_OES)
+						% FGL_PALETTE_NUM_FORMATS;
+	int pixFormat = fglPaletteExpandFormat[palFormat];
+	const FGLPixelFormat *pix = FGLPixelFormat::get(pixFormat);
+
+	obj->pixFormat = pixFormat;
+	uint32_t size = fglTexelBytes(pixFormat, fglCalculateMipmaps(obj,
+				obj->width, obj->height, pix->pixelSize));
+
+	FGLSurface *surface = new FGLLocalSurface(size);
+	if (!surface || !surface->isValid()) {
+		delete surface;
+		obj->pixFormat = oldFormat;
+		fglCalculateMipmaps(obj, obj->width, obj->height,
+				FGLPixelFormat::get(oldFormat)->pixelSize);
+		return false;
+	}
+
+	/* Retired memory stays valid until the hardware is finished with it */
+	FGLSurface *old = obj->surface;
+	fglOrphanTexture(ctx, obj);
+
+	unsigned width = obj->width;
+	unsigned height = obj->height;
+	for (int level = 0; level <= obj->maxLevel; ++level) {
+		const uint8_t *src = (const uint8_t *)old->vaddr
+							+ offset[level];
+		unsigned dst = fimgGetTexMipmapOffset(obj->fimg, level);
+		uint16_t *dst16 = (uint16_t *)surface->vaddr + dst;
+		uint32_t *dst32 = (uint32_t *)surface->vaddr + dst;
+
+		for (unsigned i = 0; i < width*height; ++i) {
+			unsigned idx;
+
+			/* First texel of a byte is in its low nibble */
+			if (oldFormat == FGL_PIXFMT_4BPP)
+				idx = (src[i / 2] >> (4 * (i & 1))) & 0xf;
+			else
+				idx = src[i];
+
+			if (pix->pixelSize == 4)
+				dst32[i] = palette[idx];
+			else
+				dst16[i] = palette[idx];
+		}
+
+		width = max(width / 2, 1U);
+		height = max(height / 2, 1U);
+	}
+
+	if (obj->surface == old)
+		delete old;
+
+	obj->surface = surface;
+	obj->dirty = true;
+
+	fimgInitTexture(obj->fimg, pix->flags,
+					pix->texFormat, surface->paddr);
+	fimgSetTex2DSize(obj->fimg, obj->width, obj->height, obj->maxLevel);
+	fimgSetTexPalette(obj->fimg, 0, NULL, 0);
+	obj->cachedUnits = BIT_MASK(FGL_MAX_TEXTURE_UNITS);
+
+	return true;
+}
+
+/**
+ * Specifies base level of texture image, (re)allocating texture memory
+ * and setting up hardware texture state for given dimensions and format.
+ * Contents of the image are left undefined.
+ * @param ctx Rendering context.
+ * @param obj Texture object.
+ * @param width Texture width.
+ * @param height Texture height.
+ * @param format Texture format as specified by application.
+ * @param type Texture pixel type as specified by application.
+ * @param pixFormat Pixel format used to store the texture.
+ * @param convert Indicates that the image needs conversion when loading.
+ * @return True if texture memory is ready to be loaded, false if the texture
+ * is empty or allocation failed (with error set).
+ */
+static bool fglSpecifyTexture(FGLContext *ctx, FGLTexture *obj,
+			GLsizei width, GLsizei height, GLenum format,
+			GLenum type, int pixFormat, bool convert)
+{
+	fglOrphanTexture(ctx, obj);
+
+	if (obj->eglImage) {
+		obj->eglImage->disconnect();
+		obj->eglImage = 0;
+		obj->surface = 0;
+	}
+
+	if (width != obj->width || height != obj->height
+	    || (uint32_t)pixFormat != obj->pixFormat)
+		obj->markFramebufferDirty();
+
+	const FGLPixelFormat *pix = FGLPixelFormat::get(pixFormat);
+	obj->invReady = false;
+	obj->width = width;
+	obj->height = height;
+	obj->format = format;
+	obj->type = type;
+	obj->pixFormat = pixFormat;
+	obj->convert = convert;
+	obj->compressed = GL_FALSE;
+	obj->compressionHint = ctx->hint.textureCompression;
+	obj->mask = 0;
+	if (pix->pixFormat != (uint32_t)-1)
+		obj->mask = BIT_VAL(FGL_ATTACHMENT_COLOR);
+
+	if (!width || !height) {
+		delete obj->surface;
+		obj->surface = 0;
+		return false;
+	}
+
+	/* Calculate mipmaps */
+	uint32_t size = fglTexelBytes(pixFormat,
+			fglCalculateMipmaps(obj, width, height, pix->pixelSize));
+
+	if (obj->surface) {
+		int32_t delta = obj->surface->size - size;
+		if (delta < 0 || delta > 16384) {
+			delete obj->surface;
+			obj->surface = 0;
+		}
+	}
+
+	/* (Re)allocate the texture if needed */
+	if (!obj->surface) {
+		obj->surface = new FGLLocalSurface(size);
+		if(!obj->surface || !obj->surface->isValid()) {
+			delete obj->surface;
+			obj->surface = 0;
+			obj->width = 0;
+			obj->height = 0;
+			obj->format = 0;
+			obj->type = 0;
+			obj->pixFormat = 0;
+			setError(GL_OUT_OF_MEMORY);
+			return false;
+		}
+	}
+
+	fimgInitTexture(obj->fimg, pix->flags,
+					pix->texFormat, obj->surface->paddr);
+	fimgSetTex2DSize(obj->fimg, width, height, obj->maxLevel);
+	/* Paletted textures set their palette after specification */
+	fimgSetTexPalette(obj->fimg, 0, NULL, 0);
+	/* Any unit might have cached previous contents of this memory */
+	obj->cachedUnits = BIT_MASK(FGL_MAX_TEXTURE_UNITS);
+
+	return true;
+}
+
+static bool fglUploadTexture(FGLTexture *obj, unsigned level,
+			const GLvoid *pixels, unsigned alignment);
+
+GL_API void GL_APIENTRY glTexImage2D (GLenum target, GLint level,
+	GLint internalformat, GLsizei width, GLsizei height, GLint border,
+	GLenum format, GLenum type, const GLvoid *pixels)
+{
+	/* Check conditions required by specification */
+	if (target != GL_TEXTURE_2D) {
+		setError(GL_INVALID_ENUM);
+		return;
+	}
+
+	if (level < 0) {
+		setError(GL_INVALID_VALUE);
+		return;
+	}
+
+	if (border != 0) {
+		setError(GL_INVALID_VALUE);
+		return;
+	}
+
+	if ((GLenum)internalformat != format) {
+		setError(GL_INVALID_OPERATION);
+		return;
+	}
+
+	FGLContext *ctx = getContext();
+	FGLTexture *obj = ctx->texture[ctx->activeTexture].getTexture();
+
+	/* Mipmap image specification */
+	if (level > 0) {
+		if (obj->eglImage) {
+			/* TODO: Copy eglImage contents into new texture */
+			setError(GL_INVALID_OPERATION);
+			return;
+		}
+
+		GLint mipmapW, mipmapH;
+
+		mipmapW = obj->width >> level;
+		if (!mipmapW)
+			mipmapW = 1;
+
+		mipmapH = obj->height >> level;
+		if (!mipmapH)
+			mipmapH = 1;
+
+		if (!obj->surface) {
+			/* Mipmaps can be specified only if base level exists */
+			setError(GL_INVALID_OPERATION);
+			return;
+		}
+
+		/* Check dimensions */
+		if (mipmapW != width || mipmapH != height) {
+			/* Invalid size */
+			setError(GL_INVALID_VALUE);
+			return;
+		}
+
+		/* Check format */
+		if (obj->format != format || obj->type != type) {
+			/* Must be the same format as base level */
+			setError(GL_INVALID_ENUM);
+			return;
+		}
+
+		/* Copy the image (with conversion if needed) */
+		if (pixels != NULL) {
+			/* Encoded textures stay encoded only if opaque */
+			if (obj->pixFormat == FGL_PIXFMT_S3TC
+			    && !fglIsImageOpaque(format, width, height,
+						pixels, ctx->unpackAlignment)
+			    && !fglDecodeTexture(ctx, obj)) {
+				setError(GL_OUT_OF_MEMORY);
+				return;
+			}
+
+			fglOrphanTextureLevel(ctx, obj, level);
+#ifdef FIMG_PERF_COUNTERS
+			fimgPerfTextureUpload(ctx->fimg,
+				fglTexelBytes(obj->pixFormat, width*height));
+#endif
+
+			if (!fglUploadTexture(obj, level, pixels,
+						ctx->unpackAlignment)) {
+				setError(GL_OUT_OF_MEMORY);
+				return;
+			}
+
+			obj->dirty = true;
+		}
+
+		return;
+	}
+
+	/* Base image specification */
+	bool convert;
+	int pixFormat = fglGetFormatInfo(format, type, &convert);
+	if (pixFormat < 0) {
+		setError(GL_INVALID_VALUE);
+		return;
+	}
+
+	/* Textures specified more than once are likely to be updated */
+	if (obj->surface)
+		obj->noEncode = true;
+
+	if (!obj->noEncode && fglShouldEncodeS3TC(ctx, format, type,
+				width, height, pixels, ctx->unpackAlignment)) {
+		/* Stored as S3TC, but updated as uncompressed texture */
+		pixFormat = FGL_PIXFMT_S3TC;
+		convert = true;
+	}
+
+	if (!fglSpecifyTexture(ctx, obj, width, height,
+					format, type, pixFormat, convert))
+		return;
+
+	/* Copy the image (with conversion if needed) */
+	if (pixels != NULL) {
+#ifdef FIMG_PERF_COUNTERS
+		fimgPerfTextureUpload(ctx->fimg,
+				fglTexelBytes(pixFormat, width*height));
+#endif
+		if (!fglUploadTexture(obj, 0, pixels, ctx->unpackAlignment)) {
+			setError(GL_OUT_OF_MEMORY);
+			return;
+		}
+
+		obj->dirty = true;
+	}
+}
+
+/**
+ * Copies part of texture image from client buffer to texture memory.
+ * Line-by-line variant.
+ * @param obj Texture object.
+ * @param level Mipmap level.
+ * @param pixels Client buffer.
+ * @param alignment Line width alignment.
+ * @param x Left-most coordinate of the region.
+ * @param y Bottom-most coordinate of the region.
+ * @param w Width of the region.
+ * @param h Height of the region.
+ */
+static void fglLoadTexturePartial(FGLTexture *obj, unsigned level,
+			const GLvoid *pixels, unsigned alignment,
+			unsigned x, unsigned y, unsigned w, unsigned h)
+{
+	const FGLPixelFormat *pix = FGLPixelFormat::get(obj->pixFormat);
+	unsigned offset = pix->pixelSize*fimgGetTexMipmapOffset(obj->fimg, level);
+
+	unsigned width = obj->width >> level;
+	if (!width)
+		width = 1;
+	unsigned height = obj->height >> level;
+	if (!height)
+		height = 1;
+
+	size_t line = w*pix->pixelSize;
+	size_t srcStride = (line + alignment - 1) & ~(alignment - 1);
+	size_t dstStride = width*pix->pixelSize;
+	size_t xoffset = x*pix->pixelSize;
+	size_t yoffset = y*dstStride;
+	const uint8_t *src8 = (const uint8_t *)pixels;
+	uint8_t *dst8 = (uint8_t *)obj->surface->vaddr
+						+ offset + yoffset + xoffset;
+	do {
+		memcpy(dst8, src8, line);
+		src8 += srcStride;
+		dst8 += dstStride;
+	} while (--h);
+}
+
+/**
+ * Copies part of texture image from client buffer to texture memory.
+ * Variant with pixel format conversion to supported format.
+ * @param obj Texture object.
+ * @param level Mipmap level.
+ * @param pixels Client buffer.
+ * @param alignment Line width alignment.
+ * @param x Left-most coordinate of the region.
+ * @param y Bottom-most coordinate of the region.
+ * @param w Width of the region.
+ * @param h Height of the region.
+ */
+static void fglConvertTexturePartial(FGLTexture *obj, unsigned level,
+			const GLvoid *pixels, unsigned alignment,
+			unsigned x, unsigned y, unsigned w, unsigned h)
+{
+	FGL_PROFILE_SCOPE("fglConvertTexturePartial");
+	const FGLPixelFormat *pix = FGLPixelFormat::get(obj->pixFormat);
+	unsigned offset = pix->pixelSize*fimgGetTexMipmapOffset(obj->fimg, level);
+
+	unsigned width = obj->width >> level;
+	if (!width)
+		width = 1;
+
+	unsigned height = obj->height >> level;
+	if (!height)
+		height = 1;
+
+	switch (obj->format) {
+	case GL_RGB: {
+		size_t line = 3*w;
+		size_t srcStride = (line + alignment - 1) & ~(alignment - 1);
+		size_t dstStride = 4*width;
+		size_t xOffset = 4*x;
+		size_t yOffset = y*dstStride;
+		size_t srcPad = srcStride - line;
+		size_t dstPad = width - w;
+		const uint8_t *src8 = (const uint8_t *)pixels;
+		uint32_t *dst32 = (uint32_t *)((uint8_t *)obj->surface->vaddr
+						+ offset + yOffset + xOffset);
+		do {
+			unsigned x = w;
+			do {
+				*(dst32++) = fglPackARGB8888(src8[0],
+						src8[1], src8[2], 255);
+				src8 += 3;
+			} while (--x);
+			src8 += srcPad;
+			dst32 += dstPad;
+		} while (--h);
+		break;
+	}
+	case GL_RGBA: {
+		size_t line = 4*w;
+		size_t srcStride = (line + alignment - 1) & ~(alignment - 1);
+		size_t dstStride = 4*width;
+		size_t xOffset = 4*x;
+		size_t yOffset = y*dstStride;
+		size_t srcPad = srcStride - line;
+		size_t dstPad = width - w;
+		const uint8_t *src8 = (const uint8_t *)pixels;
+		uint32_t *dst32 = (uint32_t *)((uint8_t *)obj->surface->vaddr
+						+ offset + yOffset + xOffset);
+		do {
+			unsigned x = w;
+			do {
+				*(dst32++) = fglPackARGB8888(src8[0],
+						src8[1], src8[2], src8[3]);
+				src8 += 4;
+			} while (--x);
+			src8 += srcPad;
+			dst32 += dstPad;
+		} while (--h);
+		break;
+	}
+	case GL_LUMINANCE: {
+		size_t line = w;
+		size_t srcStride = (line + alignment - 1) & ~(alignment - 1);
+		size_t dstStride = 2*width;
+		size_t xOffset = 2*x;
+		size_t yOffset = y*dstStride;
+		size_t srcPad = srcStride - line;
+		size_t dstPad = width - w;
+		const uint8_t *src8 = (const uint8_t *)pixels;
+		uint16_t *dst16 = (uint16_t *)((uint8_t *)obj->surface->vaddr
+						+ offset + yOffset + xOffset);
+		do {
+			unsigned x = w;
+			do {
+				*(dst16++) = fglPackAL88(*(src8++), 255);
+			} while (--x);
+			src8 += srcPad;
+			dst16 += dstPad;
+		} while (--h);
+		break;
+	}
+	case GL_ALPHA: {
+		size_t line = w;
+		size_t srcStride = (line + alignment - 1) & ~(alignment - 1);
+		size_t dstStride = 2*width;
+		size_t xOffset = 2*x;
+		size_t yOffset = y*dstStride;
+		size_t srcPad = srcStride - line;
+		size_t dstPad = width - w;
+		const uint8_t *src8 = (const uint8_t *)pixels;
+		uint16_t *dst16 = (uint16_t *)((uint8_t *)obj->surface->vaddr
+						+ offset + yOffset + xOffset);
+		do {
+			unsigned x = w;
+			do {
+				*(dst16++) = fglPackAL88(0xff, *(src8++));
+			} while (--x);
+			src8 += srcPad;
+			dst16 += dstPad;
+		} while (--h);
+		break;
+	}
+	default:
+		LOGW("Unsupported texture conversion %d", obj->format);
+		return;
+	}
+}
+
+/**
+ * Writes texture image from client buffer to texture memory, converting
+ * or encoding it if needed, and generates mipmaps.
+ * @param obj Texture object.
+ * @param level Mipmap level.
+ * @param pixels Client buffer.
+ * @param alignment Line width alignment.
+ * @param genMipmap Indicates that mipmaps should be generated.
+ * @return True on success, false on allocation failure.
+ */
+static bool fglWriteTexture(FGLTexture *obj, unsigned level,
+			const GLvoid *pixels, unsigned alignment,
+			bool genMipmap)
+{
+	const FGLPixelFormat *pix = FGLPixelFormat::get(obj->pixFormat);
+
+	if (obj->pixFormat == FGL_PIXFMT_S3TC) {
+		if (!fglEncodeTexture(obj, level, pixels, alignment))
+			return false;
+	} else if (obj->convert) {
+		fglConvertTexture(obj, level, pixels, alignment);
+	} else {
+		if (alignment <= pix->pixelSize)
+			fglLoadTextureDirect(obj, level, pixels);
+		else
+			fglLoadTexture(obj, level, pixels, alignment);
+	}
+
+	if (genMipmap)
+		fglGenerateMipmaps(obj, level);
+
+	return true;
+}
+
+/**
+ * Writes part of texture image from client buffer to texture memory,
+ * converting it if needed, and generates mipmaps.
+ * @param obj Texture object.
+ * @param level Mipmap level.
+ * @param pixels Client buffer.
+ * @param alignment Line width alignment.
+ * @param x Left-most coordinate of the region.
+ * @param y Bottom-most coordinate of the region.
+ * @param w Width of the region.
+ * @param h Height of the region.
+ * @param genMipmap Indicates that mipmaps should be generated.
+ * @return True on success, false on allocation failure.
+ */
+static bool fglWriteTexturePartial(FGLTexture *obj, unsigned level,
+			const GLvoid *pixels, unsigned alignment,
+			unsigned x, unsigned y, unsigned w, unsigned h,
+			bool genMipmap)
+{
+	if (obj->convert) {
+		fglConvertTexturePartial(obj, level, pixels,
+						alignment, x, y, w, h);
+	} else {
+		fglLoadTexturePartial(obj, level, pixels,
+						alignment, x, y, w, h);
+	}
+
+	if (genMipmap)
+		fglGenerateMipmaps(obj, level);
+
+	return true;
+}
+
+#ifdef FIMG_ASYNC_TEXTURE_UPLOAD
+
+/*
+ * Asynchronous texture uploads
+ *
+ * Client data are copied to a staging buffer and the rest of the upload
+ * (conversion, encoding and mipmap generation) is done by an upload thread,
+ * shared by all contexts and started at first upload. Queued uploads are
+ * processed in order. Every texture counts its pending uploads, so anything
+ * accessing texture memory has to wait only for uploads of given texture.
+ */
+
+/** Queued upload of texture image. */
+struct FGLUploadJob {
+	/** Next queued upload. */
+	FGLUploadJob *next;
+	/** Texture object. */
+	FGLTexture *obj;
+	/** Mipmap level. */
+	unsigned level;
+	/** Staging buffer with copy of client data. */
+	void *pixels;
+	/** Line width alignment of staging buffer. */
+	unsigned alignment;
+	/** Indicates update of a region instead of whole level. */
+	bool partial;
+	/** Region of the level to update. */
+	unsigned x, y, w, h;
+	/** Indicates that mipmaps should be generated. */
+	bool genMipmap;
+};
+
+static pthread_mutex_t fglUploadMutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t fglUploadWork = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t fglUploadDone = PTHREAD_COND_INITIALIZER;
+static pthread_once_t fglUploadOnce = PTHREAD_ONCE_INIT;
+static bool fglUploadStarted;
+static FGLUploadJob *fglUploadHead;
+static FGLUploadJob *fglUploadTail;
+
+/**
+ * Main loop of upload thread.
+ * @param arg Unused.
+ * @return Never returns.
+ */
+static void *fglUploadThread(void *arg)
+{
+	pthread_mutex_lock(&fglUploadMutex);
+
+	while (1) {
+		FGLUploadJob *job = fglUploadHead;
+		if (!job) {
+			pthread_cond_wait(&fglUploadWork, &fglUploadMutex);
+			continue;
+		}
+
+		fglUploadHead = job->next;
+		if (!fglUploadHead)
+			fglUploadTail = 0;
+
+		pthread_mutex_unlock(&fglUploadMutex);
+
+		FGL_PROFILE_SCOPE("fglUploadThread");
+		bool ret;
+		if (job->partial)
+			ret = fglWriteTexturePartial(job->obj, job->level,
+					job->pixels, job->alignment, job->x,
+					job->y, job->w, job->h, job->genMipmap);
+		else
+			ret = fglWriteTexture(job->obj, job->level, job->pixels,
+					job->alignment, job->genMipmap);
+		if (!ret)
+			LOGE("Failed to allocate texture upload buffer");
+
+		free(job->pixels);
+
+		pthread_mutex_lock(&fglUploadMutex);
+		--job->obj->pendingUploads;
+		pthread_cond_broadcast(&fglUploadDone);
+		delete job;
+	}
+
+	return NULL;
+}
+
+/**
+ * Starts the upload thread, which runs until the process exits.
+ */
+static void fglStartUploadThread(void)
+{
+	pthread_t thread;
+
+	if (pthread_create(&thread, NULL, fglUploadThread, NULL)) {
+		LOGW("Failed to create upload thread, uploading synchronously.");
+		return;
+	}
+
+	pthread_detach(thread);
+	fglUploadStarted = true;
+}
+
+void fglWaitForTextureUpload(FGLTexture *tex)
+{
+	if (!tex->pendingUploads)
+		return;
+
+	FGL_PROFILE_SCOPE("fglWaitForTextureUpload");
+	pthread_mutex_lock(&fglUploadMutex);
+	while (tex->pendingUploads)
+		pthread_cond_wait(&fglUploadDone, &fglUploadMutex);
+	pthread_mutex_unlock(&fglUploadMutex);
+}
+
+/**
+ * Gets size of pixel in client buffer.
+ * @param format Pixel format.
+ * @param type Pixel type.
+ * @return Pixel size in bytes.
+ */
+static inline unsigned fglClientPixelSize(GLenum format, GLenum type)
+{
+	if (type != GL_UNSIGNED_BYTE)
+		return 2;
+
+	switch (format) {
+	case GL_RGB:
+		return 3;
+	case GL_RGBA:
+	case GL_BGRA_EXT:
+		return 4;
+	case GL_LUMINANCE_ALPHA:
+		return 2;
+	default:
+		return 1;
+	}
+}
+
+/**
+ * Queues upload of texture image to be done by the upload thread.
+ * @param obj Texture object.
+ * @param level Mipmap level.
+ * @param pixels Client buffer.
+ * @param alignment Line width alignment.
+ * @param partial Indicates update of a region instead of whole level.
+ * @param x Left-most coordinate of the region.
+ * @param y Bottom-most coordinate of the region.
+ * @param w Width of the region.
+ * @param h Height of the region.
+ * @return True if the upload has been queued, false if it must be done
+ * synchronously.
+ */
+static bool fglQueueTextureUpload(FGLTexture *obj, unsigned level,
+			const GLvoid *pixels, unsigned alignment, bool partial,
+			unsigned x, unsigned y, unsigned w, unsigned h)
+{
+	/* Plain copies would not be any faster through staging buffer */
+	if (!w || !h || (!obj->convert && !obj->genMipmap))
+		return false;
+
+	/* Hardware might render into framebuffer attachments at any time */
+	FGLFramebufferAttachableObject *fbo =
+				&obj->FGLFramebufferAttachable::object;
+	if (fbo->begin() != fbo->end())
+		return false;
+
+	pthread_once(&fglUploadOnce, fglStartUploadThread);
+	if (!fglUploadStarted)
+		return false;
+
+	size_t line = w*fglClientPixelSize(obj->format, obj->type);
+	size_t stride = (line + alignment - 1) & ~(alignment - 1);
+	size_t size = stride*(h - 1) + line;
+
+	FGLUploadJob *job = new FGLUploadJob;
+	if (!job)
+		return false;
+
+	job->pixels = malloc(size);
+	if (!job->pixels) {
+		delete job;
+		return false;
+	}
+
+	memcpy(job->pixels, pixels, size);
+	job->next = 0;
+	job->obj = obj;
+	job->level = level;
+	job->alignment = alignment;
+	job->partial = partial;
+	job->x = x;
+	job->y = y;
+	job->w = w;
+	job->h = h;
+	job->genMipmap = obj->genMipmap;
+
+	pthread_mutex_lock(&fglUploadMutex);
+	++obj->pendingUploads;
+	if (fglUploadTail)
+		fglUploadTail->next = job;
+	else
+		fglUploadHead = job;
+	fglUploadTail = job;
+	pthread_cond_signal(&fglUploadWork);
+	pthread_mutex_unlock(&fglUploadMutex);
+
+	return true;
+}
+
+#endif /* FIMG_ASYNC_TEXTURE_UPLOAD */
+
+/**
+ * Uploads texture image from client buffer to texture memory.
+ * @param obj Texture object.
+ * @param level Mipmap level.
+ * @param pixels Client buffer.
+ * @param alignment Line width alignment.
+ * @return True on success, false on allocation failure.
+ */
+static bool fglUploadTexture(FGLTexture *obj, unsigned level,
+			const GLvoid *pixels, unsigned alignment)
+{
+#ifdef FIMG_ASYNC_TEXTURE_UPLOAD
+	unsigned width = obj->width >> level;
+	if (!width)
+		width = 1;
+
+	unsigned height = obj->height >> level;
+	if (!height)
+		height = 1;
+
+	if (fglQueueTextureUpload(obj, level, pixels, alignment,
+						false, 0, 0, width, height))
+		return true;
+#endif
+	return fglWriteTexture(obj, level, pixels, alignment, obj->genMipmap);
+}
+
+/**
+ * Uploads part of texture image from client buffer to texture memory.
+ * @param obj Texture object.
+ * @param level Mipmap level.
+ * @param pixels Client buffer.
+ * @param alignment Line width alignment.
+ * @param x Left-most coordinate of the region.
+ * @param y Bottom-most coordinate of the region.
+ * @param w Width of the region.
+ * @param h Height of the region.
+ * @return True on success, false on allocation failure.
+ */
+static bool fglUploadTexturePartial(FGLTexture *obj, unsigned level,
+			const GLvoid *pixels, unsigned alignment,
+			unsigned x, unsigned y, unsigned w, unsigned h)
+{
+#ifdef FIMG_ASYNC_TEXTURE_UPLOAD
+	if (fglQueueTextureUpload(obj, level, pixels, alignment,
+							true, x, y, w, h))
+		return true;
+#endif
+	return fglWriteTexturePartial(obj, level, pixels, alignment,
+						x, y, w, h, obj->genMipmap);
+}
+
+GL_API void GL_APIENTRY glTexSubImage2D (GLenum target, GLint level,
+		GLint xoffset, GLint yoffset, GLsizei width, GLsizei height,
+		GLenum format, GLenum type, const GLvoid *pixels)
+{
+	if (target != GL_TEXTURE_2D) {
+		setError(GL_INVALID_ENUM);
+		return;
+	}
+
+	FGLContext *ctx = getContext();
+	FGLTexture *obj = ctx->texture[ctx->activeTexture].getTexture();
+
+	if (obj->eglImage) {
+		/* TODO: Copy eglImage contents into new texture */
+		setError(GL_INVALID_OPERATION);
+		return;
+	}
+
+	/* Compressed images can be specified only as a whole */
+	if (!obj->surface || obj->compressed) {
+		setError(GL_INVALID_OPERATION);
+		return;
+	}
+
+	if (level > obj->maxLevel) {
+		setError(GL_INVALID_VALUE);
+		return;
+	}
+
+	GLint mipmapW, mipmapH;
+
+	mipmapW = obj->width >> level;
+	if (!mipmapW)
+		mipmapW = 1;
+
+	mipmapH = obj->height >> level;
+	if (!mipmapH)
+		mipmapH = 1;
+
+	if (!xoffset && !yoffset && mipmapW == width && mipmapH == height) {
+		glTexImage2D(target, level, format, width, height,
+						0, format, type, pixels);
+		return;
+	}
+
+	if (format != obj->format || type != obj->type) {
+		setError(GL_INVALID_ENUM);
+		return;
+	}
+
+	if (xoffset < 0 || yoffset < 0) {
+		setError(GL_INVALID_VALUE);
+		return;
+	}
+
+	if (xoffset + width > mipmapW || yoffset + height > mipmapH) {
+		setError(GL_INVALID_VALUE);
+		return;
+	}
+
+	if (!pixels)
+		return;
+
+	if (!fglDecodeTexture(ctx, obj)) {
+		setError(GL_OUT_OF_MEMORY);
+		return;
+	}
+
+	fglOrphanTextureRegion(ctx, obj, level, xoffset, yoffset,
+							width, height);
+#ifdef FIMG_PERF_COUNTERS
+	fimgPerfTextureUpload(ctx->fimg,
+			fglTexelBytes(obj->pixFormat, width*height));
+#endif
+
+	if (!fglUploadTexturePartial(obj, level, pixels, ctx->unpackAlignment,
+					xoffset, yoffset, width, height)) {
+		setError(GL_OUT_OF_MEMORY);
+		return;
+	}
+
+	obj->dirty = true;
+}
+
+/**
+ * Specifies paletted texture image with given count of mipmap levels.
+ * @param ctx Rendering context.
+ * @param obj Texture object.
+ * @param levels Count of mipmap levels in the image.
+ * @param format Paletted texture format.
+ * @param width Texture width.
+ * @param height Texture height.
+ * @param imageSize Size of the image.
+ * @param data Palette followed by indices of all levels.
+ */
+static void fglPalettedTexImage2D(FGLContext *ctx, FGLTexture *obj,
+			unsigned levels, GLenum format, GLsizei width,
+			GLsizei height, GLsizei imageSize, const GLvoid *data)
+{
+	unsigned idx = format - GL_PALETTE4_RGB8_OES;
+	unsigned palFormat = idx % FGL_PALETTE_NUM_FORMATS;
+	unsigned bits = (idx < FGL_PALETTE_NUM_FORMATS) ? 4 : 8;
+	unsigned entries = 1 << bits;
+	size_t size = entries*fglPaletteEntrySize[palFormat];
+	unsigned check = max(width, height);
+	unsigned w = width;
+	unsigned h = height;
+
+	for (unsigned lvl = 0; lvl < levels; ++lvl) {
+		if (lvl && !(check >>= 1)) {
+			/* More levels than in complete mipmap chain */
+			setError(GL_INVALID_VALUE);
+			return;
+		}
+
+		size += (w*h*bits + 7)/8;
+
+		if (w >= 2)
+			w /= 2;
+		if (h >= 2)
+			h /= 2;
+	}
+
+	if ((size_t)imageSize != size) {
+		setError(GL_INVALID_VALUE);
+		return;
+	}
+
+	int pixFormat = (bits == 4) ? FGL_PIXFMT_4BPP : FGL_PIXFMT_8BPP;
+	if (!fglSpecifyTexture(ctx, obj, width, height, format,
+						0, pixFormat, false))
+		return;
+
+	obj->compressed = GL_TRUE;
+
+	if (data == NULL)
+		return;
+
+#ifdef FIMG_PERF_COUNTERS
+	fimgPerfTextureUpload(ctx->fimg, imageSize);
+#endif
+	const uint8_t *src8 = (const uint8_t *)data;
+	uint32_t palette[FGTU_MAX_PALETTE_SIZE];
+
+	for (unsigned i = 0; i < entries; ++i) {
+		palette[i] = fglConvertPaletteEntry(palFormat, src8);
+		src8 += fglPaletteEntrySize[palFormat];
+	}
+
+	if (fimgSetTexPalette(obj->fimg, fglPaletteHwFormat[palFormat],
+							palette, entries)) {
+		setError(GL_OUT_OF_MEMORY);
+		return;
+	}
+
+	for (unsigned lvl = 0; lvl < levels; ++lvl)
+		src8 += fglLoadTexturePaletted(obj, lvl, src8);
+
+	obj->dirty = true;
+}
+
+GL_API void GL_APIENTRY glCompressedTexImage2D (GLenum target, GLint level,
+		GLenum internalformat, GLsizei width, GLsizei height,
+		GLint border, GLsizei imageSize, const GLvoid *data)
+{
+	/* Check conditions required by specification */
+	if (target != GL_TEXTURE_2D) {
+		setError(GL_INVALID_ENUM);
+		return;
+	}
+
+	if (width < 0 || height < 0) {
+		setError(GL_INVALID_VALUE);
+		return;
+	}
+
+	if (border != 0) {
+		setError(GL_INVALID_VALUE);
+		return;
+	}
+
+	int pixFormat = fglGetCompressedFormatInfo(internalformat);
+	if (pixFormat < 0) {
+		setError(GL_INVALID_ENUM);
+		return;
+	}
+
+	FGLContext *ctx = getContext();
+	FGLTexture *obj = ctx->texture[ctx->activeTexture].getTexture();
+
+	if (pixFormat == FGL_PIXFMT_4BPP || pixFormat == FGL_PIXFMT_8BPP) {
+		/* Non-positive level gives count of levels in the image */
+		if (level > 0) {
+			setError(GL_INVALID_VALUE);
+			return;
+		}
+
+		fglPalettedTexImage2D(ctx, obj, 1 - level, internalformat,
+					width, height, imageSize, data);
+		return;
+	}
+
+	if (level < 0) {
+		setError(GL_INVALID_VALUE);
+		return;
+	}
+
+	if (imageSize != fglCompressedImageSize(width, height)) {
+		setError(GL_INVALID_VALUE);
+		return;
+	}
+
+
+	/* Mipmap image specification */
+	if (level > 0) {
+		if (obj->eglImage || !obj->surface) {
+			/* Mipmaps can be specified only if base level exists */
+			setError(GL_INVALID_OPERATION);
+			return;
+		}
+
+		if (level > obj->maxLevel) {
+			/* Level beyond mipmap chain of base level */
+			setError(GL_INVALID_VALUE);
+			return;
+		}
+
+		GLint mipmapW, mipmapH;
+
+		mipmapW = obj->width >> level;
+		if (!mipmapW)
+			mipmapW = 1;
+
+		mipmapH = obj->height >> level;
+		if (!mipmapH)
+			mipmapH = 1;
+
+		/* Check dimensions */
+		if (mipmapW != width || mipmapH != height) {
+			/* Invalid size */
+			setError(GL_INVALID_VALUE);
+			return;
+		}
+
+		/* Check format */
+		if (!obj->compressed || obj->format != internalformat) {
+			/* Must be the same format as base level */
+			setError(GL_INVALID_OPERATION);
+			return;
+		}
+
+		if (data != NULL) {
+			fglOrphanTextureLevel(ctx, obj, level);
+#ifdef FIMG_PERF_COUNTERS
+			fimgPerfTextureUpload(ctx->fimg, imageSize);
+#endif
+			fglLoadCompressedTexture(obj, level, data);
+
+			if (obj->genMipmap)
+				fglGenerateMipmaps(obj, level);
+
+			obj->dirty = true;
+		}
+
+		return;
+	}
+
+	/* Base image specification */
+	if (!fglSpecifyTexture(ctx, obj, width, height, internalformat,
+						0, pixFormat, false))
+		return;
+
+	obj->compressed = GL_TRUE;
+
+	if (data != NULL) {
+#ifdef FIMG_PERF_COUNTERS
+		fimgPerfTextureUpload(ctx->fimg, imageSize);
+#endif
+		fglLoadCompressedTexture(obj, 0, data);
+
+		if (obj->genMipmap)
+			fglGenerateMipmaps(obj, 0);
+
+		obj->dirty = true;
+	}
+}
+
+GL_API void GL_APIENTRY glCompressedTexSubImage2D (GLenum target, GLint level,
+		GLint xoffset, GLint yoffset, GLsizei width, GLsizei height,
+		GLenum format, GLsizei imageSize, const GLvoid *data)
+{
+	if (target != GL_TEXTURE_2D) {
+		setError(GL_INVALID_ENUM);
+		return;
+	}
+
+	int pixFormat = fglGetCompressedFormatInfo(format);
+	if (pixFormat < 0) {
+		setError(GL_INVALID_ENUM);
+		return;
+	}
+
+	FGLContext *ctx = getContext();
+	FGLTexture *obj = ctx->texture[ctx->activeTexture].getTexture();
+
+	/* ETC1 and paletted images can be specified only as a whole */
+	if (pixFormat != FGL_PIXFMT_S3TC || !obj->surface
+	    || !obj->compressed || format != obj->format) {
+		setError(GL_INVALID_OPERATION);
+		return;
+	}
+
+	if (level < 0 || level > obj->maxLevel) {
+		setError(GL_INVALID_VALUE);
+		return;
+	}
+
+	GLint mipmapW, mipmapH;
+
+	mipmapW = obj->width >> level;
+	if (!mipmapW)
+		mipmapW = 1;
+
+	mipmapH = obj->height >> level;
+	if (!mipmapH)
+		mipmapH = 1;
+
+	if (xoffset < 0 || yoffset < 0 || width < 0 || height < 0
+	    || xoffset + width > mipmapW || yoffset + height > mipmapH) {
+		setError(GL_INVALID_VALUE);
+		return;
+	}
+
+	/* Only whole blocks can be replaced */
+	if ((xoffset & 3) || (yoffset & 3)
+	    || ((width & 3) && xoffset + width != mipmapW)
+	    || ((height & 3) && yoffset + height != mipmapH)) {
+		setError(GL_INVALID_OPERATION);
+		return;
+	}
+
+	if (imageSize != fglCompressedImageSize(width, height)) {
+		setError(GL_INVALID_VALUE);
+		return;
+	}
+
+	if (!width || !height || data == NULL)
+		return;
+
+	fglOrphanTextureRegion(ctx, obj, level, xoffset, yoffset,
+							width, height);
+#ifdef FIMG_PERF_COUNTERS
+	fimgPerfTextureUpload(ctx->fimg, imageSize);
+#endif
+	fglLoadTextureS3TCPartial(obj, level, data,
+					xoffset, yoffset, width, height);
+
+	if (obj->genMipmap)
+		fglGenerateMipmaps(obj, level);
+
+	obj->dirty = true;
+}
+
+/*
+ * Copying framebuffer contents to textures
+ *
+ * Pixels are copied by the CPU directly from color surface of current
+ * framebuffer to texture memory, without going through any intermediate
+ * client buffer. Texture format is selected to match the framebuffer where
+ * possible, so lines can be copied as a whole, otherwise every pixel is
+ * converted using component layouts of both formats. Framebuffer lines
+ * are stored from top to bottom, so they are flipped on the way.
+ */
+
+/**
+ * Selects texture format for copying from framebuffer of given format,
+ * preferring the format of the framebuffer to allow direct copies.
+ * @param format Requested texture format.
+ * @param fbFormat Pixel format of the framebuffer.
+ * @param type Pointer to variable receiving texture pixel type.
+ * @param conv Pointer to variable receiving conversion flag.
+ * @return Pixel format of the texture or -1 if format is invalid.
+ */
+static int fglGetCopyFormatInfo(GLenum format, uint32_t fbFormat,
+						GLenum *type, bool *conv)
+{
+	switch (format) {
+	case GL_RGB:
+		if (fbFormat == FGL_PIXFMT_RGB565) {
+			*type = GL_UNSIGNED_SHORT_5_6_5;
+			return fglGetFormatInfo(format, *type, conv);
+		}
+		break;
+	case GL_RGBA:
+		switch (fbFormat) {
+		case FGL_PIXFMT_ARGB8888:
+			/* Updated with conversion, the same as RGB textures */
+			*type = GL_UNSIGNED_BYTE;
+			*conv = true;
+			return FGL_PIXFMT_ARGB8888;
+		case FGL_PIXFMT_ARGB4444:
+			*type = GL_UNSIGNED_SHORT_4_4_4_4;
+			return fglGetFormatInfo(format, *type, conv);
+		case FGL_PIXFMT_ARGB1555:
+			*type = GL_UNSIGNED_SHORT_5_5_5_1;
+			return fglGetFormatInfo(format, *type, conv);
+		}
+		break;
+	case GL_ALPHA:
+	case GL_LUMINANCE:
+	case GL_LUMINANCE_ALPHA:
+		break;
+	default:
+		return -1;
+	}
+
+	*type = GL_UNSIGNED_BYTE;
+	return fglGetFormatInfo(format, *type, conv);
+}
+
+/**
+ * Gets color component of a pixel expanded to 8 bits.
+ * @param val Pixel value.
+ * @param pix Pixel format of the value.
+ * @param comp Index of the component. (See ::FGLColorComponent)
+ * @return Component value, 255 if not present in the format.
+ */
+static inline uint32_t fglGetComponent(uint32_t val,
+				const FGLPixelFormat *pix, unsigned comp)
+{
+	int size = pix->comp[comp].size;
+	if (!size)
+		return 255;
+
+	uint32_t c = (val >> pix->comp[comp].pos) & ((1 << size) - 1);
+	if (size >= 8)
+		return c >> (size - 8);
+
+	/* Replicate the bits to cover whole range */
+	uint32_t ret = 0;
+	for (int shift = 8 - size; shift > -size; shift -= size)
+		ret |= (shift >= 0) ? c << shift : c >> -shift;
+
+	return ret;
+}
+
+/**
+ * Packs 8-bit color component into a pixel value.
+ * @param c Component value.
+ * @param pix Pixel format of the value.
+ * @param comp Index of the component. (See ::FGLColorComponent)
+ * @return Component shifted to its position in the pixel value.
+ */
+static inline uint32_t fglPutComponent(uint32_t c,
+				const FGLPixelFormat *pix, unsigned comp)
+{
+	unsigned size = pix->comp[comp].size;
+	if (!size)
+		return 0;
+
+	return (c >> (8 - size)) << pix->comp[comp].pos;
+}
+
+/**
+ * Copies region of framebuffer into a buffer of given pixel format.
+ * @param dst8 Destination buffer, pointing at the first pixel of the region.
+ * @param dstStride Line width of destination buffer in bytes.
+ * @param dstFormat Pixel format of destination buffer.
+ * @param format Texture format, defining used components.
+ * @param fb Framebuffer to copy from.
+ * @param x Left-most framebuffer coordinate of the region.
+ * @param y Bottom-most framebuffer coordinate of the region.
+ * @param w Width of the region.
+ * @param h Height of the region.
+ */
+static void fglCopyFramebuffer(uint8_t *dst8, size_t dstStride,
+			uint32_t dstFormat, GLenum format,
+			FGLAbstractFramebuffer *fb, unsigned x, unsigned y,
+			unsigned w, unsigned h)
+{
+	FGL_PROFILE_SCOPE("fglCopyFramebuffer");
+	uint32_t srcFormat = fb->getColorFormat();
+	const FGLPixelFormat *src = FGLPixelFormat::get(srcFormat);
+	const FGLPixelFormat *dst = FGLPixelFormat::get(dstFormat);
+	FGLSurface *draw = fb->get(FGL_ATTACHMENT_COLOR)->surface;
+
+	size_t srcStride = src->pixelSize*fb->getWidth();
+	const uint8_t *src8 = (const uint8_t *)draw->vaddr
+			+ (fb->getHeight() - y - 1)*srcStride + src->pixelSize*x;
+
+	/* Alpha of XRGB8888 textures is ignored by the hardware */
+	if (srcFormat == dstFormat || (dstFormat == FGL_PIXFMT_XRGB8888
+				&& srcFormat == FGL_PIXFMT_ARGB8888)) {
+		size_t line = w*dst->pixelSize;
+		do {
+			memcpy(dst8, src8, line);
+			src8 -= srcStride;
+			dst8 += dstStride;
+		} while (--h);
+		return;
+	}
+
+	bool opaque = format == GL_RGB || format == GL_LUMINANCE;
+	/* Alpha textures are stored with white luminance */
+	bool white = format == GL_ALPHA;
+
+	do {
+		const uint8_t *s8 = src8;
+		uint8_t *d8 = dst8;
+
+		for (unsigned i = 0; i < w; ++i) {
+			uint32_t val, c[4];
+
+			if (src->pixelSize == 4)
+				val = *(const uint32_t *)s8;
+			else
+				val = *(const uint16_t *)s8;
+
+			for (unsigned comp = 0; comp < 4; ++comp)
+				c[comp] = fglGetComponent(val, src, comp);
+
+			if (opaque)
+				c[FGL_COMP_ALPHA] = 255;
+			if (white)
+				c[FGL_COMP_RED] = c[FGL_COMP_GREEN]
+						= c[FGL_COMP_BLUE] = 255;
+
+			/* Luminance is taken from red component */
+			val = 0;
+			for (unsigned comp = 0; comp < 4; ++comp)
+				val |= fglPutComponent(c[comp], dst, comp);
+
+			if (dst->pixelSize == 4)
+				*(uint32_t *)d8 = val;
+			else
+				*(uint16_t *)d8 = val;
+
+			s8 += src->pixelSize;
+			d8 += dst->pixelSize;
+		}
+
+		src8 -= srcStride;
+		dst8 += dstStride;
+	} while (--h);
+}
+
+/**
+ * Copies region of framebuffer to texture memory.
+ * @param obj Texture object.
+ * @param level Mipmap level.
+ * @param fb Framebuffer to copy from.
+ * @param xoffset Left-most texture coordinate of the region.
+ * @param yoffset Bottom-most texture coordinate of the region.
+ * @param x Left-most framebuffer coordinate of the region.
+ * @param y Bottom-most framebuffer coordinate of the region.
+ * @param w Width of the region.
+ * @param h Height of the region.
+ */
+static void fglCopyFramebufferTexture(FGLTexture *obj, unsigned level,
+			FGLAbstractFramebuffer *fb, unsigned xoffset,
+			unsigned yoffset, unsigned x, unsigned y,
+			unsigned w, unsigned h)
+{
+	unsigned offset = fglTexelBytes(obj->pixFormat,
+				fimgGetTexMipmapOffset(obj->fimg, level));
+	uint8_t *level8 = (uint8_t *)obj->surface->vaddr + offset;
+
+	unsigned width = obj->width >> level;
+	if (!width)
+		width = 1;
+
+	unsigned height = obj->height >> level;
+	if (!height)
+		height = 1;
+
+	unsigned bpp = FGLPixelFormat::get(obj->pixFormat)->pixelSize;
+
+	fglCopyFramebuffer(level8 + bpp*(yoffset*width + xoffset),
+			bpp*width, obj->pixFormat, obj->format,
+			fb, x, y, w, h);
+}
+
+/**
+ * Gets current framebuffer for copying its contents to texture.
+ * @param ctx Rendering context.
+ * @param format Texture format to copy to.
+ * @return Framebuffer or NULL if it cannot be copied (with error set).
+ */
+static FGLAbstractFramebuffer *fglGetCopyFramebuffer(FGLContext *ctx,
+								GLenum format)
+{
+	FGLAbstractFramebuffer *fb = ctx->framebuffer.get();
+	if (!fb->isValid()) {
+		setError(GL_INVALID_FRAMEBUFFER_OPERATION_OES);
+		return 0;
+	}
+
+	FGLSurface *draw = fb->get(FGL_ATTACHMENT_COLOR)->surface;
+	if (!draw || !draw->vaddr) {
+		setError(GL_INVALID_OPERATION);
+		return 0;
+	}
+
+	/* Texture cannot use components missing in the framebuffer */
+	const FGLPixelFormat *pix = FGLPixelFormat::get(fb->getColorFormat());
+	if (!pix->comp[FGL_COMP_ALPHA].size && (format == GL_RGBA
+	    || format == GL_ALPHA || format == GL_LUMINANCE_ALPHA)) {
+		setError(GL_INVALID_OPERATION);
+		return 0;
+	}
+
+	return fb;
+}
+
+/**
+ * Copies region of framebuffer to texture image, clipped to framebuffer
+ * bounds. Texels outside of the framebuffer are left unchanged.
+ * @param ctx Rendering context.
+ * @param obj Texture object.
+ * @param level Mipmap level.
+ * @param fb Framebuffer to copy from.
+ * @param xoffset Left-most texture coordinate of the region.
+ * @param yoffset Bottom-most texture coordinate of the region.
+ * @param x Left-most framebuffer coordinate of the region.
+ * @param y Bottom-most framebuffer coordinate of the region.
+ * @param width Width of the region.
+ * @param height Height of the region.
+ */
+static void fglCopyTexImage(FGLContext *ctx, FGLTexture *obj, unsigned level,
+			FGLAbstractFramebuffer *fb, GLint xoffset,
+			GLint yoffset, GLint x, GLint y, GLsizei width,
+			GLsizei height)
+{
+	if (x < 0) {
+		xoffset -= x;
+		width += x;
+		x = 0;
+	}
+
+	if (y < 0) {
+		yoffset -= y;
+		height += y;
+		y = 0;
+	}
+
+	if (x + width > (GLint)fb->getWidth())
+		width = fb->getWidth() - x;
+
+	if (y + height > (GLint)fb->getHeight())
+		height = fb->getHeight() - y;
 
-	unsigned width = obj->width >> level;
-	if (!width)
-		width = 1;
+	if (width <= 0 || height <= 0)
+		// Nothing to copy
+		return;
 
-	unsigned height = obj->height >> level;
-	if (!height)
-		height = 1;
+#ifdef FIMG_ASYNC_TEXTURE_UPLOAD
+	fglWaitForTextureUpload(obj);
+#endif
+	glFinish();
+	fb->get(FGL_ATTACHMENT_COLOR)->surface->flush();
 
-	switch (obj->format) {
-	case GL_RGB: {
-		size_t line = 3*w;
-		size_t srcStride = (line + alignment - 1) & ~(alignment - 1);
-		size_t dstStride = 4*width;
-		size_t xOffset = 4*x;
-		size_t yOffset = y*dstStride;
-		size_t srcPad = srcStride - line;
-		size_t dstPad = width - w;
-		const uint8_t *src8 = (const uint8_t *)pixels;
-		uint32_t *dst32 = (uint32_t *)((uint8_t *)obj->surface->vaddr
-						+ offset + yOffset + xOffset);
-		do {
-			unsigned x = w;
-			do {
-				*(dst32++) = fglPackARGB8888(src8[0],
-						src8[1], src8[2], 255);
-				src8 += 3;
-			} while (--x);
-			src8 += srcPad;
-			dst32 += dstPad;
-		} while (--h);
-		break;
+	/* Framebuffer contents cannot be encoded without loss */
+	if (!fglDecodeTexture(ctx, obj)) {
+		setError(GL_OUT_OF_MEMORY);
+		return;
 	}
-	case GL_RGBA: {
-		size_t line = 4*w;
-		size_t srcStride = (line + alignment - 1) & ~(alignment - 1);
-		size_t dstStride = 4*width;
-		size_t xOffset = 4*x;
-		size_t yOffset = y*dstStride;
-		size_t srcPad = srcStride - line;
-		size_t dstPad = width - w;
-		const uint8_t *src8 = (const uint8_t *)pixels;
-		uint32_t *dst32 = (uint32_t *)((uint8_t *)obj->surface->vaddr
-						+ offset + yOffset + xOffset);
-		do {
-			unsigned x = w;
-			do {
-				*(dst32++) = fglPackARGB8888(src8[0],
-						src8[1], src8[2], src8[3]);
-				src8 += 4;
-			} while (--x);
-			src8 += srcPad;
-			dst32 += dstPad;
-		} while (--h);
-		break;
+
+#ifdef FIMG_PERF_COUNTERS
+	fimgPerfTextureUpload(ctx->fimg,
+			fglTexelBytes(obj->pixFormat, width*height));
+#endif
+	fglCopyFramebufferTexture(obj, level, fb, xoffset, yoffset,
+						x, y, width, height);
+
+	if (obj->genMipmap)
+		fglGenerateMipmaps(obj, level);
+
+	obj->dirty = true;
+}
+
+GL_API void GL_APIENTRY glCopyTexImage2D (GLenum target, GLint level,
+		GLenum internalformat, GLint x, GLint y, GLsizei width,
+		GLsizei height, GLint border)
+{
+	if (target != GL_TEXTURE_2D) {
+		setError(GL_INVALID_ENUM);
+		return;
 	}
-	case GL_LUMINANCE: {
-		size_t line = w;
-		size_t srcStride = (line + alignment - 1) & ~(alignment - 1);
-		size_t dstStride = 2*width;
-		size_t xOffset = 2*x;
-		size_t yOffset = y*dstStride;
-		size_t srcPad = srcStride - line;
-		size_t dstPad = width - w;
-		const uint8_t *src8 = (const uint8_t *)pixels;
-		uint16_t *dst16 = (uint16_t *)((uint8_t *)obj->surface->vaddr
-						+ offset + yOffset + xOffset);
-		do {
-			unsigned x = w;
-			do {
-				*(dst16++) = fglPackAL88(*(src8++), 255);
-			} while (--x);
-			src8 += srcPad;
-			dst16 += dstPad;
-		} while (--h);
-		break;
+
+	if (level < 0 || border != 0 || width < 0 || height < 0) {
+		setError(GL_INVALID_VALUE);
+		return;
 	}
-	case GL_ALPHA: {
-		size_t line = w;
-		size_t srcStride = (line + alignment - 1) & ~(alignment - 1);
-		size_t dstStride = 2*width;
-		size_t xOffset = 2*x;
-		size_t yOffset = y*dstStride;
-		size_t srcPad = srcStride - line;
-		size_t dstPad = width - w;
-		const uint8_t *src8 = (const uint8_t *)pixels;
-		uint16_t *dst16 = (uint16_t *)((uint8_t *)obj->surface->vaddr
-						+ offset + yOffset + xOffset);
-		do {
-			unsigned x = w;
-			do {
-				*(dst16++) = fglPackAL88(0xff, *(src8++));
-			} while (--x);
-			src8 += srcPad;
-			dst16 += dstPad;
-		} while (--h);
-		break;
+
+	FGLContext *ctx = getContext();
+	FGLTexture *obj = ctx->texture[ctx->activeTexture].getTexture();
+
+	FGLAbstractFramebuffer *fb = fglGetCopyFramebuffer(ctx, internalformat);
+	if (!fb)
+		return;
+
+	/* Texture memory might be reallocated while being copied from */
+	if (obj->surface
+	    && fb->get(FGL_ATTACHMENT_COLOR)->surface == obj->surface) {
+		setError(GL_INVALID_OPERATION);
+		return;
 	}
-	default:
-		LOGW("Unsupported texture conversion %d", obj->format);
+
+	/* Mipmap image specification */
+	if (level > 0) {
+		if (obj->eglImage || !obj->surface || obj->compressed) {
+			/* Mipmaps can be specified only if base level exists */
+			setError(GL_INVALID_OPERATION);
+			return;
+		}
+
+		if (level > obj->maxLevel) {
+			/* Level beyond mipmap chain of base level */
+			setError(GL_INVALID_VALUE);
+			return;
+		}
+
+		GLint mipmapW, mipmapH;
+
+		mipmapW = obj->width >> level;
+		if (!mipmapW)
+			mipmapW = 1;
+
+		mipmapH = obj->height >> level;
+		if (!mipmapH)
+			mipmapH = 1;
+
+		/* Check dimensions */
+		if (mipmapW != width || mipmapH != height) {
+			/* Invalid size */
+			setError(GL_INVALID_VALUE);
+			return;
+		}
+
+		/* Check format */
+		if (obj->format != internalformat) {
+			/* Must be the same format as base level */
+			setError(GL_INVALID_ENUM);
+			return;
+		}
+
+		fglCopyTexImage(ctx, obj, level, fb, 0, 0, x, y, width, height);
+		return;
+	}
+
+	/* Base image specification */
+	GLenum type;
+	bool convert;
+	int pixFormat = fglGetCopyFormatInfo(internalformat,
+					fb->getColorFormat(), &type, &convert);
+	if (pixFormat < 0) {
+		setError(GL_INVALID_VALUE);
 		return;
 	}
+
+	if (!fglSpecifyTexture(ctx, obj, width, height,
+				internalformat, type, pixFormat, convert))
+		return;
+
+	fglCopyTexImage(ctx, obj, 0, fb, 0, 0, x, y, width, height);
 }
 
-GL_API void GL_APIENTRY glTexSubImage2D (GLenum target, GLint level,
-		GLint xoffset, GLint yoffset, GLsizei width, GLsizei height,
-		GLenum format, GLenum type, const GLvoid *pixels)
+GL_API void GL_APIENTRY glCopyTexSubImage2D (GLenum target, GLint level,
+		GLint xoffset, GLint yoffset, GLint x, GLint y, GLsizei width,
+		GLsizei height)
 {
 	if (target != GL_TEXTURE_2D) {
 		setError(GL_INVALID_ENUM);
@@ -1186,18 +3692,19 @@ GL_API void GL_APIENTRY glTexSubImage2D (GLenum target, GLint level,
 	FGLContext *ctx = getContext();
 	FGLTexture *obj = ctx->texture[ctx->activeTexture].getTexture();
 
+	/* EGLImage contents are not copied into a private texture */
 	if (obj->eglImage) {
-		/* TODO: Copy eglImage contents into new texture */
 		setError(GL_INVALID_OPERATION);
 		return;
 	}
 
-	if (!obj->surface) {
+	/* Compressed images can be specified only as a whole */
+	if (!obj->surface || obj->compressed) {
 		setError(GL_INVALID_OPERATION);
 		return;
 	}
 
-	if (level > obj->maxLevel) {
+	if (level < 0 || level > obj->maxLevel) {
 		setError(GL_INVALID_VALUE);
 		return;
 	}
@@ -1212,71 +3719,18 @@ GL_API void GL_APIENTRY glTexSubImage2D (GLenum target, GLint level,
 	if (!mipmapH)
 		mipmapH = 1;
 
-	if (!xoffset && !yoffset && mipmapW == width && mipmapH == height) {
-		glTexImage2D(target, level, format, width, height,
-						0, format, type, pixels);
-		return;
-	}
-
-	if (format != obj->format || type != obj->type) {
-		setError(GL_INVALID_ENUM);
-		return;
-	}
-
-	if (xoffset < 0 || yoffset < 0) {
-		setError(GL_INVALID_VALUE);
-		return;
-	}
-
-	if (xoffset + width > mipmapW || yoffset + height > mipmapH) {
+	if (xoffset < 0 || yoffset < 0 || width < 0 || height < 0
+	    || xoffset + width > mipmapW || yoffset + height > mipmapH) {
 		setError(GL_INVALID_VALUE);
 		return;
 	}
 
-	if (!pixels)
+	FGLAbstractFramebuffer *fb = fglGetCopyFramebuffer(ctx, obj->format);
+	if (!fb)
 		return;
 
-	fglWaitForTexture(ctx, obj);
-
-	if (obj->convert)
-		fglConvertTexturePartial(obj, level, pixels,
-			ctx->unpackAlignment, xoffset, yoffset, width, height);
-	else
-		fglLoadTexturePartial(obj, level, pixels,
-			ctx->unpackAlignment, xoffset, yoffset, width, height);
-
-	if (obj->genMipmap)
-		fglGenerateMipmaps(obj, level);
-
-	obj->dirty = true;
-}
-
-GL_API void GL_APIENTRY glCompressedTexImage2D (GLenum target, GLint level,
-		GLenum internalformat, GLsizei width, GLsizei height,
-		GLint border, GLsizei imageSize, const GLvoid *data)
-{
-	FUNC_UNIMPLEMENTED;
-}
-
-GL_API void GL_APIENTRY glCompressedTexSubImage2D (GLenum target, GLint level,
-		GLint xoffset, GLint yoffset, GLsizei width, GLsizei height,
-		GLenum format, GLsizei imageSize, const GLvoid *data)
-{
-	FUNC_UNIMPLEMENTED;
-}
-
-GL_API void GL_APIENTRY glCopyTexImage2D (GLenum target, GLint level,
-		GLenum internalformat, GLint x, GLint y, GLsizei width,
-		GLsizei height, GLint border)
-{
-	FUNC_UNIMPLEMENTED;
-}
-
-GL_API void GL_APIENTRY glCopyTexSubImage2D (GLenum target, GLint level,
-		GLint xoffset, GLint yoffset, GLint x, GLint y, GLsizei width,
-		GLsizei height)
-{
-	FUNC_UNIMPLEMENTED;
+	fglCopyTexImage(ctx, obj, level, fb, xoffset, yoffset,
+						x, y, width, height);
 }
 
 GL_API void GL_APIENTRY glEGLImageTargetTexture2DOES (GLenum target,
@@ -1305,6 +3759,9 @@ GL_API void GL_APIENTRY glEGLImageTargetTexture2DOES (GLenum target,
 
 	const FGLPixelFormat *cfg = FGLPixelFormat::get(image->pixelFormat);
 
+	/* Previous memory might still be accessed by the hardware */
+	fglOrphanTexture(ctx, tex);
+
 	if (tex->eglImage)
 		tex->eglImage->disconnect();
 	else
@@ -1327,6 +3784,7 @@ GL_API void GL_APIENTRY glEGLImageTargetTexture2DOES (GLenum target,
 			cfg->flags, cfg->texFormat, tex->surface->paddr);
 	fimgSetTex2DSize(tex->fimg, image->width, image->height, tex->maxLevel);
 	fimgSetTexMipmap(tex->fimg, FGTU_TSTA_MIPMAP_DISABLED);
+	tex->cachedUnits = BIT_MASK(FGL_MAX_TEXTURE_UNITS);
 	if (target == GL_TEXTURE_EXTERNAL_OES)
 		fimgSetTexMinFilter(tex->fimg, FGTU_TSTA_FILTER_LINEAR);
 
@@ -1560,6 +4018,17 @@ GL_API void GL_APIENTRY glTexParameterxv (GLenum target, GLenum pname,
 
 GL_API void GL_APIENTRY glTexEnvi (GLenum target, GLenum pname, GLint param)
 {
+	if (target == GL_POINT_SPRITE_OES) {
+		if (pname != GL_COORD_REPLACE_OES) {
+			setError(GL_INVALID_ENUM);
+			return;
+		}
+
+		FGLContext *ctx = getContext();
+		ctx->texture[ctx->activeTexture].coordReplace = !!param;
+		return;
+	}
+
 	if (target != GL_TEXTURE_ENV) {
 		setError(GL_INVALID_ENUM);
 		return;
@@ -1941,6 +4410,11 @@ GL_API void GL_APIENTRY glTexEnvi (GLenum target, GLenum pname, GLint param)
 GL_API void GL_APIENTRY glTexEnvfv (GLenum target, GLenum pname,
 							const GLfloat *params)
 {
+	if (target == GL_POINT_SPRITE_OES) {
+		glTexEnvi(target, pname, (GLint)params[0]);
+		return;
+	}
+
 	if (target != GL_TEXTURE_ENV) {
 		setError(GL_INVALID_ENUM);
 		return;
@@ -1961,6 +4435,11 @@ GL_API void GL_APIENTRY glTexEnvfv (GLenum target, GLenum pname,
 
 GL_API void GL_APIENTRY glTexEnvf (GLenum target, GLenum pname, GLfloat param)
 {
+	if (target == GL_POINT_SPRITE_OES) {
+		glTexEnvi(target, pname, (GLint)param);
+		return;
+	}
+
 	if (target != GL_TEXTURE_ENV) {
 		setError(GL_INVALID_ENUM);
 		return;
@@ -1993,6 +4472,11 @@ GL_API void GL_APIENTRY glTexEnvf (GLenum target, GLenum pname, GLfloat param)
 
 GL_API void GL_APIENTRY glTexEnvx (GLenum target, GLenum pname, GLfixed param)
 {
+	if (target == GL_POINT_SPRITE_OES) {
+		glTexEnvi(target, pname, param);
+		return;
+	}
+
 	if (target != GL_TEXTURE_ENV) {
 		setError(GL_INVALID_ENUM);
 		return;
@@ -2026,6 +4510,11 @@ GL_API void GL_APIENTRY glTexEnvx (GLenum target, GLenum pname, GLfixed param)
 GL_API void GL_APIENTRY glTexEnviv (GLenum target, GLenum pname,
 							const GLint *params)
 {
+	if (target == GL_POINT_SPRITE_OES) {
+		glTexEnvi(target, pname, params[0]);
+		return;
+	}
+
 	if (target != GL_TEXTURE_ENV) {
 		setError(GL_INVALID_ENUM);
 		return;
@@ -2048,6 +4537,11 @@ GL_API void GL_APIENTRY glTexEnviv (GLenum target, GLenum pname,
 GL_API void GL_APIENTRY glTexEnvxv (GLenum target, GLenum pname,
 							const GLfixed *params)
 {
+	if (target == GL_POINT_SPRITE_OES) {
+		glTexEnvi(target, pname, params[0]);
+		return;
+	}
+
 	if (target != GL_TEXTURE_ENV) {
 		setError(GL_INVALID_ENUM);
 		return;
@@ -10,15 +10,57 @@ LOCAL_CFLAGS += -DLOG_TAG=\"libfimg\"
 LOCAL_CFLAGS += -DFGL_PLATFORM_ANDROID
 
 LOCAL_SRC_FILES := \
+	backend.c \
 	compat.c \
 	fragment.c \
 	global.c \
 	host.c \
+	lease.c \
 	primitive.c \
+	profile.c \
 	raster.c \
+	sim.c \
+	stream.c \
 	system.c \
 	texture.c \
+	trace.c \
 	dump.c
 
 LOCAL_MODULE := libfimg
 include $(BUILD_STATIC_LIBRARY)
+
+include $(CLEAR_VARS)
+
+LOCAL_MODULE_TAGS := optional
+
+LOCAL_ARM_MODE := arm
+LOCAL_CFLAGS += -Wall -Wno-unused-parameter -O2 -mcpu=arm1176jzf-s -mfloat-abi=softfp -mfpu=vfp
+LOCAL_CFLAGS += -DLOG_TAG=\"fimgreplay\"
+LOCAL_CFLAGS += -DFGL_PLATFORM_ANDROID
+
+LOCAL_SRC_FILES := \
+	fimgreplay.c
+
+LOCAL_STATIC_LIBRARIES := libfimg
+LOCAL_SHARED_LIBRARIES := libcutils
+
+LOCAL_MODULE := fimgreplay
+include $(BUILD_EXECUTABLE)
+
+include $(CLEAR_VARS)
+
+LOCAL_MODULE_TAGS := optional
+
+LOCAL_ARM_MODE := arm
+LOCAL_CFLAGS += -Wall -Wno-unused-parameter -O2 -mcpu=arm1176jzf-s -mfloat-abi=softfp -mfpu=vfp
+LOCAL_CFLAGS += -DLOG_TAG=\"fimgcheck\"
+LOCAL_CFLAGS += -DFGL_PLATFORM_ANDROID
+
+LOCAL_SRC_FILES := \
+	fimgcheck.c
+
+LOCAL_STATIC_LIBRARIES := libfimg
+LOCAL_SHARED_LIBRARIES := libcutils
+
+LOCAL_MODULE := fimgcheck
+include $(BUILD_EXECUTABLE)
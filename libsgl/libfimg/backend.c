@@ -0,0 +1,352 @@
+/*
+ * fimg/backend.c
+ *
+ * SAMSUNG S3C6410 FIMG-3DSE SOFTWARE DEVICE BACKENDS
+ *
+ * Copyrights:	2010 by Tomasz Figa < tomasz.figa at gmail.com >
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifdef HAVE_CONFIG_H
+# include <config.h>
+#endif
+
+#include "fimg_private.h"
+
+#ifdef FIMG_IO_BACKEND
+
+#include <string.h>
+
+/*
+ * Software backends let the driver run without G3D device, e.g. on a Linux
+ * host, to measure CPU overhead of the driver. Writes go to a memory buffer
+ * mirroring the register space, so burst writes can be done in place, while
+ * all reads return zero, which means idle pipeline, finished cache operations
+ * and empty shader input buffers.
+ */
+
+/* Address range of vertex buffer port */
+#define FGHI_VB_ENTRY		(0xe000)
+#define FGHI_VB_END		(0x10000)
+
+/* Default capacity of write log (in records) */
+#define FIMG_RECORD_LIMIT	(1 << 20)
+
+typedef struct {
+	/* Pending burst write */
+	uint32_t burstAddr;
+	uint32_t burstWords;
+	/* Write log */
+	fimgIoRecord *log;
+	unsigned int logCount;
+	unsigned int logSize;
+	fimgIoStats stats;
+} fimgRecorder;
+
+/* Context which claimed virtual hardware last */
+static fimgContext *fimgVirtualOwner;
+
+/**
+ * Claims virtual hardware of software backends for a context. Like the kernel
+ * lock, reports that context restore is needed when the hardware was used by
+ * another context since the last claim, which includes the first claim.
+ * @param ctx Hardware context.
+ * @return 1 if context restore is needed, 0 otherwise.
+ */
+int fimgClaimVirtualHardware(fimgContext *ctx)
+{
+	return __sync_lock_test_and_set(&fimgVirtualOwner, ctx) != ctx;
+}
+
+/**
+ * Forgets a destroyed context as last user of virtual hardware, so a context
+ * created later at the same address still gets its state restored.
+ * @param ctx Hardware context.
+ */
+void fimgReleaseVirtualHardware(fimgContext *ctx)
+{
+	__sync_bool_compare_and_swap(&fimgVirtualOwner, ctx, NULL);
+}
+
+/*
+ * Null backend
+ */
+
+static int nullOpen(fimgContext *ctx)
+{
+	ctx->fd = -1;
+	ctx->base = calloc(1, FIMG_SFR_SIZE);
+	if (!ctx->base)
+		return -ENOMEM;
+
+	ctx->backendData = calloc(1, sizeof(fimgRecorder));
+	if (!ctx->backendData) {
+		free((void *)ctx->base);
+		return -ENOMEM;
+	}
+
+	return 0;
+}
+
+static void nullClose(fimgContext *ctx)
+{
+	fimgReleaseVirtualHardware(ctx);
+	free(ctx->backendData);
+	free((void *)ctx->base);
+}
+
+static int nullLock(fimgContext *ctx)
+{
+	return fimgClaimVirtualHardware(ctx);
+}
+
+static int nullUnlock(fimgContext *ctx)
+{
+	return 0;
+}
+
+static int nullFlush(fimgContext *ctx, uint32_t target)
+{
+	return 0;
+}
+
+static void nullWrite(fimgContext *ctx, uint32_t data, uint32_t addr)
+{
+	*(volatile uint32_t *)(ctx->base + addr) = data;
+}
+
+static uint32_t nullRead(fimgContext *ctx, uint32_t addr)
+{
+	return 0;
+}
+
+static volatile uint32_t *nullBurstBegin(fimgContext *ctx,
+					uint32_t addr, uint32_t words)
+{
+	return (volatile uint32_t *)(ctx->base + addr);
+}
+
+static void nullBurstEnd(fimgContext *ctx)
+{
+}
+
+const fimgBackend fimgNullBackend = {
+	.name		= "null",
+	.open		= nullOpen,
+	.close		= nullClose,
+	.lock		= nullLock,
+	.unlock		= nullUnlock,
+	.flush		= nullFlush,
+	.write		= nullWrite,
+	.read		= nullRead,
+	.burstBegin	= nullBurstBegin,
+	.burstEnd	= nullBurstEnd,
+};
+
+/*
+ * Recording backend
+ */
+
+static int recordOpen(fimgContext *ctx)
+{
+	fimgRecorder *rec;
+	const char *limit;
+	int ret;
+
+	if ((ret = nullOpen(ctx)) != 0)
+		return ret;
+
+	rec = ctx->backendData;
+	rec->logSize = FIMG_RECORD_LIMIT;
+
+	limit = getenv("FIMG_RECORD_LIMIT");
+	if (limit)
+		rec->logSize = strtoul(limit, NULL, 0);
+
+	rec->log = malloc(rec->logSize * sizeof(*rec->log));
+	if (!rec->log) {
+		nullClose(ctx);
+		return -ENOMEM;
+	}
+
+	return 0;
+}
+
+static void recordClose(fimgContext *ctx)
+{
+	fimgRecorder *rec = ctx->backendData;
+
+	free(rec->log);
+	nullClose(ctx);
+}
+
+/**
+ * Appends register write to the log.
+ * @param rec Recorder state.
+ * @param data Register value.
+ * @param addr Register address.
+ */
+static inline void recordWord(fimgRecorder *rec, uint32_t data, uint32_t addr)
+{
+	++rec->stats.writes;
+	if (addr >= FGHI_VB_ENTRY && addr < FGHI_VB_END)
+		++rec->stats.vertexWords;
+
+	if (rec->logCount == rec->logSize) {
+		++rec->stats.dropped;
+		return;
+	}
+
+	rec->log[rec->logCount].addr = addr;
+	rec->log[rec->logCount].data = data;
+	++rec->logCount;
+}
+
+static int recordLock(fimgContext *ctx)
+{
+	fimgRecorder *rec = ctx->backendData;
+
+	++rec->stats.locks;
+	return nullLock(ctx);
+}
+
+static int recordUnlock(fimgContext *ctx)
+{
+	fimgRecorder *rec = ctx->backendData;
+
+	++rec->stats.unlocks;
+	return 0;
+}
+
+static int recordFlush(fimgContext *ctx, uint32_t target)
+{
+	fimgRecorder *rec = ctx->backendData;
+
+	++rec->stats.flushes;
+	return 0;
+}
+
+static void recordWrite(fimgContext *ctx, uint32_t data, uint32_t addr)
+{
+	nullWrite(ctx, data, addr);
+	recordWord(ctx->backendData, data, addr);
+}
+
+static uint32_t recordRead(fimgContext *ctx, uint32_t addr)
+{
+	fimgRecorder *rec = ctx->backendData;
+
+	++rec->stats.reads;
+	return 0;
+}
+
+static volatile uint32_t *recordBurstBegin(fimgContext *ctx,
+					uint32_t addr, uint32_t words)
+{
+	fimgRecorder *rec = ctx->backendData;
+
+	rec->burstAddr = addr;
+	rec->burstWords = words;
+
+	return (volatile uint32_t *)(ctx->base + addr);
+}
+
+/**
+ * Logs words written by burst write, reading them back from register
+ * space mirror.
+ * @param ctx Hardware context.
+ */
+static void recordBurstEnd(fimgContext *ctx)
+{
+	fimgRecorder *rec = ctx->backendData;
+	const volatile uint32_t *data =
+		(const volatile uint32_t *)(ctx->base + rec->burstAddr);
+	uint32_t addr = rec->burstAddr;
+	uint32_t i;
+
+	for (i = 0; i < rec->burstWords; ++i, addr += 4)
+		recordWord(rec, data[i], addr);
+
+	rec->burstWords = 0;
+}
+
+const fimgBackend fimgRecordBackend = {
+	.name		= "record",
+	.open		= recordOpen,
+	.close		= recordClose,
+	.lock		= recordLock,
+	.unlock		= recordUnlock,
+	.flush		= recordFlush,
+	.write		= recordWrite,
+	.read		= recordRead,
+	.burstBegin	= recordBurstBegin,
+	.burstEnd	= recordBurstEnd,
+};
+
+/*
+ * Recording interface
+ */
+
+/**
+ * Gets I/O statistics collected since last reset.
+ * @param ctx Hardware context.
+ * @param stats Structure to store statistics in.
+ * @return 0 on success, negative if the context does not use recording backend.
+ */
+int fimgGetIoStats(fimgContext *ctx, fimgIoStats *stats)
+{
+	fimgRecorder *rec = ctx->backendData;
+
+	if (ctx->backend != &fimgRecordBackend)
+		return -1;
+
+	*stats = rec->stats;
+	return 0;
+}
+
+/**
+ * Gets log of register writes recorded since last reset.
+ * @param ctx Hardware context.
+ * @param count Pointer to store record count in.
+ * @return Pointer to the first record or NULL if the context does not use
+ * recording backend.
+ */
+const fimgIoRecord *fimgGetIoLog(fimgContext *ctx, unsigned int *count)
+{
+	fimgRecorder *rec = ctx->backendData;
+
+	if (ctx->backend != &fimgRecordBackend)
+		return NULL;
+
+	*count = rec->logCount;
+	return rec->log;
+}
+
+/**
+ * Clears write log and I/O statistics, e.g. at the beginning of a frame.
+ * @param ctx Hardware context.
+ */
+void fimgResetIoLog(fimgContext *ctx)
+{
+	fimgRecorder *rec = ctx->backendData;
+
+	if (ctx->backend != &fimgRecordBackend)
+		return;
+
+	rec->logCount = 0;
+	memset(&rec->stats, 0, sizeof(rec->stats));
+}
+
+#endif /* FIMG_IO_BACKEND */
@@ -25,6 +25,8 @@
 
 #include <string.h>
 #include <stdio.h>
+#include <math.h>
+#include <float.h>
 #include "fimg_private.h"
 #include "shaders/vert.h"
 #include "shaders/frag.h"
@@ -56,6 +58,19 @@
 
 #define FGFP_TEXENV(unit)	(4 + 2*(unit))
 #define FGFP_COMBSCALE(unit)	(5 + 2*(unit))
+#define FGFP_FOGCOLOR		(8)
+
+#define FGFP_FOGPARAMS		(20)
+#define FGFP_CLIPPLANE(plane)	(21 + (plane))
+#define FGFP_POINTATTEN		(25)
+
+/* Vertex shader state bits requiring eye-space vertex position */
+#define FGFP_VS_EYEPOS_MASK	(FGFP_VS_FOG_MODE_MASK | \
+		(((1 << FIMG_NUM_CLIP_PLANES) - 1) << FGFP_VS_CLIP_EN_SHIFT(0)) | \
+		(FGFP_POINT_SIZE_ATTENUATED << FGFP_VS_POINT_SIZE_SHIFT))
+
+#define FOG_LOG2E		(1.442695041f)
+#define FOG_SQRT_LOG2E		(1.201122409f)
 
 #define MAX_INSTR		(64)
 
@@ -103,28 +118,6 @@ struct shaderBlock {
 
 #define SHADER_BLOCK(blk)	{ blk, sizeof(blk) / 16 }
 
-enum fimgSrcRegType {
-	REG_SRC_V = 0,
-	REG_SRC_R,
-	REG_SRC_C,
-	REG_SRC_I,
-	REG_SRC_AL,
-	REG_SRC_B,
-	REG_SRC_P,
-	REG_SRC_S,
-	REG_SRC_D,
-	REG_SRC_VFACE,
-	REG_SRC_VPOS
-};
-
-enum fimgDstRegType {
-	REG_DST_O = 0,
-	REG_DST_R,
-	REG_DST_P,
-	REG_DST_A0,
-	REG_DST_AL
-};
-
 struct registerMap {
 	union {
 		struct {
@@ -143,127 +136,11 @@ struct registerMap {
 
 #define SWIZZLE(a, b, c, d)	((a) | ((b) << 2) | ((c) << 4) | ((d) << 6))
 
-typedef struct __attribute__ ((__packed__)) _fimgShaderInstruction {
-	struct {
-		unsigned src2_regnum	:5;
-		unsigned		:3;
-		unsigned src2_regtype	:3;
-		unsigned src2_ar	:1;
-		unsigned		:2;
-		unsigned src2_modifier	:2;
-		unsigned src2_swizzle	:8;
-		unsigned src1_regnum	:5;
-		unsigned src1_pch	:2;
-		unsigned src1_pa	:1;
-	};
-	struct {
-		unsigned src1_regtype	:3;
-		unsigned src1_ar	:1;
-		unsigned src1_pn	:1;
-		unsigned src1_p		:1;
-		unsigned src1_modifier	:2;
-		unsigned src1_swizzle	:8;
-		unsigned src0_regnum	:5;
-		unsigned src0_extnum	:3;
-		unsigned src0_regtype	:3;
-		unsigned src0_ar	:3;
-		unsigned src0_modifier	:2;
-	};
-	union {
-		struct {
-			unsigned src0_swizzle	:8;
-			unsigned dest_regnum	:5;
-			unsigned dest_regtype	:3;
-			unsigned dest_a		:1;
-			unsigned dest_modifier	:2;
-			unsigned dest_mask	:4;
-			unsigned opcode		:6;
-			unsigned next_3src	:1;
-			unsigned		:2;
-		};
-		struct {
-			unsigned 		:8;
-			unsigned branch_offs	:8;
-			unsigned branch_dir	:1;
-			unsigned		:15;
-		};
-	};
-	struct {
-		uint32_t reserved;
-	};
-} fimgShaderInstruction;
-
-typedef struct opcodeInfo {
-	uint8_t type;
-	uint8_t srcCount;
-} fimgOpcodeInfo;
-
-enum fimgOpcode {
-	OP_NOP = 0,
-	OP_MOV,
-	OP_MOVA,
-	OP_MOVC,
-	OP_ADD,
-	OP_MUL,
-	OP_MUL_LIT,
-	OP_DP3,
-	OP_DP4,
-	OP_DPH,
-	OP_DST,
-	OP_EXP,
-	OP_EXP_LIT,
-	OP_LOG,
-	OP_LOG_LIT,
-	OP_RCP,
-	OP_RSQ,
-	OP_DP2ADD,
-	OP_RSVD_13,
-	OP_MAX,
-	OP_MIN,
-	OP_SGE,
-	OP_SLT,
-	OP_SETP_EQ,
-	OP_SETP_GE,
-	OP_SETP_GT,
-	OP_SETP_NE,
-	OP_CMP,
-	OP_MAD,
-	OP_FRC,
-	OP_RSVD_1F,
-	OP_TEXLD,
-	OP_CUBEDIR,
-	OP_MAXCOMP,
-	OP_TEXLDC,
-	OP_RSVD_24,
-	OP_RSVD_25,
-	OP_RSVD_26,
-	OP_TEXKILL,
-	OP_MOVIPS,
-	OP_ADDI,
-	OP_B,
-	OP_BF,
-	OP_RSVD_32,
-	OP_RSVD_33,
-	OP_BP,
-	OP_BFP,
-	OP_BZP,
-	OP_RSVD_37,
-	OP_CALL,
-	OP_CALLNZ,
-	OP_RSVD_3A,
-	OP_RSVD_3B,
-	OP_RET
-};
-
-enum fimgOpcodeType {
-	OP_TYPE_RESERVED = 0,
-	OP_TYPE_FLOW,
-	OP_TYPE_NORMAL,
-	OP_TYPE_MOVE
-};
 
 static const struct shaderBlock vertexConstFloat = SHADER_BLOCK(vert_cfloat);
 static const struct shaderBlock vertexHeader = SHADER_BLOCK(vert_header);
+static const struct shaderBlock vertexHeaderScreen =
+					SHADER_BLOCK(vert_header_screen);
 static const struct shaderBlock vertexFooter = SHADER_BLOCK(vert_footer);
 
 static const struct shaderBlock texcoordTransform[] = {
@@ -271,10 +148,44 @@ static const struct shaderBlock texcoordTransform[] = {
 	SHADER_BLOCK(vert_texture1)
 };
 
+static const struct shaderBlock texcoordCopy[] = {
+	SHADER_BLOCK(vert_texture0_identity),
+	SHADER_BLOCK(vert_texture1_identity)
+};
+
+static const struct shaderBlock eyePosition = SHADER_BLOCK(vert_eyepos);
+
+static const struct shaderBlock fogFunc[] = {
+	{ 0, 0 },
+	SHADER_BLOCK(vert_fog_linear),
+	SHADER_BLOCK(vert_fog_exp),
+	SHADER_BLOCK(vert_fog_exp2)
+};
+
+static const struct shaderBlock clipDistance[] = {
+	SHADER_BLOCK(vert_clip0),
+	SHADER_BLOCK(vert_clip1),
+	SHADER_BLOCK(vert_clip2),
+	SHADER_BLOCK(vert_clip3)
+};
+
+static const struct shaderBlock pointSizeFunc[] = {
+	{ 0, 0 },
+	SHADER_BLOCK(vert_pointsize),
+	SHADER_BLOCK(vert_pointsize_atten)
+};
+
 static const struct shaderBlock pixelConstFloat = SHADER_BLOCK(frag_cfloat);
 static const struct shaderBlock pixelHeader = SHADER_BLOCK(frag_header);
 static const struct shaderBlock pixelFooter = SHADER_BLOCK(frag_footer);
 
+static const struct shaderBlock clipTest[] = {
+	SHADER_BLOCK(frag_clip0),
+	SHADER_BLOCK(frag_clip1),
+	SHADER_BLOCK(frag_clip2),
+	SHADER_BLOCK(frag_clip3)
+};
+
 static const struct shaderBlock textureUnit[] = {
 	SHADER_BLOCK(frag_texture0),
 	SHADER_BLOCK(frag_texture1)
@@ -360,9 +271,9 @@ static const struct shaderBlock combine_a = SHADER_BLOCK(frag_combine_a);
 static const struct shaderBlock combine_u = SHADER_BLOCK(frag_combine_uni);
 static const struct shaderBlock tex_swap = SHADER_BLOCK(frag_tex_swap);
 static const struct shaderBlock out_swap = SHADER_BLOCK(frag_out_swap);
+static const struct shaderBlock fog_blend = SHADER_BLOCK(frag_fog);
 
-#ifndef FIMG_BYPASS_SHADER_OPTIMIZER
-static fimgOpcodeInfo opcodeMap[64] = {
+const fimgOpcodeInfo fimgOpcodeMap[64] = {
 	[OP_NOP] = {
 		.type		= OP_TYPE_RESERVED,
 		.srcCount	= 0,
@@ -383,6 +294,10 @@ static fimgOpcodeInfo opcodeMap[64] = {
 		.type		= OP_TYPE_NORMAL,
 		.srcCount	= 2,
 	},
+	[OP_RSVD_05] = {
+		.type		= OP_TYPE_RESERVED,
+		.srcCount	= 0,
+	},
 	[OP_MUL] = {
 		.type		= OP_TYPE_NORMAL,
 		.srcCount	= 2,
@@ -580,7 +495,6 @@ static fimgOpcodeInfo opcodeMap[64] = {
 		.srcCount	= 0,
 	}
 };
-#endif
 
 /*
  * Utility functions
@@ -677,7 +591,7 @@ static inline void setPixelShaderAttribCount(fimgContext *ctx, uint32_t count)
 {
 	fimgWrite(ctx, count, FGPS_ATTRIB_NUM);
 
-	while (fimgRead(ctx, FGPS_IBSTATUS) & 1);
+	fimgPoll(ctx, FGPS_IBSTATUS, 1);
 }
 
 /**
@@ -695,8 +609,41 @@ static inline void setPixelShaderRange(fimgContext *ctx,
 	fimgWrite(ctx, 1, FGPS_PC_COPY);
 }
 
+/**
+ * Checks whether vector differs from shadowed contents of const float slot.
+ * @param shadow Shadow copy of const float register bank.
+ * @param dirty Bitmap of slots with unknown hardware contents.
+ * @param data Pointer to vector data.
+ * @param slot Number of slot.
+ * @return Non-zero if the slot has to be written to hardware.
+ */
+static inline int constFloatChanged(uint32_t (*shadow)[4], uint32_t dirty,
+					const uint32_t *data, uint32_t slot)
+{
+	if (dirty & (1 << slot))
+		return 1;
+
+	return shadow[slot][0] != data[0] || shadow[slot][1] != data[1]
+		|| shadow[slot][2] != data[2] || shadow[slot][3] != data[3];
+}
+
+/**
+ * Checks whether vector differs from contents of pixel shader const float slot.
+ * @param ctx Hardware context.
+ * @param pfData Pointer to vector data.
+ * @param slot Number of slot.
+ * @return Non-zero if the slot has to be written to hardware.
+ */
+static inline int psConstFloatChanged(fimgContext *ctx, const float *pfData,
+								uint32_t slot)
+{
+	return constFloatChanged(ctx->compat.psConst, ctx->compat.psConstDirty,
+					(const uint32_t *)pfData, slot);
+}
+
 /**
  * Loads vector into pixel shader const float slots.
+ * Only vectors differing from shadow copy of the register bank are written.
  * @param ctx Hardware context.
  * @param pfData Pointer to vector data.
  * @param slot Number of first slot.
@@ -705,24 +652,54 @@ static void loadPSConstFloat(fimgContext *ctx, const float *pfData,
 								uint32_t slot)
 {
 	const uint32_t *data = (const uint32_t *)pfData;
-	volatile uint32_t *reg = (volatile uint32_t *)(ctx->base
-						+ FGPS_CFLOAT_START + 16*slot);
-#if 0
-	asm ( 	"ldmia %0!, {r0-r3}"
-		"stmia %1!, {r0-r3}"
-		: "=r"(data), "=r"(reg)
-		: "0"(data), "1"(reg)
-		: "r0", "r1", "r2", "r3");
-#else
-	*(reg++) = *(data++);
-	*(reg++) = *(data++);
-	*(reg++) = *(data++);
-	*(reg++) = *(data++);
-#endif
+	uint32_t *shadow = ctx->compat.psConst[slot];
+	volatile uint32_t *reg;
+
+	if (!constFloatChanged(ctx->compat.psConst,
+				ctx->compat.psConstDirty, data, slot))
+		return;
+
+	reg = fimgBurstBegin(ctx, FGPS_CFLOAT_START + 16*slot, 4);
+	*(reg++) = *(shadow++) = *(data++);
+	*(reg++) = *(shadow++) = *(data++);
+	*(reg++) = *(shadow++) = *(data++);
+	*(reg++) = *(shadow++) = *(data++);
+	fimgBurstEnd(ctx);
+
+	ctx->compat.psConstDirty &= ~(1 << slot);
+}
+
+/**
+ * Loads vector into vertex shader const float slots.
+ * Only vectors differing from shadow copy of the register bank are written.
+ * @param ctx Hardware context.
+ * @param pfData Pointer to vector data.
+ * @param slot Number of first slot.
+ */
+static void loadVSConstFloat(fimgContext *ctx, const float *pfData,
+								uint32_t slot)
+{
+	const uint32_t *data = (const uint32_t *)pfData;
+	uint32_t *shadow = ctx->compat.vsConst[slot];
+	volatile uint32_t *reg;
+
+	if (!constFloatChanged(ctx->compat.vsConst,
+				ctx->compat.vsConstDirty, data, slot))
+		return;
+
+	reg = fimgBurstBegin(ctx, FGVS_CFLOAT_START + 16*slot, 4);
+	*(reg++) = *(shadow++) = *(data++);
+	*(reg++) = *(shadow++) = *(data++);
+	*(reg++) = *(shadow++) = *(data++);
+	*(reg++) = *(shadow++) = *(data++);
+	fimgBurstEnd(ctx);
+
+	ctx->compat.vsConstDirty &= ~(1 << slot);
 }
 
 /**
  * Loads matrix into vertex shader const float slots.
+ * Each column occupies one slot and is written only if it has changed.
  * @param ctx Hardware context.
  * @param pfData Pointer to matrix data.
  * @param slot Number of first slot.
@@ -730,22 +707,41 @@ static void loadPSConstFloat(fimgContext *ctx, const float *pfData,
 static void loadVSMatrix(fimgContext *ctx, const float *pfData, uint32_t slot)
 {
 	uint32_t i;
-	const uint32_t *data = (const uint32_t *)pfData;
-	volatile uint32_t *reg = (volatile uint32_t *)(ctx->base
-						+ FGVS_CFLOAT_START + 16*slot);
-	for (i = 0; i < 4; i++) {
-#if 0
-		asm ( 	"ldmia %0!, {r0-r3}"
-			"stmia %1!, {r0-r3}"
-			: "=r"(data), "=r"(reg)
-			: "0"(data), "1"(reg)
-			: "r0", "r1", "r2", "r3");
-#else
-		*(reg++) = *(data++);
-		*(reg++) = *(data++);
-		*(reg++) = *(data++);
-		*(reg++) = *(data++);
-#endif
+
+	for (i = 0; i < 4; i++)
+		loadVSConstFloat(ctx, pfData + 4*i, slot + i);
+}
+
+/**
+ * Calculates fog function coefficients for vertex shader.
+ * Fog factor is calculated by vertex shader from eye-space Z coordinate
+ * as sat(z * params[0] + params[1]) in linear mode, 2^(z * params[0])
+ * in exponential mode and 2^(-(z * params[0])^2) in squared exponential mode.
+ * @param ctx Hardware context.
+ */
+static void calculateFogParams(fimgContext *ctx)
+{
+	fimgFogCompat *fog = &ctx->compat.fog;
+	float range;
+
+	fog->params[0] = 0.0f;
+	fog->params[1] = 1.0f;
+
+	switch (FGFP_BITFIELD_GET(ctx->compat.vsState.vs, VS_FOG_MODE)) {
+	case FGFP_FOG_LINEAR:
+		range = fog->end - fog->start;
+		/* Avoid infinite scale for empty or denormal range */
+		if (fabsf(range) < FLT_MIN)
+			break;
+		fog->params[0] = 1.0f / range;
+		fog->params[1] = fog->end / range;
+		break;
+	case FGFP_FOG_EXP:
+		fog->params[0] = fog->density * FOG_LOG2E;
+		break;
+	case FGFP_FOG_EXP2:
+		fog->params[0] = fog->density * FOG_SQRT_LOG2E;
+		break;
 	}
 }
 
@@ -804,7 +800,7 @@ static uint32_t optimizeShader(uint32_t *start, uint32_t *end)
 
 	/* Optimization pass */
 	for (instr = instrStart; instr < instrEnd; ++instr) {
-		fimgOpcodeInfo *info = &opcodeMap[instr->opcode];
+		const fimgOpcodeInfo *info = &fimgOpcodeMap[instr->opcode];
 		uint32_t depMask;
 		uint32_t depReg;
 
@@ -993,7 +989,7 @@ static uint32_t optimizeShader(uint32_t *start, uint32_t *end)
 	for (instr = instrStart; instr < instrEnd; ++instr) {
 		if (instr->reserved == 0xdeadc0de)
 			continue;
-		if (opcodeMap[instr->opcode].srcCount == 3)
+		if (fimgOpcodeMap[instr->opcode].srcCount == 3)
 			(instr - 1)->next_3src = 1;
 		*(instrPtr++) = *instr;
 	}
@@ -1026,7 +1022,9 @@ static inline uint32_t *shaderSlotAddr(uint32_t *buf, uint32_t slot)
  */
 static void buildVertexShader(fimgContext *ctx, uint32_t slot)
 {
-	uint32_t unit;
+	uint32_t unit, plane;
+	uint32_t fogMode;
+	uint32_t pointSizeMode;
 	uint32_t *addr;
 	uint32_t *start;
 
@@ -1039,15 +1037,54 @@ static void buildVertexShader(fimgContext *ctx, uint32_t slot)
 	}
 	start = addr = shaderSlotAddr(ctx->compat.vshaderBuf, slot);
 
+	if (FGFP_BITFIELD_GET(ctx->compat.vsState.vs, VS_SCREEN_SPACE)) {
+		addr += loadShaderBlock(&vertexHeaderScreen, addr);
+
+		for (unit = 0; unit < FIMG_NUM_TEXTURE_UNITS; unit++) {
+			if (!FGFP_BITFIELD_GET_IDX(ctx->compat.vsState.vs,
+							VS_TEX_EN, unit))
+				continue;
+
+			addr += loadShaderBlock(&texcoordCopy[unit], addr);
+		}
+
+		goto footer;
+	}
+
 	addr += loadShaderBlock(&vertexHeader, addr);
 
 	for (unit = 0; unit < FIMG_NUM_TEXTURE_UNITS; unit++) {
 		if (!FGFP_BITFIELD_GET_IDX(ctx->compat.vsState.vs, VS_TEX_EN, unit))
 			continue;
 
+		if (!FGFP_BITFIELD_GET_IDX(ctx->compat.vsState.vs,
+							VS_TEX_MATRIX, unit)) {
+			addr += loadShaderBlock(&texcoordCopy[unit], addr);
+			continue;
+		}
+
 		addr += loadShaderBlock(&texcoordTransform[unit], addr);
 	}
 
+	if (ctx->compat.vsState.vs & FGFP_VS_EYEPOS_MASK)
+		addr += loadShaderBlock(&eyePosition, addr);
+
+	fogMode = FGFP_BITFIELD_GET(ctx->compat.vsState.vs, VS_FOG_MODE);
+	if (fogMode != FGFP_FOG_NONE)
+		addr += loadShaderBlock(&fogFunc[fogMode], addr);
+
+	for (plane = 0; plane < FIMG_NUM_CLIP_PLANES; plane++) {
+		if (!FGFP_BITFIELD_GET_IDX(ctx->compat.vsState.vs, VS_CLIP_EN, plane))
+			continue;
+
+		addr += loadShaderBlock(&clipDistance[plane], addr);
+	}
+
+	pointSizeMode = FGFP_BITFIELD_GET(ctx->compat.vsState.vs, VS_POINT_SIZE);
+	if (pointSizeMode != FGFP_POINT_SIZE_STATIC)
+		addr += loadShaderBlock(&pointSizeFunc[pointSizeMode], addr);
+
+footer:
 	addr += loadShaderBlock(&vertexFooter, addr);
 
 	FGFP_BITFIELD_SET(ctx->compat.vsState.vs, VS_INVALID, 0);
@@ -1069,17 +1106,19 @@ static void loadVertexShader(fimgContext *ctx)
 #ifdef FIMG_DYNSHADER_DEBUG
 	LOGD("Loading optimized shader");
 #endif
-	reg = (volatile uint32_t *)(ctx->base + FGVS_INSTMEM_START);
 	blk.data = shaderSlotAddr(ctx->compat.vshaderBuf, slot);
 	blk.len = vs->instrCount;
+	reg = fimgBurstBegin(ctx, FGVS_INSTMEM_START, 4*blk.len);
 	loadShaderBlock(&blk, reg);
+	fimgBurstEnd(ctx);
 
 	setVertexShaderRange(ctx, 0, vs->instrCount - 1);
 #ifdef FIMG_DYNSHADER_DEBUG
 	LOGD("Loading const float");
 #endif
-	reg = (volatile uint32_t *)(ctx->base + FGVS_CFLOAT_START);
+	reg = fimgBurstBegin(ctx, FGVS_CFLOAT_START, 4*vertexConstFloat.len);
 	loadShaderBlock(&vertexConstFloat, reg);
+	fimgBurstEnd(ctx);
 #ifdef FIMG_DYNSHADER_DEBUG
 	LOGD("Loaded pixel shader");
 #endif
@@ -1093,7 +1132,7 @@ static void loadVertexShader(fimgContext *ctx)
  */
 static void buildPixelShader(fimgContext *ctx, uint32_t slot)
 {
-	uint32_t unit, arg;
+	uint32_t unit, arg, plane;
 	uint32_t *addr;
 	uint32_t *start;
 	uint32_t instrCount;
@@ -1114,6 +1153,16 @@ static void buildPixelShader(fimgContext *ctx, uint32_t slot)
 #endif
 	addr += loadShaderBlock(&pixelHeader, addr);
 
+	for (plane = 0; plane < FIMG_NUM_CLIP_PLANES; plane++) {
+		if (FGFP_BITFIELD_GET(ctx->compat.psState.ps, PS_SCREEN_SPACE))
+			break;
+
+		if (!FGFP_BITFIELD_GET_IDX(ctx->compat.psState.ps, PS_CLIP_EN, plane))
+			continue;
+
+		addr += loadShaderBlock(&clipTest[plane], addr);
+	}
+
 	for (unit = 0; unit < FIMG_NUM_TEXTURE_UNITS; unit++) {
 		uint32_t reg = ctx->compat.psState.tex[unit];
 		if (!FGFP_BITFIELD_GET(reg, TEX_MODE))
@@ -1156,6 +1205,10 @@ static void buildPixelShader(fimgContext *ctx, uint32_t slot)
 		addr += loadShaderBlock(&combine_a, addr);
 	}
 
+	if (FGFP_BITFIELD_GET(ctx->compat.psState.ps, PS_FOG)
+	    && !FGFP_BITFIELD_GET(ctx->compat.psState.ps, PS_SCREEN_SPACE))
+		addr += loadShaderBlock(&fog_blend, addr);
+
 	if (FGFP_BITFIELD_GET(ctx->compat.psState.ps, PS_SWAP))
 		addr += loadShaderBlock(&out_swap, addr);
 
@@ -1179,22 +1232,25 @@ static void loadPixelShader(fimgContext *ctx)
 {
 	volatile uint32_t *reg;
 	struct shaderBlock blk;
+	uint32_t i;
 	uint32_t slot = ctx->compat.curPsNum;
 	struct fimgPixelShaderProgram *ps = &ctx->compat.pixelShaders[slot];
 #ifdef FIMG_DYNSHADER_DEBUG
 	LOGD("Loading optimized shader");
 #endif
-	reg = (volatile uint32_t *)(ctx->base + FGPS_INSTMEM_START);
 	blk.data = shaderSlotAddr(ctx->compat.pshaderBuf, slot);
 	blk.len = ps->instrCount;
+	reg = fimgBurstBegin(ctx, FGPS_INSTMEM_START, 4*blk.len);
 	loadShaderBlock(&blk, reg);
+	fimgBurstEnd(ctx);
 
 	setPixelShaderRange(ctx, 0, ps->instrCount - 1);
 #ifdef FIMG_DYNSHADER_DEBUG
 	LOGD("Loading const float");
 #endif
-	reg = (volatile uint32_t *)(ctx->base + FGPS_CFLOAT_START);
-	loadShaderBlock(&pixelConstFloat, reg);
+	for (i = 0; i < pixelConstFloat.len; i++)
+		loadPSConstFloat(ctx,
+			(const float *)&pixelConstFloat.data[4*i], i);
 #ifdef FIMG_DYNSHADER_DEBUG
 	LOGD("Loaded pixel shader");
 #endif
@@ -1257,6 +1313,9 @@ static void validateVertexShader(fimgContext *ctx)
 	if (!ret) {
 #ifdef FIMG_SHADER_CACHE_STATS
 		++ctx->compat.vsSameHits;
+#endif
+#ifdef FIMG_PERF_COUNTERS
+		++ctx->perf.shaderHits;
 #endif
 		return;
 	}
@@ -1271,6 +1330,9 @@ static void validateVertexShader(fimgContext *ctx)
 		if (!ret) {
 #ifdef FIMG_SHADER_CACHE_STATS
 			++ctx->compat.vsCacheHits;
+#endif
+#ifdef FIMG_PERF_COUNTERS
+			++ctx->perf.shaderHits;
 #endif
 			ctx->compat.curVsNum = i;
 			return;
@@ -1278,11 +1340,16 @@ static void validateVertexShader(fimgContext *ctx)
 	}
 #ifdef FIMG_SHADER_CACHE_STATS
 	++ctx->compat.vsMisses;
+#endif
+#ifdef FIMG_PERF_COUNTERS
+	++ctx->perf.shaderMisses;
 #endif
 	i = ctx->compat.vsEvictCounter++;
 	ctx->compat.vsEvictCounter %= VS_CACHE_SIZE;
 
+	FIMG_PROFILE_BEGIN(build);
 	buildVertexShader(ctx, i);
+	FIMG_PROFILE_END(build, "buildVertexShader");
 	ctx->compat.curVsNum = i;
 }
 
@@ -1311,6 +1378,9 @@ static void validatePixelShader(fimgContext *ctx)
 	if (!ret) {
 #ifdef FIMG_SHADER_CACHE_STATS
 		++ctx->compat.psSameHits;
+#endif
+#ifdef FIMG_PERF_COUNTERS
+		++ctx->perf.shaderHits;
 #endif
 		return;
 	}
@@ -1325,6 +1395,9 @@ static void validatePixelShader(fimgContext *ctx)
 		if (!ret) {
 #ifdef FIMG_SHADER_CACHE_STATS
 			++ctx->compat.psCacheHits;
+#endif
+#ifdef FIMG_PERF_COUNTERS
+			++ctx->perf.shaderHits;
 #endif
 			ctx->compat.curPsNum = i;
 			return;
@@ -1332,11 +1405,16 @@ static void validatePixelShader(fimgContext *ctx)
 	}
 #ifdef FIMG_SHADER_CACHE_STATS
 	++ctx->compat.psMisses;
+#endif
+#ifdef FIMG_PERF_COUNTERS
+	++ctx->perf.shaderMisses;
 #endif
 	i = ctx->compat.psEvictCounter++;
 	ctx->compat.psEvictCounter %= PS_CACHE_SIZE;
 
+	FIMG_PROFILE_BEGIN(build);
 	buildPixelShader(ctx, i);
+	FIMG_PROFILE_END(build, "buildPixelShader");
 	ctx->compat.curPsNum = i;
 }
 
@@ -1507,6 +1585,121 @@ void fimgCompatSetupTexture(fimgContext *ctx, fimgTexture *tex, uint32_t unit)
 				TEX_SWAP, !!(tex->reserved2 & FGTU_TEX_BGR));
 }
 
+/**
+ * Sets fog mode.
+ * @param ctx Hardware context.
+ * @param mode Fog mode (FGFP_FOG_NONE to disable fog).
+ */
+void fimgCompatSetFogMode(fimgContext *ctx, fimgFogMode mode)
+{
+	FGFP_BITFIELD_SET(ctx->compat.vsState.vs, VS_FOG_MODE, mode);
+	FGFP_BITFIELD_SET(ctx->compat.psState.ps, PS_FOG,
+						mode != FGFP_FOG_NONE);
+
+	ctx->compat.fog.dirty = 1;
+}
+
+/**
+ * Sets fog parameters.
+ * @param ctx Hardware context.
+ * @param density Fog density (used by exponential modes).
+ * @param start Fog start distance (used by linear mode).
+ * @param end Fog end distance (used by linear mode).
+ */
+void fimgCompatSetFogParams(fimgContext *ctx,
+				float density, float start, float end)
+{
+	ctx->compat.fog.density = density;
+	ctx->compat.fog.start = start;
+	ctx->compat.fog.end = end;
+
+	ctx->compat.fog.dirty = 1;
+}
+
+/**
+ * Sets fog color.
+ * @param ctx Hardware context.
+ * @param r Red component of fog color.
+ * @param g Green component of fog color.
+ * @param b Blue component of fog color.
+ * @param a Alpha component of fog color.
+ */
+void fimgCompatSetFogColor(fimgContext *ctx,
+					float r, float g, float b, float a)
+{
+	ctx->compat.fog.color[0] = r;
+	ctx->compat.fog.color[1] = g;
+	ctx->compat.fog.color[2] = b;
+	ctx->compat.fog.color[3] = a;
+
+	ctx->compat.fog.dirty = 1;
+}
+
+/**
+ * Sets equation of selected user clip plane.
+ * @param ctx Hardware context.
+ * @param plane Index of clip plane.
+ * @param equation Plane equation coefficients in eye coordinates.
+ */
+void fimgCompatSetClipPlane(fimgContext *ctx, uint32_t plane,
+							const float *equation)
+{
+	memcpy(ctx->compat.clipPlane[plane], equation, 4 * sizeof(float));
+
+	ctx->compat.clipPlaneDirty = 1;
+}
+
+/**
+ * Enables or disables selected user clip plane.
+ * @param ctx Hardware context.
+ * @param plane Index of clip plane.
+ * @param en Non-zero to enable the clip plane.
+ */
+void fimgCompatSetClipPlaneEnable(fimgContext *ctx, uint32_t plane, int en)
+{
+	FGFP_BITFIELD_SET_IDX(ctx->compat.vsState.vs, VS_CLIP_EN, plane, !!en);
+	FGFP_BITFIELD_SET_IDX(ctx->compat.psState.ps, PS_CLIP_EN, plane, !!en);
+}
+
+/**
+ * Selects source of point size used for point rendering.
+ * Point size computed by vertex shader is passed in last output attribute.
+ * @param ctx Hardware context.
+ * @param mode Point size mode.
+ */
+void fimgCompatSetPointSizeMode(fimgContext *ctx, fimgPointSizeMode mode)
+{
+	FGFP_BITFIELD_SET(ctx->compat.vsState.vs, VS_POINT_SIZE, mode);
+	ctx->primitive.vctx.pointSize = (mode != FGFP_POINT_SIZE_STATIC);
+}
+
+/**
+ * Sets point size distance attenuation coefficients.
+ * @param ctx Hardware context.
+ * @param coeffs Constant, linear and quadratic attenuation coefficients.
+ */
+void fimgCompatSetPointAttenuation(fimgContext *ctx, const float *coeffs)
+{
+	memcpy(ctx->compat.pointAtten, coeffs, 3 * sizeof(float));
+
+	ctx->compat.pointAttenDirty = 1;
+}
+
+/**
+ * Enables or disables screen-space rendering mode.
+ * In this mode vertex positions are passed to primitive engine without
+ * any transformation, texture coordinates are not transformed by texture
+ * matrices and eye-space effects (fog, clip planes) are disabled, while
+ * matrices and other vertex shader constants are left untouched.
+ * @param ctx Hardware context.
+ * @param en Non-zero to enable screen-space rendering.
+ */
+void fimgCompatSetScreenSpace(fimgContext *ctx, int en)
+{
+	FGFP_BITFIELD_SET(ctx->compat.vsState.vs, VS_SCREEN_SPACE, !!en);
+	FGFP_BITFIELD_SET(ctx->compat.psState.ps, PS_SCREEN_SPACE, !!en);
+}
+
 /**
  * Initializes hardware context of fixed pipeline emulation block.
  * @param ctx Hardware context.
@@ -1553,6 +1746,16 @@ void fimgCreateCompatContext(fimgContext *ctx)
 		FGFP_BITFIELD_SET(ctx->compat.pixelShaders[unit].state.ps,
 								PS_INVALID, 1);
 
+	ctx->compat.fog.density = 1.0f;
+	ctx->compat.fog.start = 0.0f;
+	ctx->compat.fog.end = 1.0f;
+	ctx->compat.fog.dirty = 1;
+	ctx->compat.clipPlaneDirty = 1;
+	ctx->compat.pointAtten[0] = 1.0f;
+	ctx->compat.pointAttenDirty = 1;
+	ctx->compat.vsConstDirty = 0xffffffff;
+	ctx->compat.psConstDirty = 0xffffffff;
+
 	ctx->compat.psMask[FIMG_NUM_TEXTURE_UNITS] = 0xffffffff;
 }
 
@@ -1563,27 +1766,78 @@ void fimgCreateCompatContext(fimgContext *ctx)
 void fimgCompatFlush(fimgContext *ctx)
 {
 	uint32_t i;
+	uint32_t fogMode;
+	uint32_t pointSizeMode;
+	uint32_t eyePos;
+	uint32_t screen;
 	int psStopped = 0;
 
 	validateVertexShader(ctx);
 	if (!ctx->compat.vshaderLoaded) {
+#ifdef FIMG_PERF_COUNTERS
+		++ctx->perf.shaderLoads;
+#endif
+		FIMG_PROFILE_BEGIN(load);
 		loadVertexShader(ctx);
+		FIMG_PROFILE_END(load, "loadVertexShader");
 		setVertexShaderAttribCount(ctx, ctx->numAttribs);
 		ctx->compat.vshaderLoaded = 1;
 	}
 
-	for (i = 0; i < 2 + FIMG_NUM_TEXTURE_UNITS; i++) {
+	fogMode = FGFP_BITFIELD_GET(ctx->compat.vsState.vs, VS_FOG_MODE);
+	pointSizeMode = FGFP_BITFIELD_GET(ctx->compat.vsState.vs, VS_POINT_SIZE);
+	eyePos = ctx->compat.vsState.vs & FGFP_VS_EYEPOS_MASK;
+
+	/* Screen-space shaders do not use any vertex shader constants */
+	screen = FGFP_BITFIELD_GET(ctx->compat.vsState.vs, VS_SCREEN_SPACE);
+	if (screen) {
+		fogMode = FGFP_FOG_NONE;
+		pointSizeMode = FGFP_POINT_SIZE_STATIC;
+		eyePos = 0;
+	}
+
+	for (i = 0; i < FGFP_MATRIX_NUM && !screen; i++) {
 		if (!ctx->compat.matrixDirty[i] || ctx->compat.matrix[i] == NULL)
 			continue;
 
+		/* Model-view matrix is used only for eye-space effects */
+		if (i == FGFP_MATRIX_MODELVIEW && !eyePos)
+			continue;
+
+		/* Texture matrices of disabled units are not used */
+		if (i >= FGFP_MATRIX_TEXTURE(0)
+		    && i < FGFP_MATRIX_TEXTURE(FIMG_NUM_TEXTURE_UNITS)
+		    && !FGFP_BITFIELD_GET_IDX(ctx->compat.vsState.vs, VS_TEX_EN,
+						i - FGFP_MATRIX_TEXTURE(0)))
+			continue;
+
 		loadVSMatrix(ctx, ctx->compat.matrix[i], 4*i);
 		ctx->compat.matrixDirty[i] = 0;
 	}
 
+	if (eyePos && ctx->compat.clipPlaneDirty) {
+		for (i = 0; i < FIMG_NUM_CLIP_PLANES; i++)
+			loadVSConstFloat(ctx, ctx->compat.clipPlane[i],
+							FGFP_CLIPPLANE(i));
+
+		ctx->compat.clipPlaneDirty = 0;
+	}
+
+	if (pointSizeMode == FGFP_POINT_SIZE_ATTENUATED
+	    && ctx->compat.pointAttenDirty) {
+		loadVSConstFloat(ctx, ctx->compat.pointAtten, FGFP_POINTATTEN);
+		ctx->compat.pointAttenDirty = 0;
+	}
+
 	validatePixelShader(ctx);
 	if (!ctx->compat.pshaderLoaded) {
+#ifdef FIMG_PERF_COUNTERS
+		++ctx->perf.shaderLoads;
+#endif
 		setPixelShaderState(ctx, 0);
+		FIMG_PROFILE_BEGIN(load);
 		loadPixelShader(ctx);
+		FIMG_PROFILE_END(load, "loadPixelShader");
 		psStopped = 1;
 		ctx->compat.pshaderLoaded = 1;
 	}
@@ -1600,7 +1854,10 @@ void fimgCompatFlush(fimgContext *ctx)
 		if (!ctx->compat.texture[i].dirty)
 			continue;
 
-		if (!psStopped) {
+		if (!psStopped && (psConstFloatChanged(ctx,
+				ctx->compat.texture[i].env, FGFP_TEXENV(i))
+		    || psConstFloatChanged(ctx,
+				ctx->compat.texture[i].scale, FGFP_COMBSCALE(i)))) {
 			setPixelShaderState(ctx, 0);
 			psStopped = 1;
 		}
@@ -1613,6 +1870,21 @@ void fimgCompatFlush(fimgContext *ctx)
 		ctx->compat.texture[i].dirty = 0;
 	}
 
+	if (fogMode != FGFP_FOG_NONE && ctx->compat.fog.dirty) {
+		calculateFogParams(ctx);
+		loadVSConstFloat(ctx, ctx->compat.fog.params, FGFP_FOGPARAMS);
+
+		if (!psStopped && psConstFloatChanged(ctx,
+					ctx->compat.fog.color, FGFP_FOGCOLOR)) {
+			setPixelShaderState(ctx, 0);
+			psStopped = 1;
+		}
+
+		loadPSConstFloat(ctx, ctx->compat.fog.color, FGFP_FOGCOLOR);
+
+		ctx->compat.fog.dirty = 0;
+	}
+
 	if (psStopped) {
 		setPixelShaderAttribCount(ctx, FIMG_ATTRIB_NUM - 1);
 		setPixelShaderState(ctx, 1);
@@ -1621,14 +1893,22 @@ void fimgCompatFlush(fimgContext *ctx)
 
 /**
  * Sets data pointer of selected matrix and marks it to be reloaded.
+ * Identity matrices are not loaded and texture coordinates of units with
+ * identity texture matrix are passed through without transformation.
  * @param ctx Hardware context.
  * @param matrix Which matrix to load (FGL_MATRIX_*).
- * @param pData Pointer to matrix elements in column-major ordering.
+ * @param pData Pointer to matrix elements in column-major ordering
+ * or NULL for identity matrix.
  */
 void fimgLoadMatrix(fimgContext *ctx, uint32_t matrix, const float *pfData)
 {
 	ctx->compat.matrix[matrix] = pfData;
 	ctx->compat.matrixDirty[matrix] = 1;
+
+	if (matrix >= FGFP_MATRIX_TEXTURE(0)
+	    && matrix < FGFP_MATRIX_TEXTURE(FIMG_NUM_TEXTURE_UNITS))
+		FGFP_BITFIELD_SET_IDX(ctx->compat.vsState.vs, VS_TEX_MATRIX,
+				matrix - FGFP_MATRIX_TEXTURE(0), pfData != NULL);
 }
 
 /**
@@ -1639,12 +1919,19 @@ void fimgRestoreCompatState(fimgContext *ctx)
 {
 	uint32_t i;
 
-	for (i = 0; i < 2 + FIMG_NUM_TEXTURE_UNITS; i++)
+	for (i = 0; i < FGFP_MATRIX_NUM; i++)
 		ctx->compat.matrixDirty[i] = 1;
 
 	for (i = 0; i < FIMG_NUM_TEXTURE_UNITS; i++)
 		ctx->compat.texture[i].dirty = 1;
 
+	ctx->compat.fog.dirty = 1;
+	ctx->compat.clipPlaneDirty = 1;
+	ctx->compat.pointAttenDirty = 1;
+
+	ctx->compat.vsConstDirty = 0xffffffff;
+	ctx->compat.psConstDirty = 0xffffffff;
+
 	ctx->compat.vshaderLoaded = 0;
 	ctx->compat.pshaderLoaded = 0;
 }
@@ -37,6 +37,27 @@
 /* Dump file path */
 #define FIMG_DUMP_FILE_PATH	"/tmp"
 
+/*
+ * Allow capturing binary traces of hardware accesses for replay with
+ * fimgreplay, started with fimgTraceStart or for every context if FIMG_TRACE
+ * environment variable is set (files are stored in dump file path)
+ */
+//#define FIMG_TRACE
+
+/*
+ * Maintain per-context driver performance counters, readable with
+ * fimgGetPerfCounters or glGetPerfCountersFIMG and logged for every frame
+ * if FIMG_PERF environment variable is set
+ */
+//#define FIMG_PERF_COUNTERS
+
+/*
+ * Record timeline of driver phases for export in Chrome trace event format
+ * with fimgProfileDump or at exit to file given in FIMG_PROFILE environment
+ * variable (profiling markers compile to nothing if not defined)
+ */
+//#define FIMG_PROFILE
+
 /* Map/unmap memory when locking/unlocking */
 //#define FIMG_DEBUG_IOMEM_ACCESS
 
@@ -52,4 +73,30 @@
 /* Disable shader optimizer */
 //#define FIMG_BYPASS_SHADER_OPTIMIZER
 
+/*
+ * Keep hardware lock between consecutive draws, releasing it at frame
+ * boundaries or after given time (ms) without draws, which can be overridden
+ * with FIMG_LOCK_LEASE environment variable (0 disables leasing)
+ */
+//#define FIMG_LOCK_LEASE	(4)
+
+/*
+ * Submit hardware commands from a dedicated driver thread, unless
+ * FIMG_THREADED_SUBMIT environment variable is set to 0
+ */
+//#define FIMG_THREADED_SUBMIT
+
+/*
+ * Convert textures and generate their mipmaps on a worker thread, copying
+ * client data to staging buffers (draws wait only for textures they use)
+ */
+//#define FIMG_ASYNC_TEXTURE_UPLOAD
+
+/*
+ * Route register access through selectable device backend (FIMG_BACKEND
+ * environment variable: "null", "record" or "sim"), e.g. to profile the
+ * driver or compare its rendering output without G3D hardware
+ */
+//#define FIMG_IO_BACKEND
+
 #endif /* _FIMG_CONFIG_H_ */
@@ -216,6 +216,8 @@ int fimgLoadPShader(fimgContext *ctx,
 
 /** Max. mipmap level supported by FIMG-3DSE. */
 #define FGTU_MAX_MIPMAP_LEVEL	11
+/** Max. count of palette entries supported by FIMG-3DSE. */
+#define FGTU_MAX_PALETTE_SIZE	256
 
 /* Type definitions */
 
@@ -330,7 +332,10 @@ void fimgSetTexMinFilter(fimgTexture *texture, unsigned mode);
 void fimgSetTexMagFilter(fimgTexture *texture, unsigned mode);
 void fimgSetTexMipmap(fimgTexture *texture, unsigned mode);
 void fimgSetTexCoordSys(fimgTexture *texture, unsigned mode);
-void fimgInvalidateTextureCache(fimgContext *ctx);
+int fimgSetTexPalette(fimgTexture *texture, unsigned int format,
+			const uint32_t *palette, unsigned int count);
+unsigned int fimgGetTexPalette(fimgTexture *texture, const uint32_t **palette);
+void fimgInvalidateTextureCache(fimgContext *ctx, unsigned int unit);
 
 /*
  * OpenGL 1.1 compatibility
@@ -339,12 +344,15 @@ void fimgInvalidateTextureCache(fimgContext *ctx);
 #ifdef FIMG_FIXED_PIPELINE
 
 #define FIMG_NUM_TEXTURE_UNITS	2
+#define FIMG_NUM_CLIP_PLANES	4
 
 /** Transformation matrices */
 typedef enum {
 	FGFP_MATRIX_TRANSFORM = 0,
 	FGFP_MATRIX_LIGHTING,
-	FGFP_MATRIX_TEXTURE
+	FGFP_MATRIX_TEXTURE,
+	FGFP_MATRIX_MODELVIEW = FGFP_MATRIX_TEXTURE + FIMG_NUM_TEXTURE_UNITS,
+	FGFP_MATRIX_NUM
 } fimgMatrix;
 /**
  * Returns index of texture coordinate matrix of given texture unit.
@@ -392,6 +400,21 @@ typedef enum {
 	FGFP_COMBARG_ONE_MINUS_SRC_ALPHA
 } fimgCombArgMod;
 
+/** Fog modes. */
+typedef enum {
+	FGFP_FOG_NONE = 0,
+	FGFP_FOG_LINEAR,
+	FGFP_FOG_EXP,
+	FGFP_FOG_EXP2
+} fimgFogMode;
+
+/** Point size modes. */
+typedef enum {
+	FGFP_POINT_SIZE_STATIC = 0,	/**< Size from point width register */
+	FGFP_POINT_SIZE_ATTRIB,		/**< Size from point size attribute */
+	FGFP_POINT_SIZE_ATTENUATED	/**< Attribute size with attenuation */
+} fimgPointSizeMode;
+
 void fimgLoadMatrix(fimgContext *ctx, uint32_t matrix, const float *pData);
 void fimgCompatSetTextureFunc(fimgContext *ctx, uint32_t unit, fimgTexFunc func);
 void fimgCompatSetColorCombiner(fimgContext *ctx, uint32_t unit,
@@ -411,6 +434,18 @@ void fimgCompatSetAlphaScale(fimgContext *ctx, uint32_t unit, float scale);
 void fimgCompatSetEnvColor(fimgContext *ctx, uint32_t unit,
 					float r, float g, float b, float a);
 void fimgCompatSetupTexture(fimgContext *ctx, fimgTexture *tex, uint32_t unit);
+void fimgCompatSetFogMode(fimgContext *ctx, fimgFogMode mode);
+void fimgCompatSetFogParams(fimgContext *ctx,
+				float density, float start, float end);
+void fimgCompatSetFogColor(fimgContext *ctx,
+					float r, float g, float b, float a);
+void fimgCompatSetClipPlane(fimgContext *ctx, uint32_t plane,
+							const float *equation);
+void fimgCompatSetClipPlaneEnable(fimgContext *ctx, uint32_t plane, int en);
+void fimgCompatSetPointSizeMode(fimgContext *ctx, fimgPointSizeMode mode);
+void fimgCompatSetPointAttenuation(fimgContext *ctx,
+						const float *coeffs);
+void fimgCompatSetScreenSpace(fimgContext *ctx, int en);
 
 #endif
 
@@ -580,6 +615,160 @@ int fimgDeviceOpen(fimgContext *ctx);
 void fimgDeviceClose(fimgContext *ctx);
 int fimgWaitForFlush(fimgContext *ctx, uint32_t target);
 
+#ifdef FIMG_LOCK_LEASE
+void fimgEndHardwareLease(fimgContext *ctx);
+#endif
+
+#ifdef FIMG_TRACE
+int fimgTraceStart(fimgContext *ctx, const char *path);
+void fimgTraceStop(fimgContext *ctx);
+void fimgTraceFrame(fimgContext *ctx);
+#endif
+
+#ifdef FIMG_PERF_COUNTERS
+/**
+ * Driver performance counters (all fields must be of uint32_t type).
+ * Counters wrap around, wait times after about 71 minutes of waiting.
+ */
+typedef struct {
+	uint32_t frames;	/**< Finished frames */
+	uint32_t draws;		/**< Draw calls sent to hardware */
+	uint32_t batches;	/**< Vertex buffer batches */
+	uint32_t vertices;	/**< Vertices packed into vertex buffer */
+	uint32_t vertexBytes;	/**< Bytes uploaded to vertex buffer */
+	uint32_t writes;	/**< Register and memory words written */
+	uint32_t fullFlushes;	/**< Flushes of complete pipeline */
+	uint32_t selectiveFlushes; /**< Flushes of selected pipeline parts */
+	uint32_t flushWaitTime;	/**< Time blocked in fimgWaitForFlush (us) */
+	uint32_t cacheWaitTime;	/**< Time blocked waiting for caches (us) */
+	uint32_t shaderHits;	/**< Shaders found in shader cache */
+	uint32_t shaderMisses;	/**< Shaders rebuilt after cache miss */
+	uint32_t shaderLoads;	/**< Shaders loaded into shader memory */
+	uint32_t texCacheInvalidations; /**< Texture cache invalidations */
+	uint32_t fullRestores;	/**< Restores of complete hardware context */
+	uint32_t textureUploads; /**< Texture images uploaded by application */
+	uint32_t textureBytes;	/**< Bytes of uploaded texture images */
+} fimgPerfCounters;
+
+#define FIMG_NUM_PERF_COUNTERS	(sizeof(fimgPerfCounters) / sizeof(uint32_t))
+
+/** Types of waits for hardware. */
+enum {
+	FIMG_WAIT_PIPELINE = 0,	/**< Pipeline flush */
+	FIMG_WAIT_CACHE,	/**< Cache flush or invalidation */
+	FIMG_NUM_WAIT_TYPES
+};
+
+/** Count of latency histogram buckets. */
+#define FIMG_WAIT_BUCKETS	16
+
+/** Statistics of waits for hardware of single type. */
+typedef struct {
+	uint32_t waits;		/**< Waits for busy hardware */
+	uint32_t slept;		/**< Waits not finished while spinning */
+	/**
+	 * Waits by latency, bucket 0 counts waits shorter than 1 us,
+	 * bucket n waits from 2^(n-1) us to 2^n us, the last one all longer
+	 */
+	uint32_t histogram[FIMG_WAIT_BUCKETS];
+} fimgWaitStats;
+
+void fimgGetPerfCounters(fimgContext *ctx, fimgPerfCounters *counters);
+void fimgResetPerfCounters(fimgContext *ctx);
+int fimgGetWaitStats(fimgContext *ctx, unsigned int type,
+					fimgWaitStats *stats);
+void fimgPerfFrame(fimgContext *ctx);
+void fimgPerfTextureUpload(fimgContext *ctx, uint32_t bytes);
+#endif
+
+#ifdef FIMG_PROFILE
+extern int fimgProfileEnabled;
+
+void fimgProfileInit(void);
+void fimgProfileEnable(int enable);
+void fimgProfileFrame(void);
+int fimgProfileDump(const char *path);
+uint64_t fimgProfileTime(void);
+void fimgProfileEvent(const char *name, uint64_t start);
+
+/**
+ * Returns start time of profiled phase.
+ * @return Start time or 0 if profiling is disabled.
+ */
+static inline uint64_t fimgProfileBegin(void)
+{
+	return fimgProfileEnabled ? fimgProfileTime() : 0;
+}
+
+/**
+ * Records profiled phase if profiling was enabled when it started.
+ * @param name Name of the phase (must be a static string).
+ * @param start Start time returned by fimgProfileBegin.
+ */
+static inline void fimgProfileEnd(const char *name, uint64_t start)
+{
+	if (start)
+		fimgProfileEvent(name, start);
+}
+
+/** Marks start of profiled phase identified by given tag. */
+#define FIMG_PROFILE_BEGIN(tag)	\
+	uint64_t fimgProfile_##tag = fimgProfileBegin()
+/** Marks end of profiled phase identified by given tag. */
+#define FIMG_PROFILE_END(tag, name)	\
+	fimgProfileEnd(name, fimgProfile_##tag)
+#else
+#define FIMG_PROFILE_BEGIN(tag)		do { } while (0)
+#define FIMG_PROFILE_END(tag, name)	do { } while (0)
+#endif
+
+#ifdef FIMG_IO_BACKEND
+/** Register access statistics of recording backend. */
+typedef struct {
+	uint32_t writes;	/**< Register writes (including bursts) */
+	uint32_t vertexWords;	/**< Words written to vertex buffer port */
+	uint32_t reads;		/**< Register reads */
+	uint32_t flushes;	/**< Pipeline flush requests */
+	uint32_t locks;		/**< Hardware lock acquisitions */
+	uint32_t unlocks;	/**< Hardware lock releases */
+	uint32_t dropped;	/**< Writes not logged due to full log */
+} fimgIoStats;
+
+/** Single register write recorded by recording backend. */
+typedef struct {
+	uint32_t addr;
+	uint32_t data;
+} fimgIoRecord;
+
+int fimgGetIoStats(fimgContext *ctx, fimgIoStats *stats);
+const fimgIoRecord *fimgGetIoLog(fimgContext *ctx, unsigned int *count);
+void fimgResetIoLog(fimgContext *ctx);
+
+/** Work counters of simulator backend. */
+typedef struct {
+	uint32_t draws;		/**< Draw requests */
+	uint32_t vertices;	/**< Vertices processed by vertex shader */
+	uint32_t vsInstructions; /**< Executed vertex shader instructions */
+	uint32_t primitives;	/**< Assembled primitives */
+	uint32_t culled;	/**< Primitives culled or clipped away */
+	uint32_t fragments;	/**< Fragments generated by rasterizer */
+	uint32_t psInstructions; /**< Executed pixel shader instructions */
+	uint32_t shaded;	/**< Fragments processed by pixel shader */
+	uint32_t killed;	/**< Fragments discarded by texkill */
+	uint32_t texels;	/**< Texels fetched by texture units */
+	uint32_t alphaFailed;	/**< Fragments failing alpha test */
+	uint32_t stencilFailed;	/**< Fragments failing stencil test */
+	uint32_t depthFailed;	/**< Fragments failing depth test */
+	uint32_t written;	/**< Pixels written to color buffer */
+} fimgSimStats;
+
+unsigned long fimgSimMapMemory(unsigned long paddr, void *vaddr,
+							unsigned long size);
+void fimgSimUnmapMemory(unsigned long paddr);
+int fimgGetSimStats(fimgContext *ctx, fimgSimStats *stats);
+void fimgResetSimStats(fimgContext *ctx);
+#endif
+
 //=============================================================================
 
 #ifdef __cplusplus
@@ -23,9 +23,12 @@
 #define _FIMG_PRIVATE_H_
 
 /* Include public part */
+#include <stddef.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <errno.h>
+#include <sched.h>
+#include <time.h>
 #include "platform.h"
 #include "fimg.h"
 
@@ -276,6 +279,156 @@ typedef union {
 	};
 } fimgFramebufferControl;
 
+/*
+ * Shaders
+ */
+
+enum fimgSrcRegType {
+	REG_SRC_V = 0,
+	REG_SRC_R,
+	REG_SRC_C,
+	REG_SRC_I,
+	REG_SRC_AL,
+	REG_SRC_B,
+	REG_SRC_P,
+	REG_SRC_S,
+	REG_SRC_D,
+	REG_SRC_VFACE,
+	REG_SRC_VPOS
+};
+
+enum fimgDstRegType {
+	REG_DST_O = 0,
+	REG_DST_R,
+	REG_DST_P,
+	REG_DST_A0,
+	REG_DST_AL
+};
+
+
+typedef struct __attribute__ ((__packed__)) _fimgShaderInstruction {
+	struct {
+		unsigned src2_regnum	:5;
+		unsigned		:3;
+		unsigned src2_regtype	:3;
+		unsigned src2_ar	:1;
+		unsigned		:2;
+		unsigned src2_modifier	:2;
+		unsigned src2_swizzle	:8;
+		unsigned src1_regnum	:5;
+		unsigned src1_pch	:2;
+		unsigned src1_pa	:1;
+	};
+	struct {
+		unsigned src1_regtype	:3;
+		unsigned src1_ar	:1;
+		unsigned src1_pn	:1;
+		unsigned src1_p		:1;
+		unsigned src1_modifier	:2;
+		unsigned src1_swizzle	:8;
+		unsigned src0_regnum	:5;
+		unsigned src0_extnum	:3;
+		unsigned src0_regtype	:3;
+		unsigned src0_ar	:3;
+		unsigned src0_modifier	:2;
+	};
+	union {
+		struct {
+			unsigned src0_swizzle	:8;
+			unsigned dest_regnum	:5;
+			unsigned dest_regtype	:3;
+			unsigned dest_a		:1;
+			unsigned dest_modifier	:2;
+			unsigned dest_mask	:4;
+			unsigned opcode		:6;
+			unsigned next_3src	:1;
+			unsigned		:2;
+		};
+		struct {
+			unsigned 		:8;
+			unsigned branch_offs	:8;
+			unsigned branch_dir	:1;
+			unsigned		:15;
+		};
+	};
+	struct {
+		uint32_t reserved;
+	};
+} fimgShaderInstruction;
+
+typedef struct opcodeInfo {
+	uint8_t type;
+	uint8_t srcCount;
+} fimgOpcodeInfo;
+
+enum fimgOpcode {
+	OP_NOP = 0,
+	OP_MOV,
+	OP_MOVA,
+	OP_MOVC,
+	OP_ADD,
+	OP_RSVD_05,
+	OP_MUL,
+	OP_MUL_LIT,
+	OP_DP3,
+	OP_DP4,
+	OP_DPH,
+	OP_DST,
+	OP_EXP,
+	OP_EXP_LIT,
+	OP_LOG,
+	OP_LOG_LIT,
+	OP_RCP,
+	OP_RSQ,
+	OP_DP2ADD,
+	OP_RSVD_13,
+	OP_MAX,
+	OP_MIN,
+	OP_SGE,
+	OP_SLT,
+	OP_SETP_EQ,
+	OP_SETP_GE,
+	OP_SETP_GT,
+	OP_SETP_NE,
+	OP_CMP,
+	OP_MAD,
+	OP_FRC,
+	OP_RSVD_1F,
+	OP_TEXLD,
+	OP_CUBEDIR,
+	OP_MAXCOMP,
+	OP_TEXLDC,
+	OP_RSVD_24,
+	OP_RSVD_25,
+	OP_RSVD_26,
+	OP_TEXKILL,
+	OP_MOVIPS,
+	OP_ADDI,
+	OP_B = 0x30,
+	OP_BF,
+	OP_RSVD_32,
+	OP_RSVD_33,
+	OP_BP,
+	OP_BFP,
+	OP_BZP,
+	OP_RSVD_37,
+	OP_CALL,
+	OP_CALLNZ,
+	OP_RSVD_3A,
+	OP_RSVD_3B,
+	OP_RET
+};
+
+enum fimgOpcodeType {
+	OP_TYPE_RESERVED = 0,
+	OP_TYPE_FLOW,
+	OP_TYPE_NORMAL,
+	OP_TYPE_MOVE
+};
+
+/* Type and source count of each opcode */
+extern const fimgOpcodeInfo fimgOpcodeMap[64];
+
 /*
  * Texturing
  */
@@ -325,8 +478,23 @@ struct _fimgTexture {
 	unsigned int baseAddr;
 	unsigned int reserved1;
 	unsigned int reserved2;
+	/* Fields below are not written to texture unit registers */
+	unsigned int generation;
+	/* Palette of paletted texture formats */
+	uint32_t *palette;
+	unsigned int paletteSize;
 };
 
+/* Number of texture unit registers written from texture object */
+#define FGTU_TEX_REG_COUNT	(offsetof(fimgTexture, generation) / 4)
+
+typedef struct {
+	const fimgTexture *texture;
+	unsigned int generation;
+} fimgTextureUnit;
+
+void fimgRestoreTextureState(fimgContext *ctx);
+
 /*
  * Hardware context
  */
@@ -438,6 +606,12 @@ void fimgRestoreFragmentState(fimgContext *ctx);
 #define FGFP_TEX_COMBA_FUNC_MASK	(0x7 << 28)
 #define FGFP_PS_SWAP_SHIFT		(0)
 #define FGFP_PS_SWAP_MASK		(0x1 << 0)
+#define FGFP_PS_FOG_SHIFT		(1)
+#define FGFP_PS_FOG_MASK		(0x1 << 1)
+#define FGFP_PS_CLIP_EN_SHIFT(i)	(2 + (i))
+#define FGFP_PS_CLIP_EN_MASK(i)		(0x1 << (2 + (i)))
+#define FGFP_PS_SCREEN_SPACE_SHIFT	(6)
+#define FGFP_PS_SCREEN_SPACE_MASK	(0x1 << 6)
 #define FGFP_PS_INVALID_SHIFT		(31)
 #define FGFP_PS_INVALID_MASK		(0x1 << 31)
 
@@ -451,6 +625,16 @@ typedef union _fimgPixelShaderState {
 
 #define FGFP_VS_TEX_EN_SHIFT(i)		(i)
 #define FGFP_VS_TEX_EN_MASK(i)		(0x1 << (i))
+#define FGFP_VS_TEX_MATRIX_SHIFT(i)	(4 + (i))
+#define FGFP_VS_TEX_MATRIX_MASK(i)	(0x1 << (4 + (i)))
+#define FGFP_VS_FOG_MODE_SHIFT		(8)
+#define FGFP_VS_FOG_MODE_MASK		(0x3 << 8)
+#define FGFP_VS_CLIP_EN_SHIFT(i)	(12 + (i))
+#define FGFP_VS_CLIP_EN_MASK(i)		(0x1 << (12 + (i)))
+#define FGFP_VS_POINT_SIZE_SHIFT	(16)
+#define FGFP_VS_POINT_SIZE_MASK		(0x3 << 16)
+#define FGFP_VS_SCREEN_SPACE_SHIFT	(20)
+#define FGFP_VS_SCREEN_SPACE_MASK	(0x1 << 20)
 #define FGFP_VS_INVALID_SHIFT		(31)
 #define FGFP_VS_INVALID_MASK		(0x1 << 31)
 
@@ -468,6 +652,15 @@ typedef struct {
 	fimgTexture *texture;
 } fimgTextureCompat;
 
+typedef struct {
+	int dirty;
+	float color[4];
+	float params[4];
+	float density;
+	float start;
+	float end;
+} fimgFogCompat;
+
 typedef struct fimgPixelShaderProgram {
 	uint32_t instrCount;
 	fimgPixelShaderState state;
@@ -481,6 +674,10 @@ typedef struct fimgVertexShaderProgram {
 #define VS_CACHE_SIZE	4
 #define PS_CACHE_SIZE	8
 
+/* Number of shadowed const float slots (limited by dirty bitmap width) */
+#define FGFP_VS_CFLOAT_NUM	32
+#define FGFP_PS_CFLOAT_NUM	32
+
 typedef struct {
 	uint32_t		*vshaderBuf;
 	int			vshaderLoaded;
@@ -510,9 +707,20 @@ typedef struct {
 #endif
 
 	fimgTextureCompat	texture[FIMG_NUM_TEXTURE_UNITS];
+	fimgFogCompat		fog;
+
+	int			clipPlaneDirty;
+	float			clipPlane[FIMG_NUM_CLIP_PLANES][4];
+	int			pointAttenDirty;
+	float			pointAtten[4];
+
+	int			matrixDirty[FGFP_MATRIX_NUM];
+	const float		*matrix[FGFP_MATRIX_NUM];
 
-	int			matrixDirty[2 + FIMG_NUM_TEXTURE_UNITS];
-	const float		*matrix[2 + FIMG_NUM_TEXTURE_UNITS];
+	uint32_t		vsConst[FGFP_VS_CFLOAT_NUM][4];
+	uint32_t		vsConstDirty;
+	uint32_t		psConst[FGFP_PS_CFLOAT_NUM][4];
+	uint32_t		psConstDirty;
 } fimgCompatContext;
 
 void fimgCreateCompatContext(fimgContext *ctx);
@@ -521,15 +729,203 @@ void fimgCompatFlush(fimgContext *ctx);
 
 #endif
 
+/*
+ * Register shadow
+ */
+
+/* Blocks of registers updated through fimgQueue */
+enum {
+	FIMG_SHADOW_PRIMITIVE = 0,	/* 0x30000 - primitive engine */
+	FIMG_SHADOW_RASTER,		/* 0x38000 - raster engine */
+	FIMG_SHADOW_RASTER_LOD,		/* 0x3c000 - LOD control and X clip */
+	FIMG_SHADOW_FRAGMENT,		/* 0x70000 - per-fragment unit */
+	FIMG_SHADOW_NUM_BLOCKS
+};
+
+/* Maximum number of registers in a shadowed block */
+#define FIMG_SHADOW_BLOCK_SIZE	16
+
+typedef struct {
+	/* Last values requested by state setters */
+	uint32_t value[FIMG_SHADOW_NUM_BLOCKS][FIMG_SHADOW_BLOCK_SIZE];
+	/* Values last written to hardware */
+	uint32_t hw[FIMG_SHADOW_NUM_BLOCKS][FIMG_SHADOW_BLOCK_SIZE];
+	/* Registers set since last flush */
+	uint32_t dirty[FIMG_SHADOW_NUM_BLOCKS];
+	/* Registers set at least once */
+	uint32_t used[FIMG_SHADOW_NUM_BLOCKS];
+	/* Registers with known hardware value */
+	uint32_t valid[FIMG_SHADOW_NUM_BLOCKS];
+	/* Blocks with dirty registers */
+	uint32_t dirtyBlocks;
+} fimgRegisterShadow;
+
+/* Size of mapped register space */
+#define FIMG_SFR_SIZE		(0x80000)
+
+/*
+ * Device backend
+ */
+
+typedef struct _fimgBackend {
+	const char *name;
+	int (*open)(fimgContext *ctx);
+	void (*close)(fimgContext *ctx);
+	int (*lock)(fimgContext *ctx);
+	int (*unlock)(fimgContext *ctx);
+	int (*flush)(fimgContext *ctx, uint32_t target);
+#ifdef FIMG_IO_BACKEND
+	void (*write)(fimgContext *ctx, uint32_t data, uint32_t addr);
+	uint32_t (*read)(fimgContext *ctx, uint32_t addr);
+	volatile uint32_t *(*burstBegin)(fimgContext *ctx,
+					uint32_t addr, uint32_t words);
+	void (*burstEnd)(fimgContext *ctx);
+#endif
+} fimgBackend;
+
+extern const fimgBackend fimgHardwareBackend;
+
+#ifdef FIMG_IO_BACKEND
+#ifdef FIMG_THREADED_SUBMIT
+#error FIMG_IO_BACKEND and FIMG_THREADED_SUBMIT cannot be used together
+#endif
+
+/* Discards writes and reports idle hardware */
+extern const fimgBackend fimgNullBackend;
+/* Like null backend, but records all writes in memory */
+extern const fimgBackend fimgRecordBackend;
+/* Software model of the GPU rendering into registered memory */
+extern const fimgBackend fimgSimBackend;
+
+int fimgClaimVirtualHardware(fimgContext *ctx);
+void fimgReleaseVirtualHardware(fimgContext *ctx);
+#endif
+
+/*
+ * Command stream
+ */
+
+#ifdef FIMG_THREADED_SUBMIT
+#ifdef FIMG_DEBUG_IOMEM_ACCESS
+#error FIMG_THREADED_SUBMIT requires registers to stay mapped
+#endif
+
+typedef struct _fimgStream fimgStream;
+
+fimgStream *fimgStreamCreate(volatile char *base, int fd);
+void fimgStreamDestroy(fimgStream *s);
+volatile uint32_t *fimgStreamBurstBegin(fimgStream *s,
+					uint32_t addr, uint32_t words);
+void fimgStreamBurstEnd(fimgStream *s);
+void fimgStreamWrite(fimgStream *s, uint32_t addr, uint32_t data);
+void fimgStreamPoll(fimgStream *s, uint32_t addr, uint32_t mask);
+void fimgStreamFlush(fimgStream *s, uint32_t mask);
+void fimgStreamUnlock(fimgStream *s);
+int fimgStreamRelock(fimgStream *s);
+void fimgStreamSync(fimgStream *s);
+#endif
+
+/*
+ * Trace
+ */
+
+/*
+ * Trace file starts with FIMG_TRACE_MAGIC and FIMG_TRACE_VERSION words,
+ * followed by records, each made of a header word (type in bits 31-24,
+ * payload length in words in bits 23-0) and the payload. All words are
+ * stored in native byte order.
+ */
+#define FIMG_TRACE_MAGIC	(0x52544746)	/* "FGTR" */
+#define FIMG_TRACE_VERSION	(1)
+
+enum {
+	FIMG_TRACE_WRITE = 1,	/* Register address, data words */
+	FIMG_TRACE_POLL,	/* Register address, bit mask */
+	FIMG_TRACE_FLUSH,	/* Pipeline mask, start time (2 words), duration */
+	FIMG_TRACE_LOCK,	/* Lock result, start time (2 words), duration */
+	FIMG_TRACE_UNLOCK,	/* Time (2 words) */
+	FIMG_TRACE_FRAME	/* Time (2 words) */
+};
+
+#define FIMG_TRACE_HEADER(type, len)	(((type) << 24) | (len))
+#define FIMG_TRACE_TYPE(hdr)		((hdr) >> 24)
+#define FIMG_TRACE_LEN(hdr)		((hdr) & 0xffffff)
+
+#ifdef FIMG_TRACE
+typedef struct _fimgTrace fimgTrace;
+
+uint64_t fimgTraceTime(void);
+volatile uint32_t *fimgTraceBurstBegin(fimgContext *ctx,
+					uint32_t addr, uint32_t words);
+void fimgTraceBurstEnd(fimgContext *ctx);
+void fimgTraceWrite(fimgTrace *t, uint32_t addr, uint32_t data);
+void fimgTracePoll(fimgTrace *t, uint32_t addr, uint32_t mask);
+void fimgTraceFlush(fimgTrace *t, uint32_t mask, uint64_t start);
+void fimgTraceLock(fimgTrace *t, int ret, uint64_t start);
+void fimgTraceUnlock(fimgTrace *t, uint64_t time);
+#endif
+
+/*
+ * Waits
+ */
+
+/*
+ * Count of register polls done before a wait for hardware stops spinning
+ * and blocks in kernel (pipeline flush) or yields the CPU (cache operations)
+ */
+#define FIMG_WAIT_SPINS		(32)
+
+/*
+ * Performance counters
+ */
+
+#ifdef FIMG_PERF_COUNTERS
+/**
+ * Returns current time for measurement of time spent in waits.
+ * @return Monotonic time in microseconds.
+ */
+static inline uint64_t fimgPerfTime(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+void fimgDumpWaitStats(fimgContext *ctx);
+#endif
+
+/*
+ * Hardware lock leasing
+ */
+
+#ifdef FIMG_LOCK_LEASE
+typedef struct _fimgLease fimgLease;
+
+fimgLease *fimgLeaseCreate(fimgContext *ctx);
+void fimgLeaseDestroy(fimgLease *l);
+void fimgLeaseStart(fimgLease *l);
+int fimgLeaseResume(fimgLease *l);
+#endif
+
+int fimgReleaseHardwareLockUntraced(fimgContext *ctx);
+
 struct _fimgContext {
 	volatile char *base;
 	int fd;
+#ifdef FIMG_IO_BACKEND
+	const fimgBackend *backend;
+	void *backendData;
+#endif
 	/* Individual contexts */
 	fimgGlobalContext global;
 	fimgHostContext host;
 	fimgPrimitiveContext primitive;
 	fimgRasterizerContext rasterizer;
 	fimgFragmentContext fragment;
+	fimgTextureUnit unit[FIMG_NUM_TEXTURE_UNITS];
+	/* Texture which palette is loaded into palette memory */
+	fimgTextureUnit palette;
 #ifdef FIMG_FIXED_PIPELINE
 	fimgCompatContext compat;
 #endif
@@ -539,12 +935,29 @@ struct _fimgContext {
 	unsigned int fbHeight;
 	unsigned int fbFlags;
 	int flipY;
-	/* Register queue */
-	unsigned int *queueStart;
-	unsigned int *queue;
-	unsigned int queueLen;
+	/* Register shadow */
+	fimgRegisterShadow shadow;
 	/* Lock state */
 	unsigned int locked;
+#ifdef FIMG_LOCK_LEASE
+	/* Lock kept between uses of hardware */
+	fimgLease *lease;
+#endif
+#ifdef FIMG_THREADED_SUBMIT
+	/* Commands executed by driver thread */
+	fimgStream *stream;
+#endif
+#ifdef FIMG_TRACE
+	/* Binary trace of hardware accesses */
+	fimgTrace *trace;
+#endif
+#ifdef FIMG_PERF_COUNTERS
+	/* Performance counters (total and at start of current frame) */
+	fimgPerfCounters perf;
+	fimgPerfCounters perfFrame;
+	fimgWaitStats waitStats[FIMG_NUM_WAIT_TYPES];
+	int perfDump;
+#endif
 	/* Vertex data */
 	uint8_t *vertexData;
 	size_t vertexDataSize;
@@ -559,6 +972,23 @@ static inline void fimgWrite(fimgContext *ctx, unsigned int data, unsigned int a
 		LOGE("Tried to access hardware registers without hw lock.");
 		return;
 	}
+#endif
+#ifdef FIMG_PERF_COUNTERS
+	++ctx->perf.writes;
+#endif
+#ifdef FIMG_TRACE
+	if (ctx->trace)
+		fimgTraceWrite(ctx->trace, addr, data);
+#endif
+#ifdef FIMG_THREADED_SUBMIT
+	if (ctx->stream) {
+		fimgStreamWrite(ctx->stream, addr, data);
+		return;
+	}
+#endif
+#ifdef FIMG_IO_BACKEND
+	ctx->backend->write(ctx, data, addr);
+	return;
 #endif
 	*reg = data;
 	__sync_synchronize();
@@ -573,6 +1003,13 @@ static inline unsigned int fimgRead(fimgContext *ctx, unsigned int addr)
 		LOGE("Tried to access hardware registers without hw lock.");
 		return 0xdeaddead;
 	}
+#endif
+#ifdef FIMG_THREADED_SUBMIT
+	if (ctx->stream)
+		fimgStreamSync(ctx->stream);
+#endif
+#ifdef FIMG_IO_BACKEND
+	return ctx->backend->read(ctx, addr);
 #endif
 	val = *reg;
 	__sync_synchronize();
@@ -582,11 +1019,37 @@ static inline unsigned int fimgRead(fimgContext *ctx, unsigned int addr)
 static inline void fimgWriteF(fimgContext *ctx, float data, unsigned int addr)
 {
 	volatile float *reg = (volatile float *)((volatile char *)ctx->base + addr);
+#if defined(FIMG_THREADED_SUBMIT) || defined(FIMG_IO_BACKEND) \
+    || defined(FIMG_TRACE)
+	union {
+		float f;
+		unsigned int u;
+	} val;
+
+	val.f = data;
+#endif
 #ifdef FIMG_DEBUG_HW_LOCK
 	if (!ctx->locked) {
 		LOGE("Tried to access hardware registers without hw lock.");
 		return;
 	}
+#endif
+#ifdef FIMG_PERF_COUNTERS
+	++ctx->perf.writes;
+#endif
+#ifdef FIMG_TRACE
+	if (ctx->trace)
+		fimgTraceWrite(ctx->trace, addr, val.u);
+#endif
+#ifdef FIMG_THREADED_SUBMIT
+	if (ctx->stream) {
+		fimgStreamWrite(ctx->stream, addr, val.u);
+		return;
+	}
+#endif
+#ifdef FIMG_IO_BACKEND
+	ctx->backend->write(ctx, val.u, addr);
+	return;
 #endif
 	*reg = data;
 	__sync_synchronize();
@@ -601,77 +1064,193 @@ static inline float fimgReadF(fimgContext *ctx, unsigned int addr)
 		LOGE("Tried to access hardware registers without hw lock.");
 		return 0xdeaddead;
 	}
+#endif
+#ifdef FIMG_THREADED_SUBMIT
+	if (ctx->stream)
+		fimgStreamSync(ctx->stream);
+#endif
+#ifdef FIMG_IO_BACKEND
+	{
+		union {
+			float f;
+			unsigned int u;
+		} data;
+
+		data.u = ctx->backend->read(ctx, addr);
+		return data.f;
+	}
 #endif
 	val = *reg;
 	__sync_synchronize();
 	return val;
 }
 
-/* Register queue */
-#define FIMG_MAX_QUEUE_LEN	64
-
-static inline void fimgQueueFlush(fimgContext *ctx)
+/**
+ * Waits until selected bits of register become cleared.
+ * The register is polled FIMG_WAIT_SPINS times and then the CPU is yielded
+ * between polls, so the wait does not starve other threads.
+ * (Must be called with hardware lock.)
+ * @param ctx Hardware context.
+ * @param addr Register address.
+ * @param mask Bit mask.
+ * @return 0 if finished while polling, 1 if the CPU had to be yielded.
+ */
+static inline int fimgPoll(fimgContext *ctx, unsigned int addr, unsigned int mask)
 {
-	unsigned int cnt;
-	unsigned int *ptr;
+	unsigned int spins = FIMG_WAIT_SPINS;
+	int yielded = 0;
 
-	if (!ctx->queueLen)
-		return;
+#ifdef FIMG_TRACE
+	if (ctx->trace)
+		fimgTracePoll(ctx->trace, addr, mask);
+#endif
+#ifdef FIMG_THREADED_SUBMIT
+	if (ctx->stream) {
+		fimgStreamPoll(ctx->stream, addr, mask);
+		return 0;
+	}
+#endif
+	while (fimgRead(ctx, addr) & mask) {
+		if (spins) {
+			--spins;
+			continue;
+		}
+		sched_yield();
+		yielded = 1;
+	}
 
-	/* Above the maximum length it's more effective to restore the whole
-	 * context than just the changed registers */
-	if (ctx->queueLen == FIMG_MAX_QUEUE_LEN) {
-		fimgRestoreContext(ctx);
+	return yielded;
+}
+
+/**
+ * Starts a burst write of consecutive registers or shader memory words.
+ * Data must be written through returned pointer and followed by
+ * fimgBurstEnd.
+ * (Must be called with hardware lock.)
+ * @param ctx Hardware context.
+ * @param addr Address of first register.
+ * @param words Count of words to be written.
+ * @return Pointer to write the data to.
+ */
+static inline volatile uint32_t *fimgBurstBegin(fimgContext *ctx,
+					unsigned int addr, unsigned int words)
+{
+#ifdef FIMG_PERF_COUNTERS
+	ctx->perf.writes += words;
+#endif
+#ifdef FIMG_TRACE
+	if (ctx->trace)
+		return fimgTraceBurstBegin(ctx, addr, words);
+#endif
+#ifdef FIMG_THREADED_SUBMIT
+	if (ctx->stream)
+		return fimgStreamBurstBegin(ctx->stream, addr, words);
+#endif
+#ifdef FIMG_IO_BACKEND
+	return ctx->backend->burstBegin(ctx, addr, words);
+#endif
+	return (volatile uint32_t *)(ctx->base + addr);
+}
+
+/**
+ * Finishes a burst write started with fimgBurstBegin.
+ * @param ctx Hardware context.
+ */
+static inline void fimgBurstEnd(fimgContext *ctx)
+{
+#ifdef FIMG_TRACE
+	if (ctx->trace) {
+		fimgTraceBurstEnd(ctx);
 		return;
 	}
+#endif
+#ifdef FIMG_THREADED_SUBMIT
+	if (ctx->stream)
+		fimgStreamBurstEnd(ctx->stream);
+#endif
+#ifdef FIMG_IO_BACKEND
+	ctx->backend->burstEnd(ctx);
+#endif
+}
 
-	cnt = ctx->queueLen;
-	ptr = ctx->queueStart + 2;
+/* Register shadow */
 
-	while (cnt--) {
-		fimgWrite(ctx, ptr[1], ptr[0]);
-		ptr += 2;
+/**
+ * Returns index of shadowed register block containing given register.
+ * Only registers of primitive engine, raster engine and per-fragment unit
+ * may be updated using fimgQueue.
+ * @param addr Register address.
+ * @return Index of register block.
+ */
+static inline unsigned int fimgShadowBlock(unsigned int addr)
+{
+	switch (addr & ~0xfff) {
+	case 0x30000:
+		return FIMG_SHADOW_PRIMITIVE;
+	case 0x38000:
+		return FIMG_SHADOW_RASTER;
+	case 0x3c000:
+		return FIMG_SHADOW_RASTER_LOD;
+	default:
+		return FIMG_SHADOW_FRAGMENT;
 	}
-
-	ctx->queueLen = 0;
-	ctx->queue = ctx->queueStart;
-	ctx->queue[0] = 0;
 }
 
-static inline void fimgQueue(fimgContext *ctx, unsigned int data, unsigned int addr)
+/**
+ * Returns address of first register of shadowed register block.
+ * @param blk Index of register block.
+ * @return Register address.
+ */
+static inline unsigned int fimgShadowBase(unsigned int blk)
 {
-	if (ctx->queue[0] == addr) {
-		ctx->queue[1] = data;
-		return;
+	switch (blk) {
+	case FIMG_SHADOW_PRIMITIVE:
+		return 0x30000;
+	case FIMG_SHADOW_RASTER:
+		return 0x38000;
+	case FIMG_SHADOW_RASTER_LOD:
+		return 0x3c000;
+	default:
+		return 0x70000;
 	}
+}
 
-	/* Above the maximum length it's more effective to restore the whole
-	 * context than just the changed registers */
-	if (ctx->queueLen == FIMG_MAX_QUEUE_LEN)
-		return;
+void fimgQueueFlush(fimgContext *ctx);
 
-	ctx->queue += 2;
-	ctx->queueLen++;
-	ctx->queue[0] = addr;
-	ctx->queue[1] = data;
+/**
+ * Sets value of shadowed register to be written at next flush.
+ * Repeated writes to the same register before flush are collapsed.
+ * @param ctx Hardware context.
+ * @param data Register value.
+ * @param addr Register address.
+ */
+static inline void fimgQueue(fimgContext *ctx, unsigned int data, unsigned int addr)
+{
+	fimgRegisterShadow *shadow = &ctx->shadow;
+	unsigned int blk = fimgShadowBlock(addr);
+	unsigned int idx = (addr & 0xfff) >> 2;
+
+	shadow->value[blk][idx] = data;
+	shadow->dirty[blk] |= 1 << idx;
+	shadow->used[blk] |= 1 << idx;
+	shadow->dirtyBlocks |= 1 << blk;
 }
 
+/**
+ * Sets value of shadowed floating point register to be written at next flush.
+ * @param ctx Hardware context.
+ * @param data Register value.
+ * @param addr Register address.
+ */
 static inline void fimgQueueF(fimgContext *ctx, float data, unsigned int addr)
 {
-	if (ctx->queue[0] == addr) {
-		((float *)ctx->queue)[1] = data;
-		return;
-	}
+	union {
+		float f;
+		unsigned int u;
+	} val;
 
-	/* Above the maximum length it's more effective to restore the whole
-	 * context than just the changed registers */
-	if (ctx->queueLen == FIMG_MAX_QUEUE_LEN)
-		return;
-
-	ctx->queue += 2;
-	ctx->queueLen++;
-	ctx->queue[0] = addr;
-	((float *)ctx->queue)[1] = data;
+	val.f = data;
+	fimgQueue(ctx, val.u, addr);
 }
 
 /* Hardware context */
@@ -680,14 +1259,26 @@ static inline void fimgGetHardware(fimgContext *ctx)
 {
 	int ret;
 
+#ifdef FIMG_LOCK_LEASE
+	/* Lock has been kept, so no other context could use the hardware */
+	if (ctx->lease && fimgLeaseResume(ctx->lease))
+		return;
+#endif
 	ret = fimgAcquireHardwareLock(ctx);
 	if (likely(!ret))
 		return;
 
 	switch (ret) {
 	case 2:
+		/* Hardware state has been lost */
 		/* Fall through */
 	case 1:
+		/*
+		 * Hardware has been used by another context. The lock does
+		 * not tell which one and every context opens its own device
+		 * file, so even a context of this process cannot be told
+		 * apart from other processes. All state must be restored.
+		 */
 		fimgRestoreContext(ctx);
 		break;
 	default:
@@ -699,7 +1290,10 @@ static inline void fimgGetHardware(fimgContext *ctx)
 static inline void fimgFlushContext(fimgContext *ctx)
 {
 	if (ctx->invalTexCache) {
-		fimgInvalidateCache(ctx, 0, 3);
+#ifdef FIMG_PERF_COUNTERS
+		++ctx->perf.texCacheInvalidations;
+#endif
+		fimgInvalidateCache(ctx, 0, ctx->invalTexCache);
 		ctx->invalTexCache = 0;
 	}
 	fimgQueueFlush(ctx);
@@ -710,6 +1304,12 @@ static inline void fimgFlushContext(fimgContext *ctx)
 
 static inline void fimgPutHardware(fimgContext *ctx)
 {
+#ifdef FIMG_LOCK_LEASE
+	if (ctx->lease) {
+		fimgLeaseStart(ctx->lease);
+		return;
+	}
+#endif
 	fimgReleaseHardwareLock(ctx);
 }
 
@@ -0,0 +1,117 @@
+/*
+ * fimg/fimg_regs.h
+ *
+ * SAMSUNG S3C6410 FIMG-3DSE REGISTER MAP
+ *
+ * Copyrights:	2010 by Tomasz Figa < tomasz.figa at gmail.com >
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _FIMG_REGS_H_
+#define _FIMG_REGS_H_
+
+/*
+ * Register addresses used by code looking at the register file as a whole
+ * (simulator backend, trace replay). Driver modules keep defining registers
+ * they program locally.
+ */
+
+/* Global block */
+#define FGGB_PIPESTATE		(0x0000)
+#define FGGB_CACHECTL		(0x0004)
+#define FGGB_VERSION		(0x0010)
+
+/* Host interface */
+#define FGHI_FIFO_ENTRY		(0xc000)
+#define FGHI_VB_ENTRY		(0xe000)
+#define FGHI_VB_SIZE		(0x2000)
+#define FGHI_ATTRIB(i)		(0x8040 + 4*(i))
+#define FGHI_ATTRIB_VBCTRL(i)	(0x8080 + 4*(i))
+#define FGHI_ATTRIB_VBBASE(i)	(0x80c0 + 4*(i))
+
+/* Vertex shader */
+#define FGVS_INSTMEM_START	(0x10000)
+#define FGVS_CFLOAT_START	(0x14000)
+#define FGVS_CINT_START		(0x18000)
+#define FGVS_CBOOL_START	(0x18400)
+#define FGVS_STATUS		(0x1c804)
+#define FGVS_PCRANGE		(0x20000)
+#define FGVS_ATTRIB_NUM		(0x20004)
+
+/* Primitive engine */
+#define FGPE_VERTEX_CONTEXT		(0x30000)
+#define FGPE_VIEWPORT_OX		(0x30004)
+#define FGPE_VIEWPORT_OY		(0x30008)
+#define FGPE_VIEWPORT_HALF_PX		(0x3000c)
+#define FGPE_VIEWPORT_HALF_PY		(0x30010)
+#define FGPE_DEPTHRANGE_HALF_F_SUB_N	(0x30014)
+#define FGPE_DEPTHRANGE_HALF_F_ADD_N	(0x30018)
+
+/* Raster engine */
+#define FGRA_PIX_SAMP		(0x38000)
+#define FGRA_D_OFF_EN		(0x38004)
+#define FGRA_D_OFF_FACTOR	(0x38008)
+#define FGRA_D_OFF_UNITS	(0x3800c)
+#define FGRA_BFCULL		(0x38014)
+#define FGRA_YCLIP		(0x38018)
+#define FGRA_PWIDTH		(0x3801c)
+#define FGRA_PSIZE_MIN		(0x38020)
+#define FGRA_PSIZE_MAX		(0x38024)
+#define FGRA_COORDREPLACE	(0x38028)
+#define FGRA_LWIDTH		(0x3802c)
+#define FGRA_XCLIP		(0x3c004)
+
+/* Pixel shader */
+#define FGPS_INSTMEM_START	(0x40000)
+#define FGPS_CFLOAT_START	(0x44000)
+#define FGPS_CINT_START		(0x48000)
+#define FGPS_CBOOL_START	(0x48400)
+#define FGPS_PC_START		(0x4c804)
+#define FGPS_PC_END		(0x4c808)
+#define FGPS_IBSTATUS		(0x4c814)
+
+/* Texture units */
+#define FGTU_NUM_UNITS		(8)
+#define FGTU_NUM_VTX_UNITS	(4)
+
+#define FGTU_TSTA(i)		(0x60000 + 0x50 * (i))
+#define FGTU_USIZE(i)		(0x60004 + 0x50 * (i))
+#define FGTU_VSIZE(i)		(0x60008 + 0x50 * (i))
+#define FGTU_TOFFS_L1(i)	(0x60010 + 0x50 * (i))
+#define FGTU_T_MIN_L(i)		(0x6003c + 0x50 * (i))
+#define FGTU_T_MAX_L(i)		(0x60040 + 0x50 * (i))
+#define FGTU_TBADD(i)		(0x60044 + 0x50 * (i))
+#define FGTU_VTBADDR(i)		(0x602c4 + 8 * (i))
+#define FGTU_PALETTE_ADDR	(0x60290)
+#define FGTU_PALETTE_IN		(0x60294)
+
+/* Per-fragment unit */
+#define FGPF_SCISSOR_X		(0x70000)
+#define FGPF_SCISSOR_Y		(0x70004)
+#define FGPF_ALPHAT		(0x70008)
+#define FGPF_FRONTST		(0x7000c)
+#define FGPF_BACKST		(0x70010)
+#define FGPF_DEPTHT		(0x70014)
+#define FGPF_CCLR		(0x70018)
+#define FGPF_BLEND		(0x7001c)
+#define FGPF_LOGOP		(0x70020)
+#define FGPF_CBMSK		(0x70024)
+#define FGPF_DBMSK		(0x70028)
+#define FGPF_FBCTL		(0x7002c)
+#define FGPF_DBADDR		(0x70030)
+#define FGPF_CBADDR		(0x70034)
+#define FGPF_FBW		(0x70038)
+
+#endif /* _FIMG_REGS_H_ */
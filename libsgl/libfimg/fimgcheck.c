@@ -0,0 +1,773 @@
+/*
+ * fimg/fimgcheck.c
+ *
+ * SAMSUNG S3C6410 FIMG-3DSE SOFTWARE BACKEND CHECKS
+ *
+ * Copyrights:	2010 by Tomasz Figa < tomasz.figa at gmail.com >
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifdef HAVE_CONFIG_H
+# include <config.h>
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "fimg_private.h"
+
+/*
+ * Runs libfimg against software device backends (FIMG_IO_BACKEND) to check
+ * driver behaviour which can be observed without G3D hardware, such as
+ * register traffic. Each check prints its measurements and the tool exits
+ * with nonzero status if any check fails.
+ *
+ * The scenes check renders fixed pipeline scenes with the simulator backend.
+ * Images are written as PPM files to directory given by FIMG_CHECK_OUTPUT
+ * and compared with golden images from directory given by FIMG_CHECK_GOLDEN,
+ * if these variables are set. Golden images are the output of a run which
+ * was verified, e.g. against the same scenes rendered by the hardware.
+ */
+
+#ifdef FIMG_IO_BACKEND
+
+/* Draws done by each context in a check */
+#define CHECK_DRAWS		(64)
+/* Frames rendered by frame based checks */
+#define CHECK_FRAMES		(3)
+
+/* Vertex attributes used by fixed pipeline */
+#define CHECK_NUM_ATTRIBS	(4 + FIMG_NUM_TEXTURE_UNITS)
+
+static const float checkDefault[4] = { 0.0f, 0.0f, 0.0f, 1.0f };
+static const float checkTriangle[3][4] = {
+	{ -1.0f, -1.0f, 0.0f, 1.0f },
+	{  1.0f, -1.0f, 0.0f, 1.0f },
+	{ -1.0f,  1.0f, 0.0f, 1.0f },
+};
+
+/**
+ * Creates a hardware context using given software backend.
+ * @param backend Name of backend.
+ * @return Hardware context or NULL on error.
+ */
+static fimgContext *createContext(const char *backend)
+{
+	fimgContext *ctx;
+
+	setenv("FIMG_BACKEND", backend, 1);
+	ctx = fimgCreateContext();
+	if (!ctx)
+		fprintf(stderr, "Could not create %s context\n", backend);
+
+	return ctx;
+}
+
+/**
+ * Draws a single triangle with current state of the context.
+ * @param ctx Hardware context.
+ */
+static void drawTriangle(fimgContext *ctx)
+{
+	fimgArray arrays[CHECK_NUM_ATTRIBS];
+	unsigned int i;
+
+	for (i = 0; i < CHECK_NUM_ATTRIBS; ++i) {
+		arrays[i].pointer = checkDefault;
+		arrays[i].stride = 0;
+		arrays[i].width = 16;
+	}
+
+	arrays[0].pointer = checkTriangle;
+	arrays[0].stride = 16;
+
+	fimgSetAttribute(ctx, 0, FGHI_ATTRIB_DT_FLOAT, 4);
+	fimgSetAttribCount(ctx, CHECK_NUM_ATTRIBS);
+	fimgDrawArrays(ctx, FGPE_TRIANGLES, arrays, 3);
+}
+
+/**
+ * Lets other contexts claim the hardware, like the kernel lock does after
+ * the lease of a context expires.
+ * @param ctx Hardware context.
+ */
+static void yieldHardware(fimgContext *ctx)
+{
+#ifdef FIMG_LOCK_LEASE
+	fimgEndHardwareLease(ctx);
+#endif
+}
+
+/**
+ * Counts register writes of a context since its log was reset, excluding
+ * vertex data.
+ * @param ctx Hardware context.
+ * @return Count of register writes.
+ */
+static uint32_t countWrites(fimgContext *ctx)
+{
+	fimgIoStats stats;
+
+	fimgGetIoStats(ctx, &stats);
+	return stats.writes - stats.vertexWords;
+}
+
+/**
+ * Checks that a context using the hardware alone does not restore its state,
+ * while two contexts drawing in turns restore full state at every switch,
+ * because the hardware lock does not tell which context used it last.
+ * @return 0 on success, 1 on failure.
+ */
+static int checkRestore(void)
+{
+	fimgContext *ctx[2];
+	uint32_t alone, shared[2], restore;
+	unsigned int i;
+	int ret = 1;
+
+	ctx[0] = createContext("record");
+	ctx[1] = createContext("record");
+	if (!ctx[0] || !ctx[1])
+		goto out;
+
+	/* Initial restore of both contexts is not measured */
+	drawTriangle(ctx[0]);
+	yieldHardware(ctx[0]);
+	drawTriangle(ctx[1]);
+	yieldHardware(ctx[1]);
+
+	fimgResetIoLog(ctx[0]);
+	for (i = 0; i < CHECK_DRAWS; ++i)
+		drawTriangle(ctx[0]);
+	yieldHardware(ctx[0]);
+	alone = countWrites(ctx[0]);
+
+	fimgResetIoLog(ctx[0]);
+	fimgResetIoLog(ctx[1]);
+	for (i = 0; i < CHECK_DRAWS; ++i) {
+		drawTriangle(ctx[0]);
+		yieldHardware(ctx[0]);
+		drawTriangle(ctx[1]);
+		yieldHardware(ctx[1]);
+	}
+	shared[0] = countWrites(ctx[0]);
+	shared[1] = countWrites(ctx[1]);
+
+	/* Single full restore of the first context, owning the hardware */
+	drawTriangle(ctx[0]);
+	fimgResetIoLog(ctx[0]);
+	fimgGetHardware(ctx[0]);
+	fimgRestoreContext(ctx[0]);
+	fimgPutHardware(ctx[0]);
+	yieldHardware(ctx[0]);
+	restore = countWrites(ctx[0]);
+
+	printf("restore: %u draws, %u writes per draw alone, "
+		"%u/%u writes per draw shared, %u writes per restore\n",
+		CHECK_DRAWS, alone / CHECK_DRAWS, shared[0] / CHECK_DRAWS,
+		shared[1] / CHECK_DRAWS, restore);
+
+	ret = 0;
+	for (i = 0; i < 2; ++i) {
+		if (shared[i] < alone + CHECK_DRAWS * restore) {
+			fprintf(stderr, "restore: context %u skipped restore "
+					"after the other context\n", i);
+			ret = 1;
+		}
+	}
+
+out:
+	if (ctx[1])
+		fimgDestroyContext(ctx[1]);
+	if (ctx[0])
+		fimgDestroyContext(ctx[0]);
+	return ret;
+}
+
+#ifdef FIMG_LOCK_LEASE
+/**
+ * Counts hardware lock and unlock requests of a context since its log was
+ * reset.
+ * @param ctx Hardware context.
+ * @param unlocks Pointer to store count of unlock requests in.
+ * @return Count of lock requests.
+ */
+static uint32_t countLocks(fimgContext *ctx, uint32_t *unlocks)
+{
+	fimgIoStats stats;
+
+	fimgGetIoStats(ctx, &stats);
+	if (unlocks)
+		*unlocks = stats.unlocks;
+	return stats.locks;
+}
+
+/**
+ * Counts lock requests done by a context rendering frames of draws.
+ * @param lease Lease timeout (ms), as string, 0 disables leasing.
+ * @return Count of lock requests.
+ */
+static uint32_t countFrameLocks(const char *lease)
+{
+	fimgContext *ctx;
+	uint32_t locks;
+	unsigned int i, j;
+
+	setenv("FIMG_LOCK_LEASE", lease, 1);
+	ctx = createContext("record");
+	if (!ctx)
+		return 0;
+
+	for (i = 0; i < CHECK_FRAMES; ++i) {
+		for (j = 0; j < CHECK_DRAWS; ++j)
+			drawTriangle(ctx);
+		fimgFinish(ctx);
+	}
+
+	locks = countLocks(ctx, NULL);
+	fimgDestroyContext(ctx);
+	return locks;
+}
+#endif
+
+/**
+ * Checks that leasing the hardware lock saves lock ioctls of consecutive
+ * draws and that the lease thread releases the lock after the lease timeout,
+ * without any further call by the thread using the context.
+ * @return 0 on success, 1 on failure.
+ */
+static int checkLease(void)
+{
+#ifdef FIMG_LOCK_LEASE
+	char timeout[16];
+	fimgContext *ctx;
+	uint32_t direct, leased;
+	uint32_t locks, unlocks;
+	int ret = 0;
+
+	direct = countFrameLocks("0");
+	snprintf(timeout, sizeof(timeout), "%u", FIMG_LOCK_LEASE);
+	leased = countFrameLocks(timeout);
+
+	printf("lease: %u frames of %u draws, %u lock ioctls without lease, "
+		"%u with lease\n", CHECK_FRAMES, CHECK_DRAWS, direct, leased);
+
+	if (leased > CHECK_FRAMES) {
+		fprintf(stderr, "lease: lock not kept between draws\n");
+		ret = 1;
+	}
+
+	ctx = createContext("record");
+	if (!ctx)
+		return 1;
+
+	drawTriangle(ctx);
+	usleep(10 * 1000 * FIMG_LOCK_LEASE);
+	locks = countLocks(ctx, &unlocks);
+
+	printf("lease: %u locks, %u unlocks after timeout\n", locks, unlocks);
+
+	if (unlocks != locks) {
+		fprintf(stderr, "lease: expired lease not ended "
+					"by lease thread\n");
+		ret = 1;
+	}
+
+	fimgDestroyContext(ctx);
+	return ret;
+#else
+	printf("lease: leasing disabled (FIMG_LOCK_LEASE)\n");
+	return 0;
+#endif
+}
+
+/*
+ * Scenes
+ */
+
+/* Size of rendered images */
+#define SCENE_WIDTH		(32)
+#define SCENE_HEIGHT		(32)
+/* Size of scene textures */
+#define SCENE_TEX_SIZE		(4)
+/* Max. difference of color components from golden images */
+#define SCENE_TOLERANCE		(1)
+
+typedef struct {
+	fimgContext *ctx;
+	uint32_t color[SCENE_WIDTH * SCENE_HEIGHT];
+	uint8_t texels[4 * SCENE_TEX_SIZE * SCENE_TEX_SIZE];
+	unsigned long texAddr;
+	fimgTexture *tex;
+} sceneState;
+
+/* Screen covering quad, drawn as triangle strip */
+static const float sceneQuad[4][4] = {
+	{ -1.0f, -1.0f, 0.0f, 1.0f },
+	{  1.0f, -1.0f, 0.0f, 1.0f },
+	{ -1.0f,  1.0f, 0.0f, 1.0f },
+	{  1.0f,  1.0f, 0.0f, 1.0f },
+};
+
+static const float sceneTexCoords[4][4] = {
+	{ 0.0f, 0.0f, 0.0f, 1.0f },
+	{ 1.0f, 0.0f, 0.0f, 1.0f },
+	{ 0.0f, 1.0f, 0.0f, 1.0f },
+	{ 1.0f, 1.0f, 0.0f, 1.0f },
+};
+
+static const float sceneColors[4][4] = {
+	{ 1.0f, 0.0f, 0.0f, 1.0f },
+	{ 0.0f, 1.0f, 0.0f, 1.0f },
+	{ 0.0f, 0.0f, 1.0f, 1.0f },
+	{ 1.0f, 1.0f, 1.0f, 1.0f },
+};
+
+static const float sceneIdentity[16] = {
+	1.0f, 0.0f, 0.0f, 0.0f,
+	0.0f, 1.0f, 0.0f, 0.0f,
+	0.0f, 0.0f, 1.0f, 0.0f,
+	0.0f, 0.0f, 0.0f, 1.0f,
+};
+
+/**
+ * Gets ARGB8888 color of texel of scene textures, distinct for each texel.
+ * @param idx Texel index.
+ * @return Texel color.
+ */
+static uint32_t sceneTexelColor(unsigned int idx)
+{
+	return 0xff000000 | ((idx & 3) * 0x55 << 16)
+			| ((idx >> 2) * 0x55 << 8) | (idx * 0x11);
+}
+
+/**
+ * Draws screen covering quad.
+ * @param st Scene state.
+ * @param colors Vertex colors or NULL for constant white.
+ * @param texture Non-zero to pass texture coordinates to first unit.
+ */
+static void sceneDrawQuad(sceneState *st, const float (*colors)[4],
+								int texture)
+{
+	fimgArray arrays[CHECK_NUM_ATTRIBS];
+	unsigned int i;
+
+	for (i = 0; i < CHECK_NUM_ATTRIBS; ++i) {
+		arrays[i].pointer = checkDefault;
+		arrays[i].stride = 0;
+		arrays[i].width = 16;
+		fimgSetAttribute(st->ctx, i, FGHI_ATTRIB_DT_FLOAT, 4);
+	}
+
+	arrays[0].pointer = sceneQuad;
+	arrays[0].stride = 16;
+	arrays[2].pointer = colors ? (const void *)colors : sceneColors[3];
+	arrays[2].stride = colors ? 16 : 0;
+	if (texture) {
+		arrays[4].pointer = sceneTexCoords;
+		arrays[4].stride = 16;
+	}
+
+	fimgSetAttribCount(st->ctx, CHECK_NUM_ATTRIBS);
+	fimgDrawArrays(st->ctx, FGPE_TRIANGLE_STRIP, arrays, 4);
+}
+
+/**
+ * Sets up scene texture on first texture unit, with nearest filtering.
+ * @param st Scene state.
+ * @param format Texture format (one of FGTU_TSTA_TEXTURE_FORMAT_*).
+ */
+static void sceneSetupTexture(sceneState *st, unsigned int format)
+{
+	st->tex = fimgCreateTexture();
+	fimgInitTexture(st->tex, 0, format, st->texAddr);
+	fimgSetTex2DSize(st->tex, SCENE_TEX_SIZE, SCENE_TEX_SIZE, 0);
+	fimgSetTexMipmap(st->tex, FGTU_TSTA_MIPMAP_DISABLED);
+	fimgSetTexMinFilter(st->tex, FGTU_TSTA_FILTER_NEAREST);
+	fimgSetTexMagFilter(st->tex, FGTU_TSTA_FILTER_NEAREST);
+
+	fimgCompatSetupTexture(st->ctx, st->tex, 0);
+	fimgCompatSetTextureFunc(st->ctx, 0, FGFP_TEXFUNC_REPLACE);
+}
+
+/**
+ * Gets index of scene texture texel covering given pixel of the image.
+ * (Texture coordinates grow up, while image rows grow down.)
+ * @param x Pixel column.
+ * @param y Pixel row.
+ * @return Texel index.
+ */
+static unsigned int sceneTexelAt(unsigned int x, unsigned int y)
+{
+	unsigned int u = x * SCENE_TEX_SIZE / SCENE_WIDTH;
+	unsigned int v = (SCENE_HEIGHT - 1 - y) * SCENE_TEX_SIZE / SCENE_HEIGHT;
+
+	return v * SCENE_TEX_SIZE + u;
+}
+
+/**
+ * Counts pixels of textured scene not matching texels they cover.
+ * @param st Scene state.
+ * @return Count of mismatching pixels.
+ */
+static unsigned int sceneCheckTexels(const sceneState *st)
+{
+	unsigned int x, y, bad = 0;
+
+	for (y = 0; y < SCENE_HEIGHT; ++y)
+		for (x = 0; x < SCENE_WIDTH; ++x)
+			if (st->color[y * SCENE_WIDTH + x]
+			    != sceneTexelColor(sceneTexelAt(x, y)))
+				++bad;
+
+	return bad;
+}
+
+/**
+ * Renders quad with colors interpolated between vertices.
+ * @param st Scene state.
+ * @return Count of pixels not matching expected colors.
+ */
+static unsigned int sceneGouraud(sceneState *st)
+{
+	/* Corner pixels of the image and vertices nearest to them */
+	static const unsigned int corners[4][3] = {
+		{ 0, SCENE_HEIGHT - 1, 0 },
+		{ SCENE_WIDTH - 1, SCENE_HEIGHT - 1, 1 },
+		{ 0, 0, 2 },
+		{ SCENE_WIDTH - 1, 0, 3 },
+	};
+	unsigned int i, j, bad = 0;
+
+	sceneDrawQuad(st, sceneColors, 0);
+	fimgFinish(st->ctx);
+
+	for (i = 0; i < 4; ++i) {
+		uint32_t pixel = st->color[corners[i][1] * SCENE_WIDTH
+							+ corners[i][0]];
+		const float *color = sceneColors[corners[i][2]];
+
+		/* Pixel centers are half a pixel away from the vertices */
+		for (j = 0; j < 3; ++j) {
+			int val = (pixel >> (16 - 8*j)) & 0xff;
+			int ref = 255 * color[j];
+
+			if (abs(val - ref) > 255 / SCENE_WIDTH + 1) {
+				++bad;
+				break;
+			}
+		}
+	}
+
+	return bad;
+}
+
+/**
+ * Renders quad textured with ARGB8888 texture.
+ * @param st Scene state.
+ * @return Count of pixels not matching texels.
+ */
+static unsigned int sceneTexture(sceneState *st)
+{
+	uint32_t *texels = (uint32_t *)st->texels;
+	unsigned int i;
+
+	for (i = 0; i < SCENE_TEX_SIZE * SCENE_TEX_SIZE; ++i)
+		texels[i] = sceneTexelColor(i);
+
+	sceneSetupTexture(st, FGTU_TSTA_TEXTURE_FORMAT_8888);
+	sceneDrawQuad(st, NULL, 1);
+	fimgFinish(st->ctx);
+
+	return sceneCheckTexels(st);
+}
+
+/**
+ * Renders quad textured with 4bpp paletted texture, laid out like the
+ * driver stores GL_PALETTE4_* images (first texel in low nibble).
+ * @param st Scene state.
+ * @return Count of pixels not matching texels.
+ */
+static unsigned int scenePalette4(sceneState *st)
+{
+	uint32_t palette[SCENE_TEX_SIZE * SCENE_TEX_SIZE];
+	unsigned int i;
+
+	/* Index of each texel selects palette entry of its color */
+	for (i = 0; i < SCENE_TEX_SIZE * SCENE_TEX_SIZE; ++i)
+		palette[i] = sceneTexelColor(i);
+	for (i = 0; i < SCENE_TEX_SIZE * SCENE_TEX_SIZE / 2; ++i)
+		st->texels[i] = (2*i) | ((2*i + 1) << 4);
+
+	sceneSetupTexture(st, FGTU_TSTA_TEXTURE_FORMAT_4BPP);
+	fimgSetTexPalette(st->tex, FGTU_TSTA_PAL_TEX_FORMAT_8888,
+						palette, NELEM(palette));
+	sceneDrawQuad(st, NULL, 1);
+	fimgFinish(st->ctx);
+
+	return sceneCheckTexels(st);
+}
+
+typedef struct {
+	const char *name;
+	unsigned int (*render)(sceneState *st);
+} fimgScene;
+
+static const fimgScene scenes[] = {
+	{ "gouraud", sceneGouraud },
+	{ "texture", sceneTexture },
+	{ "palette4", scenePalette4 },
+};
+
+/**
+ * Writes rendered image as binary PPM file.
+ * @param st Scene state.
+ * @param path Path of the file.
+ * @return 0 on success, 1 on failure.
+ */
+static int sceneWriteImage(const sceneState *st, const char *path)
+{
+	FILE *file;
+	unsigned int i;
+
+	file = fopen(path, "wb");
+	if (!file) {
+		fprintf(stderr, "scenes: could not create %s\n", path);
+		return 1;
+	}
+
+	fprintf(file, "P6\n%u %u\n255\n", SCENE_WIDTH, SCENE_HEIGHT);
+	for (i = 0; i < SCENE_WIDTH * SCENE_HEIGHT; ++i) {
+		fputc((st->color[i] >> 16) & 0xff, file);
+		fputc((st->color[i] >> 8) & 0xff, file);
+		fputc(st->color[i] & 0xff, file);
+	}
+
+	fclose(file);
+	return 0;
+}
+
+/**
+ * Compares rendered image with golden image stored as binary PPM file.
+ * @param st Scene state.
+ * @param path Path of the golden image.
+ * @return Count of differing pixels or -1 if golden image is invalid.
+ */
+static int sceneCompareImage(const sceneState *st, const char *path)
+{
+	unsigned int width, height, max, i, j;
+	uint8_t rgb[3];
+	FILE *file;
+	int bad = 0;
+
+	file = fopen(path, "rb");
+	if (!file) {
+		fprintf(stderr, "scenes: could not open %s\n", path);
+		return -1;
+	}
+
+	if (fscanf(file, "P6 %u %u %u", &width, &height, &max) != 3
+	    || fgetc(file) == EOF || width != SCENE_WIDTH
+	    || height != SCENE_HEIGHT || max != 255) {
+		fprintf(stderr, "scenes: %s is not a %ux%u PPM image\n",
+					path, SCENE_WIDTH, SCENE_HEIGHT);
+		fclose(file);
+		return -1;
+	}
+
+	for (i = 0; i < SCENE_WIDTH * SCENE_HEIGHT; ++i) {
+		if (fread(rgb, sizeof(rgb), 1, file) != 1) {
+			bad = -1;
+			break;
+		}
+
+		for (j = 0; j < 3; ++j) {
+			int val = (st->color[i] >> (16 - 8*j)) & 0xff;
+
+			if (abs(val - rgb[j]) > SCENE_TOLERANCE) {
+				++bad;
+				break;
+			}
+		}
+	}
+
+	fclose(file);
+	return bad;
+}
+
+/**
+ * Renders scene with the simulator backend and checks the image.
+ * @param scene Scene to render.
+ * @param output Directory to write the image to or NULL.
+ * @param golden Directory with golden images or NULL.
+ * @return 0 on success, 1 on failure.
+ */
+static int renderScene(const fimgScene *scene,
+				const char *output, const char *golden)
+{
+	char path[256];
+	sceneState *st;
+	unsigned long colorAddr;
+	unsigned int i, bad;
+	int diff = 0;
+	int ret = 0;
+
+	st = calloc(1, sizeof(*st));
+	if (!st)
+		return 1;
+
+	st->ctx = createContext("sim");
+	if (!st->ctx) {
+		free(st);
+		return 1;
+	}
+
+	colorAddr = fimgSimMapMemory(0, st->color, sizeof(st->color));
+	st->texAddr = fimgSimMapMemory(0, st->texels, sizeof(st->texels));
+
+	/* Image rows are stored from top, like window surfaces */
+	fimgSetFrameBufSize(st->ctx, SCENE_WIDTH, SCENE_HEIGHT, 1);
+	fimgSetFrameBufParams(st->ctx, 0, FGPF_COLOR_MODE_8888);
+	fimgSetColorBufBaseAddr(st->ctx, colorAddr);
+	fimgSetViewportParams(st->ctx, 0, 0, SCENE_WIDTH, SCENE_HEIGHT);
+	fimgSetXClip(st->ctx, 0, SCENE_WIDTH);
+	fimgSetYClip(st->ctx, 0, SCENE_HEIGHT);
+
+	fimgLoadMatrix(st->ctx, FGFP_MATRIX_TRANSFORM, sceneIdentity);
+	fimgLoadMatrix(st->ctx, FGFP_MATRIX_MODELVIEW, sceneIdentity);
+	fimgLoadMatrix(st->ctx, FGFP_MATRIX_LIGHTING, NULL);
+	for (i = 0; i < FIMG_NUM_TEXTURE_UNITS; ++i) {
+		fimgLoadMatrix(st->ctx, FGFP_MATRIX_TEXTURE(i), NULL);
+		fimgCompatSetTextureFunc(st->ctx, i, FGFP_TEXFUNC_NONE);
+	}
+
+	bad = scene->render(st);
+
+	if (output) {
+		snprintf(path, sizeof(path), "%s/%s.ppm", output, scene->name);
+		ret |= sceneWriteImage(st, path);
+	}
+
+	if (golden) {
+		snprintf(path, sizeof(path), "%s/%s.ppm", golden, scene->name);
+		diff = sceneCompareImage(st, path);
+	}
+
+	printf("scenes: %s: %u unexpected pixels", scene->name, bad);
+	if (golden)
+		printf(", %d pixels differ from golden image", diff);
+	printf("\n");
+
+	if (bad || diff) {
+		fprintf(stderr, "scenes: %s rendered incorrectly\n",
+								scene->name);
+		ret = 1;
+	}
+
+	fimgDestroyContext(st->ctx);
+	if (st->tex)
+		fimgDestroyTexture(st->tex);
+	fimgSimUnmapMemory(st->texAddr);
+	fimgSimUnmapMemory(colorAddr);
+	free(st);
+	return ret;
+}
+
+/**
+ * Checks images of fixed pipeline scenes rendered by the simulator, against
+ * expected pixel colors and optionally against golden images.
+ * @return 0 on success, 1 on failure.
+ */
+static int checkScenes(void)
+{
+	const char *output = getenv("FIMG_CHECK_OUTPUT");
+	const char *golden = getenv("FIMG_CHECK_GOLDEN");
+	unsigned int i;
+	int ret = 0;
+
+	for (i = 0; i < NELEM(scenes); ++i)
+		ret |= renderScene(&scenes[i], output, golden);
+
+	return ret;
+}
+
+typedef struct {
+	const char *name;
+	int (*run)(void);
+} fimgCheck;
+
+static const fimgCheck checks[] = {
+	{ "restore", checkRestore },
+	{ "lease", checkLease },
+	{ "scenes", checkScenes },
+};
+
+#define NUM_CHECKS	(sizeof(checks) / sizeof(checks[0]))
+
+static void usage(const char *name)
+{
+	unsigned int i;
+
+	fprintf(stderr, "Usage: %s [check...]\nChecks:", name);
+	for (i = 0; i < NUM_CHECKS; ++i)
+		fprintf(stderr, " %s", checks[i].name);
+	fprintf(stderr, "\n");
+}
+
+int main(int argc, char **argv)
+{
+	unsigned int i;
+	int failed = 0;
+	int arg;
+
+	for (arg = 1; arg < argc; ++arg) {
+		for (i = 0; i < NUM_CHECKS; ++i)
+			if (!strcmp(argv[arg], checks[i].name))
+				break;
+
+		if (i == NUM_CHECKS) {
+			usage(argv[0]);
+			return 1;
+		}
+	}
+
+	for (i = 0; i < NUM_CHECKS; ++i) {
+		if (argc > 1) {
+			for (arg = 1; arg < argc; ++arg)
+				if (!strcmp(argv[arg], checks[i].name))
+					break;
+			if (arg == argc)
+				continue;
+		}
+
+		failed |= checks[i].run();
+	}
+
+	printf("%s\n", failed ? "FAILED" : "OK");
+	return failed;
+}
+
+#else /* FIMG_IO_BACKEND */
+
+int main(int argc, char **argv)
+{
+	fprintf(stderr, "%s: libfimg built without FIMG_IO_BACKEND\n", argv[0]);
+	return 1;
+}
+
+#endif /* FIMG_IO_BACKEND */
@@ -0,0 +1,484 @@
+/*
+ * fimg/fimgreplay.c
+ *
+ * SAMSUNG S3C6410 FIMG-3DSE TRACE REPLAY TOOL
+ *
+ * Copyrights:	2010 by Tomasz Figa < tomasz.figa at gmail.com >
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifdef HAVE_CONFIG_H
+# include <config.h>
+#endif
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include <linux/android_pmem.h>
+
+#include "fimg_private.h"
+#include "fimg_regs.h"
+
+/*
+ * Replays a trace captured with FIMG_TRACE through libfimg, to compare
+ * timing of the same hardware command sequence between driver or kernel
+ * versions. Addresses of color, depth and texture buffers are redirected to
+ * a scratch buffer owned by the tool, so the replay never touches memory of
+ * other processes. Rendered images are meaningless, only timing is.
+ *
+ * With -s the trace is replayed with direct submission and then with threaded
+ * submission (FIMG_THREADED_SUBMIT), to compare their throughput.
+ */
+
+/* Default size of scratch buffer (MiB) */
+#define REPLAY_SCRATCH_SIZE	(16)
+
+typedef struct {
+	/* Trace */
+	const uint32_t *data;
+	size_t words;
+	/* Scratch buffer */
+	int fd;
+	void *vaddr;
+	unsigned long paddr;
+	unsigned long size;
+	/* Statistics */
+	unsigned int frames;
+	uint64_t recordedFlush;
+	uint64_t replayedFlush;
+	uint64_t recordedLock;
+	uint64_t replayedLock;
+	int verbose;
+} replayState;
+
+static uint64_t now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static inline uint64_t timestamp(const uint32_t *rec)
+{
+	return rec[0] | ((uint64_t)rec[1] << 32);
+}
+
+/**
+ * Loads trace file to memory.
+ * @param r Replay state.
+ * @param path Path of trace file.
+ * @return 0 on success, negative on error.
+ */
+static int loadTrace(replayState *r, const char *path)
+{
+	struct stat st;
+	uint32_t *data;
+	ssize_t ret;
+	size_t len;
+	int fd;
+
+	fd = open(path, O_RDONLY);
+	if (fd < 0 || fstat(fd, &st)) {
+		fprintf(stderr, "Could not open %s (%s)\n", path, strerror(errno));
+		return -1;
+	}
+
+	data = malloc(st.st_size);
+	if (!data) {
+		close(fd);
+		return -1;
+	}
+
+	for (len = 0; len < (size_t)st.st_size; len += ret) {
+		ret = read(fd, (char *)data + len, st.st_size - len);
+		if (ret <= 0) {
+			fprintf(stderr, "Could not read %s\n", path);
+			close(fd);
+			free(data);
+			return -1;
+		}
+	}
+
+	close(fd);
+
+	if (st.st_size < 8 || data[0] != FIMG_TRACE_MAGIC
+	    || data[1] != FIMG_TRACE_VERSION) {
+		fprintf(stderr, "%s is not a supported trace file\n", path);
+		free(data);
+		return -1;
+	}
+
+	r->data = data + 2;
+	r->words = st.st_size / sizeof(uint32_t) - 2;
+
+	return 0;
+}
+
+/**
+ * Allocates scratch buffer for render targets and textures.
+ * @param r Replay state.
+ * @return 0 on success, negative on error.
+ */
+static int allocScratch(replayState *r)
+{
+	struct pmem_region region;
+
+	r->fd = open("/dev/pmem_gpu1", O_RDWR, 0);
+	if (r->fd < 0) {
+#ifdef FIMG_IO_BACKEND
+		/* Use memory visible to simulator backend */
+		r->vaddr = calloc(1, r->size);
+		if (!r->vaddr)
+			return -1;
+		r->paddr = fimgSimMapMemory(0, r->vaddr, r->size);
+		return 0;
+#else
+		fprintf(stderr, "Could not open PMEM device (%s)\n",
+							strerror(errno));
+		return -1;
+#endif
+	}
+
+	r->vaddr = mmap(NULL, r->size, PROT_WRITE | PROT_READ,
+							MAP_SHARED, r->fd, 0);
+	if (r->vaddr == MAP_FAILED) {
+		fprintf(stderr, "PMEM allocation failed (%s)\n", strerror(errno));
+		close(r->fd);
+		return -1;
+	}
+
+	if (ioctl(r->fd, PMEM_GET_PHYS, &region) < 0) {
+		fprintf(stderr, "PMEM_GET_PHYS failed (%s)\n", strerror(errno));
+		munmap(r->vaddr, r->size);
+		close(r->fd);
+		return -1;
+	}
+	r->paddr = region.offset;
+
+	return 0;
+}
+
+static void freeScratch(replayState *r)
+{
+	if (r->fd < 0) {
+#ifdef FIMG_IO_BACKEND
+		fimgSimUnmapMemory(r->paddr);
+		free(r->vaddr);
+#endif
+		return;
+	}
+
+	munmap(r->vaddr, r->size);
+	close(r->fd);
+}
+
+/**
+ * Checks whether register holds address of a memory buffer.
+ * @param addr Register address.
+ * @return Non-zero if the register holds buffer address.
+ */
+static int isAddressRegister(uint32_t addr)
+{
+	if (addr == FGPF_CBADDR || addr == FGPF_DBADDR)
+		return 1;
+
+	if (addr >= FGTU_TBADD(0) && addr <= FGTU_TBADD(FGTU_NUM_UNITS - 1))
+		return (addr - FGTU_TBADD(0)) % 0x50 == 0;
+
+	if (addr >= FGTU_VTBADDR(0)
+	    && addr <= FGTU_VTBADDR(FGTU_NUM_VTX_UNITS - 1))
+		return (addr - FGTU_VTBADDR(0)) % 8 == 0;
+
+	return 0;
+}
+
+/**
+ * Redirects buffer address to scratch buffer. Buffers keep their offset
+ * modulo half of scratch size, to preserve alignment and let buffers of up to
+ * half of scratch size fit.
+ * @param r Replay state.
+ * @param val Recorded buffer address.
+ * @return Address inside scratch buffer.
+ */
+static uint32_t relocate(const replayState *r, uint32_t val)
+{
+	if (!val)
+		return 0;
+
+	return r->paddr + val % (r->size / 2);
+}
+
+/**
+ * Replays register write record.
+ * @param ctx Hardware context.
+ * @param r Replay state.
+ * @param rec Record payload.
+ * @param len Payload length in words.
+ */
+static void replayWrite(fimgContext *ctx, const replayState *r,
+				const uint32_t *rec, uint32_t len)
+{
+	volatile uint32_t *reg;
+	uint32_t addr = rec[0];
+	uint32_t i;
+
+	if (len == 2) {
+		if (isAddressRegister(addr))
+			fimgWrite(ctx, relocate(r, rec[1]), addr);
+		else
+			fimgWrite(ctx, rec[1], addr);
+		return;
+	}
+
+	reg = fimgBurstBegin(ctx, addr, len - 1);
+	for (i = 1; i < len; ++i, addr += 4) {
+		if (isAddressRegister(addr))
+			reg[i - 1] = relocate(r, rec[i]);
+		else
+			reg[i - 1] = rec[i];
+	}
+	fimgBurstEnd(ctx);
+}
+
+/**
+ * Replays the trace once.
+ * @param ctx Hardware context.
+ * @param r Replay state.
+ * @return Replay time in nanoseconds.
+ */
+static uint64_t replay(fimgContext *ctx, replayState *r)
+{
+	const uint32_t *rec = r->data;
+	const uint32_t *end = r->data + r->words;
+	uint64_t start = now();
+	uint64_t frameStart = start;
+	uint64_t recordedFrame = 0;
+	uint64_t t;
+	int locked = 0;
+
+	while (rec < end) {
+		uint32_t type = FIMG_TRACE_TYPE(rec[0]);
+		uint32_t len = FIMG_TRACE_LEN(rec[0]);
+		const uint32_t *p = rec + 1;
+
+		rec += len + 1;
+		if (rec > end) {
+			fprintf(stderr, "Trace is truncated\n");
+			break;
+		}
+
+		if (!locked && type != FIMG_TRACE_LOCK
+		    && type != FIMG_TRACE_FRAME) {
+			fimgAcquireHardwareLock(ctx);
+			locked = 1;
+		}
+
+		switch (type) {
+		case FIMG_TRACE_WRITE:
+			replayWrite(ctx, r, p, len);
+			break;
+		case FIMG_TRACE_POLL:
+			fimgPoll(ctx, p[0], p[1]);
+			break;
+		case FIMG_TRACE_FLUSH:
+			t = now();
+			fimgSelectiveFlush(ctx, p[0]);
+			r->replayedFlush += now() - t;
+			r->recordedFlush += p[3];
+			break;
+		case FIMG_TRACE_LOCK:
+			t = now();
+			if (!locked)
+				fimgAcquireHardwareLock(ctx);
+			r->replayedLock += now() - t;
+			r->recordedLock += p[3];
+			locked = 1;
+			break;
+		case FIMG_TRACE_UNLOCK:
+			fimgReleaseHardwareLock(ctx);
+			locked = 0;
+			break;
+		case FIMG_TRACE_FRAME:
+			t = now();
+			if (r->verbose && recordedFrame)
+				printf("frame %u: recorded %llu us, "
+					"replayed %llu us\n", r->frames,
+					(unsigned long long)
+					(timestamp(p) - recordedFrame) / 1000,
+					(unsigned long long)
+					(t - frameStart) / 1000);
+			recordedFrame = timestamp(p);
+			frameStart = t;
+			++r->frames;
+			break;
+		default:
+			fprintf(stderr, "Unknown record type %u\n", type);
+			break;
+		}
+	}
+
+	if (locked)
+		fimgReleaseHardwareLock(ctx);
+
+	/* Takes the hardware lock by itself */
+	fimgFinish(ctx);
+
+	return now() - start;
+}
+
+/**
+ * Replays the trace given number of times using a new hardware context.
+ * @param r Replay state.
+ * @param loops Count of replays.
+ * @return Average replay time in nanoseconds, 0 on error.
+ */
+static uint64_t replayLoops(replayState *r, unsigned int loops)
+{
+	fimgContext *ctx;
+	uint64_t total = 0;
+	unsigned int i;
+
+	ctx = fimgCreateContext();
+	if (!ctx) {
+		fprintf(stderr, "Could not create hardware context\n");
+		return 0;
+	}
+
+	r->frames = 0;
+	r->recordedFlush = r->replayedFlush = 0;
+	r->recordedLock = r->replayedLock = 0;
+
+	for (i = 0; i < loops; ++i) {
+		uint64_t time = replay(ctx, r);
+
+		printf("loop %u: %llu us\n", i, (unsigned long long)time / 1000);
+		total += time;
+	}
+
+	printf("%u loops, %u frames, %llu us per loop, %llu frames/s\n",
+			loops, r->frames / loops,
+			(unsigned long long)total / loops / 1000,
+			(unsigned long long)r->frames * 1000000000 / (total | 1));
+	printf("flush wait: recorded %llu us, replayed %llu us per loop\n",
+			(unsigned long long)r->recordedFlush / loops / 1000,
+			(unsigned long long)r->replayedFlush / loops / 1000);
+	printf("lock wait: recorded %llu us, replayed %llu us per loop\n",
+			(unsigned long long)r->recordedLock / loops / 1000,
+			(unsigned long long)r->replayedLock / loops / 1000);
+
+	fimgDestroyContext(ctx);
+	return total / loops;
+}
+
+/**
+ * Replays the trace with direct and then with threaded submission.
+ * @param r Replay state.
+ * @param loops Count of replays in each mode.
+ * @return 0 on success, 1 on error.
+ */
+static int compareSubmission(replayState *r, unsigned int loops)
+{
+#ifdef FIMG_THREADED_SUBMIT
+	uint64_t direct, threaded;
+
+	printf("direct submission:\n");
+	setenv("FIMG_THREADED_SUBMIT", "0", 1);
+	direct = replayLoops(r, loops);
+
+	printf("threaded submission:\n");
+	setenv("FIMG_THREADED_SUBMIT", "1", 1);
+	threaded = replayLoops(r, loops);
+
+	if (!direct || !threaded)
+		return 1;
+
+	printf("threaded submission: %llu%% of direct replay time\n",
+				(unsigned long long)threaded * 100 / direct);
+	return 0;
+#else
+	fprintf(stderr, "libfimg built without FIMG_THREADED_SUBMIT\n");
+	return 1;
+#endif
+}
+
+static void usage(const char *name)
+{
+	fprintf(stderr, "Usage: %s [-n loops] [-m scratch MiB] [-s] [-v] "
+							"trace\n", name);
+}
+
+int main(int argc, char **argv)
+{
+	replayState r;
+	unsigned int loops = 1;
+	int compare = 0;
+	int ret;
+	int opt;
+
+	memset(&r, 0, sizeof(r));
+	r.size = REPLAY_SCRATCH_SIZE << 20;
+
+	while ((opt = getopt(argc, argv, "n:m:sv")) != -1) {
+		switch (opt) {
+		case 'n':
+			loops = strtoul(optarg, NULL, 0);
+			break;
+		case 'm':
+			r.size = strtoul(optarg, NULL, 0) << 20;
+			break;
+		case 's':
+			compare = 1;
+			break;
+		case 'v':
+			r.verbose = 1;
+			break;
+		default:
+			usage(argv[0]);
+			return 1;
+		}
+	}
+
+	if (optind != argc - 1 || !loops || !r.size) {
+		usage(argv[0]);
+		return 1;
+	}
+
+	if (loadTrace(&r, argv[optind]))
+		return 1;
+
+	if (allocScratch(&r)) {
+		free((void *)(r.data - 2));
+		return 1;
+	}
+
+	if (compare)
+		ret = compareSubmission(&r, loops);
+	else
+		ret = !replayLoops(&r, loops);
+
+	freeScratch(&r);
+	free((void *)(r.data - 2));
+
+	return ret;
+}
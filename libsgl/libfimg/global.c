@@ -65,6 +65,81 @@ uint32_t fimgGetPipelineStatus(fimgContext *ctx)
 	return fimgRead(ctx, FGGB_PIPESTATE);
 }
 
+#ifdef FIMG_PERF_COUNTERS
+/**
+ * Accounts finished wait for hardware in latency histogram.
+ * @param ctx Hardware context.
+ * @param type Type of the wait (FIMG_WAIT_*).
+ * @param start Time when the wait started.
+ * @param slept Indicates that the wait did not finish while spinning.
+ * @return Duration of the wait in microseconds.
+ */
+static uint32_t recordWait(fimgContext *ctx, unsigned int type,
+						uint64_t start, int slept)
+{
+	fimgWaitStats *stats = &ctx->waitStats[type];
+	uint32_t time = fimgPerfTime() - start;
+	unsigned int bucket = time ? 32 - __builtin_clz(time) : 0;
+
+	if (bucket >= FIMG_WAIT_BUCKETS)
+		bucket = FIMG_WAIT_BUCKETS - 1;
+
+	++stats->waits;
+	if (slept)
+		++stats->slept;
+	++stats->histogram[bucket];
+
+	return time;
+}
+#endif
+
+/**
+ * Flushes selected parts of graphics pipeline, if they are busy.
+ * The pipeline state is polled for a while first, because short operations
+ * finish sooner than the kernel wakes up the process from the interrupt.
+ * @param ctx Hardware context.
+ * @param mask Mask of pipeline parts to be flushed.
+ * @return 0 on success, negative on error.
+ */
+static int flushPipeline(fimgContext *ctx, uint32_t mask)
+{
+	unsigned int spins = FIMG_WAIT_SPINS;
+	int ret = 0;
+#ifdef FIMG_PERF_COUNTERS
+	uint64_t start;
+	int slept = 0;
+#endif
+
+#ifdef FIMG_THREADED_SUBMIT
+	if (ctx->stream) {
+		fimgStreamFlush(ctx->stream, mask);
+		return 0;
+	}
+#endif
+	if (!(fimgRead(ctx, FGGB_PIPESTATE) & mask))
+		return 0;
+
+#ifdef FIMG_PERF_COUNTERS
+	start = fimgPerfTime();
+#endif
+	while (fimgRead(ctx, FGGB_PIPESTATE) & mask) {
+		if (!spins) {
+			/* Sleep until interrupt of requested pipeline parts */
+			ret = fimgWaitForFlush(ctx, mask);
+#ifdef FIMG_PERF_COUNTERS
+			slept = 1;
+#endif
+			break;
+		}
+		--spins;
+	}
+#ifdef FIMG_PERF_COUNTERS
+	recordWait(ctx, FIMG_WAIT_PIPELINE, start, slept);
+#endif
+
+	return ret;
+}
+
 /**
  * Flushes complete graphics pipeline.
  * (Must be called with hardware lock.)
@@ -73,12 +148,7 @@ uint32_t fimgGetPipelineStatus(fimgContext *ctx)
  */
 int fimgFlush(fimgContext *ctx)
 {
-	/* Return if already flushed */
-	if((fimgRead(ctx, FGGB_PIPESTATE) & FGHI_PIPELINE_ALL) == 0)
-		return 0;
-
-	/* Flush whole pipeline */
-	return fimgWaitForFlush(ctx, FGHI_PIPELINE_ALL);
+	return fimgSelectiveFlush(ctx, FGHI_PIPELINE_ALL);
 }
 
 /**
@@ -90,10 +160,41 @@ int fimgFlush(fimgContext *ctx)
  */
 int fimgSelectiveFlush(fimgContext *ctx, uint32_t mask)
 {
-	if (fimgRead(ctx, FGGB_PIPESTATE) & mask)
-		return fimgWaitForFlush(ctx, mask);
+#ifdef FIMG_PERF_COUNTERS
+	if (mask == FGHI_PIPELINE_ALL)
+		++ctx->perf.fullFlushes;
+	else
+		++ctx->perf.selectiveFlushes;
+#endif
+#ifdef FIMG_TRACE
+	if (ctx->trace) {
+		uint64_t start = fimgTraceTime();
+		int ret = flushPipeline(ctx, mask);
+
+		fimgTraceFlush(ctx->trace, mask, start);
+		return ret;
+	}
+#endif
+	return flushPipeline(ctx, mask);
+}
 
-	return 0;
+/**
+ * Waits until selected cache operations finish.
+ * (Must be called with hardware lock.)
+ * @param ctx Hardware context.
+ * @param mask Mask of cache control bits to wait for.
+ */
+static void pollCache(fimgContext *ctx, uint32_t mask)
+{
+#ifdef FIMG_PERF_COUNTERS
+	uint64_t start = fimgPerfTime();
+	int yielded = fimgPoll(ctx, FGGB_CACHECTL, mask);
+
+	ctx->perf.cacheWaitTime += recordWait(ctx, FIMG_WAIT_CACHE,
+							start, yielded);
+#else
+	fimgPoll(ctx, FGGB_CACHECTL, mask);
+#endif
 }
 
 /**
@@ -116,7 +217,7 @@ int fimgInvalidateCache(fimgContext *ctx,
 
 	fimgWrite(ctx, ctl.val, FGGB_CACHECTL); // start clearing the cache
 
-	while(fimgRead(ctx, FGGB_CACHECTL) & ctl.val);
+	pollCache(ctx, ctl.val);
 
 	return 0;
 }
@@ -159,7 +260,7 @@ int fimgWaitForCacheFlush(fimgContext *ctx,
 	ctl.ccflush = ccflush;
 	ctl.zcflush = zcflush;
 
-	while(fimgRead(ctx, FGGB_CACHECTL) & ctl.val);
+	pollCache(ctx, ctl.val);
 
 	return 0;
 }
@@ -177,6 +278,13 @@ void fimgFinish(fimgContext *ctx)
 	fimgSelectiveFlush(ctx, FGHI_PIPELINE_CCACHE);
 	fimgWaitForCacheFlush(ctx, 3, 3);
 	fimgPutHardware(ctx);
+#ifdef FIMG_LOCK_LEASE
+	fimgEndHardwareLease(ctx);
+#endif
+#ifdef FIMG_THREADED_SUBMIT
+	if (ctx->stream)
+		fimgStreamSync(ctx->stream);
+#endif
 }
 
 /**
@@ -194,13 +194,18 @@ static unsigned int calculateBatchSize(fimgArray *arrays, int count)
  */
 static void fillVertexBuffer(fimgContext *ctx)
 {
-	volatile uint32_t *reg =
-			(volatile uint32_t *)(ctx->base + FGHI_VB_ENTRY);
+	volatile uint32_t *reg;
 	uint32_t *data = (uint32_t *)ctx->vertexData;
 	unsigned count = (ctx->vertexDataSize + 31) / 32;
+	FIMG_PROFILE_BEGIN(fill);
 
+#ifdef FIMG_PERF_COUNTERS
+	ctx->perf.vertexBytes += 32*count;
+#endif
 	fimgWrite(ctx, 0, FGHI_VBADDR);
 
+	reg = fimgBurstBegin(ctx, FGHI_VB_ENTRY, 8*count);
+#ifdef __arm__
 	asm volatile (
 		"1:\n\t"
 		"ldmia %1!, {r0-r7}\n\t"
@@ -211,6 +216,13 @@ static void fillVertexBuffer(fimgContext *ctx)
 		: "r"(reg), "r"(data), "r"(count)
 		: "r0", "r1", "r2", "r3", "r4", "r5", "r6", "r7"
 	);
+#else
+	count *= 8;
+	while (count--)
+		*(reg++) = *(data++);
+#endif
+	fimgBurstEnd(ctx);
+	FIMG_PROFILE_END(fill, "fillVertexBuffer");
 }
 
 #define BUF_ADDR_32(buf, offs)	\
@@ -1584,6 +1596,10 @@ static const struct primitiveHandler primitiveHandler[FGPE_PRIMITIVE_MAX] = {
 static inline void drawAutoinc(fimgContext *ctx,
 				uint32_t first, uint32_t count)
 {
+#ifdef FIMG_PERF_COUNTERS
+	++ctx->perf.batches;
+	ctx->perf.vertices += count;
+#endif
 	fimgWrite(ctx, count, FGHI_FIFO_ENTRY);
 	fimgWrite(ctx, first, FGHI_FIFO_ENTRY);
 }
@@ -1652,10 +1668,15 @@ void fimgDrawArrays(fimgContext *ctx, unsigned int mode,
 	}
 
 	/* Prepare first batch without waiting for hardware */
+	FIMG_PROFILE_BEGIN(pack);
 	copied = primitiveHandler[mode].direct(ctx, arrays, &first, &count);
+	FIMG_PROFILE_END(pack, "packVertices");
 	if (!copied)
 		return;
 
+#ifdef FIMG_PERF_COUNTERS
+	++ctx->perf.draws;
+#endif
 	/* Get hardware */
 	fimgGetHardware(ctx);
 	fimgFlush(ctx);
@@ -1673,8 +1694,10 @@ void fimgDrawArrays(fimgContext *ctx, unsigned int mode,
 		fillVertexBuffer(ctx);
 		setupVertexBuffer(ctx);
 		drawAutoinc(ctx, 0, copied);
+		FIMG_PROFILE_BEGIN(repack);
 		copied = primitiveHandler[mode].direct(ctx,
 							arrays, &first, &count);
+		FIMG_PROFILE_END(repack, "packVertices");
 	} while (copied);
 
 	/* Release hardware */
@@ -1713,11 +1736,16 @@ void fimgDrawElementsUByteIdx(fimgContext *ctx, unsigned int mode,
 	}
 
 	/* Prepare first batch without waiting for hardware */
+	FIMG_PROFILE_BEGIN(pack);
 	copied = primitiveHandler[mode].indexed_8(ctx,
 						arrays, indices, &pos, &count);
+	FIMG_PROFILE_END(pack, "packVertices");
 	if (!copied)
 		return;
 
+#ifdef FIMG_PERF_COUNTERS
+	++ctx->perf.draws;
+#endif
 	/* Get hardware */
 	fimgGetHardware(ctx);
 	fimgFlush(ctx);
@@ -1735,8 +1763,10 @@ void fimgDrawElementsUByteIdx(fimgContext *ctx, unsigned int mode,
 		fillVertexBuffer(ctx);
 		setupVertexBuffer(ctx);
 		drawAutoinc(ctx, 0, copied);
+		FIMG_PROFILE_BEGIN(repack);
 		copied = primitiveHandler[mode].indexed_8(ctx,
 						arrays, indices, &pos, &count);
+		FIMG_PROFILE_END(repack, "packVertices");
 	} while (copied);
 
 	/* Release hardware */
@@ -1775,11 +1805,16 @@ void fimgDrawElementsUShortIdx(fimgContext *ctx, unsigned int mode,
 	}
 
 	/* Prepare first batch without waiting for hardware */
+	FIMG_PROFILE_BEGIN(pack);
 	copied = primitiveHandler[mode].indexed_16(ctx,
 						arrays, indices, &pos, &count);
+	FIMG_PROFILE_END(pack, "packVertices");
 	if (!copied)
 		return;
 
+#ifdef FIMG_PERF_COUNTERS
+	++ctx->perf.draws;
+#endif
 	/* Get hardware */
 	fimgGetHardware(ctx);
 	fimgFlush(ctx);
@@ -1797,8 +1832,10 @@ void fimgDrawElementsUShortIdx(fimgContext *ctx, unsigned int mode,
 		fillVertexBuffer(ctx);
 		setupVertexBuffer(ctx);
 		drawAutoinc(ctx, 0, copied);
+		FIMG_PROFILE_BEGIN(repack);
 		copied = primitiveHandler[mode].indexed_16(ctx,
 						arrays, indices, &pos, &count);
+		FIMG_PROFILE_END(repack, "packVertices");
 	} while (copied);
 
 	/* Release hardware */
@@ -0,0 +1,281 @@
+/*
+ * fimg/lease.c
+ *
+ * SAMSUNG S3C6410 FIMG-3DSE HARDWARE LOCK LEASING
+ *
+ * Copyrights:	2010 by Tomasz Figa < tomasz.figa at gmail.com >
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifdef HAVE_CONFIG_H
+# include <config.h>
+#endif
+
+#include "fimg_private.h"
+
+#ifdef FIMG_LOCK_LEASE
+
+#include <pthread.h>
+#include <string.h>
+#include <time.h>
+
+/*
+ * Instead of releasing the hardware lock in fimgPutHardware, the context
+ * keeps it leased, so the next fimgGetHardware can take it back without
+ * any system call. The lease is ended explicitly at frame boundaries
+ * (glFlush, glFinish, eglSwapBuffers) or by the lease thread when no draw
+ * has been made for whole lease timeout, so other processes cannot be locked
+ * out for long. The kernel driver gives no way to find out whether another
+ * process is waiting for the lock, so the timeout also bounds their latency.
+ *
+ * While the lock is leased, the thread using the context does not submit
+ * anything, because it would have to resume the lease first, so the lease
+ * thread can release the lock through the command stream under the lease
+ * mutex. Frame marks can be recorded into the trace without the lock, so
+ * the release is recorded by the thread using the context when it resumes
+ * or ends the lease.
+ *
+ * The lease thread wakes up once per timeout while the lease is used and
+ * sleeps indefinitely otherwise, so fimgPutHardware has to wake it up only
+ * after an idle period.
+ */
+
+struct _fimgLease {
+	fimgContext *ctx;
+	pthread_mutex_t mutex;
+	pthread_cond_t cond;
+	pthread_t thread;
+	/* Lease timeout (ms) */
+	unsigned int timeout;
+	/* Lock is held while the context is not using the hardware */
+	int leased;
+	/* Count of lease starts, to detect activity during timeout */
+	uint32_t seq;
+	/* Lease thread is sleeping without timeout */
+	int idle;
+	int exit;
+#ifdef FIMG_TRACE
+	/* Time of release by lease thread, not recorded into trace yet */
+	uint64_t unlockTime;
+#endif
+};
+
+/**
+ * Releases leased hardware lock by the thread using the context.
+ * (Must be called with lease mutex held.)
+ * @param l Hardware lock lease.
+ */
+static void leaseEnd(fimgLease *l)
+{
+	if (!l->leased)
+		return;
+
+	fimgReleaseHardwareLock(l->ctx);
+	l->leased = 0;
+}
+
+/**
+ * Releases leased hardware lock by the lease thread, after timeout.
+ * (Must be called with lease mutex held.)
+ * @param l Hardware lock lease.
+ */
+static void leaseExpire(fimgLease *l)
+{
+#ifdef FIMG_TRACE
+	if (l->ctx->trace)
+		l->unlockTime = fimgTraceTime();
+#endif
+	fimgReleaseHardwareLockUntraced(l->ctx);
+	l->leased = 0;
+}
+
+/**
+ * Records release of the lock done by the lease thread into the trace.
+ * (Must be called with lease mutex held, by the thread using the context.)
+ * @param l Hardware lock lease.
+ */
+static inline void leaseTraceExpiry(fimgLease *l)
+{
+#ifdef FIMG_TRACE
+	if (!l->unlockTime)
+		return;
+
+	fimgTraceUnlock(l->ctx->trace, l->unlockTime);
+	l->unlockTime = 0;
+#endif
+}
+
+/**
+ * Waits for lease timeout or a wake up.
+ * (Must be called with lease mutex held.)
+ * @param l Hardware lock lease.
+ */
+static void leaseWait(fimgLease *l)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_REALTIME, &ts);
+	ts.tv_sec += l->timeout / 1000;
+	ts.tv_nsec += (l->timeout % 1000) * 1000000;
+	if (ts.tv_nsec >= 1000000000) {
+		ts.tv_nsec -= 1000000000;
+		++ts.tv_sec;
+	}
+
+	pthread_cond_timedwait(&l->cond, &l->mutex, &ts);
+}
+
+/**
+ * Main loop of lease thread.
+ * @param arg Hardware lock lease.
+ * @return Always NULL.
+ */
+static void *leaseThread(void *arg)
+{
+	fimgLease *l = arg;
+	uint32_t seq;
+
+	pthread_mutex_lock(&l->mutex);
+
+	while (!l->exit) {
+		if (!l->leased) {
+			l->idle = 1;
+			pthread_cond_wait(&l->cond, &l->mutex);
+			l->idle = 0;
+			continue;
+		}
+
+		seq = l->seq;
+		leaseWait(l);
+
+		/* No draw during whole timeout */
+		if (l->leased && l->seq == seq)
+			leaseExpire(l);
+	}
+
+	pthread_mutex_unlock(&l->mutex);
+
+	return NULL;
+}
+
+/**
+ * Starts leasing of the hardware lock for a context.
+ * Lease timeout can be overridden by FIMG_LOCK_LEASE environment variable,
+ * 0 disables leasing.
+ * @param ctx Hardware context.
+ * @return Hardware lock lease or NULL if leasing is disabled or failed.
+ */
+fimgLease *fimgLeaseCreate(fimgContext *ctx)
+{
+	unsigned int timeout = FIMG_LOCK_LEASE;
+	const char *env = getenv("FIMG_LOCK_LEASE");
+	fimgLease *l;
+
+	if (env)
+		timeout = atoi(env);
+	if (!timeout)
+		return NULL;
+
+	l = calloc(1, sizeof(*l));
+	if (!l)
+		return NULL;
+
+	l->ctx = ctx;
+	l->timeout = timeout;
+	pthread_mutex_init(&l->mutex, NULL);
+	pthread_cond_init(&l->cond, NULL);
+
+	if (pthread_create(&l->thread, NULL, leaseThread, l)) {
+		LOGW("Failed to create lease thread, not leasing hardware lock.");
+		pthread_cond_destroy(&l->cond);
+		pthread_mutex_destroy(&l->mutex);
+		free(l);
+		return NULL;
+	}
+
+	return l;
+}
+
+/**
+ * Stops leasing of the hardware lock, releasing it if leased.
+ * @param l Hardware lock lease.
+ */
+void fimgLeaseDestroy(fimgLease *l)
+{
+	pthread_mutex_lock(&l->mutex);
+	leaseTraceExpiry(l);
+	leaseEnd(l);
+	l->exit = 1;
+	pthread_cond_signal(&l->cond);
+	pthread_mutex_unlock(&l->mutex);
+
+	pthread_join(l->thread, NULL);
+
+	pthread_cond_destroy(&l->cond);
+	pthread_mutex_destroy(&l->mutex);
+	free(l);
+}
+
+/**
+ * Keeps the hardware lock leased after the context stops using hardware.
+ * @param l Hardware lock lease.
+ */
+void fimgLeaseStart(fimgLease *l)
+{
+	pthread_mutex_lock(&l->mutex);
+	l->leased = 1;
+	++l->seq;
+	if (l->idle)
+		pthread_cond_signal(&l->cond);
+	pthread_mutex_unlock(&l->mutex);
+}
+
+/**
+ * Takes back the hardware lock if still leased.
+ * @param l Hardware lock lease.
+ * @return Non-zero if the lock is held, zero if it must be acquired.
+ */
+int fimgLeaseResume(fimgLease *l)
+{
+	int leased;
+
+	pthread_mutex_lock(&l->mutex);
+	leaseTraceExpiry(l);
+	leased = l->leased;
+	l->leased = 0;
+	pthread_mutex_unlock(&l->mutex);
+
+	return leased;
+}
+
+/**
+ * Releases the hardware lock kept leased by a context, letting other
+ * processes use the hardware. Should be called at frame boundaries.
+ * @param ctx Hardware context.
+ */
+void fimgEndHardwareLease(fimgContext *ctx)
+{
+	fimgLease *l = ctx->lease;
+
+	if (!l)
+		return;
+
+	pthread_mutex_lock(&l->mutex);
+	leaseTraceExpiry(l);
+	leaseEnd(l);
+	pthread_mutex_unlock(&l->mutex);
+}
+
+#endif /* FIMG_LOCK_LEASE */
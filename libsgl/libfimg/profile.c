@@ -0,0 +1,272 @@
+/*
+ * fimg/profile.c
+ *
+ * SAMSUNG S3C6410 FIMG-3DSE FRAME TIMELINE PROFILER
+ *
+ * Copyrights:	2010 by Tomasz Figa < tomasz.figa at gmail.com >
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifdef HAVE_CONFIG_H
+# include <config.h>
+#endif
+
+#include "fimg_private.h"
+
+#ifdef FIMG_PROFILE
+
+#include <pthread.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+
+/*
+ * Every thread recording profiler events gets its own ring of most recent
+ * events, so recording needs neither locks nor atomic operations. Rings are
+ * never freed and are linked into a global list, which is walked when
+ * the events are exported. An event may be overwritten by its thread while
+ * being exported, such events are detected by rereading the ring head and
+ * skipped.
+ */
+
+#define PROFILE_EVENTS		(8192)
+#define PROFILE_EVENTS_MASK	(PROFILE_EVENTS - 1)
+
+typedef struct {
+	const char *name;
+	uint64_t start;
+	uint64_t duration;
+} profileEvent;
+
+typedef struct _profileRing {
+	struct _profileRing *next;
+	pid_t tid;
+	/* Count of events ever recorded into the ring */
+	volatile uint32_t head;
+	profileEvent events[PROFILE_EVENTS];
+} profileRing;
+
+int fimgProfileEnabled;
+
+static profileRing *volatile profileRings;
+static pthread_key_t profileKey;
+static pthread_once_t profileOnce = PTHREAD_ONCE_INIT;
+static const char *profileExitPath;
+static unsigned profileFrames;
+static unsigned profileDumpFrame;
+
+/**
+ * Returns current time for profiler events.
+ * @return Monotonic time in nanoseconds.
+ */
+uint64_t fimgProfileTime(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+/**
+ * Exports recorded events to file given in FIMG_PROFILE environment variable
+ * at exit of the process.
+ */
+static void profileExit(void)
+{
+	fimgProfileDump(profileExitPath);
+}
+
+/**
+ * Initializes profiler state shared by all threads.
+ */
+static void profileInit(void)
+{
+	const char *frames;
+
+	pthread_key_create(&profileKey, NULL);
+
+	profileExitPath = getenv("FIMG_PROFILE");
+	if (!profileExitPath)
+		return;
+
+	frames = getenv("FIMG_PROFILE_FRAMES");
+	if (frames)
+		profileDumpFrame = atoi(frames);
+
+	atexit(profileExit);
+	fimgProfileEnabled = 1;
+}
+
+/**
+ * Initializes the profiler. Recording of events is enabled if FIMG_PROFILE
+ * environment variable is set to path of file to export them to at exit
+ * or after number of frames given in FIMG_PROFILE_FRAMES variable.
+ */
+void fimgProfileInit(void)
+{
+	pthread_once(&profileOnce, profileInit);
+}
+
+/**
+ * Returns event ring of calling thread, allocating it on first use.
+ * @return Event ring or NULL on allocation failure.
+ */
+static profileRing *getRing(void)
+{
+	profileRing *ring = pthread_getspecific(profileKey);
+
+	if (ring)
+		return ring;
+
+	ring = calloc(1, sizeof(*ring));
+	if (!ring)
+		return NULL;
+
+	ring->tid = syscall(__NR_gettid);
+
+	do {
+		ring->next = profileRings;
+	} while (!__sync_bool_compare_and_swap(&profileRings,
+							ring->next, ring));
+
+	pthread_setspecific(profileKey, ring);
+	return ring;
+}
+
+/**
+ * Records a profiler event finishing at current time.
+ * Should be used through FIMG_PROFILE_END macro.
+ * @param name Name of the event (must be a static string).
+ * @param start Start time of the event returned by fimgProfileTime.
+ */
+void fimgProfileEvent(const char *name, uint64_t start)
+{
+	uint64_t end = fimgProfileTime();
+	profileRing *ring;
+	profileEvent *ev;
+
+	ring = getRing();
+	if (!ring)
+		return;
+
+	ev = &ring->events[ring->head & PROFILE_EVENTS_MASK];
+	ev->name = name;
+	ev->start = start;
+	ev->duration = end - start;
+
+	__sync_synchronize();
+	++ring->head;
+}
+
+/**
+ * Enables or disables recording of profiler events.
+ * @param enable Non-zero to enable recording.
+ */
+void fimgProfileEnable(int enable)
+{
+	fimgProfileInit();
+	fimgProfileEnabled = enable;
+}
+
+/**
+ * Marks end of a frame, exporting recorded events if number of frames
+ * given in FIMG_PROFILE_FRAMES environment variable has been reached.
+ */
+void fimgProfileFrame(void)
+{
+	if (!fimgProfileEnabled)
+		return;
+
+	if (++profileFrames == profileDumpFrame)
+		fimgProfileDump(profileExitPath);
+}
+
+/**
+ * Writes events recorded by a single thread.
+ * @param f File to write to.
+ * @param ring Event ring of the thread.
+ * @param pid Process ID.
+ * @param first Indicates that no event has been written to the file yet.
+ * @return Count of written events.
+ */
+static unsigned dumpRing(FILE *f, profileRing *ring, pid_t pid, int first)
+{
+	profileEvent *events;
+	uint32_t head, tail, i;
+	unsigned count = 0;
+
+	events = malloc(sizeof(ring->events));
+	if (!events)
+		return 0;
+
+	head = ring->head;
+	__sync_synchronize();
+	memcpy(events, ring->events, sizeof(ring->events));
+	__sync_synchronize();
+
+	/* Skip events overwritten while copying */
+	tail = ring->head;
+	tail = (tail > PROFILE_EVENTS) ? tail - PROFILE_EVENTS : 0;
+
+	for (i = tail; i < head; ++i) {
+		profileEvent *ev = &events[i & PROFILE_EVENTS_MASK];
+
+		fprintf(f, "%s\n{\"name\":\"%s\",\"cat\":\"fimg\",\"ph\":\"X\","
+			"\"pid\":%d,\"tid\":%d,\"ts\":%llu.%03u,"
+			"\"dur\":%llu.%03u}", (first && !count) ? "" : ",",
+			ev->name, pid, ring->tid,
+			(unsigned long long)(ev->start / 1000),
+			(unsigned)(ev->start % 1000),
+			(unsigned long long)(ev->duration / 1000),
+			(unsigned)(ev->duration % 1000));
+		++count;
+	}
+
+	free(events);
+	return count;
+}
+
+/**
+ * Exports events recorded by all threads to a file in Chrome trace event
+ * format, which can be viewed with chrome://tracing.
+ * @param path Path of file to write to.
+ * @return 0 on success, negative on error.
+ */
+int fimgProfileDump(const char *path)
+{
+	pid_t pid = getpid();
+	profileRing *ring;
+	unsigned count = 0;
+	FILE *f;
+
+	f = fopen(path, "w");
+	if (!f) {
+		LOGE("Failed to open profile file %s", path);
+		return -1;
+	}
+
+	fputs("{\"traceEvents\":[", f);
+	for (ring = profileRings; ring; ring = ring->next)
+		count += dumpRing(f, ring, pid, !count);
+	fputs("\n]}\n", f);
+
+	fclose(f);
+
+	LOGI("Written %u profiler events to %s", count, path);
+	return 0;
+}
+
+#endif /* FIMG_PROFILE */
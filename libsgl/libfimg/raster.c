@@ -209,12 +209,18 @@ void fimgSetMaximumPointWidth(fimgContext *ctx, float pWidthMax)
 /**
  * Selects attribute used as texture coordinate in point sprite mode.
  * @param ctx Hardware context.
- * @param coordReplaceNum Attribute index.
+ * @param coordReplaceNum Attribute index (FIMG_ATTRIB_NUM or higher
+ * disables coordinate replacement).
  */
 void fimgSetCoordReplace(fimgContext *ctx, unsigned int coordReplaceNum)
 {
-	ctx->rasterizer.spriteCoordAttrib = FGRA_COORDREPLACE_VAL(coordReplaceNum);
-	fimgQueue(ctx, FGRA_COORDREPLACE_VAL(coordReplaceNum), FGRA_COORDREPLACE);
+	uint32_t val = 0;
+
+	if (coordReplaceNum < FIMG_ATTRIB_NUM)
+		val = FGRA_COORDREPLACE_VAL(coordReplaceNum);
+
+	ctx->rasterizer.spriteCoordAttrib = val;
+	fimgQueue(ctx, val, FGRA_COORDREPLACE);
 }
 
 /**
@@ -45,6 +45,9 @@ def c3, 4.0, 4.0, 4.0, 4.0
 # Combiner scale 1
 # def c7, 1.0, 1.0, 1.0, 1.0
 
+# Fog color
+# def c8, 0.0, 0.0, 0.0, 0.0
+
 % f header
 
 # Shader header
@@ -56,6 +59,44 @@ label start
 
 ################################################################################
 
+% f clip0
+
+# Clip plane function
+#
+# Inputs:	v4.x - signed distance from clip plane
+
+# Clip plane 0
+	texkill v4.x
+
+% f clip1
+
+# Clip plane function
+#
+# Inputs:	v4.y - signed distance from clip plane
+
+# Clip plane 1
+	texkill v4.y
+
+% f clip2
+
+# Clip plane function
+#
+# Inputs:	v4.z - signed distance from clip plane
+
+# Clip plane 2
+	texkill v4.z
+
+% f clip3
+
+# Clip plane function
+#
+# Inputs:	v4.w - signed distance from clip plane
+
+# Clip plane 3
+	texkill v4.w
+
+################################################################################
+
 % f texture0
 
 # Sampling function
@@ -648,6 +689,23 @@ label start
 
 ################################################################################
 
+% f fog
+
+# Fog function
+#
+# Inputs:	r0 - current fragment value
+#		v3 - fog factor (x component)
+#		c8 - fog color
+#
+# Output:	r0 - new fragment value
+
+# Fog
+	# C = f * (Cf - Cfog) + Cfog
+	add r1.xyz, r0, -c8
+	mad r0.xyz, r1, v3.x, c8
+
+################################################################################
+
 % f out_swap
 
 # Output RGB -> BGR color component swap
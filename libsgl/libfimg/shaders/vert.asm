@@ -50,6 +50,24 @@ fimg_version	0x01050000
 # def c14, 0.0, 0.0, 1.0, 0.0
 # def c15, 0.0, 0.0, 0.0, 1.0
 
+# Model-view matrix
+# def c16, 1.0, 0.0, 0.0, 0.0
+# def c17, 0.0, 1.0, 0.0, 0.0
+# def c18, 0.0, 0.0, 1.0, 0.0
+# def c19, 0.0, 0.0, 0.0, 1.0
+
+# Fog parameters (scale, bias)
+# def c20, 0.0, 0.0, 0.0, 0.0
+
+# Eye-space clip planes
+# def c21, 0.0, 0.0, 0.0, 0.0
+# def c22, 0.0, 0.0, 0.0, 0.0
+# def c23, 0.0, 0.0, 0.0, 0.0
+# def c24, 0.0, 0.0, 0.0, 0.0
+
+# Point size attenuation coefficients (constant, linear, quadratic)
+# def c25, 1.0, 0.0, 0.0, 0.0
+
 % v header
 
 # Shader header
@@ -65,6 +83,16 @@ label start
 
 # Code is being inserted here dynamically
 
+% v header_screen
+
+# Shader header (screen-space vertices)
+label start
+	# Pass position without transformation
+	mov o0.xyzw, v0.xyzw
+
+	# Pass vertex color
+	mov o1, v2
+
 ################################################################################
 
 % v texture0
@@ -85,6 +113,152 @@ label start
 	mad r2.xyzw, c14.xyzw, v5.zzzz, r2.xyzw
 	mad o3.xyzw, c15.xyzw, v5.wwww, r2.xyzw
 
+% v texture0_identity
+
+# Texture 0 (identity matrix)
+	# Pass texture0 coordinates
+	mov o2.xyzw, v4.xyzw
+
+% v texture1_identity
+
+# Texture 1 (identity matrix)
+	# Pass texture1 coordinates
+	mov o3.xyzw, v5.xyzw
+
+################################################################################
+
+% v eyepos
+
+# Eye-space position
+#
+# Output:	r3 - eye-space vertex position
+
+# Eye position
+	# Transform position by model-view matrix
+	mul r3.xyzw, c16.xyzw, v0.xxxx
+	mad r3.xyzw, c17.xyzw, v0.yyyy, r3.xyzw
+	mad r3.xyzw, c18.xyzw, v0.zzzz, r3.xyzw
+	mad r3.xyzw, c19.xyzw, v0.wwww, r3.xyzw
+
+################################################################################
+
+% v fog_linear
+
+# Fog function
+#
+# Inputs:	r3 - eye-space vertex position
+#
+# Output:	o4.x - fog factor
+
+# Linear
+	# f = (end - d) / (end - start), d = -z
+	mad_sat o4.x, r3.z, c20.x, c20.y
+
+% v fog_exp
+
+# Fog function
+#
+# Inputs:	r3 - eye-space vertex position
+#
+# Output:	o4.x - fog factor
+
+# Exponential
+	# f = 2^(density * log2(e) * z)
+	mul r4.x, r3.z, c20.x
+	exp_sat o4.x, r4.x
+
+% v fog_exp2
+
+# Fog function
+#
+# Inputs:	r3 - eye-space vertex position
+#
+# Output:	o4.x - fog factor
+
+# Squared exponential
+	# f = 2^(-(density * sqrt(log2(e)) * z)^2)
+	mul r4.x, r3.z, c20.x
+	mul r4.x, r4.x, -r4.x
+	exp o4.x, r4.x
+
+################################################################################
+
+% v clip0
+
+# Clip plane function
+#
+# Inputs:	r3 - eye-space vertex position
+#
+# Output:	o5.x - signed distance from clip plane
+
+# Clip plane 0
+	dp4 o5.x, r3, c21
+
+% v clip1
+
+# Clip plane function
+#
+# Inputs:	r3 - eye-space vertex position
+#
+# Output:	o5.y - signed distance from clip plane
+
+# Clip plane 1
+	dp4 o5.y, r3, c22
+
+% v clip2
+
+# Clip plane function
+#
+# Inputs:	r3 - eye-space vertex position
+#
+# Output:	o5.z - signed distance from clip plane
+
+# Clip plane 2
+	dp4 o5.z, r3, c23
+
+% v clip3
+
+# Clip plane function
+#
+# Inputs:	r3 - eye-space vertex position
+#
+# Output:	o5.w - signed distance from clip plane
+
+# Clip plane 3
+	dp4 o5.w, r3, c24
+
+################################################################################
+
+% v pointsize
+
+# Point size function
+#
+# Inputs:	v3 - point size attribute
+#
+# Output:	o8.x - point size
+
+# Pass point size
+	mov o8.x, v3.x
+
+% v pointsize_atten
+
+# Point size function
+#
+# Inputs:	v3 - point size attribute
+#		r3 - eye-space vertex position
+#
+# Output:	o8.x - point size
+
+# Attenuated point size
+	# size = size * sqrt(1 / (a + b * d + c * d^2))
+	dp3 r5.y, r3, r3
+	rsq r5.x, r5.y
+	mul r5.x, r5.x, r5.y
+	mad r5.z, c25.y, r5.x, c25.x
+	mad r5.z, c25.z, r5.y, r5.z
+	rsq r5.z, r5.z
+	mul o8.x, v3.x, r5.z
+
 ################################################################################
 
 % v footer
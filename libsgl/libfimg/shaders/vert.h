@@ -12,6 +12,11 @@ static const unsigned int vert_header[] = {
 	0x00000000, 0x00020000, 0x00f801e4, 0x00000000,
 };
 
+static const unsigned int vert_header_screen[] = {
+	0x00000000, 0x00000000, 0x00f800e4, 0x00000000,
+	0x00000000, 0x00020000, 0x00f801e4, 0x00000000,
+};
+
 static const unsigned int vert_texture0[] = {
 	0x04000000, 0x02080000, 0x237821e4, 0x00000000,
 	0x04e40101, 0x02095500, 0x2ef821e4, 0x00000000,
@@ -26,6 +31,66 @@ static const unsigned int vert_texture1[] = {
 	0x05e40102, 0x020fff00, 0x0ef803e4, 0x00000000,
 };
 
+static const unsigned int vert_texture0_identity[] = {
+	0x00000000, 0x00040000, 0x00f802e4, 0x00000000,
+};
+
+static const unsigned int vert_texture1_identity[] = {
+	0x00000000, 0x00050000, 0x00f803e4, 0x00000000,
+};
+
+static const unsigned int vert_eyepos[] = {
+	0x00000000, 0x02100000, 0x237823e4, 0x00000000,
+	0x00e40103, 0x02115500, 0x2ef823e4, 0x00000000,
+	0x00e40103, 0x0212aa00, 0x2ef823e4, 0x00000000,
+	0x00e40103, 0x0213ff00, 0x0ef823e4, 0x00000000,
+};
+
+static const unsigned int vert_fog_linear[] = {
+	0x14550214, 0x01030002, 0x0e8a04aa, 0x00000000,
+};
+
+static const unsigned int vert_fog_exp[] = {
+	0x14000000, 0x01030002, 0x030824aa, 0x00000000,
+	0x00000000, 0x01040000, 0x060a0400, 0x00000000,
+};
+
+static const unsigned int vert_fog_exp2[] = {
+	0x14000000, 0x01030002, 0x030824aa, 0x00000000,
+	0x04000000, 0x01040041, 0x03082400, 0x00000000,
+	0x00000000, 0x01040000, 0x06080400, 0x00000000,
+};
+
+static const unsigned int vert_clip0[] = {
+	0x15000000, 0x0103e402, 0x048805e4, 0x00000000,
+};
+
+static const unsigned int vert_clip1[] = {
+	0x16000000, 0x0103e402, 0x049005e4, 0x00000000,
+};
+
+static const unsigned int vert_clip2[] = {
+	0x17000000, 0x0103e402, 0x04a005e4, 0x00000000,
+};
+
+static const unsigned int vert_clip3[] = {
+	0x18000000, 0x0103e402, 0x04c005e4, 0x00000000,
+};
+
+static const unsigned int vert_pointsize[] = {
+	0x00000000, 0x00030000, 0x00880800, 0x00000000,
+};
+
+static const unsigned int vert_pointsize_atten[] = {
+	0x03000000, 0x0103e401, 0x041025e4, 0x00000000,
+	0x00000000, 0x01050000, 0x08882555, 0x00000000,
+	0x05000000, 0x01055501, 0x23082500, 0x00000000,
+	0x05000219, 0x02190001, 0x2ea02555, 0x00000000,
+	0x05aa0105, 0x02195501, 0x0ea025aa, 0x00000000,
+	0x00000000, 0x01050000, 0x08a025aa, 0x00000000,
+	0x05000000, 0x0003aa01, 0x03080800, 0x00000000,
+};
+
 static const unsigned int vert_footer[] = {
 	0x00000000, 0x00000000, 0x1e000000, 0x00000000,
 };
@@ -0,0 +1,2402 @@
+/*
+ * fimg/sim.c
+ *
+ * SAMSUNG S3C6410 FIMG-3DSE FUNCTIONAL SIMULATOR BACKEND
+ *
+ * Copyrights:	2010 by Tomasz Figa < tomasz.figa at gmail.com >
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifdef HAVE_CONFIG_H
+# include <config.h>
+#endif
+
+#include "fimg_private.h"
+#include "fimg_regs.h"
+
+#ifdef FIMG_IO_BACKEND
+
+#include <string.h>
+#include <math.h>
+#include <pthread.h>
+
+/*
+ * Simulator backend executes draw requests in software, using register
+ * values written by the driver, and renders into memory registered with
+ * fimgSimMapMemory. It models the pipeline at functional level (vertex fetch,
+ * shaders, clipping, rasterization, texturing and per-fragment operations)
+ * to let rendering results and per-stage work counters be compared between
+ * driver versions without G3D hardware. Timing of the real hardware is not
+ * modelled and all requests complete synchronously.
+ */
+
+/* Reported hardware version (1.5.0) */
+#define SIM_VERSION		(0x01050000)
+
+/* Register file sizes */
+#define SIM_VS_INPUTS		(10)
+#define SIM_VS_OUTPUTS		(10)
+#define SIM_PS_INPUTS		(8)
+#define SIM_TEMPS		(32)
+#define SIM_CFLOATS		(256)
+#define SIM_CINTS		(16)
+#define SIM_INSTRS		(512)
+
+/* Maximum vertex count of clipped polygon */
+#define SIM_CLIP_VERTICES	(12)
+
+#define SIM_PALETTE_SIZE	(256)
+
+/* Base of addresses assigned to memory registered without physical address */
+#define SIM_FAKE_ADDR_BASE	(0x10000000UL)
+#define SIM_PAGE_SIZE		(4096UL)
+
+/*
+ * Memory registry
+ */
+
+typedef struct {
+	unsigned long paddr;
+	unsigned long size;
+	uint8_t *vaddr;
+} simRegion;
+
+static simRegion *simRegions;
+static unsigned int simRegionCount;
+static unsigned int simRegionSize;
+static unsigned long simNextAddr = SIM_FAKE_ADDR_BASE;
+static pthread_mutex_t simRegionMutex = PTHREAD_MUTEX_INITIALIZER;
+
+/**
+ * Makes memory accessible to simulated hardware.
+ * Buffers used as render targets or textures must be registered, otherwise
+ * the simulator ignores them.
+ * @param paddr Physical address of the memory or 0 to assign a fake one.
+ * @param vaddr Virtual address of the memory.
+ * @param size Size of the memory in bytes.
+ * @return Address to be used by the driver to refer to the memory.
+ */
+unsigned long fimgSimMapMemory(unsigned long paddr, void *vaddr,
+							unsigned long size)
+{
+	pthread_mutex_lock(&simRegionMutex);
+
+	if (!paddr) {
+		paddr = simNextAddr;
+		simNextAddr += (size + SIM_PAGE_SIZE - 1) & ~(SIM_PAGE_SIZE - 1);
+	}
+
+	if (simRegionCount == simRegionSize) {
+		unsigned int newSize = simRegionSize ? 2*simRegionSize : 16;
+		simRegion *regions;
+
+		regions = realloc(simRegions, newSize * sizeof(*regions));
+		if (!regions) {
+			LOGE("%s: Could not register memory at %08lx",
+							__func__, paddr);
+			pthread_mutex_unlock(&simRegionMutex);
+			return paddr;
+		}
+
+		simRegions = regions;
+		simRegionSize = newSize;
+	}
+
+	simRegions[simRegionCount].paddr = paddr;
+	simRegions[simRegionCount].size = size;
+	simRegions[simRegionCount].vaddr = vaddr;
+	++simRegionCount;
+
+	pthread_mutex_unlock(&simRegionMutex);
+	return paddr;
+}
+
+/**
+ * Makes memory registered with fimgSimMapMemory inaccessible.
+ * @param paddr Address returned by fimgSimMapMemory.
+ */
+void fimgSimUnmapMemory(unsigned long paddr)
+{
+	unsigned int i;
+
+	pthread_mutex_lock(&simRegionMutex);
+
+	for (i = 0; i < simRegionCount; ++i) {
+		if (simRegions[i].paddr != paddr)
+			continue;
+
+		simRegions[i] = simRegions[--simRegionCount];
+		break;
+	}
+
+	pthread_mutex_unlock(&simRegionMutex);
+}
+
+/**
+ * Translates address used by hardware to virtual address.
+ * @param addr Address used by hardware.
+ * @param size Pointer to store number of bytes accessible at the address.
+ * @return Virtual address or NULL if the address is not registered.
+ */
+static uint8_t *simResolve(unsigned long addr, unsigned long *size)
+{
+	uint8_t *vaddr = NULL;
+	unsigned int i;
+
+	*size = 0;
+
+	pthread_mutex_lock(&simRegionMutex);
+
+	for (i = 0; i < simRegionCount; ++i) {
+		simRegion *r = &simRegions[i];
+
+		if (addr < r->paddr || addr - r->paddr >= r->size)
+			continue;
+
+		vaddr = r->vaddr + (addr - r->paddr);
+		*size = r->size - (addr - r->paddr);
+		break;
+	}
+
+	pthread_mutex_unlock(&simRegionMutex);
+	return vaddr;
+}
+
+/*
+ * Simulator state
+ */
+
+typedef struct {
+	/* Draw request being collected from host FIFO */
+	uint32_t fifo[2];
+	unsigned int fifoWords;
+	/* Palette memory */
+	uint32_t paletteAddr;
+	uint32_t palette[SIM_PALETTE_SIZE];
+	fimgSimStats stats;
+} fimgSim;
+
+/* Vertex in clip coordinates */
+typedef struct {
+	float pos[4];
+	float var[SIM_PS_INPUTS][4];
+	float pointSize;
+} simVertex;
+
+/* Vertex in window coordinates */
+typedef struct {
+	float x, y, z, q;
+	float var[SIM_PS_INPUTS][4];
+} simWinVertex;
+
+/* Plane equation of interpolated value: a*x + b*y + c */
+typedef struct {
+	float a, b, c;
+} simPlane;
+
+/* Interpolation setup of a triangle */
+typedef struct {
+	simPlane z;
+	simPlane q;
+	/* Attributes premultiplied by q, constant for flat shaded attributes */
+	simPlane var[SIM_PS_INPUTS][4];
+	uint32_t flat;
+	int back;
+} simSetup;
+
+typedef struct {
+	int enabled;
+	fimgTexControl control;
+	unsigned int uSize;
+	unsigned int vSize;
+	unsigned int offset[FGTU_MAX_MIPMAP_LEVEL + 1];
+	unsigned int minLevel;
+	unsigned int maxLevel;
+	const uint8_t *data;
+	unsigned long size;
+} simTexUnit;
+
+/* Register state and resolved buffers of a draw request */
+typedef struct {
+	fimgSim *sim;
+	const uint8_t *regs;
+
+	/* Vertex shader */
+	uint32_t vsCode[SIM_INSTRS][4];
+	float vsConst[SIM_CFLOATS][4];
+	int32_t vsInt[SIM_CINTS][4];
+	uint32_t vsBool;
+	unsigned int vsStart;
+	unsigned int vsEnd;
+	unsigned int vsInputs;
+
+	/* Primitive engine */
+	fimgVertexContext vctx;
+	float ox, oy, halfPX, halfPY, halfDistance, center;
+
+	/* Raster engine */
+	float sampleOffset;
+	int dOffEn;
+	float dOffFactor;
+	float dOffUnits;
+	fimgCullingControl cull;
+	float pointWidth, pointWidthMin, pointWidthMax;
+	uint32_t coordReplace;
+	float lineWidth;
+	int xmin, xmax, ymin, ymax;
+
+	/* Pixel shader */
+	uint32_t psCode[SIM_INSTRS][4];
+	float psConst[SIM_CFLOATS][4];
+	int32_t psInt[SIM_CINTS][4];
+	uint32_t psBool;
+	unsigned int psStart;
+	unsigned int psEnd;
+	simTexUnit unit[FIMG_NUM_TEXTURE_UNITS];
+
+	/* Per-fragment unit */
+	fimgAlphaTestData alpha;
+	fimgStencilTestData stFront;
+	fimgStencilTestData stBack;
+	fimgDepthTestData depth;
+	fimgBlendControl blend;
+	float blendColor[4];
+	fimgLogOpControl logop;
+	fimgColorBufMask mask;
+	fimgDepthBufMask dbmask;
+	fimgFramebufferControl fbctl;
+	unsigned int width;
+	unsigned int height;
+	unsigned int bpp;
+	uint8_t *color;
+	unsigned long colorSize;
+	uint32_t *zbuf;
+	unsigned long zbufSize;
+} simDraw;
+
+static inline uint32_t simReg(const simDraw *d, uint32_t addr)
+{
+	return *(const uint32_t *)(d->regs + addr);
+}
+
+static inline float simRegF(const simDraw *d, uint32_t addr)
+{
+	union {
+		uint32_t u;
+		float f;
+	} val;
+
+	val.u = simReg(d, addr);
+	return val.f;
+}
+
+/* Zero test without exact float comparison, true for NaN as well */
+static inline int simIsZero(float val)
+{
+	return !(val < 0.0f) && !(val > 0.0f);
+}
+
+static inline float simClamp(float val, float min, float max)
+{
+	if (val < min)
+		return min;
+	if (val > max)
+		return max;
+	return val;
+}
+
+static inline int simClampInt(int val, int min, int max)
+{
+	if (val < min)
+		return min;
+	if (val > max)
+		return max;
+	return val;
+}
+
+/*
+ * Host interface
+ */
+
+static const uint8_t simTypeSize[] = {
+	[FGHI_ATTRIB_DT_BYTE]		= 1,
+	[FGHI_ATTRIB_DT_SHORT]		= 2,
+	[FGHI_ATTRIB_DT_INT]		= 4,
+	[FGHI_ATTRIB_DT_FIXED]		= 4,
+	[FGHI_ATTRIB_DT_UBYTE]		= 1,
+	[FGHI_ATTRIB_DT_USHORT]		= 2,
+	[FGHI_ATTRIB_DT_UINT]		= 4,
+	[FGHI_ATTRIB_DT_FLOAT]		= 4,
+	[FGHI_ATTRIB_DT_NBYTE]		= 1,
+	[FGHI_ATTRIB_DT_NSHORT]		= 2,
+	[FGHI_ATTRIB_DT_NINT]		= 4,
+	[FGHI_ATTRIB_DT_NFIXED]		= 4,
+	[FGHI_ATTRIB_DT_NUBYTE]		= 1,
+	[FGHI_ATTRIB_DT_NUSHORT]	= 2,
+	[FGHI_ATTRIB_DT_NUINT]		= 4,
+	[FGHI_ATTRIB_DT_HALF_FLOAT]	= 2,
+};
+
+/**
+ * Converts half precision floating point value to single precision.
+ * @param h Half precision value.
+ * @return Single precision value.
+ */
+static float simHalfToFloat(uint16_t h)
+{
+	unsigned int exp = (h >> 10) & 0x1f;
+	unsigned int man = h & 0x3ff;
+	float val;
+
+	if (!exp)
+		val = ldexpf(man, -24);
+	else if (exp == 31)
+		val = man ? NAN : INFINITY;
+	else
+		val = ldexpf(man | 0x400, exp - 25);
+
+	return (h & 0x8000) ? -val : val;
+}
+
+/**
+ * Converts single vertex attribute component to floating point.
+ * @param p Pointer to component data.
+ * @param dt Data type (see fimgHostDataType enum).
+ * @return Component value.
+ */
+static float simConvert(const uint8_t *p, unsigned int dt)
+{
+	union {
+		uint8_t b[4];
+		int8_t sb;
+		uint16_t h;
+		int16_t sh;
+		uint32_t w;
+		int32_t sw;
+		float f;
+	} v;
+
+	memcpy(v.b, p, simTypeSize[dt]);
+
+	switch (dt) {
+	case FGHI_ATTRIB_DT_BYTE:
+		return v.sb;
+	case FGHI_ATTRIB_DT_SHORT:
+		return v.sh;
+	case FGHI_ATTRIB_DT_INT:
+		return v.sw;
+	case FGHI_ATTRIB_DT_FIXED:
+	case FGHI_ATTRIB_DT_NFIXED:
+		return v.sw / 65536.0f;
+	case FGHI_ATTRIB_DT_UBYTE:
+		return v.b[0];
+	case FGHI_ATTRIB_DT_USHORT:
+		return v.h;
+	case FGHI_ATTRIB_DT_UINT:
+		return v.w;
+	case FGHI_ATTRIB_DT_FLOAT:
+		return v.f;
+	case FGHI_ATTRIB_DT_NBYTE:
+		return fmaxf(v.sb / 127.0f, -1.0f);
+	case FGHI_ATTRIB_DT_NSHORT:
+		return fmaxf(v.sh / 32767.0f, -1.0f);
+	case FGHI_ATTRIB_DT_NINT:
+		return fmaxf(v.sw / 2147483647.0f, -1.0f);
+	case FGHI_ATTRIB_DT_NUBYTE:
+		return v.b[0] / 255.0f;
+	case FGHI_ATTRIB_DT_NUSHORT:
+		return v.h / 65535.0f;
+	case FGHI_ATTRIB_DT_NUINT:
+		return v.w / 4294967295.0f;
+	default:
+		return simHalfToFloat(v.h);
+	}
+}
+
+/**
+ * Fetches input attribute of a vertex from vertex buffer.
+ * Missing components default to (0, 0, 0, 1).
+ * @param d Draw state.
+ * @param attr Attribute index.
+ * @param index Vertex index.
+ * @param out Array to store attribute value in.
+ */
+static void simFetchAttrib(const simDraw *d, unsigned int attr,
+					unsigned int index, float *out)
+{
+	const uint8_t *vb = d->regs + FGHI_VB_ENTRY;
+	fimgAttribute a;
+	fimgVtxBufAttrib ctrl;
+	float in[4] = { 0.0f, 0.0f, 0.0f, 1.0f };
+	unsigned int size;
+	uint32_t offset;
+	unsigned int i;
+
+	a.val = simReg(d, FGHI_ATTRIB(attr));
+	ctrl.val = simReg(d, FGHI_ATTRIB_VBCTRL(attr));
+	offset = simReg(d, FGHI_ATTRIB_VBBASE(attr)) + ctrl.stride * index;
+	size = simTypeSize[a.dt];
+
+	for (i = 0; i <= a.numcomp; ++i, offset += size) {
+		if (offset + size > FGHI_VB_SIZE)
+			break;
+		in[i] = simConvert(vb + offset, a.dt);
+	}
+
+	out[0] = in[a.srcx];
+	out[1] = in[a.srcy];
+	out[2] = in[a.srcz];
+	out[3] = in[a.srcw];
+}
+
+/*
+ * Texture unit
+ */
+
+/* Bits per texel of texture formats */
+static const uint8_t simTexelBits[] = {
+	[FGTU_TSTA_TEXTURE_FORMAT_1555]		= 16,
+	[FGTU_TSTA_TEXTURE_FORMAT_565]		= 16,
+	[FGTU_TSTA_TEXTURE_FORMAT_4444]		= 16,
+	[FGTU_TSTA_TEXTURE_FORMAT_DEPTHCOMP16]	= 16,
+	[FGTU_TSTA_TEXTURE_FORMAT_88]		= 16,
+	[FGTU_TSTA_TEXTURE_FORMAT_8]		= 8,
+	[FGTU_TSTA_TEXTURE_FORMAT_8888]		= 32,
+	[FGTU_TSTA_TEXTURE_FORMAT_1BPP]		= 1,
+	[FGTU_TSTA_TEXTURE_FORMAT_2BPP]		= 2,
+	[FGTU_TSTA_TEXTURE_FORMAT_4BPP]		= 4,
+	[FGTU_TSTA_TEXTURE_FORMAT_8BPP]		= 8,
+	[FGTU_TSTA_TEXTURE_FORMAT_S3TC]		= 4,
+	[FGTU_TSTA_TEXTURE_FORMAT_Y1VY0U]	= 16,
+	[FGTU_TSTA_TEXTURE_FORMAT_VY1UY0]	= 16,
+	[FGTU_TSTA_TEXTURE_FORMAT_Y1UY0V]	= 16,
+	[FGTU_TSTA_TEXTURE_FORMAT_UY1VY0]	= 16,
+};
+
+/**
+ * Loads texture unit configuration and resolves texture memory.
+ * @param d Draw state.
+ * @param i Texture unit index.
+ */
+static void simLoadTexUnit(simDraw *d, unsigned int i)
+{
+	simTexUnit *t = &d->unit[i];
+	unsigned int level;
+
+	t->control.val = simReg(d, FGTU_TSTA(i));
+	t->uSize = simReg(d, FGTU_USIZE(i));
+	t->vSize = simReg(d, FGTU_VSIZE(i));
+	t->offset[0] = 0;
+	for (level = 1; level <= FGTU_MAX_MIPMAP_LEVEL; ++level)
+		t->offset[level] = simReg(d, FGTU_TOFFS_L1(i) + 4*(level - 1));
+	t->minLevel = simReg(d, FGTU_T_MIN_L(i));
+	t->maxLevel = simReg(d, FGTU_T_MAX_L(i));
+	t->data = simResolve(simReg(d, FGTU_TBADD(i)), &t->size);
+
+	t->enabled = t->data && t->uSize && t->vSize
+			&& t->control.type == FGTU_TSTA_TYPE_2D
+			&& t->control.textureFmt < NELEM(simTexelBits);
+}
+
+/**
+ * Expands color component to floating point.
+ * @param t Texture unit.
+ * @param val Component value.
+ * @param bits Component width in bits.
+ * @return Component value in [0, 1] range.
+ */
+static inline float simExpand(const simTexUnit *t, uint32_t val,
+							unsigned int bits)
+{
+	if (bits > 1 && bits < 8
+	    && t->control.texExp == FGTU_TSTA_TEX_EXP_ZERO)
+		return (float)(val << (8 - bits)) / 255.0f;
+
+	return (float)val / ((1 << bits) - 1);
+}
+
+/**
+ * Decodes 16-bit or 32-bit RGBA texel or palette entry.
+ * @param t Texture unit.
+ * @param fmt Texel format (1555, 565, 4444 or 8888).
+ * @param val Texel value.
+ * @param rgba Alpha stored in LSBs.
+ * @param out Array to store color in.
+ */
+static void simDecodeColor(const simTexUnit *t, unsigned int fmt,
+				uint32_t val, int rgba, float *out)
+{
+	switch (fmt) {
+	case FGTU_TSTA_TEXTURE_FORMAT_1555:
+		if (rgba) {
+			out[0] = simExpand(t, (val >> 11) & 0x1f, 5);
+			out[1] = simExpand(t, (val >> 6) & 0x1f, 5);
+			out[2] = simExpand(t, (val >> 1) & 0x1f, 5);
+			out[3] = val & 1;
+		} else {
+			out[0] = simExpand(t, (val >> 10) & 0x1f, 5);
+			out[1] = simExpand(t, (val >> 5) & 0x1f, 5);
+			out[2] = simExpand(t, val & 0x1f, 5);
+			out[3] = (val >> 15) & 1;
+		}
+		break;
+	case FGTU_TSTA_TEXTURE_FORMAT_565:
+		out[0] = simExpand(t, (val >> 11) & 0x1f, 5);
+		out[1] = simExpand(t, (val >> 5) & 0x3f, 6);
+		out[2] = simExpand(t, val & 0x1f, 5);
+		out[3] = 1.0f;
+		break;
+	case FGTU_TSTA_TEXTURE_FORMAT_4444:
+		if (rgba)
+			val = (val >> 4) | ((val & 0xf) << 12);
+		out[0] = simExpand(t, (val >> 8) & 0xf, 4);
+		out[1] = simExpand(t, (val >> 4) & 0xf, 4);
+		out[2] = simExpand(t, val & 0xf, 4);
+		out[3] = simExpand(t, (val >> 12) & 0xf, 4);
+		break;
+	default:
+		if (rgba)
+			val = (val >> 8) | (val << 24);
+		out[0] = ((val >> 16) & 0xff) / 255.0f;
+		out[1] = ((val >> 8) & 0xff) / 255.0f;
+		out[2] = (val & 0xff) / 255.0f;
+		out[3] = (val >> 24) / 255.0f;
+		break;
+	}
+}
+
+/**
+ * Reads little endian value from texture memory.
+ * @param t Texture unit.
+ * @param offset Byte offset from texture base address.
+ * @param size Size of the value in bytes.
+ * @return Read value or 0 if out of texture memory.
+ */
+static uint32_t simTexRead(const simTexUnit *t, unsigned long offset,
+							unsigned int size)
+{
+	uint32_t val = 0;
+
+	if (offset + size > t->size)
+		return 0;
+
+	while (size--)
+		val = (val << 8) | t->data[offset + size];
+
+	return val;
+}
+
+/**
+ * Converts YUV color to RGB (ITU-R BT.601).
+ * @param y Luminance.
+ * @param u Blue chrominance.
+ * @param v Red chrominance.
+ * @param out Array to store color in.
+ */
+static void simYuvToRgb(int y, int u, int v, float *out)
+{
+	out[0] = simClamp((y + 1.402f*(v - 128)) / 255.0f, 0.0f, 1.0f);
+	out[1] = simClamp((y - 0.344f*(u - 128) - 0.714f*(v - 128)) / 255.0f,
+								0.0f, 1.0f);
+	out[2] = simClamp((y + 1.772f*(u - 128)) / 255.0f, 0.0f, 1.0f);
+	out[3] = 1.0f;
+}
+
+/**
+ * Fetches and decodes single texel.
+ * @param d Draw state.
+ * @param t Texture unit.
+ * @param level Mipmap level.
+ * @param x Texel column.
+ * @param y Texel row.
+ * @param out Array to store color in.
+ */
+static void simTexel(simDraw *d, const simTexUnit *t, unsigned int level,
+				unsigned int x, unsigned int y, float *out)
+{
+	unsigned int width = t->uSize >> level;
+	unsigned int fmt = t->control.textureFmt;
+	unsigned int bits = simTexelBits[fmt];
+	int rgba = t->control.alphaFmt == FGTU_TSTA_AFORMAT_RGBA;
+	unsigned long texel;
+	uint32_t val;
+
+	++d->sim->stats.texels;
+
+	if (!width)
+		width = 1;
+	texel = t->offset[level] + (unsigned long)y * width + x;
+
+	switch (fmt) {
+	case FGTU_TSTA_TEXTURE_FORMAT_1555:
+	case FGTU_TSTA_TEXTURE_FORMAT_565:
+	case FGTU_TSTA_TEXTURE_FORMAT_4444:
+		simDecodeColor(t, fmt, simTexRead(t, 2*texel, 2), rgba, out);
+		break;
+	case FGTU_TSTA_TEXTURE_FORMAT_8888:
+		simDecodeColor(t, fmt, simTexRead(t, 4*texel, 4), rgba, out);
+		break;
+	case FGTU_TSTA_TEXTURE_FORMAT_DEPTHCOMP16:
+		out[0] = out[1] = out[2] = simTexRead(t, 2*texel, 2) / 65535.0f;
+		out[3] = 1.0f;
+		break;
+	case FGTU_TSTA_TEXTURE_FORMAT_88:
+		val = simTexRead(t, 2*texel, 2);
+		if (rgba)
+			val = (val >> 8) | ((val & 0xff) << 8);
+		out[0] = out[1] = out[2] = (val & 0xff) / 255.0f;
+		out[3] = (val >> 8) / 255.0f;
+		break;
+	case FGTU_TSTA_TEXTURE_FORMAT_8:
+		out[0] = out[1] = out[2] = simTexRead(t, texel, 1) / 255.0f;
+		out[3] = 1.0f;
+		break;
+	case FGTU_TSTA_TEXTURE_FORMAT_1BPP:
+	case FGTU_TSTA_TEXTURE_FORMAT_2BPP:
+	case FGTU_TSTA_TEXTURE_FORMAT_4BPP:
+	case FGTU_TSTA_TEXTURE_FORMAT_8BPP: {
+		/* First texel is stored in least significant bits */
+		unsigned int shift = (texel * bits) % 8;
+
+		val = simTexRead(t, texel * bits / 8, 1);
+		val = (val >> shift) & ((1 << bits) - 1);
+		val = d->sim->palette[val];
+		simDecodeColor(t, t->control.paletteFmt == 3
+				? FGTU_TSTA_TEXTURE_FORMAT_8888
+				: t->control.paletteFmt, val, 0, out);
+		break; }
+	case FGTU_TSTA_TEXTURE_FORMAT_S3TC: {
+		unsigned int blocks = (width + 3) / 4;
+		unsigned long block = t->offset[level] / 2
+				+ 8*((y / 4) * blocks + x / 4);
+		uint32_t c0 = simTexRead(t, block, 2);
+		uint32_t c1 = simTexRead(t, block + 2, 2);
+		uint32_t idx = simTexRead(t, block + 4, 4);
+		float col0[4], col1[4];
+		int i;
+
+		idx = (idx >> (2*(4*(y % 4) + x % 4))) & 3;
+		simDecodeColor(t, FGTU_TSTA_TEXTURE_FORMAT_565, c0, 0, col0);
+		simDecodeColor(t, FGTU_TSTA_TEXTURE_FORMAT_565, c1, 0, col1);
+
+		for (i = 0; i < 4; ++i) {
+			switch (idx) {
+			case 0:
+				out[i] = col0[i];
+				break;
+			case 1:
+				out[i] = col1[i];
+				break;
+			case 2:
+				out[i] = (c0 > c1) ? (2*col0[i] + col1[i]) / 3
+						: (col0[i] + col1[i]) / 2;
+				break;
+			default:
+				out[i] = (c0 > c1) ? (col0[i] + 2*col1[i]) / 3
+						: 0.0f;
+				break;
+			}
+		}
+		break; }
+	default: {
+		/* Two texels packed in a word, components from LSB */
+		uint32_t w = simTexRead(t, 2*(texel & ~1UL), 4);
+		unsigned int b[4];
+		unsigned int y0, y1, u, v;
+
+		b[0] = w & 0xff;
+		b[1] = (w >> 8) & 0xff;
+		b[2] = (w >> 16) & 0xff;
+		b[3] = w >> 24;
+
+		switch (fmt) {
+		case FGTU_TSTA_TEXTURE_FORMAT_Y1VY0U:
+			u = b[0]; y0 = b[1]; v = b[2]; y1 = b[3];
+			break;
+		case FGTU_TSTA_TEXTURE_FORMAT_VY1UY0:
+			y0 = b[0]; u = b[1]; y1 = b[2]; v = b[3];
+			break;
+		case FGTU_TSTA_TEXTURE_FORMAT_Y1UY0V:
+			v = b[0]; y0 = b[1]; u = b[2]; y1 = b[3];
+			break;
+		default:
+			y0 = b[0]; v = b[1]; y1 = b[2]; u = b[3];
+			break;
+		}
+
+		simYuvToRgb((texel & 1) ? y1 : y0, u, v, out);
+		break; }
+	}
+}
+
+/**
+ * Applies texture addressing mode to texel coordinate.
+ * @param coord Texel coordinate.
+ * @param size Texture size in this direction.
+ * @param mode Addressing mode.
+ * @return Texel coordinate inside the texture.
+ */
+static unsigned int simWrap(int coord, int size, unsigned int mode)
+{
+	switch (mode) {
+	case FGTU_TSTA_ADDR_MODE_REPEAT:
+		coord %= size;
+		if (coord < 0)
+			coord += size;
+		return coord;
+	case FGTU_TSTA_ADDR_MODE_FLIP:
+		coord %= 2*size;
+		if (coord < 0)
+			coord += 2*size;
+		if (coord >= size)
+			coord = 2*size - 1 - coord;
+		return coord;
+	default:
+		return simClampInt(coord, 0, size - 1);
+	}
+}
+
+/**
+ * Samples single mipmap level of a texture.
+ * @param d Draw state.
+ * @param t Texture unit.
+ * @param level Mipmap level.
+ * @param linear Non-zero for bilinear filtering.
+ * @param s Normalized horizontal coordinate.
+ * @param tc Normalized vertical coordinate.
+ * @param out Array to store color in.
+ */
+static void simSampleLevel(simDraw *d, const simTexUnit *t,
+				unsigned int level, int linear,
+				float s, float tc, float *out)
+{
+	int width = t->uSize >> level;
+	int height = t->vSize >> level;
+	unsigned int umode = t->control.uAddrMode;
+	unsigned int vmode = t->control.vAddrMode;
+	float u, v;
+	int i;
+
+	if (!width)
+		width = 1;
+	if (!height)
+		height = 1;
+
+	u = s * width;
+	v = tc * height;
+
+	if (!linear) {
+		simTexel(d, t, level, simWrap(floorf(u), width, umode),
+				simWrap(floorf(v), height, vmode), out);
+	} else {
+		float c[4][4];
+		float fu, fv;
+		int x0, y0;
+
+		u -= 0.5f;
+		v -= 0.5f;
+		x0 = floorf(u);
+		y0 = floorf(v);
+		fu = u - x0;
+		fv = v - y0;
+
+		simTexel(d, t, level, simWrap(x0, width, umode),
+				simWrap(y0, height, vmode), c[0]);
+		simTexel(d, t, level, simWrap(x0 + 1, width, umode),
+				simWrap(y0, height, vmode), c[1]);
+		simTexel(d, t, level, simWrap(x0, width, umode),
+				simWrap(y0 + 1, height, vmode), c[2]);
+		simTexel(d, t, level, simWrap(x0 + 1, width, umode),
+				simWrap(y0 + 1, height, vmode), c[3]);
+
+		for (i = 0; i < 4; ++i)
+			out[i] = (c[0][i] * (1 - fu) + c[1][i] * fu) * (1 - fv)
+				+ (c[2][i] * (1 - fu) + c[3][i] * fu) * fv;
+	}
+}
+
+/**
+ * Samples a texture.
+ * @param d Draw state.
+ * @param unit Texture unit index.
+ * @param coord Texture coordinates.
+ * @param lod Level of detail (log2 of texel to pixel ratio).
+ * @param out Array to store color in.
+ */
+static void simSample(simDraw *d, unsigned int unit,
+				const float *coord, float lod, float *out)
+{
+	const simTexUnit *t;
+	float s = coord[0], tc = coord[1];
+	unsigned int mipmap, minLevel, maxLevel, level;
+
+	if (unit >= FIMG_NUM_TEXTURE_UNITS || !d->unit[unit].enabled) {
+		out[0] = out[1] = out[2] = 0.0f;
+		out[3] = 1.0f;
+		return;
+	}
+
+	t = &d->unit[unit];
+
+	if (t->control.texCoordSys == FGTU_TSTA_TEX_COOR_NON_PARAM) {
+		s /= t->uSize;
+		tc /= t->vSize;
+	}
+
+	mipmap = t->control.useMipmap;
+	if (lod <= 0.0f || mipmap == FGTU_TSTA_MIPMAP_DISABLED) {
+		simSampleLevel(d, t, 0, lod <= 0.0f ? t->control.magFilter
+					: t->control.minFilter, s, tc, out);
+		return;
+	}
+
+	minLevel = t->minLevel;
+	maxLevel = t->maxLevel;
+	if (maxLevel > FGTU_MAX_MIPMAP_LEVEL)
+		maxLevel = FGTU_MAX_MIPMAP_LEVEL;
+	if (minLevel > maxLevel)
+		minLevel = maxLevel;
+
+	if (mipmap == FGTU_TSTA_MIPMAP_NEAREST) {
+		level = simClampInt(floorf(lod + 0.5f), minLevel, maxLevel);
+		simSampleLevel(d, t, level, t->control.minFilter, s, tc, out);
+	} else {
+		float c[4];
+		float f;
+		unsigned int next;
+		int i;
+
+		level = simClampInt(floorf(lod), minLevel, maxLevel);
+		next = simClampInt(level + 1, minLevel, maxLevel);
+		f = simClamp(lod - level, 0.0f, 1.0f);
+
+		simSampleLevel(d, t, level, t->control.minFilter, s, tc, out);
+		if (next == level)
+			return;
+		simSampleLevel(d, t, next, t->control.minFilter, s, tc, c);
+		for (i = 0; i < 4; ++i)
+			out[i] += (c[i] - out[i]) * f;
+	}
+}
+
+/*
+ * Shaders
+ */
+
+typedef struct {
+	/* Program */
+	const uint32_t (*code)[4];
+	const float (*cfloat)[4];
+	const int32_t (*cint)[4];
+	uint32_t cbool;
+	unsigned int start;
+	unsigned int end;
+	/* Registers */
+	float (*v)[4];
+	unsigned int numInputs;
+	float r[SIM_TEMPS][4];
+	float o[SIM_VS_OUTPUTS][4];
+	float color[4];
+	float a0[4];
+	int kill;
+	/* Pixel shader only */
+	simDraw *d;
+	const simSetup *setup;
+	float px, py, q;
+} simShader;
+
+/**
+ * Reads source operand of shader instruction.
+ * @param sh Shader state.
+ * @param type Register type.
+ * @param num Register number.
+ * @param swizzle Component swizzle.
+ * @param mod Source modifier (bit 0 - negate, bit 1 - absolute value).
+ * @param out Array to store operand value in.
+ */
+static void simSource(const simShader *sh, unsigned int type, unsigned int num,
+			unsigned int swizzle, unsigned int mod, float *out)
+{
+	static const float zero[4];
+	const float *src = zero;
+	float tmp[4];
+	int i;
+
+	switch (type) {
+	case REG_SRC_V:
+		if (num < sh->numInputs)
+			src = sh->v[num];
+		break;
+	case REG_SRC_R:
+		if (num < SIM_TEMPS)
+			src = sh->r[num];
+		break;
+	case REG_SRC_C:
+		if (num < SIM_CFLOATS)
+			src = sh->cfloat[num];
+		break;
+	case REG_SRC_I:
+		if (num < SIM_CINTS) {
+			for (i = 0; i < 4; ++i)
+				tmp[i] = sh->cint[num][i];
+			src = tmp;
+		}
+		break;
+	case REG_SRC_B:
+		tmp[0] = tmp[1] = tmp[2] = tmp[3] = (sh->cbool >> num) & 1;
+		src = tmp;
+		break;
+	case REG_SRC_VFACE:
+		tmp[0] = tmp[1] = tmp[2] = tmp[3] =
+				(sh->setup && sh->setup->back) ? -1.0f : 1.0f;
+		src = tmp;
+		break;
+	case REG_SRC_VPOS:
+		tmp[0] = sh->px;
+		tmp[1] = sh->py;
+		tmp[2] = tmp[3] = 0.0f;
+		src = tmp;
+		break;
+	}
+
+	for (i = 0; i < 4; ++i, swizzle >>= 2) {
+		float val = src[swizzle & 3];
+
+		if (mod & 2)
+			val = fabsf(val);
+		if (mod & 1)
+			val = -val;
+		out[i] = val;
+	}
+}
+
+/**
+ * Writes result of shader instruction to destination register.
+ * @param sh Shader state.
+ * @param instr Instruction.
+ * @param val Result.
+ */
+static void simDest(simShader *sh, const fimgShaderInstruction *instr,
+							const float *val)
+{
+	float *dst;
+	int i;
+
+	switch (instr->dest_regtype) {
+	case REG_DST_O:
+		if (sh->setup)
+			dst = sh->color;
+		else if (instr->dest_regnum < SIM_VS_OUTPUTS)
+			dst = sh->o[instr->dest_regnum];
+		else
+			return;
+		break;
+	case REG_DST_R:
+		dst = sh->r[instr->dest_regnum];
+		break;
+	case REG_DST_A0:
+		dst = sh->a0;
+		break;
+	default:
+		/* Predicates and loop counter are not modelled */
+		return;
+	}
+
+	for (i = 0; i < 4; ++i) {
+		if (!(instr->dest_mask & (1 << i)))
+			continue;
+		if (instr->dest_modifier == 1)
+			dst[i] = simClamp(val[i], 0.0f, 1.0f);
+		else
+			dst[i] = val[i];
+	}
+}
+
+/**
+ * Computes derivatives of interpolated pixel shader input.
+ * @param sh Shader state.
+ * @param attr Input attribute index.
+ * @param comp Component index.
+ * @param ddx Pointer to store horizontal derivative in.
+ * @param ddy Pointer to store vertical derivative in.
+ */
+static void simDerivative(const simShader *sh, unsigned int attr,
+			unsigned int comp, float *ddx, float *ddy)
+{
+	const simSetup *s = sh->setup;
+	const simPlane *p = &s->var[attr][comp];
+	float val;
+
+	if (s->flat & (1 << attr)) {
+		*ddx = *ddy = 0.0f;
+		return;
+	}
+
+	val = (p->a * sh->px + p->b * sh->py + p->c) / sh->q;
+	*ddx = (p->a - val * s->q.a) / sh->q;
+	*ddy = (p->b - val * s->q.b) / sh->q;
+}
+
+/**
+ * Computes level of detail for texture sampling instruction.
+ * Derivatives are known only for coordinates taken directly from
+ * pixel shader inputs, level 0 is used otherwise.
+ * @param sh Shader state.
+ * @param instr Texture sampling instruction.
+ * @param unit Texture unit index.
+ * @return Level of detail.
+ */
+static float simLod(const simShader *sh, const fimgShaderInstruction *instr,
+							unsigned int unit)
+{
+	const simTexUnit *t;
+	float dsdx, dsdy, dtdx, dtdy;
+	float rho;
+
+	if (!sh->setup || instr->src0_regtype != REG_SRC_V
+	    || instr->src0_regnum >= SIM_PS_INPUTS
+	    || unit >= FIMG_NUM_TEXTURE_UNITS)
+		return 0.0f;
+
+	t = &sh->d->unit[unit];
+	simDerivative(sh, instr->src0_regnum,
+			instr->src0_swizzle & 3, &dsdx, &dsdy);
+	simDerivative(sh, instr->src0_regnum,
+			(instr->src0_swizzle >> 2) & 3, &dtdx, &dtdy);
+
+	if (t->control.texCoordSys == FGTU_TSTA_TEX_COOR_PARAM) {
+		dsdx *= t->uSize;
+		dsdy *= t->uSize;
+		dtdx *= t->vSize;
+		dtdy *= t->vSize;
+	}
+
+	rho = fmaxf(sqrtf(dsdx*dsdx + dtdx*dtdx), sqrtf(dsdy*dsdy + dtdy*dtdy));
+	if (rho <= 0.0f)
+		return 0.0f;
+
+	return log2f(rho);
+}
+
+/**
+ * Executes shader program.
+ * Flow control other than ret, predication and relative addressing are
+ * not modelled.
+ * @param sh Shader state.
+ * @return Number of executed instructions.
+ */
+static unsigned int simExecute(simShader *sh)
+{
+	unsigned int pc;
+	unsigned int count = 0;
+
+	for (pc = sh->start; pc <= sh->end && pc < SIM_INSTRS; ++pc) {
+		const fimgShaderInstruction *instr =
+				(const fimgShaderInstruction *)sh->code[pc];
+		const fimgOpcodeInfo *info = &fimgOpcodeMap[instr->opcode];
+		float s0[4], s1[4], s2[4], res[4];
+		float val;
+		int i;
+
+		++count;
+
+		if (instr->opcode == OP_RET)
+			break;
+		if (info->type == OP_TYPE_FLOW || info->type == OP_TYPE_RESERVED)
+			continue;
+
+		simSource(sh, instr->src0_regtype, instr->src0_regnum
+				| (instr->src0_extnum << 5), instr->src0_swizzle,
+				instr->src0_modifier, s0);
+		if (info->srcCount > 1)
+			simSource(sh, instr->src1_regtype, instr->src1_regnum,
+				instr->src1_swizzle, instr->src1_modifier, s1);
+		if (info->srcCount > 2)
+			simSource(sh, instr->src2_regtype, instr->src2_regnum,
+				instr->src2_swizzle, instr->src2_modifier, s2);
+
+		switch (instr->opcode) {
+		case OP_MOV:
+		case OP_MOVA:
+		case OP_MOVC:
+			memcpy(res, s0, sizeof(res));
+			break;
+		case OP_ADD:
+			for (i = 0; i < 4; ++i)
+				res[i] = s0[i] + s1[i];
+			break;
+		case OP_MUL:
+		case OP_MUL_LIT:
+			for (i = 0; i < 4; ++i)
+				res[i] = s0[i] * s1[i];
+			break;
+		case OP_MAD:
+			for (i = 0; i < 4; ++i)
+				res[i] = s0[i] * s1[i] + s2[i];
+			break;
+		case OP_DP3:
+			val = s0[0]*s1[0] + s0[1]*s1[1] + s0[2]*s1[2];
+			res[0] = res[1] = res[2] = res[3] = val;
+			break;
+		case OP_DP4:
+			val = s0[0]*s1[0] + s0[1]*s1[1] + s0[2]*s1[2]
+				+ s0[3]*s1[3];
+			res[0] = res[1] = res[2] = res[3] = val;
+			break;
+		case OP_DPH:
+			val = s0[0]*s1[0] + s0[1]*s1[1] + s0[2]*s1[2] + s1[3];
+			res[0] = res[1] = res[2] = res[3] = val;
+			break;
+		case OP_DP2ADD:
+			val = s0[0]*s1[0] + s0[1]*s1[1] + s2[0];
+			res[0] = res[1] = res[2] = res[3] = val;
+			break;
+		case OP_DST:
+			res[0] = 1.0f;
+			res[1] = s0[1] * s1[1];
+			res[2] = s0[2];
+			res[3] = s1[3];
+			break;
+		case OP_EXP:
+		case OP_EXP_LIT:
+			for (i = 0; i < 4; ++i)
+				res[i] = exp2f(s0[i]);
+			break;
+		case OP_LOG:
+		case OP_LOG_LIT:
+			for (i = 0; i < 4; ++i)
+				res[i] = log2f(fabsf(s0[i]));
+			break;
+		case OP_RCP:
+			for (i = 0; i < 4; ++i)
+				res[i] = 1.0f / s0[i];
+			break;
+		case OP_RSQ:
+			for (i = 0; i < 4; ++i)
+				res[i] = 1.0f / sqrtf(fabsf(s0[i]));
+			break;
+		case OP_MAX:
+			for (i = 0; i < 4; ++i)
+				res[i] = fmaxf(s0[i], s1[i]);
+			break;
+		case OP_MIN:
+			for (i = 0; i < 4; ++i)
+				res[i] = fminf(s0[i], s1[i]);
+			break;
+		case OP_SGE:
+			for (i = 0; i < 4; ++i)
+				res[i] = s0[i] >= s1[i];
+			break;
+		case OP_SLT:
+			for (i = 0; i < 4; ++i)
+				res[i] = s0[i] < s1[i];
+			break;
+		case OP_CMP:
+			for (i = 0; i < 4; ++i)
+				res[i] = (s0[i] >= 0.0f) ? s1[i] : s2[i];
+			break;
+		case OP_FRC:
+			for (i = 0; i < 4; ++i)
+				res[i] = s0[i] - floorf(s0[i]);
+			break;
+		case OP_MAXCOMP:
+			val = fmaxf(fabsf(s0[0]), fmaxf(fabsf(s0[1]),
+							fabsf(s0[2])));
+			res[0] = res[1] = res[2] = res[3] = val;
+			break;
+		case OP_TEXLD:
+		case OP_TEXLDC:
+			if (!sh->d) {
+				res[0] = res[1] = res[2] = 0.0f;
+				res[3] = 1.0f;
+				break;
+			}
+			simSample(sh->d, instr->src1_regnum, s0,
+				simLod(sh, instr, instr->src1_regnum), res);
+			break;
+		case OP_TEXKILL:
+			for (i = 0; i < 4; ++i)
+				if (s0[i] < 0.0f)
+					sh->kill = 1;
+			continue;
+		default:
+			/* Predicate setup and integer operations */
+			continue;
+		}
+
+		simDest(sh, instr, res);
+	}
+
+	return count;
+}
+
+/*
+ * Vertex processing
+ */
+
+/**
+ * Runs vertex shader for a vertex.
+ * @param d Draw state.
+ * @param index Vertex index in vertex buffer.
+ * @param out Structure to store processed vertex in.
+ */
+static void simProcessVertex(simDraw *d, unsigned int index, simVertex *out)
+{
+	float in[SIM_VS_INPUTS][4];
+	simShader sh;
+	unsigned int i;
+
+	memset(&sh, 0, sizeof(sh));
+	sh.code = (const uint32_t (*)[4])d->vsCode;
+	sh.cfloat = (const float (*)[4])d->vsConst;
+	sh.cint = (const int32_t (*)[4])d->vsInt;
+	sh.cbool = d->vsBool;
+	sh.start = d->vsStart;
+	sh.end = d->vsEnd;
+	sh.v = in;
+	sh.numInputs = d->vsInputs;
+
+	for (i = 0; i < d->vsInputs; ++i)
+		simFetchAttrib(d, i, index, in[i]);
+
+	d->sim->stats.vsInstructions += simExecute(&sh);
+
+	memcpy(out->pos, sh.o[0], sizeof(out->pos));
+	for (i = 0; i < SIM_PS_INPUTS; ++i)
+		memcpy(out->var[i], sh.o[i + 1], sizeof(out->var[i]));
+
+	out->pointSize = d->pointWidth;
+	if (d->vctx.pointSize && d->vctx.vsOut < SIM_VS_OUTPUTS)
+		out->pointSize = sh.o[d->vctx.vsOut][0];
+	out->pointSize = simClamp(out->pointSize,
+				d->pointWidthMin, d->pointWidthMax);
+}
+
+/*
+ * Per-fragment operations
+ */
+
+static int simTest(unsigned int mode, uint32_t a, uint32_t b)
+{
+	switch (mode) {
+	case FGPF_TEST_MODE_NEVER:
+		return 0;
+	case FGPF_TEST_MODE_ALWAYS:
+		return 1;
+	case FGPF_TEST_MODE_LESS:
+		return a < b;
+	case FGPF_TEST_MODE_LEQUAL:
+		return a <= b;
+	case FGPF_TEST_MODE_EQUAL:
+		return a == b;
+	case FGPF_TEST_MODE_GREATER:
+		return a > b;
+	case FGPF_TEST_MODE_GEQUAL:
+		return a >= b;
+	default:
+		return a != b;
+	}
+}
+
+static int simStencilTest(unsigned int mode, uint32_t ref, uint32_t val)
+{
+	switch (mode) {
+	case FGPF_STENCIL_MODE_NEVER:
+		return 0;
+	case FGPF_STENCIL_MODE_ALWAYS:
+		return 1;
+	case FGPF_STENCIL_MODE_GREATER:
+		return ref > val;
+	case FGPF_STENCIL_MODE_GEQUAL:
+		return ref >= val;
+	case FGPF_STENCIL_MODE_EQUAL:
+		return ref == val;
+	case FGPF_STENCIL_MODE_LESS:
+		return ref < val;
+	case FGPF_STENCIL_MODE_LEQUAL:
+		return ref <= val;
+	default:
+		return ref != val;
+	}
+}
+
+static uint32_t simStencilOp(unsigned int op, uint32_t ref, uint32_t val)
+{
+	switch (op) {
+	case FGPF_TEST_ACTION_KEEP:
+		return val;
+	case FGPF_TEST_ACTION_ZERO:
+		return 0;
+	case FGPF_TEST_ACTION_REPLACE:
+		return ref;
+	case FGPF_TEST_ACTION_INCR:
+		return (val < 0xff) ? val + 1 : val;
+	case FGPF_TEST_ACTION_DECR:
+		return val ? val - 1 : val;
+	case FGPF_TEST_ACTION_INVERT:
+		return ~val & 0xff;
+	case FGPF_TEST_ACTION_INCR_WRAP:
+		return (val + 1) & 0xff;
+	default:
+		return (val - 1) & 0xff;
+	}
+}
+
+/* Component layout of framebuffer color modes: shift and width of R, G, B, A */
+static const uint8_t simColorLayout[][8] = {
+	[FGPF_COLOR_MODE_555]	= { 10, 5, 5, 5, 0, 5, 0, 0 },
+	[FGPF_COLOR_MODE_565]	= { 11, 5, 5, 6, 0, 5, 0, 0 },
+	[FGPF_COLOR_MODE_4444]	= { 8, 4, 4, 4, 0, 4, 12, 4 },
+	[FGPF_COLOR_MODE_1555]	= { 10, 5, 5, 5, 0, 5, 15, 1 },
+	[FGPF_COLOR_MODE_0888]	= { 16, 8, 8, 8, 0, 8, 0, 0 },
+	[FGPF_COLOR_MODE_8888]	= { 16, 8, 8, 8, 0, 8, 24, 8 },
+};
+
+static float simBlendFactor(const simDraw *d, unsigned int func,
+		const float *src, const float *dst, unsigned int comp)
+{
+	switch (func) {
+	case FGPF_BLEND_FUNC_ZERO:
+		return 0.0f;
+	case FGPF_BLEND_FUNC_ONE:
+		return 1.0f;
+	case FGPF_BLEND_FUNC_SRC_COLOR:
+		return src[comp];
+	case FGPF_BLEND_FUNC_ONE_MINUS_SRC_COLOR:
+		return 1.0f - src[comp];
+	case FGPF_BLEND_FUNC_DST_COLOR:
+		return dst[comp];
+	case FGPF_BLEND_FUNC_ONE_MINUS_DST_COLOR:
+		return 1.0f - dst[comp];
+	case FGPF_BLEND_FUNC_SRC_ALPHA:
+		return src[3];
+	case FGPF_BLEND_FUNC_ONE_MINUS_SRC_ALPHA:
+		return 1.0f - src[3];
+	case FGPF_BLEND_FUNC_DST_ALPHA:
+		return dst[3];
+	case FGPF_BLEND_FUNC_ONE_MINUS_DST_ALPHA:
+		return 1.0f - dst[3];
+	case FGPF_BLEND_FUNC_CONST_COLOR:
+		return d->blendColor[comp];
+	case FGPF_BLEND_FUNC_ONE_MINUS_CONST_COLOR:
+		return 1.0f - d->blendColor[comp];
+	case FGPF_BLEND_FUNC_CONST_ALPHA:
+		return d->blendColor[3];
+	case FGPF_BLEND_FUNC_ONE_MINUS_CONST_ALPHA:
+		return 1.0f - d->blendColor[3];
+	default:
+		return (comp == 3) ? 1.0f : fminf(src[3], 1.0f - dst[3]);
+	}
+}
+
+static float simBlendEquation(unsigned int eq, float s, float sf,
+							float dst, float df)
+{
+	switch (eq) {
+	case FGPF_BLEND_EQUATION_ADD:
+		return s*sf + dst*df;
+	case FGPF_BLEND_EQUATION_SUB:
+		return s*sf - dst*df;
+	case FGPF_BLEND_EQUATION_REVSUB:
+		return dst*df - s*sf;
+	case FGPF_BLEND_EQUATION_MIN:
+		return fminf(s, dst);
+	default:
+		return fmaxf(s, dst);
+	}
+}
+
+static uint32_t simLogicOp(unsigned int op, uint32_t s, uint32_t dst)
+{
+	switch (op) {
+	case FGPF_LOGOP_CLEAR:
+		return 0;
+	case FGPF_LOGOP_AND:
+		return s & dst;
+	case FGPF_LOGOP_AND_REVERSE:
+		return s & ~dst;
+	case FGPF_LOGOP_COPY:
+		return s;
+	case FGPF_LOGOP_AND_INVERTED:
+		return ~s & dst;
+	case FGPF_LOGOP_NOOP:
+		return dst;
+	case FGPF_LOGOP_XOR:
+		return s ^ dst;
+	case FGPF_LOGOP_OR:
+		return s | dst;
+	case FGPF_LOGOP_NOR:
+		return ~(s | dst);
+	case FGPF_LOGOP_EQUIV:
+		return ~(s ^ dst);
+	case FGPF_LOGOP_INVERT:
+		return ~dst;
+	case FGPF_LOGOP_OR_REVERSE:
+		return s | ~dst;
+	case FGPF_LOGOP_COPY_INVERTED:
+		return ~s;
+	case FGPF_LOGOP_OR_INVERTED:
+		return ~s | dst;
+	case FGPF_LOGOP_NAND:
+		return ~(s & dst);
+	default:
+		return ~0U;
+	}
+}
+
+/**
+ * Performs stencil and depth tests, updating depth/stencil buffer.
+ * @param d Draw state.
+ * @param zptr Pointer to depth/stencil value or NULL if not available.
+ * @param z Fragment depth in [0, 1] range.
+ * @param back Non-zero for back facing fragments.
+ * @return Non-zero if the fragment passed both tests.
+ */
+static int simDepthStencil(simDraw *d, uint32_t *zptr, float z, int back)
+{
+	const fimgStencilTestData *st = back ? &d->stBack : &d->stFront;
+	uint32_t wmask = ~(back ? d->dbmask.backmask : d->dbmask.frontmask);
+	uint32_t stored, stencil, depth;
+	unsigned int op;
+	int pass = 1;
+
+	if (!zptr)
+		return 1;
+
+	stored = *zptr;
+	stencil = stored >> 24;
+	depth = z * 0xffffff + 0.5f;
+
+	if (st->enable) {
+		if (!simStencilTest(st->mode, st->ref & st->mask,
+						stencil & st->mask)) {
+			++d->sim->stats.stencilFailed;
+			op = st->sfail;
+			pass = 0;
+		} else if (d->depth.enable
+		    && !simTest(d->depth.mode, depth, stored & 0xffffff)) {
+			++d->sim->stats.depthFailed;
+			op = st->dpfail;
+			pass = 0;
+		} else {
+			op = st->dppass;
+		}
+
+		stencil = simStencilOp(op, st->ref, stencil) & wmask & 0xff;
+		stencil |= (stored >> 24) & ~wmask & 0xff;
+	} else if (d->depth.enable
+	    && !simTest(d->depth.mode, depth, stored & 0xffffff)) {
+		++d->sim->stats.depthFailed;
+		pass = 0;
+	}
+
+	if (!pass || !d->depth.enable || d->dbmask.depth)
+		depth = stored & 0xffffff;
+
+	*zptr = (stencil << 24) | depth;
+	return pass;
+}
+
+/**
+ * Performs blending, logical operation and masking and writes the color.
+ * @param d Draw state.
+ * @param cptr Pointer to destination pixel.
+ * @param color Fragment color.
+ */
+static void simWriteColor(simDraw *d, uint8_t *cptr, const float *color)
+{
+	const uint8_t *l = simColorLayout[d->fbctl.colormode];
+	uint32_t dst = 0, src = 0, wmask = 0, cmask = 0;
+	float dcol[4];
+	float scol[4];
+	int i;
+
+	memcpy(&dst, cptr, d->bpp);
+
+	for (i = 0; i < 4; ++i) {
+		uint32_t max = (1 << l[2*i + 1]) - 1;
+		uint32_t chanMask = max << l[2*i];
+
+		if (!l[2*i + 1]) {
+			dcol[i] = d->fbctl.alphaconst / 255.0f;
+			continue;
+		}
+
+		dcol[i] = (float)((dst >> l[2*i]) & max) / max;
+		if (!(d->mask.val & (8 >> i)))
+			wmask |= chanMask;
+		if (i < 3)
+			cmask |= chanMask;
+	}
+
+	memcpy(scol, color, sizeof(scol));
+
+	if (d->blend.enable && !d->logop.enable) {
+		float res[4];
+
+		for (i = 0; i < 4; ++i) {
+			unsigned int sfunc = (i < 3) ? d->blend.csrcblendfunc
+						: d->blend.asrcblendfunc;
+			unsigned int dfunc = (i < 3) ? d->blend.cdstblendfunc
+						: d->blend.adstblendfunc;
+			unsigned int eq = (i < 3) ? d->blend.cblendequation
+						: d->blend.ablendequation;
+
+			res[i] = simBlendEquation(eq, scol[i],
+				simBlendFactor(d, sfunc, scol, dcol, i),
+				dcol[i], simBlendFactor(d, dfunc, scol, dcol, i));
+		}
+
+		for (i = 0; i < 4; ++i)
+			scol[i] = simClamp(res[i], 0.0f, 1.0f);
+	}
+
+	for (i = 0; i < 4; ++i) {
+		uint32_t max = (1 << l[2*i + 1]) - 1;
+
+		if (!l[2*i + 1])
+			continue;
+		src |= (uint32_t)(scol[i] * max + 0.5f) << l[2*i];
+	}
+
+	if (d->logop.enable)
+		src = (simLogicOp(d->logop.color, src, dst) & cmask)
+			| (simLogicOp(d->logop.alpha, src, dst) & ~cmask);
+
+	dst = (dst & ~wmask) | (src & wmask);
+	memcpy(cptr, &dst, d->bpp);
+	++d->sim->stats.written;
+}
+
+/**
+ * Processes a fragment: runs pixel shader and per-fragment operations.
+ * @param d Draw state.
+ * @param s Interpolation setup of the primitive.
+ * @param x Pixel column.
+ * @param y Pixel row.
+ * @param px Horizontal sample position.
+ * @param py Vertical sample position.
+ * @param z Fragment depth.
+ */
+static void simFragment(simDraw *d, const simSetup *s, int x, int y,
+					float px, float py, float z)
+{
+	fimgSim *sim = d->sim;
+	float in[SIM_PS_INPUTS][4];
+	uint32_t *zptr = NULL;
+	unsigned long offset;
+	simShader sh;
+	unsigned int i, c;
+	uint8_t a8;
+
+	++sim->stats.fragments;
+
+	memset(&sh, 0, sizeof(sh));
+	sh.code = (const uint32_t (*)[4])d->psCode;
+	sh.cfloat = (const float (*)[4])d->psConst;
+	sh.cint = (const int32_t (*)[4])d->psInt;
+	sh.cbool = d->psBool;
+	sh.start = d->psStart;
+	sh.end = d->psEnd;
+	sh.v = in;
+	sh.numInputs = SIM_PS_INPUTS;
+	sh.d = d;
+	sh.setup = s;
+	sh.px = px;
+	sh.py = py;
+	sh.q = s->q.a * px + s->q.b * py + s->q.c;
+
+	for (i = 0; i < SIM_PS_INPUTS; ++i) {
+		for (c = 0; c < 4; ++c) {
+			const simPlane *p = &s->var[i][c];
+
+			in[i][c] = p->a * px + p->b * py + p->c;
+			if (!(s->flat & (1 << i)))
+				in[i][c] /= sh.q;
+		}
+	}
+
+	++sim->stats.shaded;
+	sim->stats.psInstructions += simExecute(&sh);
+
+	if (sh.kill) {
+		++sim->stats.killed;
+		return;
+	}
+
+	for (c = 0; c < 4; ++c)
+		sh.color[c] = simClamp(sh.color[c], 0.0f, 1.0f);
+
+	if (d->alpha.enable) {
+		a8 = sh.color[3] * 255.0f + 0.5f;
+		if (!simTest(d->alpha.mode, a8, d->alpha.value)) {
+			++sim->stats.alphaFailed;
+			return;
+		}
+	}
+
+	offset = (unsigned long)y * d->width + x;
+	if (d->zbuf && 4*(offset + 1) <= d->zbufSize)
+		zptr = &d->zbuf[offset];
+
+	if (!simDepthStencil(d, zptr, z, s->back))
+		return;
+
+	if (d->color && d->bpp*(offset + 1) <= d->colorSize)
+		simWriteColor(d, d->color + d->bpp*offset, sh.color);
+}
+
+/*
+ * Rasterization
+ */
+
+/**
+ * Calculates plane equation of a value interpolated over a triangle.
+ * @param p Structure to store plane equation in.
+ * @param v Triangle vertices.
+ * @param f Values at the vertices.
+ * @param area Doubled signed area of the triangle.
+ */
+static void simPlaneSetup(simPlane *p, const simWinVertex *const *v,
+					const float *f, float area)
+{
+	float dx1 = v[1]->x - v[0]->x, dy1 = v[1]->y - v[0]->y;
+	float dx2 = v[2]->x - v[0]->x, dy2 = v[2]->y - v[0]->y;
+	float df1 = f[1] - f[0], df2 = f[2] - f[0];
+
+	p->a = (df1 * dy2 - df2 * dy1) / area;
+	p->b = (df2 * dx1 - df1 * dx2) / area;
+	p->c = f[0] - p->a * v[0]->x - p->b * v[0]->y;
+}
+
+/**
+ * Checks whether edge owns samples lying exactly on it (fill rule).
+ * @param a Start of the edge.
+ * @param b End of the edge.
+ * @return Non-zero if samples on the edge belong to the triangle.
+ */
+static inline int simEdgeOwns(const simWinVertex *a, const simWinVertex *b)
+{
+	float dy = b->y - a->y;
+
+	return dy > 0.0f || (simIsZero(dy) && b->x < a->x);
+}
+
+/**
+ * Rasterizes a triangle in window coordinates.
+ * @param d Draw state.
+ * @param v0 First vertex.
+ * @param v1 Second vertex.
+ * @param v2 Third vertex.
+ * @param flatv Vertex providing flat shaded attributes.
+ * @param back Non-zero for back facing triangle.
+ * @param offset Non-zero to apply depth offset.
+ */
+static void simTriangle(simDraw *d, const simWinVertex *v0,
+			const simWinVertex *v1, const simWinVertex *v2,
+			const simWinVertex *flatv, int back, int offset)
+{
+	const simWinVertex *v[3] = { v0, v1, v2 };
+	const simWinVertex *tmp;
+	simSetup s;
+	float area, f[3], bias = 0.0f;
+	float minx, maxx, miny, maxy;
+	int x0, x1, y0, y1, x, y;
+	int own0, own1, own2;
+	unsigned int i, c;
+
+	area = (v[1]->x - v[0]->x) * (v[2]->y - v[0]->y)
+		- (v[2]->x - v[0]->x) * (v[1]->y - v[0]->y);
+	if (simIsZero(area) || !isfinite(area))
+		return;
+
+	if (area < 0.0f) {
+		tmp = v[1];
+		v[1] = v[2];
+		v[2] = tmp;
+		area = -area;
+	}
+
+	s.back = back;
+	s.flat = 0;
+	if (d->vctx.flatShadeEn)
+		s.flat = d->vctx.flatShadeSel >> 1;
+
+	for (i = 0; i < 3; ++i)
+		f[i] = v[i]->z;
+	simPlaneSetup(&s.z, v, f, area);
+
+	for (i = 0; i < 3; ++i)
+		f[i] = v[i]->q;
+	simPlaneSetup(&s.q, v, f, area);
+
+	for (i = 0; i < SIM_PS_INPUTS; ++i) {
+		for (c = 0; c < 4; ++c) {
+			if (s.flat & (1 << i)) {
+				s.var[i][c].a = s.var[i][c].b = 0.0f;
+				s.var[i][c].c = flatv->var[i][c];
+				continue;
+			}
+			f[0] = v[0]->var[i][c] * v[0]->q;
+			f[1] = v[1]->var[i][c] * v[1]->q;
+			f[2] = v[2]->var[i][c] * v[2]->q;
+			simPlaneSetup(&s.var[i][c], v, f, area);
+		}
+	}
+
+	if (offset && d->dOffEn)
+		bias = d->dOffFactor * fmaxf(fabsf(s.z.a), fabsf(s.z.b))
+			+ d->dOffUnits / 16777216.0f;
+
+	minx = fminf(v[0]->x, fminf(v[1]->x, v[2]->x));
+	maxx = fmaxf(v[0]->x, fmaxf(v[1]->x, v[2]->x));
+	miny = fminf(v[0]->y, fminf(v[1]->y, v[2]->y));
+	maxy = fmaxf(v[0]->y, fmaxf(v[1]->y, v[2]->y));
+
+	x0 = simClampInt(floorf(minx - d->sampleOffset), d->xmin, d->xmax);
+	x1 = simClampInt(ceilf(maxx - d->sampleOffset) + 1, d->xmin, d->xmax);
+	y0 = simClampInt(floorf(miny - d->sampleOffset), d->ymin, d->ymax);
+	y1 = simClampInt(ceilf(maxy - d->sampleOffset) + 1, d->ymin, d->ymax);
+
+	own0 = simEdgeOwns(v[1], v[2]);
+	own1 = simEdgeOwns(v[2], v[0]);
+	own2 = simEdgeOwns(v[0], v[1]);
+
+	for (y = y0; y < y1; ++y) {
+		float py = y + d->sampleOffset;
+
+		for (x = x0; x < x1; ++x) {
+			float px = x + d->sampleOffset;
+			float e0, e1, e2;
+
+			e0 = (v[2]->x - v[1]->x) * (py - v[1]->y)
+				- (v[2]->y - v[1]->y) * (px - v[1]->x);
+			e1 = (v[0]->x - v[2]->x) * (py - v[2]->y)
+				- (v[0]->y - v[2]->y) * (px - v[2]->x);
+			e2 = (v[1]->x - v[0]->x) * (py - v[0]->y)
+				- (v[1]->y - v[0]->y) * (px - v[0]->x);
+
+			if (e0 < 0.0f || (simIsZero(e0) && !own0)
+			    || e1 < 0.0f || (simIsZero(e1) && !own1)
+			    || e2 < 0.0f || (simIsZero(e2) && !own2))
+				continue;
+
+			simFragment(d, &s, x, y, px, py, simClamp(s.z.a * px
+				+ s.z.b * py + s.z.c + bias, 0.0f, 1.0f));
+		}
+	}
+}
+
+/**
+ * Transforms vertex from clip coordinates to window coordinates.
+ * @param d Draw state.
+ * @param in Vertex in clip coordinates.
+ * @param out Structure to store vertex in window coordinates in.
+ */
+static void simViewport(const simDraw *d, const simVertex *in,
+							simWinVertex *out)
+{
+	float q = 1.0f / in->pos[3];
+
+	out->x = d->ox + d->halfPX * in->pos[0] * q;
+	out->y = d->oy + d->halfPY * in->pos[1] * q;
+	out->z = d->center + d->halfDistance * in->pos[2] * q;
+	out->q = q;
+	memcpy(out->var, in->var, sizeof(out->var));
+}
+
+/**
+ * Computes signed distance of a vertex from a clipping plane.
+ * @param v Vertex in clip coordinates.
+ * @param plane Plane index (-x, +x, -y, +y, -z, +z).
+ * @return Distance, negative outside the view volume.
+ */
+static inline float simClipDistance(const simVertex *v, unsigned int plane)
+{
+	float val = v->pos[plane / 2];
+
+	return v->pos[3] + ((plane & 1) ? -val : val);
+}
+
+static void simLerpVertex(simVertex *out, const simVertex *a,
+					const simVertex *b, float t)
+{
+	const float *pa = (const float *)a;
+	const float *pb = (const float *)b;
+	float *po = (float *)out;
+	unsigned int i;
+
+	for (i = 0; i < sizeof(simVertex) / sizeof(float); ++i)
+		po[i] = pa[i] + (pb[i] - pa[i]) * t;
+}
+
+/**
+ * Clips polygon against the view volume.
+ * @param v Array of polygon vertices (with space for SIM_CLIP_VERTICES).
+ * @param count Vertex count.
+ * @return Vertex count of clipped polygon.
+ */
+static unsigned int simClipPolygon(simVertex *v, unsigned int count)
+{
+	simVertex tmp[SIM_CLIP_VERTICES];
+	unsigned int plane, i, out;
+
+	for (plane = 0; plane < 6 && count >= 3; ++plane) {
+		out = 0;
+
+		for (i = 0; i < count; ++i) {
+			const simVertex *a = &v[i];
+			const simVertex *b = &v[(i + 1) % count];
+			float da = simClipDistance(a, plane);
+			float db = simClipDistance(b, plane);
+
+			if (da >= 0.0f && out < SIM_CLIP_VERTICES)
+				tmp[out++] = *a;
+			if ((da >= 0.0f) != (db >= 0.0f)
+			    && out < SIM_CLIP_VERTICES)
+				simLerpVertex(&tmp[out++], a, b,
+							da / (da - db));
+		}
+
+		memcpy(v, tmp, out * sizeof(*v));
+		count = out;
+	}
+
+	return count;
+}
+
+/**
+ * Processes a triangle: clipping, culling and rasterization.
+ * @param d Draw state.
+ * @param a First vertex.
+ * @param b Second vertex.
+ * @param c Third vertex.
+ */
+static void simDrawTriangle(simDraw *d, const simVertex *a,
+				const simVertex *b, const simVertex *c)
+{
+	simVertex v[SIM_CLIP_VERTICES];
+	simWinVertex w[SIM_CLIP_VERTICES];
+	simWinVertex flat;
+	unsigned int count, i;
+	float area = 0.0f;
+	int back;
+
+	++d->sim->stats.primitives;
+
+	v[0] = *a;
+	v[1] = *b;
+	v[2] = *c;
+	count = simClipPolygon(v, 3);
+	if (count < 3) {
+		++d->sim->stats.culled;
+		return;
+	}
+
+	for (i = 0; i < count; ++i)
+		simViewport(d, &v[i], &w[i]);
+
+	/* Orientation in normalized device coordinates */
+	for (i = 0; i < count; ++i) {
+		const simWinVertex *p = &w[i];
+		const simWinVertex *n = &w[(i + 1) % count];
+
+		area += (p->x - d->ox) * (n->y - d->oy)
+			- (n->x - d->ox) * (p->y - d->oy);
+	}
+	if (d->halfPX * d->halfPY < 0.0f)
+		area = -area;
+
+	back = d->cull.clockwise ? (area > 0.0f) : (area < 0.0f);
+
+	if (d->cull.enable) {
+		if (d->cull.face == FGRA_BFCULL_FACE_BOTH
+		    || (d->cull.face == FGRA_BFCULL_FACE_BACK && back)
+		    || (d->cull.face == FGRA_BFCULL_FACE_FRONT && !back)) {
+			++d->sim->stats.culled;
+			return;
+		}
+	}
+
+	/* Flat shaded attributes come from last vertex of the primitive */
+	memcpy(flat.var, c->var, sizeof(flat.var));
+
+	for (i = 1; i + 1 < count; ++i)
+		simTriangle(d, &w[0], &w[i], &w[i + 1], &flat, back, 1);
+}
+
+/**
+ * Rasterizes a window aligned or oriented quad as two triangles.
+ * @param d Draw state.
+ * @param q Quad vertices in window coordinates.
+ * @param flatv Vertex providing flat shaded attributes.
+ */
+static void simQuad(simDraw *d, const simWinVertex *q,
+					const simWinVertex *flatv)
+{
+	simTriangle(d, &q[0], &q[1], &q[2], flatv, 0, 0);
+	simTriangle(d, &q[0], &q[2], &q[3], flatv, 0, 0);
+}
+
+/**
+ * Processes a line: clipping and rasterization as a quad of line width.
+ * @param d Draw state.
+ * @param a First vertex.
+ * @param b Second vertex.
+ */
+static void simDrawLine(simDraw *d, const simVertex *a, const simVertex *b)
+{
+	simVertex v[2];
+	simWinVertex w[2], q[4];
+	float t0 = 0.0f, t1 = 1.0f;
+	float dx, dy, len, nx, ny;
+	unsigned int plane, i;
+
+	++d->sim->stats.primitives;
+
+	for (plane = 0; plane < 6; ++plane) {
+		float da = simClipDistance(a, plane);
+		float db = simClipDistance(b, plane);
+
+		if (da < 0.0f && db < 0.0f) {
+			++d->sim->stats.culled;
+			return;
+		}
+		if (da < 0.0f)
+			t0 = fmaxf(t0, da / (da - db));
+		else if (db < 0.0f)
+			t1 = fminf(t1, da / (da - db));
+	}
+	if (t0 >= t1) {
+		++d->sim->stats.culled;
+		return;
+	}
+
+	simLerpVertex(&v[0], a, b, t0);
+	simLerpVertex(&v[1], a, b, t1);
+	simViewport(d, &v[0], &w[0]);
+	simViewport(d, &v[1], &w[1]);
+
+	dx = w[1].x - w[0].x;
+	dy = w[1].y - w[0].y;
+	len = sqrtf(dx*dx + dy*dy);
+	if (simIsZero(len))
+		return;
+
+	nx = -dy / len * d->lineWidth / 2;
+	ny = dx / len * d->lineWidth / 2;
+
+	for (i = 0; i < 4; ++i) {
+		const simWinVertex *e = &w[(i == 1 || i == 2) ? 1 : 0];
+		float side = (i < 2) ? 1.0f : -1.0f;
+
+		q[i] = *e;
+		q[i].x += side * nx;
+		q[i].y += side * ny;
+	}
+
+	simQuad(d, q, &w[1]);
+}
+
+/**
+ * Processes a point: clipping and rasterization as a square of point size.
+ * @param d Draw state.
+ * @param a Vertex.
+ * @param sprite Non-zero to replace texture coordinates (point sprites).
+ */
+static void simDrawPoint(simDraw *d, const simVertex *a, int sprite)
+{
+	simWinVertex w, q[4];
+	float half = a->pointSize / 2;
+	float dir = (d->halfPY < 0.0f) ? 1.0f : -1.0f;
+	unsigned int plane, i, attr;
+
+	++d->sim->stats.primitives;
+
+	for (plane = 0; plane < 6; ++plane) {
+		if (simClipDistance(a, plane) < 0.0f) {
+			++d->sim->stats.culled;
+			return;
+		}
+	}
+
+	simViewport(d, a, &w);
+
+	for (i = 0; i < 4; ++i) {
+		float s = (i == 1 || i == 2) ? 1.0f : 0.0f;
+		float t = (i < 2) ? 0.0f : 1.0f;
+
+		q[i] = w;
+		q[i].x += (2*s - 1) * half;
+		/* Texture coordinate t grows downwards on screen */
+		q[i].y += (2*t - 1) * half * dir;
+
+		if (!sprite)
+			continue;
+
+		for (attr = 0; attr < SIM_PS_INPUTS; ++attr) {
+			if (!(d->coordReplace & (1 << (attr + 1))))
+				continue;
+			q[i].var[attr][0] = s;
+			q[i].var[attr][1] = t;
+			q[i].var[attr][2] = 0.0f;
+			q[i].var[attr][3] = 1.0f;
+		}
+	}
+
+	simQuad(d, q, &w);
+}
+
+/*
+ * Draw requests
+ */
+
+/**
+ * Loads register state needed to execute a draw request.
+ * @param ctx Hardware context.
+ * @param d Draw state to initialize.
+ */
+static void simLoadState(fimgContext *ctx, simDraw *d)
+{
+	fimgClippingControl clip;
+	fimgScissorTestData scissor;
+	uint32_t range, cclr;
+	unsigned int i;
+
+	d->sim = ctx->backendData;
+	d->regs = (const uint8_t *)ctx->base;
+
+	/* Vertex shader */
+	memcpy(d->vsCode, d->regs + FGVS_INSTMEM_START, sizeof(d->vsCode));
+	memcpy(d->vsConst, d->regs + FGVS_CFLOAT_START, sizeof(d->vsConst));
+	memcpy(d->vsInt, d->regs + FGVS_CINT_START, sizeof(d->vsInt));
+	d->vsBool = simReg(d, FGVS_CBOOL_START);
+	/* PCStart:9, PCEnd:9 at bit 16, ignorePCEnd at bit 31 */
+	range = simReg(d, FGVS_PCRANGE);
+	d->vsStart = range & 0x1ff;
+	d->vsEnd = (range >> 31) ? SIM_INSTRS - 1 : (range >> 16) & 0x1ff;
+	d->vsInputs = simReg(d, FGVS_ATTRIB_NUM);
+	if (d->vsInputs > SIM_VS_INPUTS)
+		d->vsInputs = SIM_VS_INPUTS;
+
+	/* Primitive engine */
+	d->vctx.val = simReg(d, FGPE_VERTEX_CONTEXT);
+	d->ox = simRegF(d, FGPE_VIEWPORT_OX);
+	d->oy = simRegF(d, FGPE_VIEWPORT_OY);
+	d->halfPX = simRegF(d, FGPE_VIEWPORT_HALF_PX);
+	d->halfPY = simRegF(d, FGPE_VIEWPORT_HALF_PY);
+	d->halfDistance = simRegF(d, FGPE_DEPTHRANGE_HALF_F_SUB_N);
+	d->center = simRegF(d, FGPE_DEPTHRANGE_HALF_F_ADD_N);
+
+	/* Raster engine */
+	d->sampleOffset = simReg(d, FGRA_PIX_SAMP) ? 0.0f : 0.5f;
+	d->dOffEn = simReg(d, FGRA_D_OFF_EN) & 1;
+	d->dOffFactor = simRegF(d, FGRA_D_OFF_FACTOR);
+	d->dOffUnits = simRegF(d, FGRA_D_OFF_UNITS);
+	d->cull.val = simReg(d, FGRA_BFCULL);
+	d->pointWidth = simRegF(d, FGRA_PWIDTH);
+	d->pointWidthMin = simRegF(d, FGRA_PSIZE_MIN);
+	d->pointWidthMax = simRegF(d, FGRA_PSIZE_MAX);
+	d->coordReplace = simReg(d, FGRA_COORDREPLACE);
+	d->lineWidth = simRegF(d, FGRA_LWIDTH);
+	if (d->pointWidthMax <= 0.0f)
+		d->pointWidthMax = 2048.0f;
+	if (d->lineWidth <= 0.0f)
+		d->lineWidth = 1.0f;
+
+	/* Pixel shader */
+	memcpy(d->psCode, d->regs + FGPS_INSTMEM_START, sizeof(d->psCode));
+	memcpy(d->psConst, d->regs + FGPS_CFLOAT_START, sizeof(d->psConst));
+	memcpy(d->psInt, d->regs + FGPS_CINT_START, sizeof(d->psInt));
+	d->psBool = simReg(d, FGPS_CBOOL_START);
+	d->psStart = simReg(d, FGPS_PC_START) & 0x1ff;
+	d->psEnd = simReg(d, FGPS_PC_END) & 0x1ff;
+
+	for (i = 0; i < FIMG_NUM_TEXTURE_UNITS; ++i)
+		simLoadTexUnit(d, i);
+
+	/* Per-fragment unit */
+	d->alpha.val = simReg(d, FGPF_ALPHAT);
+	d->stFront.val = simReg(d, FGPF_FRONTST);
+	d->stBack.val = simReg(d, FGPF_BACKST);
+	d->depth.val = simReg(d, FGPF_DEPTHT);
+	d->blend.val = simReg(d, FGPF_BLEND);
+	d->logop.val = simReg(d, FGPF_LOGOP);
+	d->mask.val = simReg(d, FGPF_CBMSK);
+	d->dbmask.val = simReg(d, FGPF_DBMSK);
+	d->fbctl.val = simReg(d, FGPF_FBCTL);
+
+	cclr = simReg(d, FGPF_CCLR);
+	d->blendColor[0] = (cclr >> 24) / 255.0f;
+	d->blendColor[1] = ((cclr >> 16) & 0xff) / 255.0f;
+	d->blendColor[2] = ((cclr >> 8) & 0xff) / 255.0f;
+	d->blendColor[3] = (cclr & 0xff) / 255.0f;
+
+	if (d->fbctl.colormode >= NELEM(simColorLayout))
+		d->fbctl.colormode = FGPF_COLOR_MODE_8888;
+	d->bpp = (d->fbctl.colormode >= FGPF_COLOR_MODE_0888) ? 4 : 2;
+	d->width = simReg(d, FGPF_FBW);
+	d->color = simResolve(simReg(d, FGPF_CBADDR), &d->colorSize);
+	d->zbuf = (uint32_t *)simResolve(simReg(d, FGPF_DBADDR), &d->zbufSize);
+	d->height = d->width ? d->colorSize / (d->width * d->bpp) : 0;
+
+	/* Early fragment clipping */
+	clip.val = simReg(d, FGRA_XCLIP);
+	d->xmin = clip.minval;
+	d->xmax = clip.maxval;
+	clip.val = simReg(d, FGRA_YCLIP);
+	d->ymin = clip.minval;
+	d->ymax = clip.maxval;
+
+	scissor.val = simReg(d, FGPF_SCISSOR_X);
+	if (scissor.enable) {
+		d->xmin = simClampInt(d->xmin, scissor.min, scissor.max);
+		d->xmax = simClampInt(d->xmax, scissor.min, scissor.max);
+	}
+	scissor.val = simReg(d, FGPF_SCISSOR_Y);
+	if (scissor.enable) {
+		d->ymin = simClampInt(d->ymin, scissor.min, scissor.max);
+		d->ymax = simClampInt(d->ymax, scissor.min, scissor.max);
+	}
+
+	d->xmax = simClampInt(d->xmax, 0, d->width);
+	d->ymax = simClampInt(d->ymax, 0, d->height);
+}
+
+/**
+ * Executes a draw request of vertices stored in vertex buffer.
+ * @param ctx Hardware context.
+ * @param first Index of first vertex.
+ * @param count Vertex count.
+ */
+static void simExecuteDraw(fimgContext *ctx, uint32_t first, uint32_t count)
+{
+	simDraw *d;
+	simVertex *v;
+	unsigned int type, i;
+
+	if (!count)
+		return;
+
+	d = malloc(sizeof(*d));
+	v = malloc(count * sizeof(*v));
+	if (!d || !v) {
+		LOGE("%s: Could not allocate draw state", __func__);
+		free(d);
+		free(v);
+		return;
+	}
+
+	simLoadState(ctx, d);
+	++d->sim->stats.draws;
+	d->sim->stats.vertices += count;
+
+	for (i = 0; i < count; ++i)
+		simProcessVertex(d, first + i, &v[i]);
+
+	type = ffs(d->vctx.type) - 1;
+
+	switch (type) {
+	case FGPE_POINT_SPRITE:
+	case FGPE_POINTS:
+		for (i = 0; i < count; ++i)
+			simDrawPoint(d, &v[i], type == FGPE_POINT_SPRITE);
+		break;
+	case FGPE_LINES:
+		for (i = 0; i + 1 < count; i += 2)
+			simDrawLine(d, &v[i], &v[i + 1]);
+		break;
+	case FGPE_LINE_STRIP:
+	case FGPE_LINE_LOOP:
+		for (i = 0; i + 1 < count; ++i)
+			simDrawLine(d, &v[i], &v[i + 1]);
+		if (type == FGPE_LINE_LOOP && count > 2)
+			simDrawLine(d, &v[count - 1], &v[0]);
+		break;
+	case FGPE_TRIANGLES:
+		for (i = 0; i + 2 < count; i += 3)
+			simDrawTriangle(d, &v[i], &v[i + 1], &v[i + 2]);
+		break;
+	case FGPE_TRIANGLE_STRIP:
+		for (i = 0; i + 2 < count; ++i) {
+			if (i & 1)
+				simDrawTriangle(d, &v[i + 1], &v[i], &v[i + 2]);
+			else
+				simDrawTriangle(d, &v[i], &v[i + 1], &v[i + 2]);
+		}
+		break;
+	case FGPE_TRIANGLE_FAN:
+		for (i = 1; i + 1 < count; ++i)
+			simDrawTriangle(d, &v[0], &v[i], &v[i + 1]);
+		break;
+	}
+
+	free(v);
+	free(d);
+}
+
+/*
+ * Backend operations
+ */
+
+static int simOpen(fimgContext *ctx)
+{
+	ctx->fd = -1;
+	ctx->base = calloc(1, FIMG_SFR_SIZE);
+	if (!ctx->base)
+		return -ENOMEM;
+
+	ctx->backendData = calloc(1, sizeof(fimgSim));
+	if (!ctx->backendData) {
+		free((void *)ctx->base);
+		return -ENOMEM;
+	}
+
+	return 0;
+}
+
+static void simClose(fimgContext *ctx)
+{
+	fimgReleaseVirtualHardware(ctx);
+	free(ctx->backendData);
+	free((void *)ctx->base);
+}
+
+static int simLock(fimgContext *ctx)
+{
+	return fimgClaimVirtualHardware(ctx);
+}
+
+static int simUnlock(fimgContext *ctx)
+{
+	return 0;
+}
+
+static int simFlush(fimgContext *ctx, uint32_t target)
+{
+	return 0;
+}
+
+/**
+ * Stores register value and triggers side effects of register write.
+ * @param ctx Hardware context.
+ * @param data Register value.
+ * @param addr Register address.
+ */
+static void simWrite(fimgContext *ctx, uint32_t data, uint32_t addr)
+{
+	fimgSim *sim = ctx->backendData;
+
+	*(volatile uint32_t *)(ctx->base + addr) = data;
+
+	switch (addr) {
+	case FGHI_FIFO_ENTRY:
+		/* Auto-increment mode: vertex count followed by first index */
+		sim->fifo[sim->fifoWords++] = data;
+		if (sim->fifoWords < 2)
+			break;
+		sim->fifoWords = 0;
+		simExecuteDraw(ctx, sim->fifo[1], sim->fifo[0]);
+		break;
+	case FGTU_PALETTE_ADDR:
+		sim->paletteAddr = data % SIM_PALETTE_SIZE;
+		break;
+	case FGTU_PALETTE_IN:
+		sim->palette[sim->paletteAddr] = data;
+		sim->paletteAddr = (sim->paletteAddr + 1) % SIM_PALETTE_SIZE;
+		break;
+	}
+}
+
+/**
+ * Reads register value. Status registers always report idle hardware.
+ * @param ctx Hardware context.
+ * @param addr Register address.
+ * @return Register value.
+ */
+static uint32_t simRead(fimgContext *ctx, uint32_t addr)
+{
+	switch (addr) {
+	case FGGB_PIPESTATE:
+	case FGGB_CACHECTL:
+	case FGVS_STATUS:
+	case FGPS_IBSTATUS:
+		return 0;
+	case FGGB_VERSION:
+		return SIM_VERSION;
+	}
+
+	return *(volatile uint32_t *)(ctx->base + addr);
+}
+
+static volatile uint32_t *simBurstBegin(fimgContext *ctx,
+					uint32_t addr, uint32_t words)
+{
+	return (volatile uint32_t *)(ctx->base + addr);
+}
+
+static void simBurstEnd(fimgContext *ctx)
+{
+}
+
+const fimgBackend fimgSimBackend = {
+	.name		= "sim",
+	.open		= simOpen,
+	.close		= simClose,
+	.lock		= simLock,
+	.unlock		= simUnlock,
+	.flush		= simFlush,
+	.write		= simWrite,
+	.read		= simRead,
+	.burstBegin	= simBurstBegin,
+	.burstEnd	= simBurstEnd,
+};
+
+/*
+ * Simulator interface
+ */
+
+/**
+ * Gets work counters of simulated pipeline collected since last reset.
+ * @param ctx Hardware context.
+ * @param stats Structure to store counters in.
+ * @return 0 on success, negative if the context does not use simulator backend.
+ */
+int fimgGetSimStats(fimgContext *ctx, fimgSimStats *stats)
+{
+	fimgSim *sim = ctx->backendData;
+
+	if (ctx->backend != &fimgSimBackend)
+		return -1;
+
+	*stats = sim->stats;
+	return 0;
+}
+
+/**
+ * Clears work counters of simulated pipeline, e.g. at the beginning of a frame.
+ * @param ctx Hardware context.
+ */
+void fimgResetSimStats(fimgContext *ctx)
+{
+	fimgSim *sim = ctx->backendData;
+
+	if (ctx->backend != &fimgSimBackend)
+		return;
+
+	memset(&sim->stats, 0, sizeof(sim->stats));
+}
+
+#endif /* FIMG_IO_BACKEND */
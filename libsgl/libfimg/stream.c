@@ -0,0 +1,486 @@
+/*
+ * fimg/stream.c
+ *
+ * SAMSUNG S3C6410 FIMG-3DSE COMMAND STREAM (THREADED SUBMISSION)
+ *
+ * Copyrights:	2010 by Tomasz Figa < tomasz.figa at gmail.com >
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifdef HAVE_CONFIG_H
+# include <config.h>
+#endif
+
+#include "fimg_private.h"
+
+#ifdef FIMG_THREADED_SUBMIT
+
+#include <pthread.h>
+#include <sched.h>
+#include <string.h>
+
+#include <sys/ioctl.h>
+
+#include "s3c_g3d.h"
+
+/*
+ * Hardware accesses of a context are recorded by the application thread into
+ * a single-producer, single-consumer ring of commands and executed in order
+ * by a driver thread. The application thread only blocks when the ring is
+ * full or when it needs results of hardware operations (register reads,
+ * fimgFinish).
+ *
+ * Every command starts with a header word (type in bits 31-24, payload length
+ * in words in bits 23-0) followed by the payload. Commands never cross the end
+ * of the ring, unused space at the end is skipped with CMD_WRAP.
+ */
+
+#define FIMG_STREAM_WORDS	(32768)
+
+#define FGGB_PIPESTATE		(0x0000)
+
+enum {
+	CMD_WRAP = 0,	/* Continue from beginning of the ring */
+	CMD_WRITE,	/* Write payload words starting from given address */
+	CMD_POLL,	/* Wait until register bits become cleared */
+	CMD_FLUSH,	/* Wait for selected parts of pipeline to flush */
+	CMD_UNLOCK	/* Release hardware lock */
+};
+
+#define CMD_HEADER(type, len)	(((type) << 24) | (len))
+#define CMD_TYPE(hdr)		((hdr) >> 24)
+#define CMD_LEN(hdr)		((hdr) & 0xffffff)
+
+/* Value of unlockSeq while the driver thread releases the lock */
+#define UNLOCK_BUSY		(0xffffffff)
+
+struct _fimgStream {
+	volatile char *base;
+	int fd;
+	uint32_t *ring;
+	/* Next word to be written by application thread */
+	volatile uint32_t head;
+	/* Next word to be read by driver thread */
+	volatile uint32_t tail;
+	/* Value of head after currently recorded command */
+	uint32_t next;
+	/* Sequence number of pending unlock command */
+	volatile uint32_t unlockSeq;
+	uint32_t lastSeq;
+	/* Sleep state */
+	volatile int workerWaiting;
+	volatile int producerWaiting;
+	volatile int exit;
+	pthread_t thread;
+	pthread_mutex_t mutex;
+	pthread_cond_t work;
+	pthread_cond_t done;
+};
+
+/*
+ * Driver thread
+ */
+
+/**
+ * Waits until application thread publishes new commands.
+ * @param s Command stream.
+ * @param head Last seen value of head.
+ */
+static void streamWaitWork(fimgStream *s, uint32_t head)
+{
+	pthread_mutex_lock(&s->mutex);
+	s->workerWaiting = 1;
+	__sync_synchronize();
+	if (s->head == head && !s->exit)
+		pthread_cond_wait(&s->work, &s->mutex);
+	s->workerWaiting = 0;
+	pthread_mutex_unlock(&s->mutex);
+}
+
+/**
+ * Marks commands up to given position as executed.
+ * @param s Command stream.
+ * @param tail New value of tail.
+ */
+static void streamRetire(fimgStream *s, uint32_t tail)
+{
+	__sync_synchronize();
+	s->tail = tail;
+	__sync_synchronize();
+
+	if (s->producerWaiting) {
+		pthread_mutex_lock(&s->mutex);
+		pthread_cond_signal(&s->done);
+		pthread_mutex_unlock(&s->mutex);
+	}
+}
+
+/**
+ * Polls a register for a while until selected bits become cleared.
+ * @param reg Register to poll.
+ * @param mask Bit mask.
+ * @return Non-zero if the bits are still set after FIMG_WAIT_SPINS polls.
+ */
+static inline int spinWait(volatile uint32_t *reg, uint32_t mask)
+{
+	unsigned int spins = FIMG_WAIT_SPINS;
+
+	while (*reg & mask)
+		if (!spins--)
+			return 1;
+
+	return 0;
+}
+
+/**
+ * Executes single command.
+ * @param s Command stream.
+ * @param cmd Pointer to command header.
+ */
+static void streamExecute(fimgStream *s, const uint32_t *cmd)
+{
+	uint32_t len = CMD_LEN(cmd[0]);
+	volatile uint32_t *reg;
+	uint32_t mask;
+
+	switch (CMD_TYPE(cmd[0])) {
+	case CMD_WRITE:
+		reg = (volatile uint32_t *)(s->base + cmd[1]);
+		for (cmd += 2; --len; ++cmd)
+			*(reg++) = *cmd;
+		__sync_synchronize();
+		break;
+	case CMD_POLL:
+		reg = (volatile uint32_t *)(s->base + cmd[1]);
+		if (spinWait(reg, cmd[2]))
+			while (*reg & cmd[2])
+				sched_yield();
+		break;
+	case CMD_FLUSH:
+		mask = cmd[1];
+		reg = (volatile uint32_t *)(s->base + FGGB_PIPESTATE);
+		if (spinWait(reg, mask) && ioctl(s->fd, S3C_G3D_FLUSH, mask))
+			LOGE("Could not flush the hardware pipeline");
+		break;
+	case CMD_UNLOCK:
+		/* Unlock might have been cancelled by relocking */
+		if (!__sync_bool_compare_and_swap(&s->unlockSeq,
+							cmd[1], UNLOCK_BUSY))
+			break;
+		if (ioctl(s->fd, S3C_G3D_UNLOCK, 0))
+			LOGE("Could not release the hardware lock");
+		__sync_synchronize();
+		s->unlockSeq = 0;
+		break;
+	}
+}
+
+/**
+ * Main loop of driver thread.
+ * @param arg Command stream.
+ * @return Always NULL.
+ */
+static void *streamThread(void *arg)
+{
+	fimgStream *s = arg;
+	uint32_t tail = s->tail;
+
+	for (;;) {
+		uint32_t head = s->head;
+		const uint32_t *cmd;
+
+		if (tail == head) {
+			if (s->exit)
+				break;
+			streamWaitWork(s, head);
+			continue;
+		}
+
+		__sync_synchronize();
+
+		cmd = s->ring + tail;
+		if (CMD_TYPE(cmd[0]) == CMD_WRAP) {
+			tail = 0;
+			streamRetire(s, tail);
+			continue;
+		}
+
+		streamExecute(s, cmd);
+
+		tail += CMD_LEN(cmd[0]) + 1;
+		streamRetire(s, tail);
+	}
+
+	return NULL;
+}
+
+/*
+ * Application thread
+ */
+
+/**
+ * Waits until driver thread executes some commands.
+ * @param s Command stream.
+ * @param tail Last seen value of tail.
+ */
+static void streamWaitDone(fimgStream *s, uint32_t tail)
+{
+	pthread_mutex_lock(&s->mutex);
+	s->producerWaiting = 1;
+	__sync_synchronize();
+	if (s->tail == tail)
+		pthread_cond_wait(&s->done, &s->mutex);
+	s->producerWaiting = 0;
+	pthread_mutex_unlock(&s->mutex);
+}
+
+/**
+ * Makes recorded commands visible to driver thread.
+ * @param s Command stream.
+ * @param head New value of head.
+ */
+static void streamPublish(fimgStream *s, uint32_t head)
+{
+	__sync_synchronize();
+	s->head = head;
+	__sync_synchronize();
+
+	if (s->workerWaiting) {
+		pthread_mutex_lock(&s->mutex);
+		pthread_cond_signal(&s->work);
+		pthread_mutex_unlock(&s->mutex);
+	}
+}
+
+/**
+ * Reserves contiguous space for a command in the ring, waiting for driver
+ * thread to free it if needed.
+ * @param s Command stream.
+ * @param words Command length in words, including header.
+ * @return Pointer to reserved space.
+ */
+static uint32_t *streamReserve(fimgStream *s, uint32_t words)
+{
+	uint32_t head = s->head;
+	uint32_t tail;
+
+	if (head + words >= FIMG_STREAM_WORDS) {
+		/* Driver thread must be behind us in the same lap */
+		while ((tail = s->tail) > head || tail == 0)
+			streamWaitDone(s, tail);
+
+		s->ring[head] = CMD_HEADER(CMD_WRAP, 0);
+		head = 0;
+		streamPublish(s, head);
+	}
+
+	/* Keep one word free to tell full ring from empty one */
+	while ((tail = s->tail) > head && tail - head <= words)
+		streamWaitDone(s, tail);
+
+	s->next = head + words;
+
+	return s->ring + head;
+}
+
+/**
+ * Starts recording of register write command.
+ * @param s Command stream.
+ * @param addr Address of first register.
+ * @param words Count of words to write.
+ * @return Pointer to space for data to be written.
+ */
+volatile uint32_t *fimgStreamBurstBegin(fimgStream *s,
+					uint32_t addr, uint32_t words)
+{
+	uint32_t *cmd = streamReserve(s, words + 2);
+
+	cmd[0] = CMD_HEADER(CMD_WRITE, words + 1);
+	cmd[1] = addr;
+
+	return cmd + 2;
+}
+
+/**
+ * Finishes recording of current command.
+ * @param s Command stream.
+ */
+void fimgStreamBurstEnd(fimgStream *s)
+{
+	streamPublish(s, s->next);
+}
+
+/**
+ * Records write of single register.
+ * @param s Command stream.
+ * @param addr Register address.
+ * @param data Register value.
+ */
+void fimgStreamWrite(fimgStream *s, uint32_t addr, uint32_t data)
+{
+	*fimgStreamBurstBegin(s, addr, 1) = data;
+	fimgStreamBurstEnd(s);
+}
+
+/**
+ * Records wait until selected bits of register become cleared.
+ * @param s Command stream.
+ * @param addr Register address.
+ * @param mask Bit mask.
+ */
+void fimgStreamPoll(fimgStream *s, uint32_t addr, uint32_t mask)
+{
+	uint32_t *cmd = streamReserve(s, 3);
+
+	cmd[0] = CMD_HEADER(CMD_POLL, 2);
+	cmd[1] = addr;
+	cmd[2] = mask;
+
+	streamPublish(s, s->next);
+}
+
+/**
+ * Records wait for selected parts of graphics pipeline to flush.
+ * @param s Command stream.
+ * @param mask Mask of pipeline parts.
+ */
+void fimgStreamFlush(fimgStream *s, uint32_t mask)
+{
+	uint32_t *cmd = streamReserve(s, 2);
+
+	cmd[0] = CMD_HEADER(CMD_FLUSH, 1);
+	cmd[1] = mask;
+
+	streamPublish(s, s->next);
+}
+
+/**
+ * Records release of hardware lock. The lock is released by driver thread
+ * after executing all preceding commands, unless reacquired before.
+ * @param s Command stream.
+ */
+void fimgStreamUnlock(fimgStream *s)
+{
+	uint32_t *cmd;
+
+	if (++s->lastSeq == UNLOCK_BUSY)
+		s->lastSeq = 1;
+
+	s->unlockSeq = s->lastSeq;
+
+	cmd = streamReserve(s, 2);
+	cmd[0] = CMD_HEADER(CMD_UNLOCK, 1);
+	cmd[1] = s->lastSeq;
+
+	streamPublish(s, s->next);
+}
+
+/**
+ * Cancels pending release of hardware lock.
+ * @param s Command stream.
+ * @return Non-zero if the lock is still held, zero if it has been released
+ * and must be acquired again.
+ */
+int fimgStreamRelock(fimgStream *s)
+{
+	uint32_t seq = s->unlockSeq;
+
+	if (seq && seq != UNLOCK_BUSY
+	    && __sync_bool_compare_and_swap(&s->unlockSeq, seq, 0))
+		return 1;
+
+	/* Let driver thread finish releasing the lock */
+	while (s->unlockSeq == UNLOCK_BUSY)
+		sched_yield();
+
+	return 0;
+}
+
+/**
+ * Waits until all recorded commands are executed.
+ * @param s Command stream.
+ */
+void fimgStreamSync(fimgStream *s)
+{
+	uint32_t tail;
+
+	while ((tail = s->tail) != s->head)
+		streamWaitDone(s, tail);
+}
+
+/**
+ * Creates command stream and its driver thread.
+ * @param base Mapped hardware registers.
+ * @param fd File descriptor of G3D device.
+ * @return Command stream or NULL on error.
+ */
+fimgStream *fimgStreamCreate(volatile char *base, int fd)
+{
+	fimgStream *s;
+
+	s = malloc(sizeof(*s));
+	if (!s)
+		return NULL;
+
+	memset(s, 0, sizeof(*s));
+	s->base = base;
+	s->fd = fd;
+
+	s->ring = malloc(FIMG_STREAM_WORDS * sizeof(uint32_t));
+	if (!s->ring)
+		goto err_ring;
+
+	pthread_mutex_init(&s->mutex, NULL);
+	pthread_cond_init(&s->work, NULL);
+	pthread_cond_init(&s->done, NULL);
+
+	if (pthread_create(&s->thread, NULL, streamThread, s))
+		goto err_thread;
+
+	return s;
+
+err_thread:
+	pthread_cond_destroy(&s->done);
+	pthread_cond_destroy(&s->work);
+	pthread_mutex_destroy(&s->mutex);
+	free(s->ring);
+err_ring:
+	free(s);
+	return NULL;
+}
+
+/**
+ * Executes remaining commands, stops driver thread and destroys command stream.
+ * @param s Command stream.
+ */
+void fimgStreamDestroy(fimgStream *s)
+{
+	fimgStreamSync(s);
+
+	pthread_mutex_lock(&s->mutex);
+	s->exit = 1;
+	pthread_cond_signal(&s->work);
+	pthread_mutex_unlock(&s->mutex);
+
+	pthread_join(s->thread, NULL);
+
+	pthread_cond_destroy(&s->done);
+	pthread_cond_destroy(&s->work);
+	pthread_mutex_destroy(&s->mutex);
+	free(s->ring);
+	free(s);
+}
+
+#endif /* FIMG_THREADED_SUBMIT */
@@ -37,14 +37,21 @@
 #include "fimg_private.h"
 #include "s3c_g3d.h"
 
-#define FIMG_SFR_SIZE 0x80000
+#ifdef FIMG_TRACE
+/* Serial number of last created context */
+static uint32_t fimgContextSerial;
+#endif
+
+/*
+ * Hardware device backend
+ */
 
 /**
  * Opens G3D device and maps GPU registers into application address space.
  * @param ctx Hardware context.
  * @return 0 on success, negative on error.
  */
-int fimgDeviceOpen(fimgContext *ctx)
+static int hwOpen(fimgContext *ctx)
 {
 	ctx->fd = open("/dev/s3c-g3d", O_RDWR | O_SYNC, 0);
 	if(ctx->fd < 0) {
@@ -69,7 +76,7 @@ int fimgDeviceOpen(fimgContext *ctx)
  * Unmaps GPU registers and closes G3D device.
  * @param ctx Hardware context.
  */
-void fimgDeviceClose(fimgContext *ctx)
+static void hwClose(fimgContext *ctx)
 {
 #ifndef FIMG_DEBUG_IOMEM_ACCESS
 	munmap((void *)ctx->base, FIMG_SFR_SIZE);
@@ -79,6 +86,122 @@ void fimgDeviceClose(fimgContext *ctx)
 	LOGD("fimg3D: Closed /dev/s3c-g3d (%d).", ctx->fd);
 }
 
+/**
+ * Claims the hardware using G3D device.
+ * @param ctx Hardware context.
+ * @return 0 on success, positive if context restore is needed,
+ * negative on error.
+ */
+static int hwLock(fimgContext *ctx)
+{
+	return ioctl(ctx->fd, S3C_G3D_LOCK, 0);
+}
+
+/**
+ * Releases the hardware using G3D device.
+ * @param ctx Hardware context.
+ * @return 0 on success, negative on error.
+ */
+static int hwUnlock(fimgContext *ctx)
+{
+	return ioctl(ctx->fd, S3C_G3D_UNLOCK, 0);
+}
+
+/**
+ * Waits for hardware to flush graphics pipeline using G3D device.
+ * @param ctx Hardware context.
+ * @param target Bit mask of pipeline parts to be flushed.
+ * @return 0 on success, negative on error.
+ */
+static int hwFlush(fimgContext *ctx, uint32_t target)
+{
+	return ioctl(ctx->fd, S3C_G3D_FLUSH, target);
+}
+
+#ifdef FIMG_IO_BACKEND
+/* Register accessors, inlined into callers on hardware-only builds */
+
+static void hwWrite(fimgContext *ctx, uint32_t data, uint32_t addr)
+{
+	*(volatile uint32_t *)(ctx->base + addr) = data;
+	__sync_synchronize();
+}
+
+static uint32_t hwRead(fimgContext *ctx, uint32_t addr)
+{
+	uint32_t val = *(volatile uint32_t *)(ctx->base + addr);
+
+	__sync_synchronize();
+	return val;
+}
+
+static volatile uint32_t *hwBurstBegin(fimgContext *ctx,
+					uint32_t addr, uint32_t words)
+{
+	return (volatile uint32_t *)(ctx->base + addr);
+}
+
+static void hwBurstEnd(fimgContext *ctx)
+{
+}
+#endif
+
+const fimgBackend fimgHardwareBackend = {
+	.name		= "hardware",
+	.open		= hwOpen,
+	.close		= hwClose,
+	.lock		= hwLock,
+	.unlock		= hwUnlock,
+	.flush		= hwFlush,
+#ifdef FIMG_IO_BACKEND
+	.write		= hwWrite,
+	.read		= hwRead,
+	.burstBegin	= hwBurstBegin,
+	.burstEnd	= hwBurstEnd,
+#endif
+};
+
+/* Device operations, resolved at compile time on hardware-only builds */
+#ifdef FIMG_IO_BACKEND
+#define DEVICE_OP(ctx, op)	((ctx)->backend->op)
+#else
+#define DEVICE_OP(ctx, op)	(fimgHardwareBackend.op)
+#endif
+
+/**
+ * Opens device backend of the context.
+ * Backend can be selected with FIMG_BACKEND environment variable
+ * ("hardware", "null", "record" or "sim") on builds with FIMG_IO_BACKEND.
+ * @param ctx Hardware context.
+ * @return 0 on success, negative on error.
+ */
+int fimgDeviceOpen(fimgContext *ctx)
+{
+#ifdef FIMG_IO_BACKEND
+	const char *name = getenv("FIMG_BACKEND");
+
+	ctx->backend = &fimgHardwareBackend;
+	if (name && !strcmp(name, fimgNullBackend.name))
+		ctx->backend = &fimgNullBackend;
+	else if (name && !strcmp(name, fimgRecordBackend.name))
+		ctx->backend = &fimgRecordBackend;
+	else if (name && !strcmp(name, fimgSimBackend.name))
+		ctx->backend = &fimgSimBackend;
+
+	LOGD("Using %s backend.", ctx->backend->name);
+#endif
+	return DEVICE_OP(ctx, open)(ctx);
+}
+
+/**
+ * Closes device backend of the context.
+ * @param ctx Hardware context.
+ */
+void fimgDeviceClose(fimgContext *ctx)
+{
+	DEVICE_OP(ctx, close)(ctx);
+}
+
 /**
 	Context management
 */
@@ -90,20 +213,20 @@ void fimgDeviceClose(fimgContext *ctx)
 fimgContext *fimgCreateContext(void)
 {
 	fimgContext *ctx;
-	uint32_t *queue;
+#ifdef FIMG_THREADED_SUBMIT
+	const char *env;
+#endif
 
 	if ((ctx = malloc(sizeof(*ctx))) == NULL)
 		return NULL;
 
-	if ((queue = malloc(2*(FIMG_MAX_QUEUE_LEN + 1)*sizeof(uint32_t))) == NULL) {
-		free(ctx);
-		return NULL;
-	}
+#ifdef FIMG_PROFILE
+	fimgProfileInit();
+#endif
 
 	memset(ctx, 0, sizeof(fimgContext));
 
 	if(fimgDeviceOpen(ctx)) {
-		free(queue);
 		free(ctx);
 		return NULL;
 	}
@@ -116,10 +239,33 @@ fimgContext *fimgCreateContext(void)
 #ifdef FIMG_FIXED_PIPELINE
 	fimgCreateCompatContext(ctx);
 #endif
+#ifdef FIMG_THREADED_SUBMIT
+	/* Direct submission can be selected at runtime for comparison */
+	env = getenv("FIMG_THREADED_SUBMIT");
+	if (!env || strtoul(env, NULL, 0)) {
+		/* Fall back to direct submission if thread cannot be started */
+		ctx->stream = fimgStreamCreate(ctx->base, ctx->fd);
+		if (!ctx->stream)
+			LOGW("Failed to create command stream, "
+						"using direct submission.");
+	}
+#endif
+#ifdef FIMG_TRACE
+	if (getenv("FIMG_TRACE")) {
+		char path[64];
 
-	ctx->queue = queue;
-	ctx->queue[0] = 0;
-	ctx->queueStart = queue;
+		snprintf(path, sizeof(path), FIMG_DUMP_FILE_PATH
+				"/fimg-%u-%u.trace", (unsigned)getpid(),
+				__sync_add_and_fetch(&fimgContextSerial, 1));
+		fimgTraceStart(ctx, path);
+	}
+#endif
+#ifdef FIMG_PERF_COUNTERS
+	ctx->perfDump = getenv("FIMG_PERF") != NULL;
+#endif
+#ifdef FIMG_LOCK_LEASE
+	ctx->lease = fimgLeaseCreate(ctx);
+#endif
 
 	return ctx;
 }
@@ -130,8 +276,22 @@ fimgContext *fimgCreateContext(void)
  */
 void fimgDestroyContext(fimgContext *ctx)
 {
+#ifdef FIMG_LOCK_LEASE
+	if (ctx->lease)
+		fimgLeaseDestroy(ctx->lease);
+#endif
+#ifdef FIMG_PERF_COUNTERS
+	if (ctx->perfDump)
+		fimgDumpWaitStats(ctx);
+#endif
+#ifdef FIMG_TRACE
+	fimgTraceStop(ctx);
+#endif
+#ifdef FIMG_THREADED_SUBMIT
+	if (ctx->stream)
+		fimgStreamDestroy(ctx->stream);
+#endif
 	fimgDeviceClose(ctx);
-	free(ctx->queueStart);
 	free(ctx->vertexData);
 #ifdef FIMG_FIXED_PIPELINE
 	free(ctx->compat.vshaderBuf);
@@ -140,30 +300,85 @@ void fimgDestroyContext(fimgContext *ctx)
 	free(ctx);
 }
 
+/**
+ * Marks shadowed registers of given block as present in hardware.
+ * @param ctx Hardware context.
+ * @param blk Index of shadowed register block.
+ */
+static void syncShadowBlock(fimgContext *ctx, uint32_t blk)
+{
+	fimgRegisterShadow *shadow = &ctx->shadow;
+
+	memcpy(shadow->hw[blk], shadow->value[blk], sizeof(shadow->hw[blk]));
+	shadow->valid[blk] = shadow->used[blk];
+	shadow->dirty[blk] = 0;
+	shadow->dirtyBlocks &= ~(1 << blk);
+}
+
 /**
  * Restores full hardware context to hardware.
  * @param ctx Hardware context.
  */
 void fimgRestoreContext(fimgContext *ctx)
 {
-//	fprintf(stderr, "fimg: Restoring global state\n"); fflush(stderr);
+#ifdef FIMG_PERF_COUNTERS
+	++ctx->perf.fullRestores;
+#endif
 	fimgRestoreGlobalState(ctx);
-//	fprintf(stderr, "fimg: Restoring host state\n"); fflush(stderr);
 	fimgRestoreHostState(ctx);
-//	fprintf(stderr, "fimg: Restoring primitive state\n"); fflush(stderr);
+
 	fimgRestorePrimitiveState(ctx);
-//	fprintf(stderr, "fimg: Restoring rasterizer state\n"); fflush(stderr);
+	syncShadowBlock(ctx, FIMG_SHADOW_PRIMITIVE);
+
 	fimgRestoreRasterizerState(ctx);
-//	fprintf(stderr, "fimg: Restoring fragment state\n"); fflush(stderr);
+	syncShadowBlock(ctx, FIMG_SHADOW_RASTER);
+	syncShadowBlock(ctx, FIMG_SHADOW_RASTER_LOD);
+
 	fimgRestoreFragmentState(ctx);
+	syncShadowBlock(ctx, FIMG_SHADOW_FRAGMENT);
+
+	fimgRestoreTextureState(ctx);
 #ifdef FIMG_FIXED_PIPELINE
-//	fprintf(stderr, "fimg: Restoring compat state\n"); fflush(stderr);
 	fimgRestoreCompatState(ctx);
 #endif
+}
+
+/**
+ * Writes shadowed registers changed since last flush to hardware.
+ * Registers set to value already present in hardware are skipped.
+ * @param ctx Hardware context.
+ */
+void fimgQueueFlush(fimgContext *ctx)
+{
+	fimgRegisterShadow *shadow = &ctx->shadow;
+	uint32_t blocks = shadow->dirtyBlocks;
+
+	while (blocks) {
+		uint32_t blk = __builtin_ctz(blocks);
+		uint32_t dirty = shadow->dirty[blk];
+		uint32_t base = fimgShadowBase(blk);
+
+		blocks &= blocks - 1;
 
-	ctx->queue = ctx->queueStart;
-	ctx->queue[0] = 0;
-	ctx->queueLen = 0;
+		while (dirty) {
+			uint32_t idx = __builtin_ctz(dirty);
+			uint32_t val = shadow->value[blk][idx];
+
+			dirty &= dirty - 1;
+
+			if ((shadow->valid[blk] & (1 << idx))
+			    && shadow->hw[blk][idx] == val)
+				continue;
+
+			fimgWrite(ctx, val, base + 4*idx);
+			shadow->hw[blk][idx] = val;
+		}
+
+		shadow->valid[blk] |= shadow->dirty[blk];
+		shadow->dirty[blk] = 0;
+	}
+
+	shadow->dirtyBlocks = 0;
 }
 
 /**
@@ -179,8 +394,22 @@ void fimgRestoreContext(fimgContext *ctx)
 int fimgAcquireHardwareLock(fimgContext *ctx)
 {
 	int ret;
+#ifdef FIMG_TRACE
+	uint64_t start = ctx->trace ? fimgTraceTime() : 0;
+#endif
 
-	if((ret = ioctl(ctx->fd, S3C_G3D_LOCK, 0)) < 0) {
+#ifdef FIMG_THREADED_SUBMIT
+	/* Lock still held if its release has not been executed yet */
+	if (ctx->stream && fimgStreamRelock(ctx->stream)) {
+		ctx->locked = 1;
+#ifdef FIMG_TRACE
+		if (ctx->trace)
+			fimgTraceLock(ctx->trace, 0, start);
+#endif
+		return 0;
+	}
+#endif
+	if((ret = DEVICE_OP(ctx, lock)(ctx)) < 0) {
 		LOGE("Could not acquire the hardware lock");
 		return -1;
 	}
@@ -194,6 +423,10 @@ int fimgAcquireHardwareLock(fimgContext *ctx)
 	}
 #endif
 	ctx->locked = 1;
+#ifdef FIMG_TRACE
+	if (ctx->trace)
+		fimgTraceLock(ctx->trace, ret, start);
+#endif
 
 	return ret;
 }
@@ -206,10 +439,33 @@ int fimgAcquireHardwareLock(fimgContext *ctx)
  */
 int fimgReleaseHardwareLock(fimgContext *ctx)
 {
+#ifdef FIMG_TRACE
+	if (ctx->trace)
+		fimgTraceUnlock(ctx->trace, fimgTraceTime());
+#endif
+	return fimgReleaseHardwareLockUntraced(ctx);
+}
+
+/**
+ * Releases the hardware without recording the release into the trace,
+ * which can be written only by the thread using the context.
+ * @param ctx Hardware context.
+ * @return 0 on success, negative on error.
+ */
+int fimgReleaseHardwareLockUntraced(fimgContext *ctx)
+{
+#ifdef FIMG_THREADED_SUBMIT
+	/* Released by driver thread after executing preceding commands */
+	if (ctx->stream) {
+		fimgStreamUnlock(ctx->stream);
+		ctx->locked = 0;
+		return 0;
+	}
+#endif
 #ifdef FIMG_DEBUG_IOMEM_ACCESS
 	munmap((void *)ctx->base, FIMG_SFR_SIZE);
 #endif
-	if(ioctl(ctx->fd, S3C_G3D_UNLOCK, 0)) {
+	if(DEVICE_OP(ctx, unlock)(ctx)) {
 		LOGE("Could not release the hardware lock");
 		return -1;
 	}
@@ -227,7 +483,19 @@ int fimgReleaseHardwareLock(fimgContext *ctx)
  */
 int fimgWaitForFlush(fimgContext *ctx, uint32_t target)
 {
-	if(ioctl(ctx->fd, S3C_G3D_FLUSH, target)) {
+#ifdef FIMG_PERF_COUNTERS
+	uint64_t start = fimgPerfTime();
+#endif
+	int ret;
+	FIMG_PROFILE_BEGIN(flush);
+
+	ret = DEVICE_OP(ctx, flush)(ctx, target);
+
+	FIMG_PROFILE_END(flush, "waitForFlush");
+#ifdef FIMG_PERF_COUNTERS
+	ctx->perf.flushWaitTime += fimgPerfTime() - start;
+#endif
+	if (ret) {
 		LOGE("Could not flush the hardware pipeline");
 		fimgDumpState(ctx, 0, 0, __func__);
 		return -1;
@@ -235,3 +503,130 @@ int fimgWaitForFlush(fimgContext *ctx, uint32_t target)
 
 	return 0;
 }
+
+#ifdef FIMG_PERF_COUNTERS
+/*
+	Performance counters
+*/
+
+/** Names of performance counters, in order of fimgPerfCounters fields. */
+static const char *const perfCounterNames[] = {
+	"frames",
+	"draws",
+	"batches",
+	"vertices",
+	"vertexBytes",
+	"writes",
+	"fullFlushes",
+	"selectiveFlushes",
+	"flushWaitTime",
+	"cacheWaitTime",
+	"shaderHits",
+	"shaderMisses",
+	"shaderLoads",
+	"texCacheInvalidations",
+	"fullRestores",
+	"textureUploads",
+	"textureBytes",
+};
+
+/**
+ * Reads performance counters of a context.
+ * @param ctx Hardware context.
+ * @param counters Structure to store counter values in.
+ */
+void fimgGetPerfCounters(fimgContext *ctx, fimgPerfCounters *counters)
+{
+	*counters = ctx->perf;
+}
+
+/**
+ * Resets performance counters of a context to zero.
+ * @param ctx Hardware context.
+ */
+void fimgResetPerfCounters(fimgContext *ctx)
+{
+	memset(&ctx->perf, 0, sizeof(ctx->perf));
+	memset(&ctx->perfFrame, 0, sizeof(ctx->perfFrame));
+	memset(ctx->waitStats, 0, sizeof(ctx->waitStats));
+}
+
+/**
+ * Reads statistics of waits for hardware of given type.
+ * @param ctx Hardware context.
+ * @param type Type of waits (FIMG_WAIT_*).
+ * @param stats Structure to store the statistics in.
+ * @return 0 on success, negative on invalid type.
+ */
+int fimgGetWaitStats(fimgContext *ctx, unsigned int type,
+					fimgWaitStats *stats)
+{
+	if (type >= FIMG_NUM_WAIT_TYPES)
+		return -1;
+
+	*stats = ctx->waitStats[type];
+	return 0;
+}
+
+/**
+ * Logs latency histograms of waits for hardware.
+ * @param ctx Hardware context.
+ */
+void fimgDumpWaitStats(fimgContext *ctx)
+{
+	static const char *const names[FIMG_NUM_WAIT_TYPES] = {
+		"pipeline",
+		"cache",
+	};
+	char buf[256];
+	unsigned type, i;
+	int len;
+
+	for (type = 0; type < FIMG_NUM_WAIT_TYPES; ++type) {
+		fimgWaitStats *stats = &ctx->waitStats[type];
+
+		len = 0;
+		for (i = 0; i < FIMG_WAIT_BUCKETS; ++i)
+			len += snprintf(buf + len, sizeof(buf) - len, " %u",
+							stats->histogram[i]);
+		LOGD("%s waits: %u (%u slept), histogram (log2 us):%s",
+			names[type], stats->waits, stats->slept, buf);
+	}
+}
+
+/**
+ * Marks end of a frame and logs counter increments since previous frame
+ * if enabled with FIMG_PERF environment variable.
+ * @param ctx Hardware context.
+ */
+void fimgPerfFrame(fimgContext *ctx)
+{
+	const uint32_t *cur = (const uint32_t *)&ctx->perf;
+	const uint32_t *prev = (const uint32_t *)&ctx->perfFrame;
+	char buf[512];
+	int len = 0;
+	unsigned i;
+
+	++ctx->perf.frames;
+
+	if (ctx->perfDump) {
+		for (i = 1; i < FIMG_NUM_PERF_COUNTERS; ++i)
+			len += snprintf(buf + len, sizeof(buf) - len, " %s=%u",
+					perfCounterNames[i], cur[i] - prev[i]);
+		LOGD("frame %u:%s", ctx->perf.frames, buf);
+	}
+
+	ctx->perfFrame = ctx->perf;
+}
+
+/**
+ * Accounts texture image uploaded by the application.
+ * @param ctx Hardware context.
+ * @param bytes Size of texture image in bytes.
+ */
+void fimgPerfTextureUpload(fimgContext *ctx, uint32_t bytes)
+{
+	++ctx->perf.textureUploads;
+	ctx->perf.textureBytes += bytes;
+}
+#endif
@@ -55,6 +55,21 @@
 #define FGTU_VTSTA(i)		(0x602c0 + 8 * (i))
 #define FGTU_VTBADDR(i)		(0x602c4 + 8 * (i))
 
+/* Generation of last modified texture object */
+static unsigned int fimgTexGeneration;
+
+/**
+ * Marks texture object as modified, so it gets written to texture unit
+ * registers at next setup, even if bound to the same unit.
+ * Generations are unique across objects, so a new object allocated at
+ * the address of a destroyed one is never mistaken for it.
+ * @param texture Texture object.
+ */
+static inline void texChanged(fimgTexture *texture)
+{
+	texture->generation = __sync_add_and_fetch(&fimgTexGeneration, 1);
+}
+
 typedef union {
 	unsigned int val;
 	struct {
@@ -92,6 +107,7 @@ fimgTexture *fimgCreateTexture(void)
 	texture->control.magFilter = FGTU_TSTA_FILTER_LINEAR;
 	texture->control.alphaFmt = FGTU_TSTA_AFORMAT_RGBA;
 	texture->control.type = FGTU_TSTA_TYPE_2D;
+	texChanged(texture);
 
 	return texture;
 }
@@ -102,6 +118,7 @@ fimgTexture *fimgCreateTexture(void)
  */
 void fimgDestroyTexture(fimgTexture *texture)
 {
+	free(texture->palette);
 	free(texture);
 }
 
@@ -119,6 +136,7 @@ void fimgInitTexture(fimgTexture *texture, unsigned int flags,
 	texture->control.textureFmt = format;
 	texture->control.alphaFmt = !!(flags & FGTU_TEX_RGBA);
 	texture->baseAddr = addr;
+	texChanged(texture);
 }
 
 /**
@@ -134,6 +152,7 @@ void fimgSetTexMipmapOffset(fimgTexture *texture, unsigned int level,
 		return;
 
 	texture->offset[level - 1] = offset;
+	texChanged(texture);
 }
 
 /**
@@ -151,16 +170,44 @@ unsigned int fimgGetTexMipmapOffset(fimgTexture *texture, unsigned level)
 }
 
 /**
- * Marks texture cache to be invalidated on next rendering.
+ * Marks texture cache of selected unit to be invalidated on next rendering.
+ * Caches of other units are left intact.
+ * @param ctx Hardware context.
+ * @param unit Texture unit index.
+ */
+void fimgInvalidateTextureCache(fimgContext *ctx, unsigned int unit)
+{
+	ctx->invalTexCache |= 1 << unit;
+}
+
+/**
+ * Loads palette of texture object into palette memory, unless already loaded.
+ * Palette memory is shared by all texture units, so only one paletted
+ * texture can be used at a time.
+ * (Must be called with hardware locked.)
  * @param ctx Hardware context.
+ * @param texture Texture object.
  */
-void fimgInvalidateTextureCache(fimgContext *ctx)
+static void loadPalette(fimgContext *ctx, const fimgTexture *texture)
 {
-	ctx->invalTexCache = 1;
+	fimgTextureUnit *pal = &ctx->palette;
+	unsigned int i;
+
+	if (pal->texture == texture && pal->generation == texture->generation)
+		return;
+
+	pal->texture = texture;
+	pal->generation = texture->generation;
+
+	fimgWrite(ctx, 0, FGTU_PALETTE_ADDR);
+	for (i = 0; i < texture->paletteSize; ++i)
+		fimgWrite(ctx, texture->palette[i], FGTU_PALETTE_IN);
 }
 
 /**
  * Configures selected texture unit to selected texture object.
+ * Registers are not written if the unit is already configured to the same,
+ * unmodified texture object.
  * (Must be called with hardware locked.)
  * @param ctx Hardware context.
  * @param texture Texture object.
@@ -168,10 +215,22 @@ void fimgInvalidateTextureCache(fimgContext *ctx)
  */
 void fimgSetupTexture(fimgContext *ctx, fimgTexture *texture, unsigned unit)
 {
-	volatile uint32_t *reg = (volatile uint32_t *)(ctx->base +FGTU_TSTA(unit));
+	volatile uint32_t *reg;
 	uint32_t *data = (uint32_t *)texture;
-	unsigned count = sizeof(fimgTexture) / 4;
+	unsigned count = FGTU_TEX_REG_COUNT;
+	fimgTextureUnit *hw = &ctx->unit[unit];
+
+	if (texture->palette)
+		loadPalette(ctx, texture);
+
+	if (hw->texture == texture && hw->generation == texture->generation)
+		return;
+
+	hw->texture = texture;
+	hw->generation = texture->generation;
 
+	reg = fimgBurstBegin(ctx, FGTU_TSTA(unit), count);
+#ifdef __arm__
 	asm volatile (
 		"1:\n\t"
 		"ldmia %1!, {r0-r3}\n\t"
@@ -182,6 +241,22 @@ void fimgSetupTexture(fimgContext *ctx, fimgTexture *texture, unsigned unit)
 		: "0"(reg), "1"(data), "r"(count / 4)
 		: "r0", "r1", "r2", "r3"
 	);
+#else
+	while (count--)
+		*(reg++) = *(data++);
+#endif
+	fimgBurstEnd(ctx);
+}
+
+/**
+ * Forgets texture objects set up in texture units, forcing them to be
+ * written again at next setup.
+ * @param ctx Hardware context.
+ */
+void fimgRestoreTextureState(fimgContext *ctx)
+{
+	memset(ctx->unit, 0, sizeof(ctx->unit));
+	memset(&ctx->palette, 0, sizeof(ctx->palette));
 }
 
 /**
@@ -192,6 +267,7 @@ void fimgSetupTexture(fimgContext *ctx, fimgTexture *texture, unsigned unit)
 void fimgSetTexMipmapLevel(fimgTexture *texture, int level)
 {
 	texture->maxLevel = level;
+	texChanged(texture);
 }
 
 /**
@@ -202,6 +278,7 @@ void fimgSetTexMipmapLevel(fimgTexture *texture, int level)
 void fimgSetTexBaseAddr(fimgTexture *texture, unsigned int addr)
 {
 	texture->baseAddr = addr;
+	texChanged(texture);
 }
 
 /**
@@ -217,6 +294,7 @@ void fimgSetTex2DSize(fimgTexture *texture,
 	texture->uSize = uSize;
 	texture->vSize = vSize;
 	texture->maxLevel = maxLevel;
+	texChanged(texture);
 }
 
 /**
@@ -232,6 +310,7 @@ void fimgSetTex3DSize(fimgTexture *texture, unsigned int vSize,
 	texture->uSize = uSize;
 	texture->vSize = vSize;
 	texture->pSize = pSize;
+	texChanged(texture);
 }
 
 /**
@@ -242,6 +321,7 @@ void fimgSetTex3DSize(fimgTexture *texture, unsigned int vSize,
 void fimgSetTexUAddrMode(fimgTexture *texture, unsigned mode)
 {
 	texture->control.uAddrMode = mode;
+	texChanged(texture);
 }
 
 /**
@@ -252,6 +332,7 @@ void fimgSetTexUAddrMode(fimgTexture *texture, unsigned mode)
 void fimgSetTexVAddrMode(fimgTexture *texture, unsigned mode)
 {
 	texture->control.vAddrMode = mode;
+	texChanged(texture);
 }
 
 /**
@@ -262,6 +343,7 @@ void fimgSetTexVAddrMode(fimgTexture *texture, unsigned mode)
 void fimgSetTexPAddrMode(fimgTexture *texture, unsigned mode)
 {
 	texture->control.pAddrMode = mode;
+	texChanged(texture);
 }
 
 /**
@@ -272,6 +354,7 @@ void fimgSetTexPAddrMode(fimgTexture *texture, unsigned mode)
 void fimgSetTexMinFilter(fimgTexture *texture, unsigned mode)
 {
 	texture->control.minFilter = mode;
+	texChanged(texture);
 }
 
 /**
@@ -282,6 +365,7 @@ void fimgSetTexMinFilter(fimgTexture *texture, unsigned mode)
 void fimgSetTexMagFilter(fimgTexture *texture, unsigned mode)
 {
 	texture->control.magFilter = mode;
+	texChanged(texture);
 }
 
 /**
@@ -292,6 +376,55 @@ void fimgSetTexMagFilter(fimgTexture *texture, unsigned mode)
 void fimgSetTexMipmap(fimgTexture *texture, unsigned mode)
 {
 	texture->control.useMipmap = mode;
+	texChanged(texture);
+}
+
+/**
+ * Sets palette of texture object using paletted texture format.
+ * @param texture Texture object.
+ * @param format Palette format (one of FGTU_TSTA_PAL_TEX_FORMAT_*).
+ * @param palette Array of palette entries in given format.
+ * @param count Count of palette entries (up to 256), 0 to remove palette.
+ * @return 0 on success, negative on error.
+ */
+int fimgSetTexPalette(fimgTexture *texture, unsigned int format,
+			const uint32_t *palette, unsigned int count)
+{
+	if (count > FGTU_MAX_PALETTE_SIZE)
+		return -1;
+
+	if (!count) {
+		free(texture->palette);
+		texture->palette = NULL;
+		texture->paletteSize = 0;
+		return 0;
+	}
+
+	if (count > texture->paletteSize) {
+		uint32_t *buf = realloc(texture->palette, 4*count);
+		if (!buf)
+			return -1;
+		texture->palette = buf;
+	}
+
+	memcpy(texture->palette, palette, 4*count);
+	texture->paletteSize = count;
+	texture->control.paletteFmt = format;
+	texChanged(texture);
+
+	return 0;
+}
+
+/**
+ * Gets palette of texture object.
+ * @param texture Texture object.
+ * @param palette Pointer to store pointer to array of palette entries in.
+ * @return Count of palette entries, 0 if the texture has no palette.
+ */
+unsigned int fimgGetTexPalette(fimgTexture *texture, const uint32_t **palette)
+{
+	*palette = texture->palette;
+	return texture->paletteSize;
 }
 
 /**
@@ -302,4 +435,5 @@ void fimgSetTexMipmap(fimgTexture *texture, unsigned mode)
 void fimgSetTexCoordSys(fimgTexture *texture, unsigned mode)
 {
 	texture->control.texCoordSys = mode;
+	texChanged(texture);
 }
@@ -0,0 +1,561 @@
+/*
+ * fimg/trace.c
+ *
+ * SAMSUNG S3C6410 FIMG-3DSE BINARY TRACE CAPTURE
+ *
+ * Copyrights:	2010 by Tomasz Figa < tomasz.figa at gmail.com >
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifdef HAVE_CONFIG_H
+# include <config.h>
+#endif
+
+#include "fimg_private.h"
+
+#ifdef FIMG_TRACE
+
+#include <pthread.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <fcntl.h>
+
+/*
+ * Hardware accesses of a traced context are recorded by the application
+ * thread into a single-producer, single-consumer ring of trace records
+ * (see FIMG_TRACE_* in fimg_private.h) and written to the trace file by
+ * a writer thread. The writer is woken up only when the ring gets half full
+ * or periodically, so recording costs just a copy of written data. Records
+ * never cross the end of the ring, unused space at the end is skipped with
+ * WRAP, which is not written to the file.
+ */
+
+#define FIMG_TRACE_WORDS	(1 << 20)
+
+/* Interval of periodic writes of the ring to the file (ms) */
+#define FIMG_TRACE_INTERVAL	(100)
+
+#define TRACE_WRAP		(0xff)
+
+struct _fimgTrace {
+	int fd;
+	uint32_t *ring;
+	/* Next word to be written by application thread */
+	volatile uint32_t head;
+	/* Next word to be written to the file by writer thread */
+	volatile uint32_t tail;
+	/* Value of head after currently recorded record */
+	uint32_t next;
+	/* Current burst write */
+	uint32_t *burst;
+	uint32_t burstAddr;
+	uint32_t burstWords;
+	int burstDirect;
+	/* Sleep state */
+	volatile int writerWaiting;
+	volatile int producerWaiting;
+	volatile int exit;
+	pthread_t thread;
+	pthread_mutex_t mutex;
+	pthread_cond_t work;
+	pthread_cond_t done;
+};
+
+/**
+ * Gets current time for trace timestamps.
+ * @return Monotonic time in nanoseconds.
+ */
+uint64_t fimgTraceTime(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/*
+ * Writer thread
+ */
+
+/**
+ * Waits until application thread publishes enough records or the write
+ * interval passes.
+ * @param t Trace.
+ */
+static void traceWaitWork(fimgTrace *t)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_REALTIME, &ts);
+	ts.tv_nsec += FIMG_TRACE_INTERVAL * 1000000;
+	if (ts.tv_nsec >= 1000000000) {
+		ts.tv_nsec -= 1000000000;
+		++ts.tv_sec;
+	}
+
+	pthread_mutex_lock(&t->mutex);
+	t->writerWaiting = 1;
+	__sync_synchronize();
+	if (!t->exit)
+		pthread_cond_timedwait(&t->work, &t->mutex, &ts);
+	t->writerWaiting = 0;
+	pthread_mutex_unlock(&t->mutex);
+}
+
+/**
+ * Marks records up to given position as written.
+ * @param t Trace.
+ * @param tail New value of tail.
+ */
+static void traceRetire(fimgTrace *t, uint32_t tail)
+{
+	__sync_synchronize();
+	t->tail = tail;
+	__sync_synchronize();
+
+	if (t->producerWaiting) {
+		pthread_mutex_lock(&t->mutex);
+		pthread_cond_signal(&t->done);
+		pthread_mutex_unlock(&t->mutex);
+	}
+}
+
+/**
+ * Writes a block of words to trace file.
+ * @param t Trace.
+ * @param data Words to write.
+ * @param words Count of words.
+ */
+static void traceOutput(fimgTrace *t, const uint32_t *data, uint32_t words)
+{
+	const char *buf = (const char *)data;
+	size_t len = words * sizeof(uint32_t);
+	ssize_t ret;
+
+	while (len) {
+		ret = write(t->fd, buf, len);
+		if (ret < 0) {
+			if (errno == EINTR)
+				continue;
+			LOGE("Could not write trace file (%s)", strerror(errno));
+			return;
+		}
+		buf += ret;
+		len -= ret;
+	}
+}
+
+/**
+ * Main loop of writer thread.
+ * @param arg Trace.
+ * @return Always NULL.
+ */
+static void *traceThread(void *arg)
+{
+	fimgTrace *t = arg;
+	uint32_t tail = t->tail;
+
+	for (;;) {
+		uint32_t head = t->head;
+		uint32_t pos;
+
+		if (tail == head) {
+			if (t->exit)
+				break;
+			traceWaitWork(t);
+			continue;
+		}
+
+		__sync_synchronize();
+
+		/* Write all complete records up to head or wrap marker */
+		for (pos = tail; pos != head; ) {
+			if (FIMG_TRACE_TYPE(t->ring[pos]) == TRACE_WRAP)
+				break;
+			pos += FIMG_TRACE_LEN(t->ring[pos]) + 1;
+		}
+
+		traceOutput(t, t->ring + tail, pos - tail);
+
+		tail = (pos == head) ? pos : 0;
+		traceRetire(t, tail);
+	}
+
+	return NULL;
+}
+
+/*
+ * Application thread
+ */
+
+/**
+ * Waits until writer thread writes some records.
+ * @param t Trace.
+ * @param tail Last seen value of tail.
+ */
+static void traceWaitDone(fimgTrace *t, uint32_t tail)
+{
+	pthread_mutex_lock(&t->mutex);
+	t->producerWaiting = 1;
+	__sync_synchronize();
+	if (t->tail == tail) {
+		pthread_cond_signal(&t->work);
+		pthread_cond_wait(&t->done, &t->mutex);
+	}
+	t->producerWaiting = 0;
+	pthread_mutex_unlock(&t->mutex);
+}
+
+/**
+ * Makes recorded records visible to writer thread, waking it up if the ring
+ * gets half full.
+ * @param t Trace.
+ * @param head New value of head.
+ */
+static void tracePublish(fimgTrace *t, uint32_t head)
+{
+	uint32_t used;
+
+	__sync_synchronize();
+	t->head = head;
+	__sync_synchronize();
+
+	used = (head - t->tail) & (FIMG_TRACE_WORDS - 1);
+	if (used >= FIMG_TRACE_WORDS / 2 && t->writerWaiting) {
+		pthread_mutex_lock(&t->mutex);
+		pthread_cond_signal(&t->work);
+		pthread_mutex_unlock(&t->mutex);
+	}
+}
+
+/**
+ * Reserves contiguous space for a record in the ring, waiting for writer
+ * thread to free it if needed.
+ * @param t Trace.
+ * @param words Record length in words, including header.
+ * @return Pointer to reserved space.
+ */
+static uint32_t *traceReserve(fimgTrace *t, uint32_t words)
+{
+	uint32_t head = t->head;
+	uint32_t tail;
+
+	if (head + words >= FIMG_TRACE_WORDS) {
+		/* Writer thread must be behind us in the same lap */
+		while ((tail = t->tail) > head || tail == 0)
+			traceWaitDone(t, tail);
+
+		t->ring[head] = FIMG_TRACE_HEADER(TRACE_WRAP, 0);
+		head = 0;
+		tracePublish(t, head);
+	}
+
+	/* Keep one word free to tell full ring from empty one */
+	while ((tail = t->tail) > head && tail - head <= words)
+		traceWaitDone(t, tail);
+
+	t->next = head + words;
+
+	return t->ring + head;
+}
+
+/**
+ * Records a timestamp in two words of a record.
+ * @param rec Pointer to the words.
+ * @param time Timestamp.
+ */
+static inline void traceTimestamp(uint32_t *rec, uint64_t time)
+{
+	rec[0] = time;
+	rec[1] = time >> 32;
+}
+
+/**
+ * Starts recording of a burst write. Data written to returned pointer are
+ * stored in the trace and copied to hardware at fimgTraceBurstEnd.
+ * @param ctx Hardware context.
+ * @param addr Address of first register.
+ * @param words Count of words to write.
+ * @return Pointer to write the data to.
+ */
+volatile uint32_t *fimgTraceBurstBegin(fimgContext *ctx,
+					uint32_t addr, uint32_t words)
+{
+	fimgTrace *t = ctx->trace;
+	volatile uint32_t *reg;
+	uint32_t *rec;
+
+	if (words + 2 > FIMG_TRACE_WORDS / 2) {
+		/* Too big to be traced */
+		LOGW("Burst write of %u words to %05x not traced", words, addr);
+		ctx->trace = NULL;
+		reg = fimgBurstBegin(ctx, addr, words);
+		ctx->trace = t;
+		t->burstDirect = 1;
+		return reg;
+	}
+
+	rec = traceReserve(t, words + 2);
+	rec[0] = FIMG_TRACE_HEADER(FIMG_TRACE_WRITE, words + 1);
+	rec[1] = addr;
+
+	t->burst = rec + 2;
+	t->burstAddr = addr;
+	t->burstWords = words;
+
+	return t->burst;
+}
+
+/**
+ * Finishes recording of a burst write and sends the data to hardware.
+ * @param ctx Hardware context.
+ */
+void fimgTraceBurstEnd(fimgContext *ctx)
+{
+	fimgTrace *t = ctx->trace;
+	volatile uint32_t *reg;
+	uint32_t i;
+
+	/* Send the data without tracing it again */
+	ctx->trace = NULL;
+	if (!t->burstDirect) {
+		reg = fimgBurstBegin(ctx, t->burstAddr, t->burstWords);
+		for (i = 0; i < t->burstWords; ++i)
+			reg[i] = t->burst[i];
+	}
+	fimgBurstEnd(ctx);
+	ctx->trace = t;
+
+	if (t->burstDirect) {
+		t->burstDirect = 0;
+		return;
+	}
+
+	tracePublish(t, t->next);
+}
+
+/**
+ * Records write of single register.
+ * @param t Trace.
+ * @param addr Register address.
+ * @param data Register value.
+ */
+void fimgTraceWrite(fimgTrace *t, uint32_t addr, uint32_t data)
+{
+	uint32_t *rec = traceReserve(t, 3);
+
+	rec[0] = FIMG_TRACE_HEADER(FIMG_TRACE_WRITE, 2);
+	rec[1] = addr;
+	rec[2] = data;
+
+	tracePublish(t, t->next);
+}
+
+/**
+ * Records wait until selected bits of register become cleared.
+ * @param t Trace.
+ * @param addr Register address.
+ * @param mask Bit mask.
+ */
+void fimgTracePoll(fimgTrace *t, uint32_t addr, uint32_t mask)
+{
+	uint32_t *rec = traceReserve(t, 3);
+
+	rec[0] = FIMG_TRACE_HEADER(FIMG_TRACE_POLL, 2);
+	rec[1] = addr;
+	rec[2] = mask;
+
+	tracePublish(t, t->next);
+}
+
+/**
+ * Records finished flush of graphics pipeline.
+ * @param t Trace.
+ * @param mask Mask of flushed pipeline parts.
+ * @param start Time when the flush was requested.
+ */
+void fimgTraceFlush(fimgTrace *t, uint32_t mask, uint64_t start)
+{
+	uint32_t *rec = traceReserve(t, 5);
+
+	rec[0] = FIMG_TRACE_HEADER(FIMG_TRACE_FLUSH, 4);
+	rec[1] = mask;
+	traceTimestamp(&rec[2], start);
+	rec[4] = fimgTraceTime() - start;
+
+	tracePublish(t, t->next);
+}
+
+/**
+ * Records acquisition of hardware lock.
+ * @param t Trace.
+ * @param ret Value returned by fimgAcquireHardwareLock.
+ * @param start Time when the lock was requested.
+ */
+void fimgTraceLock(fimgTrace *t, int ret, uint64_t start)
+{
+	uint32_t *rec = traceReserve(t, 5);
+
+	rec[0] = FIMG_TRACE_HEADER(FIMG_TRACE_LOCK, 4);
+	rec[1] = ret;
+	traceTimestamp(&rec[2], start);
+	rec[4] = fimgTraceTime() - start;
+
+	tracePublish(t, t->next);
+}
+
+/**
+ * Records release of hardware lock.
+ * @param t Trace.
+ * @param time Time when the lock was released.
+ */
+void fimgTraceUnlock(fimgTrace *t, uint64_t time)
+{
+	uint32_t *rec = traceReserve(t, 3);
+
+	rec[0] = FIMG_TRACE_HEADER(FIMG_TRACE_UNLOCK, 2);
+	traceTimestamp(&rec[1], time);
+
+	tracePublish(t, t->next);
+}
+
+/*
+ * Trace control
+ */
+
+/**
+ * Marks end of a frame in the trace, if the context is traced.
+ * @param ctx Hardware context.
+ */
+void fimgTraceFrame(fimgContext *ctx)
+{
+	fimgTrace *t = ctx->trace;
+	uint32_t *rec;
+
+	if (!t)
+		return;
+
+	rec = traceReserve(t, 3);
+	rec[0] = FIMG_TRACE_HEADER(FIMG_TRACE_FRAME, 2);
+	traceTimestamp(&rec[1], fimgTraceTime());
+
+	tracePublish(t, t->next);
+}
+
+/**
+ * Starts tracing of hardware accesses of a context to a file.
+ * Trace begins with complete hardware state of the context, so it can be
+ * replayed independently of preceding rendering.
+ * @param ctx Hardware context.
+ * @param path Path of trace file.
+ * @return 0 on success, negative on error.
+ */
+int fimgTraceStart(fimgContext *ctx, const char *path)
+{
+	static const uint32_t header[2] = {
+		FIMG_TRACE_MAGIC, FIMG_TRACE_VERSION
+	};
+	fimgTrace *t;
+	int locked;
+
+	if (ctx->trace)
+		return -EBUSY;
+
+	t = malloc(sizeof(*t));
+	if (!t)
+		return -ENOMEM;
+
+	memset(t, 0, sizeof(*t));
+
+	t->ring = malloc(FIMG_TRACE_WORDS * sizeof(uint32_t));
+	if (!t->ring)
+		goto err_ring;
+
+	t->fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if (t->fd < 0) {
+		LOGE("Could not open trace file %s (%s)", path, strerror(errno));
+		goto err_open;
+	}
+
+	traceOutput(t, header, NELEM(header));
+
+	pthread_mutex_init(&t->mutex, NULL);
+	pthread_cond_init(&t->work, NULL);
+	pthread_cond_init(&t->done, NULL);
+
+	if (pthread_create(&t->thread, NULL, traceThread, t))
+		goto err_thread;
+
+	ctx->trace = t;
+
+	/* Snapshot of hardware state */
+#ifdef FIMG_LOCK_LEASE
+	fimgEndHardwareLease(ctx);
+#endif
+	locked = ctx->locked;
+	if (!locked && fimgAcquireHardwareLock(ctx) < 0) {
+		fimgTraceStop(ctx);
+		return -EBUSY;
+	}
+	fimgRestoreContext(ctx);
+	if (!locked)
+		fimgReleaseHardwareLock(ctx);
+
+	LOGD("Tracing hardware accesses to %s", path);
+
+	return 0;
+
+err_thread:
+	pthread_cond_destroy(&t->done);
+	pthread_cond_destroy(&t->work);
+	pthread_mutex_destroy(&t->mutex);
+	close(t->fd);
+err_open:
+	free(t->ring);
+err_ring:
+	free(t);
+	return -ENOMEM;
+}
+
+/**
+ * Stops tracing of a context, writing all remaining records to the file.
+ * @param ctx Hardware context.
+ */
+void fimgTraceStop(fimgContext *ctx)
+{
+	fimgTrace *t = ctx->trace;
+
+	if (!t)
+		return;
+
+	ctx->trace = NULL;
+
+	pthread_mutex_lock(&t->mutex);
+	t->exit = 1;
+	pthread_cond_signal(&t->work);
+	pthread_mutex_unlock(&t->mutex);
+
+	pthread_join(t->thread, NULL);
+
+	pthread_cond_destroy(&t->done);
+	pthread_cond_destroy(&t->work);
+	pthread_mutex_destroy(&t->mutex);
+	close(t->fd);
+	free(t->ring);
+	free(t);
+}
+
+#endif /* FIMG_TRACE */
@@ -200,13 +200,16 @@ struct FGLTextureState {
 	fimgTexFunc fglFunc;
 	/** Flag indicating that texture unit is enabled. */
 	bool enabled;
+	/** Flag indicating that point sprite coordinates replace texcoords. */
+	bool coordReplace;
 
 	/** Constructor initializing texture unit state with default values. */
 	FGLTextureState() :
 		defTexture(),
 		binding(this),
 		fglFunc(FGFP_TEXFUNC_MODULATE),
-		enabled(false) {};
+		enabled(false),
+		coordReplace(false) {};
 
 	/**
 	 * Helper function returning texture connected to the unit.
@@ -349,6 +352,14 @@ struct FGLRasterizerState {
 	float lineWidth;
 	/** Point size for point rendering. */
 	float pointSize;
+	/** Lower bound of dynamic point size. */
+	float pointSizeMin;
+	/** Upper bound of dynamic point size. */
+	float pointSizeMax;
+	/** Point fade threshold size. */
+	float pointFadeThreshold;
+	/** Point size distance attenuation coefficients. */
+	float pointAttenuation[3];
 	/** Polygon face to cull. */
 	GLenum cullFace;
 	/** Which face of polygon is front. */
@@ -364,11 +375,43 @@ struct FGLRasterizerState {
 	FGLRasterizerState() :
 		lineWidth(1.0f),
 		pointSize(1.0f),
+		pointSizeMin(FGL_MIN_POINT_SIZE),
+		pointSizeMax(FGL_MAX_POINT_SIZE),
+		pointFadeThreshold(1.0f),
 		cullFace(GL_BACK),
 		frontFace(GL_CCW),
 		shadeModel(GL_SMOOTH),
 		polyOffFactor(0.0f),
-		polyOffUnits(0.0f) {};
+		polyOffUnits(0.0f)
+	{
+		pointAttenuation[0] = 1.0f;
+		pointAttenuation[1] = 0.0f;
+		pointAttenuation[2] = 0.0f;
+	}
+};
+
+/** Structure holding fog parameters. */
+struct FGLFogState {
+	/** Fog function. */
+	GLenum mode;
+	/** Fog density for exponential fog functions. */
+	GLfloat density;
+	/** Fog start distance for linear fog function. */
+	GLfloat start;
+	/** Fog end distance for linear fog function. */
+	GLfloat end;
+	/** Fog color. */
+	GLclampf color[4];
+
+	/** Constructor initializing fog parameters with default values. */
+	FGLFogState() :
+		mode(GL_EXP),
+		density(1.0f),
+		start(0.0f),
+		end(1.0f)
+	{
+		color[0] = color[1] = color[2] = color[3] = 0.0f;
+	}
 };
 
 /** Structure holding information which capabilities are enabled. */
@@ -391,6 +434,12 @@ struct FGLEnableState {
 	unsigned colorLogicOp	:1;
 	/** Indicates that alpha test is enabled. */
 	unsigned alphaTest	:1;
+	/** Indicates that fog is enabled. */
+	unsigned fog		:1;
+	/** Indicates which user clip planes are enabled. */
+	unsigned clipPlanes	:FGL_MAX_CLIP_PLANES;
+	/** Indicates that point sprites are enabled. */
+	unsigned pointSprite	:1;
 
 	/** Constructor setting default capability enable state. */
 	FGLEnableState() :
@@ -401,7 +450,35 @@ struct FGLEnableState {
 		depthTest(0),
 		blend(0),
 		dither(1),
-		colorLogicOp(0) {};
+		colorLogicOp(0),
+		fog(0),
+		clipPlanes(0),
+		pointSprite(0) {};
+};
+
+/** Structure holding implementation hints. */
+struct FGLHintState {
+	/** Perspective correction hint. */
+	GLenum perspectiveCorrection;
+	/** Point smoothing hint. */
+	GLenum pointSmooth;
+	/** Line smoothing hint. */
+	GLenum lineSmooth;
+	/** Fog hint. */
+	GLenum fog;
+	/** Mipmap generation hint. */
+	GLenum generateMipmap;
+	/** Texture compression hint (GL_FIMG_texture_compression_hint). */
+	GLenum textureCompression;
+
+	/** Constructor setting default hints. */
+	FGLHintState() :
+		perspectiveCorrection(GL_DONT_CARE),
+		pointSmooth(GL_DONT_CARE),
+		lineSmooth(GL_DONT_CARE),
+		fog(GL_DONT_CARE),
+		generateMipmap(GL_DONT_CARE),
+		textureCompression(GL_DONT_CARE) {};
 };
 
 /** Structure holding framebuffer state. */
@@ -478,8 +555,18 @@ struct FGLContext {
 	FGLPerFragmentState perFragment;
 	/** Framebuffer clear state. */
 	FGLClearState clear;
+	/** Fog state. */
+	FGLFogState fog;
+	/** User clip plane equations (in eye coordinates). */
+	FGLvec4f clipPlane[FGL_MAX_CLIP_PLANES];
 	/** Textures that might be used by GPU at the moment. */
 	FGLTexture *busyTexture[FGL_MAX_TEXTURE_UNITS];
+	/** Texture surfaces replaced while used by GPU, freed when it finishes. */
+	FGLSurface *retiredSurface[FGL_MAX_RETIRED_SURFACES];
+	/** Count of retired texture surfaces. */
+	unsigned retiredSurfaces;
+	/** Total size of retired texture surfaces in bytes. */
+	size_t retiredSize;
 	/** State of capability enable flags. */
 	FGLEnableState enable;
 	/** Framebuffer state. */
@@ -488,6 +575,8 @@ struct FGLContext {
 	FGLRenderbufferBinding renderbuffer;
 	/** EGL-specific context state. */
 	FGLEGLState egl;
+	/** Implementation hints. */
+	FGLHintState hint;
 	/** Indicates that the context does not have any pending operation. */
 	bool finished;
 
@@ -504,9 +593,12 @@ struct FGLContext {
 		clientActiveTexture(0),
 		unpackAlignment(4),
 		packAlignment(4),
+		retiredSurfaces(0),
+		retiredSize(0),
 		finished(true)
 	{
 		memcpy(vertex, defaultVertex, (4 + FGL_MAX_TEXTURE_UNITS) * sizeof(FGLvec4f));
+		memset(clipPlane, 0, sizeof(clipPlane));
 		for (int i = 0; i < FGL_MAX_TEXTURE_UNITS; ++i) {
 			busyTexture[i] = 0;
 			texture[i].defTexture.target = GL_TEXTURE_2D;